@@ -372,6 +372,29 @@ FRandom *FRandom::StaticFindRNG (const char *name)
 	return probe;
 }
 
+//==========================================================================
+//
+// FRandom :: StaticHashSeeds
+//
+// Hashes the position of every named RNG, for comparing two runs of the
+// playsim. Independent of the order the RNGs got constructed in.
+//
+//==========================================================================
+
+uint32_t FRandom::StaticHashSeeds()
+{
+	uint32_t sum = 0;
+	for (FRandom *rng = RNGList; rng != NULL; rng = rng->Next)
+	{
+		if (rng->NameCRC != 0)
+		{
+			uint32_t h = (rng->NameCRC ^ uint32_t(rng->Seed())) * 0x9E3779B1u;
+			sum += h ^ (h >> 15);
+		}
+	}
+	return sum;
+}
+
 //==========================================================================
 //
 // FRandom :: StaticPrintSeeds
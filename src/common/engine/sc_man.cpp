@@ -49,6 +49,7 @@
 #include "name.h"
 #include <inttypes.h>
 #include "filesystem.h"
+#include "md5.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -196,6 +197,8 @@ void FScanner::OpenString (const char *name, FString buffer)
 //
 //==========================================================================
 
+static MD5Context SourceDigest;
+
 void FScanner :: OpenLumpNum (int lump)
 {
 	Close ();
@@ -208,9 +211,23 @@ void FScanner :: OpenLumpNum (int lump)
 	}
 	ScriptName = fileSystem.GetFileFullPath(lump).c_str();
 	LumpNum = lump;
+	SourceDigest.Update((const uint8_t*)ScriptName.GetChars(), (unsigned)ScriptName.Len() + 1);
+	SourceDigest.Update((const uint8_t*)ScriptBuffer.GetChars(), (unsigned)ScriptBuffer.Len());
 	PrepareScript ();
 }
 
+//==========================================================================
+//
+// FScanner :: GetSourceDigest
+//
+//==========================================================================
+
+void FScanner::GetSourceDigest(uint8_t digest[16])
+{
+	MD5Context copy = SourceDigest;
+	copy.Final(digest);
+}
+
 //==========================================================================
 //
 // FScanner :: PrepareScript
@@ -104,6 +104,10 @@ public:
 
 	static FString TokenName(int token, const char *string=NULL);
 
+	// Checksum of every script lump opened so far, used to tell whether
+	// cached data derived from script definitions is still valid.
+	static void GetSourceDigest(uint8_t digest[16]);
+
 	bool GetString();
 	void MustGetString();
 	void MustGetStringName(const char *name);
@@ -43,6 +43,7 @@
 #include <string.h>
 #include <functional>
 #include <vector>
+#include <atomic>
 #include "fs_swap.h"
 
 namespace FileSys {
@@ -73,12 +74,43 @@ public:
 
 class FileReader;
 
+// Enables or disables memory mapping of resource files. On by default.
+void SetFileMapping(bool on);
+
+// A read-only memory mapping of an entire file. It stays alive as long as
+// anything still holds a reference to it.
+class FileMapping
+{
+	std::atomic<int> RefCount;
+	const uint8_t* Memory;
+	size_t Length;
+
+	FileMapping() : RefCount(1), Memory(nullptr), Length(0) {}
+	~FileMapping();
+
+public:
+	static FileMapping* Map(const char* filename);	// returns null if the file cannot be mapped.
+
+	const uint8_t* data() const { return Memory; }
+	size_t size() const { return Length; }
+
+	void AddRef() { RefCount.fetch_add(1, std::memory_order_relaxed); }
+	void Release() { if (RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+};
+
 // an opaque memory buffer to the file's content. Can either own the memory or just point to an external buffer.
 class FileData
 {
 	void* memory;
 	size_t length;
 	bool owned;
+	FileMapping* mapping = nullptr;	// keeps the memory alive if it points into a mapped file.
+
+	void releasemapping()
+	{
+		if (mapping) mapping->Release();
+		mapping = nullptr;
+	}
 
 public:
 	using value_type = uint8_t;
@@ -99,6 +131,15 @@ public:
 			owned = false;
 		}
 	}
+	// a read-only view into a mapped file.
+	FileData(FileMapping* map, const void* memory_, size_t len)
+	{
+		memory = (void*)memory_;
+		length = len;
+		owned = false;
+		mapping = map;
+		mapping->AddRef();
+	}
 	uint8_t* writable() const { return owned? (uint8_t*)memory : nullptr; }
 	const void* data() const { return memory; }
 	size_t size() const { return length; }
@@ -107,9 +148,13 @@ public:
 
 	FileData& operator = (const FileData& copy)
 	{
+		if (this == &copy) return *this;
 		if (owned && memory) free(memory);
+		if (copy.mapping) copy.mapping->AddRef();
+		releasemapping();
 		length = copy.length;
 		owned = copy.owned;
+		mapping = copy.mapping;
 		if (owned)
 		{
 			memory = malloc(length);
@@ -121,30 +166,44 @@ public:
 
 	FileData& operator = (FileData&& copy) noexcept
 	{
+		if (this == &copy) return *this;
 		if (owned && memory) free(memory);
+		releasemapping();
 		length = copy.length;
 		owned = copy.owned;
 		memory = copy.memory;
+		mapping = copy.mapping;
 		copy.memory = nullptr;
 		copy.length = 0;
 		copy.owned = true;
+		copy.mapping = nullptr;
 		return *this;
 	}
 
 	FileData(const FileData& copy)
 	{
 		memory = nullptr;
+		owned = false;
 		*this = copy;
 	}
 
+	FileData(FileData&& copy) noexcept
+	{
+		memory = nullptr;
+		owned = false;
+		*this = std::move(copy);
+	}
+
 	~FileData()
 	{
 		if (owned && memory) free(memory);
+		releasemapping();
 	}
 
 	void* allocate(size_t len)
 	{
 		if (!owned) memory = nullptr;
+		releasemapping();
 		length = len;
 		owned = true;
 		memory = realloc(memory, length);
@@ -153,6 +212,7 @@ public:
 
 	void set(const void* mem, size_t len)
 	{
+		releasemapping();
 		memory = (void*)mem;
 		length = len;
 		owned = false;
@@ -161,6 +221,7 @@ public:
 	void clear()
 	{
 		if (owned && memory) free(memory);
+		releasemapping();
 		memory = nullptr;
 		length = 0;
 		owned = true;
@@ -179,6 +240,7 @@ public:
 	virtual ptrdiff_t Read (void *buffer, ptrdiff_t len) = 0;
 	virtual char *Gets(char *strbuf, ptrdiff_t len) = 0;
 	virtual const char *GetBuffer() const { return nullptr; }
+	virtual FileMapping *GetMapping() const { return nullptr; }	// set if GetBuffer points into a mapped file.
 	ptrdiff_t GetLength () const { return Length; }
 };
 
@@ -247,6 +309,8 @@ public:
 	}
 
 	bool OpenFile(const char *filename, Size start = 0, Size length = -1, bool buffered = false);
+	bool OpenMappedFile(const char *filename);	// fails if file mapping is disabled or not possible.
+	bool OpenMappedView(FileMapping *mapping, const void *mem, Size length);	// like OpenMemory, but keeps the mapping alive
 	bool OpenFilePart(FileReader &parent, Size start, Size length);
 	bool OpenMemory(const void *mem, Size length);	// read directly from the buffer
 	bool OpenMemoryArray(FileData& data);	// take the given array
@@ -285,6 +349,11 @@ public:
 		return mReader->GetBuffer();
 	}
 
+	FileMapping *GetMapping()
+	{
+		return mReader->GetMapping();
+	}
+
 	Size GetLength() const
 	{
 		return mReader->GetLength();
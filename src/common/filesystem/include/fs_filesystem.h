@@ -145,6 +145,7 @@ public:
 	int AddFromBuffer(const char* name, char* data, int size, int id, int flags);
 	FileReader* GetFileReader(int wadnum);	// Gets a FileReader object to the entire WAD
 	void InitHashChains();
+	void BenchmarkLookups(int passes, FileSystemMessageFunc Printf);
 
 protected:
 
@@ -153,18 +154,24 @@ protected:
 	std::vector<FResourceFile *> Files;
 	std::vector<LumpRecord> FileInfo;
 
-	std::vector<uint32_t> Hashes;	// one allocation for all hash lists.
-	uint32_t *FirstLumpIndex = nullptr;	// [RH] Hashing stuff moved out of lumpinfo structure
-	uint32_t *NextLumpIndex = nullptr;
-
-	uint32_t *FirstLumpIndex_FullName = nullptr;	// The same information for fully qualified paths from .zips
-	uint32_t *NextLumpIndex_FullName = nullptr;
-
-	uint32_t *FirstLumpIndex_NoExt = nullptr;	// The same information for fully qualified paths from .zips
-	uint32_t *NextLumpIndex_NoExt = nullptr;
-
-	uint32_t* FirstLumpIndex_ResId = nullptr;	// The same information for fully qualified paths from .zips
-	uint32_t* NextLumpIndex_ResId = nullptr;
+	// All four lookup keys (short name, full name, full name without extension
+	// and resource ID) share one open-addressing table. Each slot stores the
+	// key's full hash next to the lump index so that probing rarely has to
+	// look at the lump's name.
+	struct HashSlot
+	{
+		uint32_t key;		// (hash << 2) | key kind
+		uint32_t lump;		// 0xffffffff for empty slots
+	};
+	std::vector<HashSlot> HashIndex;
+	std::vector<uint32_t> EmptyNameLumps;		// lumps without a short name, newest first; not in HashIndex
+	uint32_t HashMask = 0;
+	int HashShift = 31;
+
+	uint32_t HashHome(uint32_t key) const
+	{
+		return (key * 0x9E3779B1u) >> HashShift;
+	}
 
 	uint32_t NumEntries = 0;					// Not necessarily the same as FileInfo.Size()
 	uint32_t NumWads = 0;
@@ -177,6 +184,7 @@ protected:
 private:
 	void DeleteAll();
 	void MoveLumpsInFolder(const char *);
+	void AddResourceFile(const char *filename, FResourceFile *resfile, FileReader &filereader, LumpFilterInfo* filter, FileSystemMessageFunc Printf, FILE* hashfile);
 
 };
 
@@ -109,6 +109,11 @@ struct FResourceEntry
 
 void SetMainThread();
 
+// Optional on-disk cache of decompressed entries. Only entries read after
+// OpenLumpCache get cached, and only WriteLumpCache stores them.
+bool OpenLumpCache(const char* filename, size_t maxsize);
+void WriteLumpCache();
+
 class FResourceFile
 {
 public:
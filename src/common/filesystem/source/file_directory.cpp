@@ -63,6 +63,7 @@ public:
 	FDirectory(const char * dirname, StringPool* sp, bool nosubdirflag = false);
 	bool Open(LumpFilterInfo* filter, FileSystemMessageFunc Printf);
 	FileReader GetEntryReader(uint32_t entry, int, int) override;
+	FileData Read(uint32_t entry) override;
 };
 
 
@@ -187,6 +188,29 @@ FileReader FDirectory::GetEntryReader(uint32_t entry, int readertype, int)
 	return fr;
 }
 
+//==========================================================================
+//
+// Larger files are mapped instead of being read into a new buffer.
+// For small ones this isn't worth setting up a mapping.
+//
+//==========================================================================
+
+FileData FDirectory::Read(uint32_t entry)
+{
+	if (entry < NumLumps && Entries[entry].Length >= 65536)
+	{
+		std::string fn = mBasePath;
+		fn += SystemFilePath[Entries[entry].Position];
+		FileReader fr;
+		if (fr.OpenMappedFile(fn.c_str()))
+		{
+			auto mapping = fr.GetMapping();
+			return FileData(mapping, mapping->data(), mapping->size());
+		}
+	}
+	return FResourceFile::Read(entry);
+}
+
 //==========================================================================
 //
 // File open
@@ -40,12 +40,29 @@
 #include <string.h>
 #include "files_internal.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace FileSys {
 	
 #ifdef _WIN32
 std::wstring toWide(const char* str);
 #endif
 
+static bool UseFileMapping = true;
+
+void SetFileMapping(bool on)
+{
+	UseFileMapping = on;
+}
+
 FILE *myfopen(const char *filename, const char *flags)
 {
 #ifndef _WIN32
@@ -358,6 +375,99 @@ char* BufferingReader::Gets(char* strbuf, ptrdiff_t len)
 	return MemoryReader::Gets(strbuf, len);
 }
 
+//==========================================================================
+//
+// FileMapping
+//
+//==========================================================================
+
+FileMapping* FileMapping::Map(const char* filename)
+{
+	const void* memory = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	auto widename = toWide(filename);
+	HANDLE file = CreateFileW(widename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (uint64_t)size.QuadPart <= SIZE_MAX)
+	{
+		HANDLE map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (map != nullptr)
+		{
+			memory = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			length = (size_t)size.QuadPart;
+			CloseHandle(map);	// the view keeps the mapping alive.
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX)
+	{
+		void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			memory = p;
+			length = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	if (memory == nullptr) return nullptr;
+	auto mapping = new FileMapping;
+	mapping->Memory = (const uint8_t*)memory;
+	mapping->Length = length;
+	return mapping;
+}
+
+FileMapping::~FileMapping()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(Memory);
+#else
+	munmap((void*)Memory, Length);
+#endif
+}
+
+//==========================================================================
+//
+// MappedFileReader
+//
+// reads from a memory mapped file
+//
+//==========================================================================
+
+class MappedFileReader : public MemoryReader
+{
+	FileMapping* Mapping;
+
+public:
+	MappedFileReader(FileMapping* map)
+		: MemoryReader((const char*)map->data(), map->size())
+	{
+		Mapping = map;
+	}
+
+	MappedFileReader(FileMapping* map, const void* mem, ptrdiff_t length)
+		: MemoryReader((const char*)mem, length)
+	{
+		Mapping = map;
+		Mapping->AddRef();
+	}
+
+	~MappedFileReader()
+	{
+		Mapping->Release();
+	}
+
+	FileMapping* GetMapping() const override { return Mapping; }
+};
+
 //==========================================================================
 //
 // FileReader
@@ -380,6 +490,23 @@ bool FileReader::OpenFile(const char *filename, FileReader::Size start, FileRead
 	return true;
 }
 
+bool FileReader::OpenMappedFile(const char *filename)
+{
+	if (!UseFileMapping) return false;
+	auto mapping = FileMapping::Map(filename);
+	if (mapping == nullptr) return false;
+	Close();
+	mReader = new MappedFileReader(mapping);	// takes over the reference.
+	return true;
+}
+
+bool FileReader::OpenMappedView(FileMapping *mapping, const void *mem, FileReader::Size length)
+{
+	Close();
+	mReader = new MappedFileReader(mapping, mem, length);
+	return true;
+}
+
 bool FileReader::OpenFilePart(FileReader &parent, FileReader::Size start, FileReader::Size length)
 {
 	auto reader = new FileReaderRedirect(parent, start, length);
@@ -5,6 +5,12 @@
 
 namespace FileSys {
 
+// decompressed entry cache (fs_lumpcache.cpp)
+struct FResourceEntry;
+bool LumpCacheFind(const char* archive, const FResourceEntry& entry, FileReader& reader);
+bool LumpCacheWants(const char* archive, const FResourceEntry& entry);
+void LumpCacheStore(const char* archive, const FResourceEntry& entry, const FileData& data);
+
 class MemoryReader : public FileReaderInterface
 {
 protected:
@@ -41,6 +41,11 @@
 #include <ctype.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdarg.h>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <chrono>
 
 #include "resourcefile.h"
 #include "fs_filesystem.h"
@@ -74,6 +79,21 @@ static uint32_t MakeHash(const char* str, size_t length = SIZE_MAX)
 	return hash;
 }
 
+// The kinds of keys stored in the lookup index. The kind lives in the low
+// bits of the stored key so that different kinds never compare equal.
+enum
+{
+	HK_ShortName,
+	HK_FullName,
+	HK_NoExt,
+	HK_ResId
+};
+
+static inline uint32_t HashKey(uint32_t hash, uint32_t kind)
+{
+	return (hash << 2) | kind;
+}
+
 static void md5Hash(FileReader& reader, uint8_t* digest) 
 {
 	using namespace md5;
@@ -208,7 +228,7 @@ FileSystem::~FileSystem ()
 
 void FileSystem::DeleteAll ()
 {
-	Hashes.clear();
+	HashIndex.clear();
 	NumEntries = 0;
 
 	FileInfo.clear();
@@ -221,6 +241,95 @@ void FileSystem::DeleteAll ()
 	stringpool = nullptr;
 }
 
+//==========================================================================
+//
+// Parallel opening of resource files
+//
+// Everything that is done while opening an archive (header parsing,
+// reading the directory, name normalization and filtering) only concerns
+// that archive, so this can run on several threads. Each archive gets its
+// own string pool because the shared one is not thread safe, and messages
+// are collected and printed in order afterward.
+//
+//==========================================================================
+
+struct OpenedFile
+{
+	FResourceFile* Resfile = nullptr;
+	FileReader Reader;
+	std::vector<std::pair<FSMessageLevel, std::string>> Messages;
+	std::exception_ptr Error;	// rethrown when the file is reached in the merge.
+};
+
+static thread_local OpenedFile* CurrentOpen;
+
+static int BufferedPrintf(FSMessageLevel level, const char* fmt, ...)
+{
+	char buffer[1024];
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+	va_end(ap);
+	if (CurrentOpen) CurrentOpen->Messages.emplace_back(level, buffer);
+	return len;
+}
+
+static void OpenFileForAdd(const char* filename, OpenedFile& op, LumpFilterInfo* filter)
+{
+	bool isdir = false;
+
+	CurrentOpen = &op;
+	// Does this exist? If so, is it a directory?
+	if (!FS_DirEntryExists(filename, &isdir))
+	{
+		BufferedPrintf(FSMessageLevel::Error, "%s: File or Directory not found\n", filename);
+		PrintLastError(BufferedPrintf);
+	}
+	else if (isdir)
+	{
+		op.Resfile = FResourceFile::OpenDirectory(filename, filter, BufferedPrintf, nullptr);
+	}
+	else if (!op.Reader.OpenMappedFile(filename) && !op.Reader.OpenFile(filename))
+	{ // Didn't find file
+		BufferedPrintf(FSMessageLevel::Error, "%s: File not found\n", filename);
+		PrintLastError(BufferedPrintf);
+	}
+	else
+	{
+		op.Resfile = FResourceFile::OpenResourceFile(filename, op.Reader, false, filter, BufferedPrintf, nullptr);
+	}
+	CurrentOpen = nullptr;
+}
+
+static void OpenFilesParallel(const std::vector<std::string>& filenames, std::vector<OpenedFile>& opened, LumpFilterInfo* filter)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for (size_t i; (i = next.fetch_add(1)) < filenames.size(); )
+		{
+			try
+			{
+				OpenFileForAdd(filenames[i].c_str(), opened[i], filter);
+			}
+			catch (...)
+			{
+				CurrentOpen = nullptr;
+				opened[i].Error = std::current_exception();
+			}
+		}
+	};
+
+	size_t numthreads = std::min<size_t>(std::thread::hardware_concurrency(), filenames.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < numthreads; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) t.join();
+}
+
 //==========================================================================
 //
 // InitMultipleFiles
@@ -267,9 +376,20 @@ bool FileSystem::InitMultipleFiles (std::vector<std::string>& filenames, LumpFil
 		}
 	}
 
+	// Open all archives in parallel. Lumps only get numbered in the sequential
+	// merge below, so the result is the same as opening them one by one.
+	std::vector<OpenedFile> opened(filenames.size());
+	OpenFilesParallel(filenames, opened, filter);
+
 	for(size_t i=0;i<filenames.size(); i++)
 	{
-		AddFile(filenames[i].c_str(), nullptr, filter, Printf, hashfile);
+		auto& op = opened[i];
+		if (Printf)
+		{
+			for (auto& msg : op.Messages) Printf(msg.first, "%s", msg.second.c_str());
+		}
+		if (op.Error) std::rethrow_exception(op.Error);
+		AddResourceFile(filenames[i].c_str(), op.Resfile, op.Reader, filter, Printf, hashfile);
 
 		if (i == (unsigned)MaxIwadIndex) MoveLumpsInFolder("after_iwad/");
 		std::string path = "filter/%s";
@@ -329,7 +449,6 @@ int FileSystem::AddFromBuffer(const char* name, char* data, int size, int id, in
 
 void FileSystem::AddFile (const char *filename, FileReader *filer, LumpFilterInfo* filter, FileSystemMessageFunc Printf, FILE* hashfile)
 {
-	int startlump;
 	bool isdir = false;
 	FileReader filereader;
 
@@ -348,7 +467,7 @@ void FileSystem::AddFile (const char *filename, FileReader *filer, LumpFilterInf
 
 		if (!isdir)
 		{
-			if (!filereader.OpenFile(filename))
+			if (!filereader.OpenMappedFile(filename) && !filereader.OpenFile(filename))
 			{ // Didn't find file
 				if (Printf)
 				{
@@ -361,8 +480,6 @@ void FileSystem::AddFile (const char *filename, FileReader *filer, LumpFilterInf
 	}
 	else filereader = std::move(*filer);
 
-	startlump = NumEntries;
-
 	FResourceFile *resfile;
 
 
@@ -371,6 +488,19 @@ void FileSystem::AddFile (const char *filename, FileReader *filer, LumpFilterInf
 	else
 		resfile = FResourceFile::OpenDirectory(filename, filter, Printf, stringpool);
 
+	AddResourceFile(filename, resfile, filereader, filter, Printf, hashfile);
+}
+
+//==========================================================================
+//
+// AddResourceFile
+//
+// Adds the lumps of an opened resource file to the directory.
+//
+//==========================================================================
+
+void FileSystem::AddResourceFile(const char *filename, FResourceFile *resfile, FileReader &filereader, LumpFilterInfo* filter, FileSystemMessageFunc Printf, FILE* hashfile)
+{
 	if (resfile != NULL)
 	{
 		if (Printf) 
@@ -515,25 +645,36 @@ int FileSystem::CheckNumForName (const char *name, int space) const
 	}
 
 	UpperCopy (uname, name);
-	i = FirstLumpIndex[MakeHash(uname, 8) % NumEntries];
+	uint32_t key = HashKey(MakeHash(uname, 8), HK_ShortName);
+	const uint64_t shortname = qname;	// lambdas cannot capture the union member
 
-	while (i != NULL_INDEX)
+	auto matches = [&](uint32_t i)
 	{
+		if (FileInfo[i].shortName.qword != shortname) return false;
+		auto &lump = FileInfo[i];
+		if (lump.Namespace == space) return true;
+		// If the lump is from one of the special namespaces exclusive to Zips
+		// the check has to be done differently:
+		// If we find a lump with this name in the global namespace that does not come
+		// from a Zip return that. WADs don't know these namespaces and single lumps must
+		// work as well.
+		auto lflags = lump.resfile->GetEntryFlags(lump.resindex);
+		return space > ns_specialzipdirectory && lump.Namespace == ns_global &&
+			!((lflags ^lump.flags) & RESFF_FULLPATH);
+	};
 
-		if (FileInfo[i].shortName.qword == qname)
+	if (shortname == 0)
+	{
+		for (auto lump : EmptyNameLumps)
 		{
-			auto &lump = FileInfo[i];
-			if (lump.Namespace == space) break;
-			// If the lump is from one of the special namespaces exclusive to Zips
-			// the check has to be done differently:
-			// If we find a lump with this name in the global namespace that does not come
-			// from a Zip return that. WADs don't know these namespaces and single lumps must
-			// work as well.
-			auto lflags = lump.resfile->GetEntryFlags(lump.resindex);
-			if (space > ns_specialzipdirectory && lump.Namespace == ns_global && 
-				!((lflags ^lump.flags) & RESFF_FULLPATH)) break;
+			if (matches(lump)) return lump;
 		}
-		i = NextLumpIndex[i];
+		return -1;
+	}
+
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
+	{
+		if (HashIndex[s].key == key && matches(i)) break;
 	}
 
 	return i != NULL_INDEX ? i : -1;
@@ -554,16 +695,29 @@ int FileSystem::CheckNumForName (const char *name, int space, int rfnum, bool ex
 	}
 
 	UpperCopy (uname, name);
-	i = FirstLumpIndex[MakeHash (uname, 8) % NumEntries];
+	uint32_t key = HashKey(MakeHash(uname, 8), HK_ShortName);
 
 	// If exact is true if will only find lumps in the same WAD, otherwise
 	// also those in earlier WADs.
+	const uint64_t shortname = qname;	// lambdas cannot capture the union member
+	auto matches = [&](uint32_t i)
+	{
+		return FileInfo[i].shortName.qword == shortname && FileInfo[i].Namespace == space &&
+			(exact ? (FileInfo[i].rfnum == rfnum) : (FileInfo[i].rfnum <= rfnum));
+	};
+
+	if (shortname == 0)
+	{
+		for (auto lump : EmptyNameLumps)
+		{
+			if (matches(lump)) return lump;
+		}
+		return -1;
+	}
 
-	while (i != NULL_INDEX &&
-		(FileInfo[i].shortName.qword != qname || FileInfo[i].Namespace != space ||
-		 (exact? (FileInfo[i].rfnum != rfnum) : (FileInfo[i].rfnum > rfnum)) ))
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
 	{
-		i = NextLumpIndex[i];
+		if (HashIndex[s].key == key && matches(i)) break;
 	}
 
 	return i != NULL_INDEX ? i : -1;
@@ -609,12 +763,12 @@ int FileSystem::CheckNumForFullName (const char *name, bool trynormal, int names
 		return -1;
 	}
 	if (*name == '/') name++;	// ignore leading slashes in file names.
-	uint32_t *fli = ignoreext ? FirstLumpIndex_NoExt : FirstLumpIndex_FullName;
-	uint32_t *nli = ignoreext ? NextLumpIndex_NoExt : NextLumpIndex_FullName;
+	uint32_t key = HashKey(MakeHash(name), ignoreext ? HK_NoExt : HK_FullName);
 	auto len = strlen(name);
 
-	for (i = fli[MakeHash(name) % NumEntries]; i != NULL_INDEX; i = nli[i])
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
 	{
+		if (HashIndex[s].key != key) continue;
 		if (strnicmp(name, FileInfo[i].LongName, len)) continue;
 		if (FileInfo[i].LongName[len] == 0) break;	// this is a full match
 		if (ignoreext && FileInfo[i].LongName[len] == '.') 
@@ -642,12 +796,11 @@ int FileSystem::CheckNumForFullName (const char *name, int rfnum) const
 		return CheckNumForFullName (name);
 	}
 
-	i = FirstLumpIndex_FullName[MakeHash (name) % NumEntries];
+	uint32_t key = HashKey(MakeHash(name), HK_FullName);
 
-	while (i != NULL_INDEX && 
-		(stricmp(name, FileInfo[i].LongName) || FileInfo[i].rfnum != rfnum))
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
 	{
-		i = NextLumpIndex_FullName[i];
+		if (HashIndex[s].key == key && FileInfo[i].rfnum == rfnum && !stricmp(name, FileInfo[i].LongName)) break;
 	}
 
 	return i != NULL_INDEX ? i : -1;
@@ -690,12 +843,12 @@ int FileSystem::FindFileWithExtensions(const char* name, const char *const *exts
 		return -1;
 	}
 	if (*name == '/') name++;	// ignore leading slashes in file names.
-	uint32_t* fli = FirstLumpIndex_NoExt;
-	uint32_t* nli = NextLumpIndex_NoExt;
+	uint32_t key = HashKey(MakeHash(name), HK_NoExt);
 	auto len = strlen(name);
 
-	for (i = fli[MakeHash(name) % NumEntries]; i != NULL_INDEX; i = nli[i])
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
 	{
+		if (HashIndex[s].key != key) continue;
 		if (strnicmp(name, FileInfo[i].LongName, len)) continue;
 		if (FileInfo[i].LongName[len] != '.') continue;	// we are looking for extensions but this file doesn't have one.
 
@@ -728,11 +881,11 @@ int FileSystem::FindResource (int resid, const char *type, int filenum) const no
 		return -1;
 	}
 
-	uint32_t* fli = FirstLumpIndex_ResId;
-	uint32_t* nli = NextLumpIndex_ResId;
+	uint32_t key = HashKey(resid, HK_ResId);
 
-	for (i = fli[resid % NumEntries]; i != NULL_INDEX; i = nli[i])
+	for (uint32_t s = HashHome(key); (i = HashIndex[s].lump) != NULL_INDEX; s = (s + 1) & HashMask)
 	{
+		if (HashIndex[s].key != key) continue;
 		if (filenum > 0 && FileInfo[i].rfnum != filenum) continue;
 		if (FileInfo[i].resourceId != resid) continue;
 		auto extp = strrchr(FileInfo[i].LongName, '.');
@@ -802,60 +955,201 @@ int FileSystem::GetFileFlags (int lump)
 //
 // InitHashChains
 //
-// Prepares the lumpinfos for hashing.
-// (Hey! This looks suspiciously like something from Boom! :-)
+// Builds the lookup index. This is one linear probing table holding the
+// short name, full name, extensionless name and resource ID of every lump.
+//
+// Lumps are inserted from last to first. With linear probing this means
+// that all slots carrying the same key are met in descending lump order
+// when probing, so lookups still return the last matching lump as the old
+// hash chains did.
 //
 //==========================================================================
 
-void FileSystem::InitHashChains (void)
+static uint32_t NoExtHash(const char* name)
 {
-	unsigned int i, j;
+	auto dot = strrchr(name, '.');
+	auto slash = strrchr(name, '/');
+	if (dot == nullptr || (slash != nullptr && dot < slash)) return MakeHash(name);
+	return MakeHash(name, dot - name);
+}
 
+void FileSystem::InitHashChains (void)
+{
 	NumEntries = (uint32_t)FileInfo.size();
-	Hashes.resize(8 * NumEntries);
-	// Mark all buckets as empty
-	memset(Hashes.data(), -1, Hashes.size() * sizeof(Hashes[0]));
-	FirstLumpIndex = &Hashes[0];
-	NextLumpIndex = &Hashes[NumEntries];
-	FirstLumpIndex_FullName = &Hashes[NumEntries * 2];
-	NextLumpIndex_FullName = &Hashes[NumEntries * 3];
-	FirstLumpIndex_NoExt = &Hashes[NumEntries * 4];
-	NextLumpIndex_NoExt = &Hashes[NumEntries * 5];
-	FirstLumpIndex_ResId = &Hashes[NumEntries * 6];
-	NextLumpIndex_ResId = &Hashes[NumEntries * 7];
-
-
-	// Now set up the chains
-	for (i = 0; i < (unsigned)NumEntries; i++)
-	{
-		j = MakeHash (FileInfo[i].shortName.String, 8) % NumEntries;
-		NextLumpIndex[i] = FirstLumpIndex[j];
-		FirstLumpIndex[j] = i;
+
+	// Keep the load factor at or below 50%.
+	uint32_t size = 16;
+	HashShift = 28;
+	while (size < NumEntries * 8)
+	{
+		size <<= 1;
+		HashShift--;
+	}
+	HashMask = size - 1;
+	HashIndex.assign(size, { 0, NULL_INDEX });
+
+	auto insert = [&](uint32_t key, uint32_t lump)
+	{
+		uint32_t s = HashHome(key);
+		while (HashIndex[s].lump != NULL_INDEX) s = (s + 1) & HashMask;
+		HashIndex[s] = { key, lump };
+	};
+
+	// Keys that most lumps share are left out. Thousands of equal keys would
+	// form a single cluster that every insertion and any lookup landing
+	// in it has to walk. FindResource rejects negative IDs anyway, and
+	// CheckNumForName searches the lumps without a short name in their
+	// own list, in the same order as the index would.
+	EmptyNameLumps.clear();
+	for (uint32_t i = NumEntries; i-- > 0; )
+	{
+		if (FileInfo[i].shortName.qword != 0)
+		{
+			insert(HashKey(MakeHash(FileInfo[i].shortName.String, 8), HK_ShortName), i);
+		}
+		else
+		{
+			EmptyNameLumps.push_back(i);
+		}
 
 		// Do the same for the full paths
 		if (FileInfo[i].LongName[0] != 0)
+		{
+			insert(HashKey(MakeHash(FileInfo[i].LongName), HK_FullName), i);
+			insert(HashKey(NoExtHash(FileInfo[i].LongName), HK_NoExt), i);
+			if (FileInfo[i].resourceId >= 0)
+			{
+				insert(HashKey(FileInfo[i].resourceId, HK_ResId), i);
+			}
+		}
+	}
+	FileInfo.shrink_to_fit();
+	Files.shrink_to_fit();
+}
+
+//==========================================================================
+//
+// BenchmarkLookups
+//
+// Times CheckNumForName and CheckNumForFullName against the chained hash
+// tables this index replaced, which are rebuilt here for comparison. Every
+// lump contributes one hit and one miss per key type, and both methods
+// must agree on every result.
+//
+//==========================================================================
+
+void FileSystem::BenchmarkLookups(int passes, FileSystemMessageFunc Printf)
+{
+	if (Printf == nullptr || NumEntries == 0) return;
+	if (passes < 1) passes = 1;
+
+	std::vector<uint32_t> first(NumEntries * 2, NULL_INDEX), next(NumEntries * 2, NULL_INDEX);
+	uint32_t* firstShort = &first[0], * nextShort = &next[0];
+	uint32_t* firstFull = &first[NumEntries], * nextFull = &next[NumEntries];
+	for (uint32_t i = 0; i < NumEntries; i++)
+	{
+		uint32_t j = MakeHash(FileInfo[i].shortName.String, 8) % NumEntries;
+		nextShort[i] = firstShort[j];
+		firstShort[j] = i;
+		if (FileInfo[i].LongName[0] != 0)
 		{
 			j = MakeHash(FileInfo[i].LongName) % NumEntries;
-			NextLumpIndex_FullName[i] = FirstLumpIndex_FullName[j];
-			FirstLumpIndex_FullName[j] = i;
+			nextFull[i] = firstFull[j];
+			firstFull[j] = i;
+		}
+	}
 
-			std::string nameNoExt = FileInfo[i].LongName;
-			auto dot = nameNoExt.find_last_of('.');
-			auto slash = nameNoExt.find_last_of('/');
-			if ((dot > slash || slash == std::string::npos) && dot != std::string::npos) nameNoExt.resize(dot);
+	auto chainShort = [&](const char* name, int space) -> int
+	{
+		union
+		{
+			char uname[8];
+			uint64_t qname;
+		};
+		UpperCopy(uname, name);
+		uint32_t i;
+		for (i = firstShort[MakeHash(uname, 8) % NumEntries]; i != NULL_INDEX; i = nextShort[i])
+		{
+			if (FileInfo[i].shortName.qword != qname) continue;
+			auto& lump = FileInfo[i];
+			if (lump.Namespace == space) break;
+			auto lflags = lump.resfile->GetEntryFlags(lump.resindex);
+			if (space > ns_specialzipdirectory && lump.Namespace == ns_global &&
+				!((lflags ^ lump.flags) & RESFF_FULLPATH)) break;
+		}
+		return i != NULL_INDEX ? i : -1;
+	};
 
-			j = MakeHash(nameNoExt.c_str()) % NumEntries;
-			NextLumpIndex_NoExt[i] = FirstLumpIndex_NoExt[j];
-			FirstLumpIndex_NoExt[j] = i;
+	auto chainFull = [&](const char* name) -> int
+	{
+		auto len = strlen(name);
+		uint32_t i;
+		for (i = firstFull[MakeHash(name) % NumEntries]; i != NULL_INDEX; i = nextFull[i])
+		{
+			if (!strnicmp(name, FileInfo[i].LongName, len) && FileInfo[i].LongName[len] == 0) break;
+		}
+		return i != NULL_INDEX ? i : -1;
+	};
 
-			j = FileInfo[i].resourceId % NumEntries;
-			NextLumpIndex_ResId[i] = FirstLumpIndex_ResId[j];
-			FirstLumpIndex_ResId[j] = i;
+	struct ShortQuery { char name[9]; int space; };
+	std::vector<ShortQuery> shortQueries;
+	std::vector<std::string> fullQueries;
+	shortQueries.reserve(NumEntries * 2);
+	fullQueries.reserve(NumEntries * 2);
+	for (uint32_t i = 0; i < NumEntries; i++)
+	{
+		ShortQuery q;
+		memcpy(q.name, FileInfo[i].shortName.String, 9);
+		q.name[8] = 0;
+		q.space = FileInfo[i].Namespace;
+		if (q.name[0] == 0) continue;
+		shortQueries.push_back(q);
+		// Almost certainly a miss, since lump names rarely contain a tilde.
+		q.name[strlen(q.name) - 1] = '~';
+		shortQueries.push_back(q);
 
+		if (FileInfo[i].LongName[0] != 0)
+		{
+			fullQueries.push_back(FileInfo[i].LongName);
+			fullQueries.push_back(std::string(FileInfo[i].LongName) + "~");
 		}
 	}
-	FileInfo.shrink_to_fit();
-	Files.shrink_to_fit();
+
+	// Verify first so that the timing loops compare equivalent work.
+	int mismatches = 0;
+	for (auto& q : shortQueries)
+	{
+		if (chainShort(q.name, q.space) != CheckNumForName(q.name, q.space)) mismatches++;
+	}
+	for (auto& q : fullQueries)
+	{
+		if (chainFull(q.c_str()) != CheckNumForFullName(q.c_str(), false)) mismatches++;
+	}
+
+	using clock = std::chrono::steady_clock;
+	auto nsPerLookup = [&](auto&& func, size_t count)
+	{
+		volatile int sink = 0;
+		auto start = clock::now();
+		for (int p = 0; p < passes; p++) sink = sink + func();
+		auto ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+		return count == 0 ? 0. : ns / (double(count) * passes);
+	};
+
+	double shortChain = nsPerLookup([&]() { int r = 0; for (auto& q : shortQueries) r += chainShort(q.name, q.space); return r; }, shortQueries.size());
+	double shortIndex = nsPerLookup([&]() { int r = 0; for (auto& q : shortQueries) r += CheckNumForName(q.name, q.space); return r; }, shortQueries.size());
+	double fullChain = nsPerLookup([&]() { int r = 0; for (auto& q : fullQueries) r += chainFull(q.c_str()); return r; }, fullQueries.size());
+	double fullIndex = nsPerLookup([&]() { int r = 0; for (auto& q : fullQueries) r += CheckNumForFullName(q.c_str(), false); return r; }, fullQueries.size());
+
+	Printf(FSMessageLevel::Message, "%u lumps, %u index slots, %d passes\n", NumEntries, HashMask + 1, passes);
+	Printf(FSMessageLevel::Message, "CheckNumForName:     %zu queries, chains %.1f ns, index %.1f ns (%.2fx)\n",
+		shortQueries.size(), shortChain, shortIndex, shortIndex > 0 ? shortChain / shortIndex : 0.);
+	Printf(FSMessageLevel::Message, "CheckNumForFullName: %zu queries, chains %.1f ns, index %.1f ns (%.2fx)\n",
+		fullQueries.size(), fullChain, fullIndex, fullIndex > 0 ? fullChain / fullIndex : 0.);
+	if (mismatches > 0)
+	{
+		Printf(FSMessageLevel::Error, "%d lookups returned different lumps\n", mismatches);
+	}
 }
 
 //==========================================================================
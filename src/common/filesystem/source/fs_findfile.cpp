@@ -98,7 +98,7 @@ enum
 };
 
 
-static const char *pattern;
+static thread_local const char *pattern;	// for matchfile, which cannot get it passed.
 
 static int matchfile(const struct dirent *ent)
 {
@@ -422,4 +422,31 @@ bool FS_DirEntryExists(const char* pathname, bool* isdir)
 	return res;
 }
 
+//==========================================================================
+//
+// FS_GetFileInfo
+//
+// Returns size and modification time of a file.
+//
+//==========================================================================
+
+bool FS_GetFileInfo(const char* pathname, uint64_t* size, int64_t* mtime)
+{
+	if (pathname == NULL || *pathname == 0)
+		return false;
+
+#ifndef _WIN32
+	struct stat info;
+	bool res = stat(pathname, &info) == 0;
+#else
+	auto wstr = toWide(pathname);
+	struct _stat64 info;
+	bool res = _wstat64(wstr.c_str(), &info) == 0;
+#endif
+	if (!res || (info.st_mode & S_IFDIR)) return false;
+	*size = (uint64_t)info.st_size;
+	*mtime = (int64_t)info.st_mtime;
+	return true;
+}
+
 }
@@ -0,0 +1,528 @@
+/*
+** fs_lumpcache.cpp
+** On-disk cache of decompressed archive entries
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Compressed entries that get read are remembered in decompressed form
+** in a single file, which gets mapped on the next start so that these
+** entries can be handed out without decompressing them again.
+**
+** An entry is identified by its archive's path, size and modification
+** time and by its own position, size and CRC. If any of these changes,
+** the cached copy simply stops being found and gets dropped the next
+** time the cache is written.
+**
+** Each entry remembers the last session that used it. When a new entry
+** does not fit, entries of archives that have changed are evicted first,
+** then the least recently used ones. Entries used in the current session
+** are never evicted. The session numbers only get saved when the cache
+** file is rewritten, i.e. when something new got cached.
+**
+** File layout (host byte order, as the index is used straight from the
+** mapped file):
+**		header		"LMPC", version, byte order mark, entry count, session
+**		index		entry count * CacheIndexEntry
+**		data		each entry's data, aligned to 16 bytes
+**
+** A file written on a machine with the other byte order does not match the
+** byte order mark and gets replaced, as does one whose index would not fit
+** in the file.
+**
+** The cache file is never rewritten in place, because it is mapped while
+** the engine runs. A new version is written next to it and replaces it
+** when the cache gets opened the next time.
+**
+*/
+
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <stdio.h>
+#ifdef _WIN32
+#include <wchar.h>
+#endif
+#include "resourcefile.h"
+#include "files_internal.h"
+#include "fs_findfile.h"
+#include "critsec.h"
+
+namespace FileSys {
+
+#ifdef _WIN32
+std::wstring toWide(const char* str);
+#endif
+FILE* myfopen(const char* filename, const char* flags);
+
+static const uint32_t CACHE_VERSION = 3;
+static const uint32_t CACHE_BYTEORDER = 0x01020304;
+static const size_t MAX_CACHED_ENTRY = 16 << 20;	// larger entries are mostly music and not worth it.
+
+struct CacheHeader
+{
+	char Magic[4];
+	uint32_t Version;
+	uint32_t ByteOrder;		// CACHE_BYTEORDER as the writer stored it
+	uint32_t NumEntries;
+	uint32_t Session;
+	uint32_t Reserved;		// keeps the index 8 byte aligned
+};
+
+struct CacheIndexEntry
+{
+	uint64_t ArchiveHash;
+	uint64_t ArchiveSize;
+	int64_t ArchiveTime;
+	uint64_t Position;
+	uint64_t Length;
+	uint64_t Offset;		// of the data in the cache file
+	uint32_t CRC32;
+	uint32_t Method;
+	uint32_t LastUsed;		// session
+	uint32_t Reserved;
+};
+
+struct CachedEntry
+{
+	CacheIndexEntry Index;
+	FileData Data;			// either a view into the mapped cache file or new data from this session.
+};
+
+struct ArchiveInfo
+{
+	uint64_t Hash;
+	uint64_t Size;
+	int64_t Time;
+	bool Valid;
+};
+
+static FCriticalSection CacheLock;
+static std::string CacheFileName;
+static FileMapping* CacheMapping;
+static std::vector<CachedEntry> CacheEntries;
+static std::unordered_map<uint64_t, size_t> CacheLookup;
+static std::unordered_map<std::string, ArchiveInfo> CacheArchives;
+static size_t CacheMaxSize;
+static size_t CacheSize;
+static size_t CacheEvictable;	// size of the entries not used in this session
+static uint32_t CacheSession;
+static bool CacheActive;
+static bool CacheDirty;
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+static uint64_t HashBytes(uint64_t h, const void* data, size_t len)
+{
+	auto p = (const uint8_t*)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static uint64_t IndexKey(const CacheIndexEntry& e)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	h = HashBytes(h, &e.ArchiveHash, sizeof(e.ArchiveHash));
+	h = HashBytes(h, &e.Position, sizeof(e.Position));
+	h = HashBytes(h, &e.CRC32, sizeof(e.CRC32));
+	return h;
+}
+
+static bool SameEntry(const CacheIndexEntry& a, const CacheIndexEntry& b)
+{
+	return a.ArchiveHash == b.ArchiveHash && a.ArchiveSize == b.ArchiveSize && a.ArchiveTime == b.ArchiveTime &&
+		a.Position == b.Position && a.Length == b.Length && a.CRC32 == b.CRC32 && a.Method == b.Method;
+}
+
+static bool RenameFile(const char* from, const char* to)
+{
+#ifdef _WIN32
+	_wremove(toWide(to).c_str());
+	return _wrename(toWide(from).c_str(), toWide(to).c_str()) == 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+//==========================================================================
+//
+// Fills in the identifying part of an index entry. Returns false for
+// entries that cannot be cached, e.g. because they are in an archive
+// that is not a file of its own.
+//
+//==========================================================================
+
+static bool MakeIndexEntry(const char* archive, const FResourceEntry& entry, CacheIndexEntry& e)
+{
+	if (entry.Length == 0 || entry.Length > MAX_CACHED_ENTRY) return false;
+
+	auto it = CacheArchives.find(archive);
+	if (it == CacheArchives.end())
+	{
+		ArchiveInfo info = {};
+		info.Valid = FS_GetFileInfo(archive, &info.Size, &info.Time);
+		info.Hash = HashBytes(0xcbf29ce484222325ull, archive, strlen(archive));
+		it = CacheArchives.insert({ archive, info }).first;
+	}
+	if (!it->second.Valid) return false;
+
+	e.ArchiveHash = it->second.Hash;
+	e.ArchiveSize = it->second.Size;
+	e.ArchiveTime = it->second.Time;
+	e.Position = entry.Position;
+	e.Length = entry.Length;
+	e.Offset = 0;
+	e.CRC32 = entry.CRC32;
+	e.Method = entry.Method;
+	e.LastUsed = CacheSession;
+	e.Reserved = 0;
+	return true;
+}
+
+//==========================================================================
+//
+// Marks an entry as used in this session
+//
+//==========================================================================
+
+static void TouchEntry(CachedEntry& ce)
+{
+	if (ce.Index.LastUsed != CacheSession)
+	{
+		ce.Index.LastUsed = CacheSession;
+		CacheEvictable -= ce.Data.size();
+	}
+}
+
+//==========================================================================
+//
+// Returns true if this entry's archive is loaded and has changed
+// since the entry was cached.
+//
+//==========================================================================
+
+static bool IsStale(const CacheIndexEntry& e)
+{
+	for (auto& a : CacheArchives)
+	{
+		if (a.second.Hash == e.ArchiveHash)
+		{
+			return !a.second.Valid || a.second.Size != e.ArchiveSize || a.second.Time != e.ArchiveTime;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// MakeRoom
+//
+// Evicts entries until 'length' more bytes fit. Stale entries go first,
+// then the least recently used ones. To avoid evicting again for every
+// following entry, an extra 1/16 of the cache gets freed if possible.
+//
+//==========================================================================
+
+static void RemoveEntry(size_t i)
+{
+	auto& ce = CacheEntries[i];
+	CacheSize -= ce.Data.size();
+	if (ce.Index.LastUsed != CacheSession) CacheEvictable -= ce.Data.size();
+	CacheLookup.erase(IndexKey(ce.Index));
+	if (i != CacheEntries.size() - 1)
+	{
+		ce = std::move(CacheEntries.back());
+		CacheLookup[IndexKey(ce.Index)] = i;
+	}
+	CacheEntries.pop_back();
+	CacheDirty = true;
+}
+
+static bool CanFit(size_t length)
+{
+	return CacheSize + length <= CacheMaxSize || CacheSize - CacheEvictable + length <= CacheMaxSize;
+}
+
+static bool MakeRoom(size_t length)
+{
+	if (CacheSize + length <= CacheMaxSize) return true;
+	if (!CanFit(length)) return false;
+
+	std::vector<size_t> order;
+	std::vector<bool> stale(CacheEntries.size());
+	for (size_t i = 0; i < CacheEntries.size(); i++)
+	{
+		if (CacheEntries[i].Index.LastUsed == CacheSession) continue;
+		stale[i] = IsStale(CacheEntries[i].Index);
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		if (stale[a] != stale[b]) return stale[a] > stale[b];
+		return CacheEntries[a].Index.LastUsed < CacheEntries[b].Index.LastUsed;
+	});
+
+	size_t slack = CacheMaxSize / 16;
+	size_t target = CacheMaxSize - length;
+	target = target > slack ? target - slack : 0;
+	std::vector<bool> evict(CacheEntries.size());
+	for (auto i : order)
+	{
+		if (CacheSize <= target) break;
+		size_t size = CacheEntries[i].Data.size();
+		CacheSize -= size;
+		CacheEvictable -= size;
+		evict[i] = true;
+	}
+
+	size_t j = 0;
+	CacheLookup.clear();
+	for (size_t i = 0; i < CacheEntries.size(); i++)
+	{
+		if (evict[i]) continue;
+		if (i != j) CacheEntries[j] = std::move(CacheEntries[i]);
+		CacheLookup[IndexKey(CacheEntries[j].Index)] = j;
+		j++;
+	}
+	CacheEntries.resize(j);
+	CacheDirty = true;
+	return true;
+}
+
+//==========================================================================
+//
+// OpenLumpCache
+//
+//==========================================================================
+
+bool OpenLumpCache(const char* filename, size_t maxsize)
+{
+	std::lock_guard<FCriticalSection> lock(CacheLock);
+	if (CacheActive) return true;
+
+	CacheFileName = filename;
+	CacheMaxSize = maxsize;
+	CacheActive = true;
+
+	std::string newname = CacheFileName + ".new";
+	bool isdir;
+	if (FS_DirEntryExists(newname.c_str(), &isdir) && !isdir)
+	{
+		RenameFile(newname.c_str(), filename);
+	}
+
+	CacheMapping = FileMapping::Map(filename);
+	if (CacheMapping == nullptr) return true;	// nothing cached yet.
+
+	auto base = CacheMapping->data();
+	size_t size = CacheMapping->size();
+	auto header = (const CacheHeader*)base;
+	if (size < sizeof(CacheHeader) || memcmp(header->Magic, "LMPC", 4) || header->Version != CACHE_VERSION ||
+		header->ByteOrder != CACHE_BYTEORDER || header->NumEntries > (size - sizeof(CacheHeader)) / sizeof(CacheIndexEntry))
+	{
+		// Not usable. It will be replaced.
+		CacheMapping->Release();
+		CacheMapping = nullptr;
+		CacheDirty = true;
+		return true;
+	}
+
+	CacheSession = header->Session + 1;
+	auto index = (const CacheIndexEntry*)(base + sizeof(CacheHeader));
+	CacheEntries.reserve(header->NumEntries);
+	for (uint32_t i = 0; i < header->NumEntries; i++)
+	{
+		if (index[i].Offset > size || index[i].Length > size - index[i].Offset) continue;
+		CachedEntry ce = { index[i], FileData(CacheMapping, base + index[i].Offset, (size_t)index[i].Length) };
+		CacheLookup[IndexKey(ce.Index)] = CacheEntries.size();
+		CacheSize += (size_t)index[i].Length;
+		CacheEvictable += (size_t)index[i].Length;
+		CacheEntries.push_back(std::move(ce));
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// LumpCacheFind
+//
+// Returns true and a reader for the decompressed data if the entry is
+// in the cache.
+//
+//==========================================================================
+
+bool LumpCacheFind(const char* archive, const FResourceEntry& entry, FileReader& reader)
+{
+	if (!CacheActive) return false;
+	std::lock_guard<FCriticalSection> lock(CacheLock);
+
+	CacheIndexEntry e;
+	if (!MakeIndexEntry(archive, entry, e)) return false;
+
+	auto it = CacheLookup.find(IndexKey(e));
+	if (it == CacheLookup.end() || !SameEntry(CacheEntries[it->second].Index, e)) return false;
+
+	TouchEntry(CacheEntries[it->second]);
+	auto& data = CacheEntries[it->second].Data;
+	if (CacheMapping != nullptr && data.writable() == nullptr)
+	{
+		reader.OpenMappedView(CacheMapping, data.data(), data.size());
+	}
+	else
+	{
+		FileData copy(data.data(), data.size());
+		reader.OpenMemoryArray(copy);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// LumpCacheWants
+//
+// Checks whether a decompressed entry should be passed to LumpCacheStore,
+// i.e. whether it fits, possibly after evicting older entries.
+//
+//==========================================================================
+
+bool LumpCacheWants(const char* archive, const FResourceEntry& entry)
+{
+	if (!CacheActive) return false;
+	std::lock_guard<FCriticalSection> lock(CacheLock);
+
+	CacheIndexEntry e;
+	return MakeIndexEntry(archive, entry, e) && CanFit(entry.Length);
+}
+
+//==========================================================================
+//
+// LumpCacheStore
+//
+//==========================================================================
+
+void LumpCacheStore(const char* archive, const FResourceEntry& entry, const FileData& data)
+{
+	if (!CacheActive) return;
+	std::lock_guard<FCriticalSection> lock(CacheLock);
+
+	CacheIndexEntry e;
+	if (!MakeIndexEntry(archive, entry, e) || data.size() != entry.Length) return;
+
+	uint64_t key = IndexKey(e);
+	auto it = CacheLookup.find(key);
+	if (it != CacheLookup.end())
+	{
+		RemoveEntry(it->second);	// replaced by the new version
+	}
+	if (!MakeRoom(data.size())) return;
+
+	CacheLookup[key] = CacheEntries.size();
+	CacheEntries.push_back({ e, FileData(data.data(), data.size()) });
+	CacheSize += data.size();
+	CacheDirty = true;
+}
+
+//==========================================================================
+//
+// WriteLumpCache
+//
+// Writes everything that has been cached so far, except entries whose
+// archives have changed or are no longer loaded.
+//
+//==========================================================================
+
+void WriteLumpCache()
+{
+	std::lock_guard<FCriticalSection> lock(CacheLock);
+	if (!CacheActive) return;
+
+	std::vector<CacheIndexEntry> index;
+	std::vector<const FileData*> data;
+	for (auto& ce : CacheEntries)
+	{
+		// Entries for archives that were not used this time are kept for
+		// other load orders, those for archives that have changed are not.
+		if (IsStale(ce.Index))
+		{
+			CacheDirty = true;
+			continue;
+		}
+		index.push_back(ce.Index);
+		data.push_back(&ce.Data);
+	}
+	if (!CacheDirty) return;
+
+	uint64_t offset = sizeof(CacheHeader) + index.size() * sizeof(CacheIndexEntry);
+	for (auto& e : index)
+	{
+		offset = (offset + 15) & ~uint64_t(15);
+		e.Offset = offset;
+		offset += e.Length;
+	}
+
+	std::string newname = CacheFileName + ".new";
+	FILE* f = myfopen(newname.c_str(), "wb");
+	if (f == nullptr) return;
+
+	CacheHeader header = { { 'L', 'M', 'P', 'C' }, CACHE_VERSION, CACHE_BYTEORDER, (uint32_t)index.size(), CacheSession, 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (index.size() > 0) ok = ok && fwrite(index.data(), sizeof(CacheIndexEntry), index.size(), f) == index.size();
+
+	uint64_t pos = sizeof(CacheHeader) + index.size() * sizeof(CacheIndexEntry);
+	static const uint8_t zeros[16] = {};
+	for (size_t i = 0; i < index.size() && ok; i++)
+	{
+		ok = fwrite(zeros, 1, size_t(index[i].Offset - pos), f) == size_t(index[i].Offset - pos);
+		ok = ok && fwrite(data[i]->data(), 1, data[i]->size(), f) == data[i]->size();
+		pos = index[i].Offset + index[i].Length;
+	}
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok)
+	{
+		remove(newname.c_str());
+		return;
+	}
+#ifndef _WIN32
+	// The old file can be replaced right away. Its mapping stays valid until it is released.
+	RenameFile(newname.c_str(), CacheFileName.c_str());
+#endif
+	CacheDirty = false;
+}
+
+}
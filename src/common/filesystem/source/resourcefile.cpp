@@ -180,7 +180,7 @@ FResourceFile *FResourceFile::OpenResourceFile(const char *filename, FileReader
 FResourceFile *FResourceFile::OpenResourceFile(const char *filename, bool containeronly, LumpFilterInfo* filter, FileSystemMessageFunc Printf, StringPool* sp)
 {
 	FileReader file;
-	if (!file.OpenFile(filename)) return nullptr;
+	if (!file.OpenMappedFile(filename) && !file.OpenFile(filename)) return nullptr;
 	return DoOpenResourceFile(filename, file, containeronly, filter, Printf, sp);
 }
 
@@ -675,7 +675,10 @@ FileReader FResourceFile::GetEntryReader(uint32_t entry, int readertype, int rea
 			// if this is backed by a memory buffer, create a new reader directly referencing it.
 			if (buf != nullptr)
 			{
-				fr.OpenMemory(buf + Entries[entry].Position, Entries[entry].Length);
+				if (auto mapping = Reader.GetMapping())
+					fr.OpenMappedView(mapping, buf + Entries[entry].Position, Entries[entry].Length);
+				else
+					fr.OpenMemory(buf + Entries[entry].Position, Entries[entry].Length);
 			}
 			else
 			{
@@ -697,15 +700,23 @@ FileReader FResourceFile::GetEntryReader(uint32_t entry, int readertype, int rea
 				}
 			}
 		}
-		else
+		else if (!LumpCacheFind(FileName, Entries[entry], fr))
 		{
 			FileReader fri;
 			if (readertype == READER_NEW || !mainThread) fri.OpenFile(FileName, Entries[entry].Position, Entries[entry].CompressedSize);
 			else fri.OpenFilePart(Reader, Entries[entry].Position, Entries[entry].CompressedSize);
+			bool store = LumpCacheWants(FileName, Entries[entry]);
 			int flags = DCF_TRANSFEROWNER | DCF_EXCEPTIONS;
-			if (readertype == READER_CACHED) flags |= DCF_CACHED;
+			if (readertype == READER_CACHED || store) flags |= DCF_CACHED;
 			else if (readerflags & READERFLAG_SEEKABLE) flags |= DCF_SEEKABLE;
 			OpenDecompressor(fr, fri, Entries[entry].Length, Entries[entry].Method, flags);
+			if (store)
+			{
+				// DCF_CACHED has decompressed everything into a buffer already.
+				auto data = fr.Read();
+				LumpCacheStore(FileName, Entries[entry], data);
+				fr.OpenMemoryArray(data);
+			}
 		}
 	}
 	return fr;
@@ -719,6 +730,10 @@ FileData FResourceFile::Read(uint32_t entry)
 		// if this is backed by a memory buffer, we can just return a reference to the backing store.
 		if (buf != nullptr)
 		{
+			if (auto mapping = Reader.GetMapping())
+			{
+				return FileData(mapping, buf + Entries[entry].Position, Entries[entry].Length);
+			}
 			return FileData(buf + Entries[entry].Position, Entries[entry].Length, false);
 		}
 	}
@@ -306,9 +306,14 @@ void DObject::Release()
 			}
 		}
 	}
+	// If it's in the remembered set, remove it from there as well.
+	if (ObjectFlags & OF_Touched)
+	{
+		GC::Remembered.Delete(GC::Remembered.Find(this));
+	}
 	ObjNext = nullptr;
 	GCNext = nullptr;
-	ObjectFlags |= OF_Released;
+	ObjectFlags = (ObjectFlags & ~(OF_Old | OF_Touched)) | OF_Released;
 }
 
 //==========================================================================
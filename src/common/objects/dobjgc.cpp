@@ -56,9 +56,15 @@
 
 // HEADER FILES ------------------------------------------------------------
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "dobject.h"
 
 #include "c_dispatch.h"
+#include "c_cvars.h"
 #include "menu.h"
 #include "stats.h"
 #include "printf.h"
@@ -107,6 +113,15 @@
 // Cost of destroying an object
 #define GCDESTROYCOST		15
 
+/*
+@@ DEFAULT_GCMINORMUL defines how much the heap may grow before the next
+@* minor collection in generational mode, as a percentage.
+@@ DEFAULT_GCMAJORMUL defines how much the heap may grow since the last
+@* major collection before generational mode does another one.
+*/
+#define DEFAULT_GCMINORMUL	20
+#define DEFAULT_GCMAJORMUL	100
+
 // TYPES -------------------------------------------------------------------
 
 class FAveragizer
@@ -135,6 +150,37 @@ struct FStepStats
 	void Reset();
 };
 
+struct FPauseHistogram
+{
+	// Upper bounds of the buckets in milliseconds. The last bucket takes everything above.
+	static inline constexpr double Limits[] = { 0.1, 0.25, 0.5, 1, 2, 4, 8 };
+	static inline constexpr unsigned NumBuckets = countof(Limits) + 1;
+
+	int Count[NumBuckets];
+	double Longest;
+
+	void AddPause(double ms);
+	void Format(FString &out);
+	void Reset();
+};
+
+// A thread of the parallel marker. Newly grayed objects go on the private
+// stack first. Once that gets long, half of it moves to the shared queue
+// where idle threads can steal it.
+struct FMarkWorker
+{
+	static inline constexpr unsigned ShareSize = 64;
+
+	TArray<DObject *> Private;
+	TArray<DObject *> Shared;
+	std::mutex SharedLock;
+	std::atomic<unsigned> SharedCount;
+	size_t Marked;
+
+	void Push(DObject *obj);
+	bool Steal(FMarkWorker &victim);
+};
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
@@ -147,6 +193,10 @@ static size_t CalcStepSize();
 
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
+CVAR(Bool, gc_generational, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CVAR(Int, gc_markthreads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// 0 = one per core, 1 = never mark in parallel
+CVAR(Bool, gc_markcheck, false, 0)	// Repeat every parallel mark serially and compare
+
 namespace GC
 {
 size_t AllocBytes;
@@ -167,11 +217,27 @@ FStepStats StepStats;
 FStepStats PrevStepStats;
 bool FinalGC;
 bool HadToDestroy;
+double TotalTime;
+bool Generational;
+bool MinorCycle;
+int MinorMul = DEFAULT_GCMINORMUL;
+int MajorMul = DEFAULT_GCMAJORMUL;
+TArray<DObject *> Remembered;
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
 static FAveragizer AllocHistory;// Tracks allocation rate over time
 static cycle_t GCTime;			// Track time spent in GC
+static FPauseHistogram Pauses;	// Distribution of the time spent in single Step calls
+static size_t MajorBase;		// Heap size after the last major collection
+static bool NextMajor;			// Forces the next cycle to be a major collection
+static bool MarkingRoots;		// Old roots get rescanned while this is set
+static int MinorCount, MajorCount;
+
+static thread_local FMarkWorker *MarkWorker;	// Set on the threads of the parallel marker
+static std::atomic<int> BusyMarkers;
+static int LastMarkThreads;		// Threads used by the last parallel mark
+static double LastMarkTime;		// Time it took in milliseconds
 
 // CODE --------------------------------------------------------------------
 
@@ -204,7 +270,51 @@ void CheckGC()
 
 void SetThreshold()
 {
-	Threshold = (std::min(Estimate, AllocBytes) / 100) * Pause;
+	if (Generational)
+	{
+		// Minor collections only need to cover what was allocated since the last one.
+		size_t base = std::min(Estimate, AllocBytes);
+		if (!MinorCycle) MajorBase = base;
+		Threshold = base + std::max<size_t>(GCMINSTEPSIZE, (base / 100) * MinorMul);
+	}
+	else
+	{
+		Threshold = (std::min(Estimate, AllocBytes) / 100) * Pause;
+	}
+}
+
+//==========================================================================
+//
+// AtSweepEnd
+//
+// Minor collections stop sweeping at the first old object. Everything
+// behind it has survived an earlier collection.
+//
+//==========================================================================
+
+static inline bool AtSweepEnd()
+{
+	DObject *curr = *SweepPos;
+	return curr == nullptr || (MinorCycle && (curr->ObjectFlags & OF_Old));
+}
+
+//==========================================================================
+//
+// ResetGenerations
+//
+// Makes every object young and white again, for major collections and for
+// leaving generational mode.
+//
+//==========================================================================
+
+static void ResetGenerations()
+{
+	for (DObject *obj = Root; obj != nullptr; obj = obj->ObjNext)
+	{
+		obj->ObjectFlags &= ~(OF_Old | OF_Touched);
+		obj->MakeWhite();
+	}
+	Remembered.Clear();
 }
 
 //==========================================================================
@@ -241,13 +351,23 @@ static size_t SweepObjects(size_t count)
 	int deadmask = OtherWhite();
 	size_t swept = 0;
 
-	while ((curr = *SweepPos) != nullptr && count-- > 0)
+	while (!AtSweepEnd() && count-- > 0)
 	{
+		curr = *SweepPos;
 		swept += curr->GetClass()->Size;
 		if ((curr->ObjectFlags ^ OF_WhiteBits) & deadmask)	// not dead?
 		{
 			assert(!curr->IsDead() || (curr->ObjectFlags & OF_Fixed));
-			curr->MakeWhite();	// make it white (for next cycle)
+			if (Generational)
+			{
+				// Survivors become old. They stay black so that the write barrier
+				// catches them being pointed at young objects.
+				curr->ObjectFlags = (curr->ObjectFlags & ~OF_MarkBits) | OF_Black | OF_Old;
+			}
+			else
+			{
+				curr->MakeWhite();	// make it white (for next cycle)
+			}
 			SweepPos = &curr->ObjNext;
 		}
 		else
@@ -315,8 +435,50 @@ static size_t DestroyObjects(size_t count)
 //
 //==========================================================================
 
+static inline std::atomic<uint32_t> &AtomicFlags(DObject *obj)
+{
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic flags must have the same layout");
+	return *reinterpret_cast<std::atomic<uint32_t> *>(&obj->ObjectFlags);
+}
+
+// Parallel version of Mark. Several threads may reach the same object, so
+// whoever clears its white bits first gets to propagate it.
+static void ParallelMark(DObject **obj)
+{
+	DObject *lobj = *obj;
+	if (lobj == nullptr)
+	{
+		return;
+	}
+	auto &flags = AtomicFlags(lobj);
+	uint32_t f = flags.load(std::memory_order_relaxed);
+	if (f & OF_Released)
+	{
+		return;
+	}
+	if (f & OF_EuthanizeMe)
+	{
+		*obj = nullptr;
+		return;
+	}
+	while (f & OF_WhiteBits)
+	{
+		if (flags.compare_exchange_weak(f, f & ~OF_WhiteBits, std::memory_order_relaxed))
+		{
+			MarkWorker->Push(lobj);
+			return;
+		}
+	}
+}
+
 void Mark(DObject **obj)
 {
+	if (MarkWorker != nullptr)
+	{
+		ParallelMark(obj);
+		return;
+	}
+
 	DObject *lobj = *obj;
 
 	//assert(lobj == nullptr || !(lobj->ObjectFlags & OF_Released));
@@ -332,6 +494,35 @@ void Mark(DObject **obj)
 			lobj->GCNext = Gray;
 			Gray = lobj;
 		}
+		else if (MarkingRoots && (lobj->ObjectFlags & (OF_Old | OF_Black)) == (OF_Old | OF_Black))
+		{
+			// Roots are cheap to rescan, and it keeps minor collections safe
+			// for roots written to without a barrier.
+			lobj->Black2Gray();
+			lobj->GCNext = Gray;
+			Gray = lobj;
+		}
+	}
+}
+
+//==========================================================================
+//
+// Regray
+//
+//==========================================================================
+
+void Regray(DObject *obj)
+{
+	if (MarkWorker != nullptr)
+	{
+		AtomicFlags(obj).fetch_and(~(uint32_t)OF_Black, std::memory_order_relaxed);
+		MarkWorker->Push(obj);
+	}
+	else
+	{
+		obj->Black2Gray();
+		obj->GCNext = Gray;
+		Gray = obj;
 	}
 }
 
@@ -380,13 +571,8 @@ void AddMarkerFunc(GCMarkerFunc func)
 		markers.Push(func);
 }
 
-static void MarkRoot()
+static void MarkRootSet()
 {
-	PrevStepStats = StepStats;
-	StepStats.Reset();
-
-	Gray = nullptr;
-
 	for (auto func : markers) func();
 
 	// Mark soft roots.
@@ -403,10 +589,277 @@ static void MarkRoot()
 			}
 		}
 	}
+}
+
+static void MarkRoot()
+{
+	PrevStepStats = StepStats;
+	StepStats.Reset();
+
+	Gray = nullptr;
+
+	bool wasGenerational = Generational;
+	Generational = gc_generational;
+	MinorCycle = Generational && wasGenerational && !NextMajor && AllocBytes <= MajorBase + (MajorBase / 100) * MajorMul;
+	NextMajor = false;
+	if (MinorCycle)
+	{
+		// Old objects stay black. The ones in the remembered set get
+		// rescanned because they may point to young objects now.
+		for (auto obj : Remembered)
+		{
+			obj->ObjectFlags &= ~OF_Touched;
+			if (obj->IsBlack())
+			{
+				obj->Black2Gray();
+				obj->GCNext = Gray;
+				Gray = obj;
+			}
+		}
+		Remembered.Clear();
+		MinorCount++;
+	}
+	else
+	{
+		if (wasGenerational)
+		{
+			ResetGenerations();
+		}
+		if (Generational)
+		{
+			MajorCount++;
+		}
+	}
+	MarkingRoots = MinorCycle;
+	MarkRootSet();
+	MarkingRoots = false;
 	// Time to propagate the marks.
 	State = GCS_Propagate;
 }
 
+//==========================================================================
+//
+// FMarkWorker :: Push
+//
+//==========================================================================
+
+void FMarkWorker::Push(DObject *obj)
+{
+	Private.Push(obj);
+	if (Private.Size() >= ShareSize * 2 && SharedCount.load(std::memory_order_relaxed) == 0)
+	{
+		std::lock_guard<std::mutex> lock(SharedLock);
+		for (unsigned i = Private.Size() - ShareSize; i < Private.Size(); i++)
+		{
+			Shared.Push(Private[i]);
+		}
+		Private.Clamp(Private.Size() - ShareSize);
+		SharedCount.store(Shared.Size(), std::memory_order_relaxed);
+	}
+}
+
+//==========================================================================
+//
+// FMarkWorker :: Steal
+//
+// Takes half of the victim's shared queue.
+//
+//==========================================================================
+
+bool FMarkWorker::Steal(FMarkWorker &victim)
+{
+	if (victim.SharedCount.load(std::memory_order_relaxed) == 0)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(victim.SharedLock);
+	unsigned count = victim.Shared.Size();
+	if (count == 0)
+	{
+		return false;
+	}
+	unsigned take = (count + 1) / 2;
+	for (unsigned i = count - take; i < count; i++)
+	{
+		Private.Push(victim.Shared[i]);
+	}
+	victim.Shared.Clamp(count - take);
+	victim.SharedCount.store(victim.Shared.Size(), std::memory_order_relaxed);
+	return true;
+}
+
+//==========================================================================
+//
+// RunMarkWorker
+//
+// Propagates marks until no thread has anything left to do.
+//
+//==========================================================================
+
+static void RunMarkWorker(std::vector<FMarkWorker> &workers, unsigned self)
+{
+	FMarkWorker &me = workers[self];
+	MarkWorker = &me;
+	for (;;)
+	{
+		while (me.Private.Size() > 0 || me.Steal(me))
+		{
+			DObject *obj;
+			me.Private.Pop(obj);
+			uint32_t f = AtomicFlags(obj).fetch_or(OF_Black, std::memory_order_relaxed);
+			me.Marked += !(f & OF_EuthanizeMe) ? obj->PropagateMark() : obj->GetClass()->Size;
+		}
+
+		// Out of work. Look for someone to steal from, and quit once nobody is busy.
+		BusyMarkers.fetch_sub(1);
+		bool found = false;
+		while (!found)
+		{
+			bool empty = BusyMarkers.load() == 0;
+			for (unsigned i = 1; i < workers.size() && !found; i++)
+			{
+				FMarkWorker &victim = workers[(self + i) % workers.size()];
+				if (victim.SharedCount.load(std::memory_order_relaxed) != 0)
+				{
+					empty = false;
+					BusyMarkers.fetch_add(1);
+					found = me.Steal(victim);
+					if (!found) BusyMarkers.fetch_sub(1);
+				}
+			}
+			if (!found && empty)
+			{
+				MarkWorker = nullptr;
+				return;
+			}
+			if (!found) std::this_thread::yield();
+		}
+	}
+}
+
+//==========================================================================
+//
+// ParallelPropagate
+//
+// Propagates the whole gray list on several threads at once. This is only
+// used for full collections, where nothing else runs while marking.
+//
+//==========================================================================
+
+static unsigned MarkThreadCount()
+{
+	int threads = gc_markthreads;
+	if (threads <= 0)
+	{
+		threads = std::min<int>(std::thread::hardware_concurrency(), 16);
+	}
+	return std::max(threads, 1);
+}
+
+static void ParallelPropagate()
+{
+	unsigned numthreads = MarkThreadCount();
+	if (numthreads <= 1 || Gray == nullptr)
+	{
+		return;
+	}
+
+	cycle_t clock;
+	clock.ResetAndClock();
+
+	// The pointer tables are built on first use, which must not happen on several threads.
+	for (auto cls : PClass::AllClasses)
+	{
+		cls->BuildFlatPointers();
+		cls->BuildArrayPointers();
+		cls->BuildMapPointers();
+	}
+
+	std::vector<FMarkWorker> workers(numthreads);
+	unsigned i = 0;
+	for (DObject *obj = Gray; obj != nullptr; obj = obj->GCNext)
+	{
+		workers[i++ % numthreads].Private.Push(obj);
+	}
+	for (auto &worker : workers)
+	{
+		worker.SharedCount = 0;
+		worker.Marked = 0;
+	}
+	Gray = nullptr;
+
+	BusyMarkers = numthreads;
+	std::vector<std::thread> threads;
+	for (i = 1; i < numthreads; i++)
+	{
+		threads.emplace_back(RunMarkWorker, std::ref(workers), i);
+	}
+	RunMarkWorker(workers, 0);
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	size_t marked = 0;
+	for (auto &worker : workers)
+	{
+		marked += worker.Marked;
+	}
+	StepStats.BytesCovered[GCS_Propagate] += marked;
+
+	clock.Unclock();
+	LastMarkThreads = numthreads;
+	LastMarkTime = clock.TimeMS();
+}
+
+//==========================================================================
+//
+// CheckParallelMark
+//
+// Marks everything again with the serial marker and reports every object
+// where the two disagree. The serial result is the one kept.
+//
+//==========================================================================
+
+static void CheckParallelMark()
+{
+	TArray<bool> parallelBlack;
+	for (DObject *obj = Root; obj != nullptr; obj = obj->ObjNext)
+	{
+		parallelBlack.Push(obj->IsBlack());
+		obj->MakeWhite();
+	}
+
+	Gray = nullptr;
+	MarkRootSet();
+	while (Gray != nullptr)
+	{
+		PropagateMark();
+	}
+
+	int extra = 0, missed = 0;
+	unsigned i = 0;
+	for (DObject *obj = Root; obj != nullptr; obj = obj->ObjNext, i++)
+	{
+		if (parallelBlack[i] != obj->IsBlack())
+		{
+			(parallelBlack[i] ? extra : missed)++;
+			if (missed + extra <= 10)
+			{
+				Printf(TEXTCOLOR_RED "Parallel GC %s %s\n", parallelBlack[i] ? "kept" : "missed", obj->GetClass()->TypeName.GetChars());
+			}
+		}
+	}
+	if (extra + missed > 0)
+	{
+		Printf(TEXTCOLOR_RED "Parallel GC marked %d objects the serial marker did not and missed %d\n", extra, missed);
+	}
+	else
+	{
+		DPrintf(DMSG_NOTIFY, "Parallel GC agrees with the serial marker on %u objects\n", i);
+	}
+}
+
 //==========================================================================
 //
 // Atomic
@@ -471,7 +924,7 @@ static size_t SingleStep()
 		RunningDeallocBytes = 0;
 		size_t swept = SweepObjects(GCSWEEPGRANULARITY);
 		Estimate -= RunningDeallocBytes;
-		if (*SweepPos == nullptr)
+		if (AtSweepEnd())
 		{ // Nothing more to sweep?
 			SweepDone();
 		}
@@ -550,6 +1003,8 @@ void Step()
 	StepStats.Clock[enter_state].Unclock();
 	StepStats.BytesCovered[enter_state] += did;
 	GCTime.Unclock();
+	TotalTime += GCTime.Time();
+	Pauses.AddPause(GCTime.TimeMS());
 }
 
 //==========================================================================
@@ -582,7 +1037,16 @@ void FullGC()
 		// Loop until everything that can be destroyed and freed is
 		do
 		{
+			NextMajor = true;
 			MarkRoot();
+			if (MarkThreadCount() > 1)
+			{
+				ParallelPropagate();
+				if (gc_markcheck)
+				{
+					CheckParallelMark();
+				}
+			}
 			while (State != GCS_Pause)
 			{
 				SingleStep();
@@ -605,7 +1069,7 @@ void Barrier(DObject *pointing, DObject *pointed)
 {
 	assert(pointing == nullptr || (pointing->IsBlack() && !pointing->IsDead()));
 	assert(pointed->IsWhite() && !pointed->IsDead());
-	assert(State != GCS_Destroy && State != GCS_Pause);
+	assert(Generational || (State != GCS_Destroy && State != GCS_Pause));
 	assert(!(pointed->ObjectFlags & OF_Released));	// if a released object gets here, something must be wrong.
 	if (pointed->ObjectFlags & OF_Released) return;	// don't do anything with non-GC'd objects.
 	// The invariant only needs to be maintained in the propagate state.
@@ -615,6 +1079,16 @@ void Barrier(DObject *pointing, DObject *pointed)
 		pointed->GCNext = Gray;
 		Gray = pointed;
 	}
+	// In generational mode black objects are, or are about to become, old.
+	// Remember them so the next minor collection finds the young object.
+	else if (Generational)
+	{
+		if (pointing != nullptr && !(pointing->ObjectFlags & OF_Touched))
+		{
+			pointing->ObjectFlags |= OF_Touched;
+			Remembered.Push(pointing);
+		}
+	}
 	// In other states, we can mark the pointing object white so this
 	// barrier won't be triggered again, saving a few cycles in the future.
 	else if (pointing != nullptr)
@@ -703,8 +1177,17 @@ void DelSoftRoot(DObject *obj)
 	if (*probe == obj)
 	{
 		*probe = obj->ObjNext;
-		obj->ObjNext = Root;
-		Root = obj;
+		// Old objects must go behind the young ones, where minor collections stop sweeping.
+		probe = &Root;
+		if (obj->ObjectFlags & OF_Old)
+		{
+			while (*probe != nullptr && !((*probe)->ObjectFlags & OF_Old))
+			{
+				probe = &(*probe)->ObjNext;
+			}
+		}
+		obj->ObjNext = *probe;
+		*probe = obj;
 	}
 }
 
@@ -756,6 +1239,58 @@ size_t FAveragizer::GetAverage()
 	return TotalCount != 0 ? TotalAmount / TotalCount : 0;
 }
 
+//==========================================================================
+//
+// FPauseHistogram :: AddPause
+//
+//==========================================================================
+
+void FPauseHistogram::AddPause(double ms)
+{
+	unsigned i = 0;
+	while (i < countof(Limits) && ms >= Limits[i])
+	{
+		i++;
+	}
+	Count[i]++;
+	Longest = std::max(Longest, ms);
+}
+
+//==========================================================================
+//
+// FPauseHistogram :: Reset
+//
+//==========================================================================
+
+void FPauseHistogram::Reset()
+{
+	memset(Count, 0, sizeof(Count));
+	Longest = 0;
+}
+
+//==========================================================================
+//
+// FPauseHistogram :: Format
+//
+//==========================================================================
+
+void FPauseHistogram::Format(FString &out)
+{
+	out << "Pauses:";
+	for (unsigned i = 0; i < NumBuckets; ++i)
+	{
+		if (i < countof(Limits))
+		{
+			out.AppendFormat(" <%gms:%d", Limits[i], Count[i]);
+		}
+		else
+		{
+			out.AppendFormat(" >=%gms:%d", Limits[i - 1], Count[i]);
+		}
+	}
+	out.AppendFormat("  Longest:%.2fms", Longest);
+}
+
 //==========================================================================
 //
 // STAT gc
@@ -787,6 +1322,19 @@ ADD_STAT(gc)
 		(GC::AllocBytes + 1023) >> 10,
 		(GC::Estimate + 1023) >> 10,
 		(GC::Threshold + 1023) >> 10);
+	if (GC::Generational)
+	{
+		out.AppendFormat("\n%s  Minor:%d  Major:%d  Remembered:%u  Major at:%6zuK",
+			GC::MinorCycle ? "Minor" : "Major",
+			GC::MinorCount, GC::MajorCount, GC::Remembered.Size(),
+			(GC::MajorBase + (GC::MajorBase / 100) * GC::MajorMul + 1023) >> 10);
+	}
+	out << "\n";
+	GC::Pauses.Format(out);
+	if (GC::LastMarkThreads > 0)
+	{
+		out.AppendFormat("\nLast parallel mark: %d threads, %.2fms", GC::LastMarkThreads, GC::LastMarkTime);
+	}
 	return out;
 }
 
@@ -842,7 +1390,7 @@ CCMD(gc)
 {
 	if (argv.argc() == 1)
 	{
-		Printf ("Usage: gc stop|now|full|count|pause [size]|stepmul [size]\n");
+		Printf ("Usage: gc stop|now|full|count|resetpauses|pause [size]|stepmul [size]|minormul [size]|majormul [size]\n");
 		return;
 	}
 	if (stricmp(argv[1], "stop") == 0)
@@ -885,5 +1433,31 @@ CCMD(gc)
 			GC::StepMul = max(100, atoi(argv[2]));
 		}
 	}
+	else if (stricmp(argv[1], "minormul") == 0)
+	{
+		if (argv.argc() == 2)
+		{
+			Printf ("Current GC minormul is %d\n", GC::MinorMul);
+		}
+		else
+		{
+			GC::MinorMul = max(1, atoi(argv[2]));
+		}
+	}
+	else if (stricmp(argv[1], "majormul") == 0)
+	{
+		if (argv.argc() == 2)
+		{
+			Printf ("Current GC majormul is %d\n", GC::MajorMul);
+		}
+		else
+		{
+			GC::MajorMul = max(1, atoi(argv[2]));
+		}
+	}
+	else if (stricmp(argv[1], "resetpauses") == 0)
+	{
+		GC::Pauses.Reset();
+	}
 }
 
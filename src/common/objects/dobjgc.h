@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include "tarray.h"
 class DObject;
+class PClass;
 class FSerializer;
 
 enum EObjectFlags
@@ -27,6 +28,8 @@ enum EObjectFlags
 	OF_Spawned			= 1 << 12,      // Thinker was spawned at all (some thinkers get deleted before spawning)
 	OF_Released			= 1 << 13,		// Object was released from the GC system and should not be processed by GC function
 	OF_Networked		= 1 << 14,		// Object has a unique network identifier that makes it synchronizable between all clients.
+	OF_Old				= 1 << 15,		// Object survived a generational collection and is only rescanned by major collections
+	OF_Touched			= 1 << 16,		// Old object is in the remembered set because it was given a pointer to a young object
 };
 
 template<class T> class TObjPtr;
@@ -80,6 +83,24 @@ namespace GC
 	// Is this the final collection just before exit?
 	extern bool FinalGC;
 
+	// Total number of seconds spent in collection steps.
+	extern double TotalTime;
+
+	// Is the collector running in generational mode?
+	extern bool Generational;
+
+	// Is the current cycle a minor (nursery only) collection?
+	extern bool MinorCycle;
+
+	// Growth of the heap that triggers a minor collection, in percent.
+	extern int MinorMul;
+
+	// Growth of the heap since the last major collection that triggers the next one, in percent.
+	extern int MajorMul;
+
+	// Old objects that were given pointers to young objects since the last minor collection.
+	extern TArray<DObject *> Remembered;
+
 	// Current white value for known-dead objects.
 	static inline uint32_t OtherWhite()
 	{
@@ -137,6 +158,10 @@ namespace GC
 	// Marks an array of objects.
 	void MarkArray(DObject **objs, size_t count);
 
+	// Puts a black object back on the gray list, for objects that mark
+	// their contents over several steps.
+	void Regray(DObject *obj);
+
 	// For cleanup
 	void DelSoftRootHead();
 
@@ -172,6 +197,19 @@ namespace GC
 		MarkArray(&arr[0], arr.Size());
 	}
 
+	// Number of objects allocated and freed so far.
+	extern size_t ObjectAllocs, ObjectFrees;
+
+	// Returns zeroed memory for an object. Objects with a class come from a
+	// pool for that class and group, others from a pool for their size.
+	void *AllocObject(size_t size, const PClass *cls = nullptr, int group = 0);
+
+	// Frees memory returned by AllocObject.
+	void FreeObject(void *mem);
+
+	// Memory held by the object pools, used by live objects, and used by objects too big for the pools.
+	void GetPoolStats(size_t &slabbytes, size_t &livebytes, size_t &unpooledbytes);
+
 	using GCMarkerFunc = void(*)();
 	void AddMarkerFunc(GCMarkerFunc func);
 
@@ -0,0 +1,396 @@
+/*
+** dobjpool.cpp
+** Slab allocator for DObjects
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Objects created from a class (which includes every actor and thinker)
+** come from a pool for that class and pool group. Thinkers use their
+** statnum as the group, so everything that gets run together also sits
+** together in memory. Objects created with Create<T> come from pools for
+** their size class. Big objects, and all objects if -noobjectpools is
+** given, are allocated on their own.
+**
+** Every object is preceded by a small header that tells FreeObject where
+** it came from.
+**
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "dobject.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "printf.h"
+#include "m_argv.h"
+#include "engineerrors.h"
+
+// Objects bigger than this are not pooled.
+#define POOLMAXSIZE			4096
+
+// Granularity of the size classes.
+#define POOLSIZEGRANULARITY	16
+
+// Slabs start small and double in size up to this.
+#define POOLMAXSLABSIZE		65536
+#define POOLMINSLABCOUNT	4
+
+struct FObjectPool;
+struct FPoolSlab;
+
+struct alignas(16) FObjectHeader
+{
+	FPoolSlab *Slab;	// nullptr if allocated on its own
+	size_t Size;
+};
+
+struct alignas(16) FPoolSlab
+{
+	FObjectPool *Pool;
+	FPoolSlab *NextFree, *PrevFree;	// Links in the pool's list of slabs with free entries
+	FObjectHeader *FreeList;		// Released entries. The next one is stored in the Slab field.
+	unsigned Capacity;
+	unsigned Used;					// Entries handed out at least once
+	unsigned Live;
+	bool InFreeList;
+
+	uint8_t *Entry(unsigned i, size_t stride)
+	{
+		return (uint8_t *)(this + 1) + i * stride;
+	}
+};
+
+struct FObjectPool
+{
+	const PClass *Class;			// nullptr for size class pools
+	int Group;
+	size_t ObjectSize;
+	size_t Stride;
+	unsigned NextCapacity;
+	FPoolSlab *FreeSlabs;
+	unsigned NumSlabs;
+	size_t SlabBytes;
+	size_t Live;
+	size_t Allocs;
+};
+
+namespace GC
+{
+size_t ObjectAllocs;
+size_t ObjectFrees;
+
+static bool PoolsInitialized;
+static bool UsePools;
+static TMap<uint64_t, FObjectPool *> ClassPools;
+static FObjectPool *SizePools[POOLMAXSIZE / POOLSIZEGRANULARITY];
+static TArray<FObjectPool *> AllPools;
+static size_t UnpooledBytes;
+static size_t UnpooledLive;
+
+//==========================================================================
+//
+// CreatePool
+//
+//==========================================================================
+
+static FObjectPool *CreatePool(const PClass *cls, int group, size_t size)
+{
+	auto pool = new FObjectPool;
+	pool->Class = cls;
+	pool->Group = group;
+	pool->ObjectSize = (size + POOLSIZEGRANULARITY - 1) & ~(size_t)(POOLSIZEGRANULARITY - 1);
+	pool->Stride = sizeof(FObjectHeader) + pool->ObjectSize;
+	pool->NextCapacity = POOLMINSLABCOUNT;
+	pool->FreeSlabs = nullptr;
+	pool->NumSlabs = 0;
+	pool->SlabBytes = 0;
+	pool->Live = 0;
+	pool->Allocs = 0;
+	AllPools.Push(pool);
+	return pool;
+}
+
+//==========================================================================
+//
+// FindPool
+//
+//==========================================================================
+
+static FObjectPool *FindPool(size_t size, const PClass *cls, int group)
+{
+	if (!PoolsInitialized)
+	{
+		// Objects can be created before the command line is available.
+		if (Args == nullptr)
+		{
+			return nullptr;
+		}
+		UsePools = !Args->CheckParm("-noobjectpools");
+		PoolsInitialized = true;
+	}
+	if (!UsePools || size > POOLMAXSIZE)
+	{
+		return nullptr;
+	}
+
+	if (cls != nullptr)
+	{
+		uint64_t key = ((uint64_t)(uintptr_t)cls << 16) ^ (uint16_t)group;
+		FObjectPool *&pool = ClassPools[key];
+		if (pool == nullptr)
+		{
+			pool = CreatePool(cls, group, size);
+		}
+		return pool->ObjectSize >= size ? pool : nullptr;
+	}
+
+	FObjectPool *&pool = SizePools[(size - 1) / POOLSIZEGRANULARITY];
+	if (pool == nullptr)
+	{
+		pool = CreatePool(nullptr, 0, ((size - 1) / POOLSIZEGRANULARITY + 1) * POOLSIZEGRANULARITY);
+	}
+	return pool;
+}
+
+//==========================================================================
+//
+// Slab list maintenance
+//
+//==========================================================================
+
+static void LinkFreeSlab(FObjectPool *pool, FPoolSlab *slab)
+{
+	slab->PrevFree = nullptr;
+	slab->NextFree = pool->FreeSlabs;
+	if (pool->FreeSlabs != nullptr) pool->FreeSlabs->PrevFree = slab;
+	pool->FreeSlabs = slab;
+	slab->InFreeList = true;
+}
+
+static void UnlinkFreeSlab(FObjectPool *pool, FPoolSlab *slab)
+{
+	if (slab->PrevFree != nullptr) slab->PrevFree->NextFree = slab->NextFree;
+	else pool->FreeSlabs = slab->NextFree;
+	if (slab->NextFree != nullptr) slab->NextFree->PrevFree = slab->PrevFree;
+	slab->InFreeList = false;
+}
+
+static FPoolSlab *NewSlab(FObjectPool *pool)
+{
+	unsigned capacity = pool->NextCapacity;
+	size_t bytes = sizeof(FPoolSlab) + capacity * pool->Stride;
+	auto slab = (FPoolSlab *)malloc(bytes);
+	if (slab == nullptr)
+	{
+		I_FatalError("Could not allocate %zu bytes for an object pool", bytes);
+	}
+	slab->Pool = pool;
+	slab->FreeList = nullptr;
+	slab->Capacity = capacity;
+	slab->Used = 0;
+	slab->Live = 0;
+	LinkFreeSlab(pool, slab);
+
+	pool->NumSlabs++;
+	pool->SlabBytes += bytes;
+	if (pool->Stride * capacity * 2 <= POOLMAXSLABSIZE)
+	{
+		pool->NextCapacity = capacity * 2;
+	}
+	return slab;
+}
+
+//==========================================================================
+//
+// AllocObject
+//
+// Returns zeroed memory for an object of the given size.
+//
+//==========================================================================
+
+void *AllocObject(size_t size, const PClass *cls, int group)
+{
+	FObjectHeader *header;
+	FObjectPool *pool = FindPool(size, cls, group);
+
+	ObjectAllocs++;
+	if (pool == nullptr)
+	{
+		header = (FObjectHeader *)calloc(1, sizeof(FObjectHeader) + size);
+		if (header == nullptr)
+		{
+			I_FatalError("Could not allocate %zu bytes for an object", size);
+		}
+		header->Slab = nullptr;
+		header->Size = size;
+		UnpooledBytes += size;
+		UnpooledLive++;
+		ReportAlloc(size);
+		return header + 1;
+	}
+
+	FPoolSlab *slab = pool->FreeSlabs != nullptr ? pool->FreeSlabs : NewSlab(pool);
+	if (slab->FreeList != nullptr)
+	{
+		header = slab->FreeList;
+		slab->FreeList = (FObjectHeader *)header->Slab;
+	}
+	else
+	{
+		header = (FObjectHeader *)slab->Entry(slab->Used++, pool->Stride);
+	}
+	if (++slab->Live == slab->Capacity)
+	{
+		UnlinkFreeSlab(pool, slab);
+	}
+	header->Slab = slab;
+	header->Size = pool->ObjectSize;
+	memset(header + 1, 0, pool->ObjectSize);
+
+	pool->Live++;
+	pool->Allocs++;
+	ReportAlloc(pool->ObjectSize);
+	return header + 1;
+}
+
+//==========================================================================
+//
+// FreeObject
+//
+//==========================================================================
+
+void FreeObject(void *mem)
+{
+	if (mem == nullptr)
+	{
+		return;
+	}
+	auto header = (FObjectHeader *)mem - 1;
+	FPoolSlab *slab = header->Slab;
+
+	ObjectFrees++;
+	ReportDealloc(header->Size);
+	if (slab == nullptr)
+	{
+		UnpooledBytes -= header->Size;
+		UnpooledLive--;
+		free(header);
+		return;
+	}
+
+	FObjectPool *pool = slab->Pool;
+	pool->Live--;
+	header->Slab = (FPoolSlab *)slab->FreeList;
+	slab->FreeList = header;
+	slab->Live--;
+
+	if (slab->Live == 0 && pool->NumSlabs > 1)
+	{
+		// Give empty slabs back, but keep the last one around so that a pool
+		// that keeps creating and destroying a single object doesn't thrash.
+		if (slab->InFreeList) UnlinkFreeSlab(pool, slab);
+		pool->NumSlabs--;
+		pool->SlabBytes -= sizeof(FPoolSlab) + slab->Capacity * pool->Stride;
+		free(slab);
+	}
+	else if (!slab->InFreeList)
+	{
+		LinkFreeSlab(pool, slab);
+	}
+}
+
+//==========================================================================
+//
+// GetPoolStats
+//
+//==========================================================================
+
+void GetPoolStats(size_t &slabbytes, size_t &livebytes, size_t &unpooledbytes)
+{
+	slabbytes = livebytes = 0;
+	for (auto pool : AllPools)
+	{
+		slabbytes += pool->SlabBytes;
+		livebytes += pool->Live * pool->ObjectSize;
+	}
+	unpooledbytes = UnpooledBytes;
+}
+
+}
+
+//==========================================================================
+//
+// STAT objpools
+//
+//==========================================================================
+
+ADD_STAT(objpools)
+{
+	FString out;
+	size_t slabbytes, livebytes, unpooled;
+	GC::GetPoolStats(slabbytes, livebytes, unpooled);
+	out.AppendFormat("%s  Pools:%u  Slabs:%6zuK  Live:%6zuK (%.1f%%)  Unpooled:%6zuK in %zu\nAllocs:%zu  Frees:%zu",
+		GC::UsePools ? "Pooled" : "Not pooled",
+		GC::AllPools.Size(),
+		(slabbytes + 1023) >> 10,
+		(livebytes + 1023) >> 10,
+		slabbytes > 0 ? livebytes * 100. / slabbytes : 0.,
+		(unpooled + 1023) >> 10, GC::UnpooledLive,
+		GC::ObjectAllocs, GC::ObjectFrees);
+	return out;
+}
+
+//==========================================================================
+//
+// CCMD dumpobjpools
+//
+// Lists the pools with the most memory in them.
+//
+//==========================================================================
+
+CCMD(dumpobjpools)
+{
+	TArray<FObjectPool *> pools = GC::AllPools;
+	std::sort(pools.begin(), pools.end(), [](FObjectPool *a, FObjectPool *b) { return a->SlabBytes > b->SlabBytes; });
+
+	int count = argv.argc() > 1 ? atoi(argv[1]) : 30;
+	for (int i = 0; i < count && i < (int)pools.Size(); i++)
+	{
+		auto pool = pools[i];
+		if (pool->Class != nullptr)
+		{
+			Printf("%-32s %4d", pool->Class->TypeName.GetChars(), pool->Group);
+		}
+		else
+		{
+			Printf("%-32s     ", FStringf("<%zu bytes>", pool->ObjectSize).GetChars());
+		}
+		Printf(" %6zu live %6zu allocs %4u slabs %6zuK\n", pool->Live, pool->Allocs, pool->NumSlabs, (pool->SlabBytes + 1023) >> 10);
+	}
+}
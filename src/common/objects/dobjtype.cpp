@@ -417,24 +417,23 @@ PClass *PClass::FindClass (FName zaname)
 //
 // PClass :: CreateNew
 //
-// Create a new object that this class represents
+// Create a new object that this class represents. Objects of the same
+// class and pool group are kept together in memory.
 //
 //==========================================================================
 
-DObject *PClass::CreateNew()
+DObject *PClass::CreateNew(int poolgroup)
 {
-	uint8_t *mem = (uint8_t *)M_Malloc (Size);
+	uint8_t *mem = (uint8_t *)GC::AllocObject (Size, this, poolgroup);
 	assert (mem != nullptr);
 
 	// Set this object's defaults before constructing it.
 	if (Defaults != nullptr)
 		memcpy (mem, Defaults, Size);
-	else
-		memset (mem, 0, Size);
 
 	if (ConstructNative == nullptr || bAbstract)
 	{
-		M_Free(mem);
+		GC::FreeObject(mem);
 		I_Error("Attempt to instantiate abstract class %s.", TypeName.GetChars());
 	}
 	ConstructNative (mem);
@@ -55,6 +55,8 @@ int vertexcount, flatvertices, flatprimitives;
 
 int rendered_lines,rendered_flats,rendered_sprites,render_vertexsplit,render_texsplit,rendered_decals, rendered_portals, rendered_commandbuffers;
 int iter_dlightf, iter_dlight, draw_dlight, draw_dlightf;
+int relinked_dlight, dlight_nodes;
+cycle_t LinkDLight;
 
 void ResetProfilingData()
 {
@@ -120,6 +122,8 @@ static void AppendLightStats(FString &out)
 {
 	out.AppendFormat("DLight - Walls: %d processed, %d rendered - Flats: %d processed, %d rendered\n", 
 		iter_dlight, draw_dlight, iter_dlightf, draw_dlightf );
+	out.AppendFormat("DLight linking: %d relinked, %d nodes, %2.3f ms\n",
+		relinked_dlight, dlight_nodes, LinkDLight.TimeMS());
 }
 
 ADD_STAT(rendertimes)
@@ -7440,6 +7440,21 @@ ExpEmit FxCVar::Emit(VMFunctionBuilder *build)
 	return dest;
 }
 
+void *FxCVar::ValueAddress(FBaseCVar *cvar)
+{
+	switch (cvar->GetRealType())
+	{
+	case CVAR_Int:		return &static_cast<FIntCVar *>(cvar)->Value;
+	case CVAR_Color:	return &static_cast<FColorCVar *>(cvar)->Value;
+	case CVAR_Float:	return &static_cast<FFloatCVar *>(cvar)->Value;
+	case CVAR_Bool:		return &static_cast<FBoolCVar *>(cvar)->Value;
+	case CVAR_String:	return &static_cast<FStringCVar *>(cvar)->mValue;
+	case CVAR_Flag:		return &static_cast<FFlagCVar *>(cvar)->ValueVar.Value;
+	case CVAR_Mask:		return &static_cast<FMaskCVar *>(cvar)->ValueVar.Value;
+	default:			return nullptr;
+	}
+}
+
 
 //==========================================================================
 //
@@ -1462,6 +1462,9 @@ public:
 	FxCVar(FBaseCVar*, const FScriptPosition&);
 	FxExpression *Resolve(FCompileContext&);
 	ExpEmit Emit(VMFunctionBuilder *build);
+
+	// The address emitted code reads the CVar's value from.
+	static void *ValueAddress(FBaseCVar *cvar);
 };
 
 
@@ -2395,6 +2398,13 @@ struct CompileEnvironment
 	FxExpression* (*CheckCustomGlobalFunctions)(FxFunctionCall* func, FCompileContext& ctx);
 	bool (*ResolveSpecialFunction)(FxVMFunctionCall* func, FCompileContext& ctx);
 	FName CustomBuiltinNew;	//override the 'new' function if some classes need special treatment.
+
+	// For the bytecode cache: game side tables that resolving code appends to.
+	// MarkTables returns the current fill state, SaveTables serializes everything
+	// added since then and RestoreTables appends it again in a later run.
+	unsigned (*MarkTables)();
+	bool (*SaveTables)(unsigned mark, TArray<uint8_t> &data);
+	bool (*RestoreTables)(unsigned mark, const TArray<uint8_t> &data);
 };
 
 extern CompileEnvironment compileEnvironment;
@@ -835,18 +835,73 @@ VMFunction *FFunctionBuildList::AddFunction(PNamespace *gnspc, const VersionInfo
 }
 
 
+//==========================================================================
+//
+// FFunctionBuildList :: Build
+//
+// Functions found in the bytecode cache (vmcache.cpp) are neither
+// resolved nor emitted, they only get the final setup below.
+//
+//==========================================================================
+
+TMap<void *, unsigned> FFunctionBuildList::ArenaConstants;
+
+void FFunctionBuildList::FinishFunction(Item &item, VMDisassemblyDumper &disasmdump)
+{
+	VMScriptFunction *sfunc = item.Function;
+	sfunc->NumArgs = 0;
+	// NumArgs for the VMFunction must be the amount of stack elements, which can differ from the amount of logical function arguments if vectors are in the list.
+	// For the VM a vector is 2 or 3 args, depending on size.
+	auto funcVariant = item.Func->Variants[0];
+	for (unsigned int i = 0; i < funcVariant.Proto->ArgumentTypes.Size(); i++)
+	{
+		auto argType = funcVariant.Proto->ArgumentTypes[i];
+		auto argFlags = funcVariant.ArgFlags[i];
+		if (argFlags & VARF_Out)
+		{
+			auto argPointer = NewPointer(argType);
+			sfunc->NumArgs += argPointer->GetRegCount();
+		}
+		else
+		{
+			sfunc->NumArgs += argType->GetRegCount();
+		}
+	}
+
+	disasmdump.Write(sfunc, item.PrintableName);
+
+	#if HAVE_VM_JIT
+		if(vm_jit && vm_jit_aot)
+		{
+			sfunc->JitCompile();
+		}
+	#endif
+}
+
 void FFunctionBuildList::Build()
 {
 	VMDisassemblyDumper disasmdump(VMDisassemblyDumper::Overwrite);
+	std::vector<bool> built(mItems.Size());
+	FBytecodeCache cache;
+	cache.Open(*this);
 
-	for (auto &item : mItems)
+	for (unsigned n = 0; n < mItems.Size(); n++)
 	{
+		auto &item = mItems[n];
 		// [Player701] Do not emit code for abstract functions
 		bool isAbstract = item.Func->Variants[0].Implementation->VarFlags & VARF_Abstract;
 		if (isAbstract) continue;
 
 		assert(item.Code != NULL);
 
+		if (cache.Load(n, item))
+		{
+			FinishFunction(item, disasmdump);
+			delete item.Code;
+			disasmdump.Flush();
+			continue;
+		}
+
 		// We don't know the return type in advance for anonymous functions.
 		FCompileContext ctx(item.CurGlobals, item.Func, item.Func->SymbolName == NAME_None ? nullptr : item.Func->Variants[0].Proto, item.FromDecorate, item.StateIndex, item.StateCount, item.Lump, item.Version);
 
@@ -909,35 +964,10 @@ void FFunctionBuildList::Build()
 				item.Code->Emit(&buildit);
 				buildit.EndStatement();
 				buildit.MakeFunction(sfunc);
-				sfunc->NumArgs = 0;
-				// NumArgs for the VMFunction must be the amount of stack elements, which can differ from the amount of logical function arguments if vectors are in the list.
-				// For the VM a vector is 2 or 3 args, depending on size.
-				auto funcVariant = item.Func->Variants[0];
-				for (unsigned int i = 0; i < funcVariant.Proto->ArgumentTypes.Size(); i++)
-				{
-					auto argType = funcVariant.Proto->ArgumentTypes[i];
-					auto argFlags = funcVariant.ArgFlags[i];
-					if (argFlags & VARF_Out)
-					{
-						auto argPointer = NewPointer(argType);
-						sfunc->NumArgs += argPointer->GetRegCount();
-					}
-					else
-					{
-						sfunc->NumArgs += argType->GetRegCount();
-					}
-				}
-
-				disasmdump.Write(sfunc, item.PrintableName);
-
 				sfunc->Unsafe = ctx.Unsafe;
+				built[n] = true;
 
-				#if HAVE_VM_JIT
-					if(vm_jit && vm_jit_aot)
-					{
-						sfunc->JitCompile();
-					}
-				#endif
+				FinishFunction(item, disasmdump);
 			}
 			catch (CRecoverableError &err)
 			{
@@ -956,6 +986,7 @@ void FFunctionBuildList::Build()
 		if (Args->CheckParm("-dumpjit")) DumpJit(true);
 		else if (Args->CheckParm("-dumpjitmod")) DumpJit(false);
 	}
+	cache.Save(*this, built);
 	mItems.Clear();
 	mItems.ShrinkToFit();
 	FxAlloc.FreeAllBlocks();
@@ -1117,6 +1148,7 @@ ExpEmit FunctionCallEmitter::EmitCall(VMFunctionBuilder *build, TArray<ExpEmit>
 		// Pass a hidden type information parameter to vararg functions.
 		// It would really be nicer to actually pass real types but that'd require a far more complex interface on the compiler side than what we have.
 		uint8_t *regbuffer = (uint8_t*)ClassDataAllocator.Alloc(reginfo.Size());	// Allocate in the arena so that the pointer does not need to be maintained.
+		FFunctionBuildList::ArenaConstants.Insert(regbuffer, reginfo.Size());
 		memcpy(regbuffer, reginfo.Data(), reginfo.Size());
 		build->Emit(OP_PARAM, REGT_POINTER | REGT_KONST, build->GetConstantAddress(regbuffer));
 		paramcount++;
@@ -7,6 +7,7 @@
 #include <functional>
 
 class VMFunctionBuilder;
+class VMDisassemblyDumper;
 class FxExpression;
 class FxLocalVariableDeclaration;
 
@@ -143,6 +144,7 @@ class FxExpression;
 
 class FFunctionBuildList
 {
+public:
 	struct Item
 	{
 		PFunction *Func = nullptr;
@@ -158,13 +160,52 @@ class FFunctionBuildList
 		bool FromDecorate;
 	};
 
+private:
 	TArray<Item> mItems;
 
 	void DumpJit(bool include_gzdoom_pk3);
+	static void FinishFunction(Item &item, VMDisassemblyDumper &disasmdump);
 
 public:
 	VMFunction *AddFunction(PNamespace *curglobals, const VersionInfo &ver, PFunction *func, FxExpression *code, const FString &name, bool fromdecorate, int currentstate, int statecnt, int lumpnum);
 	void Build();
+
+	// Small constant blocks that generated code points to (vararg type
+	// info), with their size, so that the bytecode cache can store them.
+	static TMap<void *, unsigned> ArenaConstants;
+
+	friend class FBytecodeCache;
+};
+
+//==========================================================================
+//
+// Bytecode cache (vmcache.cpp)
+//
+//==========================================================================
+
+class FBytecodeCache
+{
+public:
+	// Must be called before anything gets resolved. Returns true if a valid
+	// cache was found, in which case the names and state labels created by
+	// the run that wrote it have been restored.
+	bool Open(FFunctionBuildList &list);
+	// Sets up a function from the cache. Returns false if it needs to be compiled.
+	bool Load(unsigned index, FFunctionBuildList::Item &item);
+	// Writes the cache if none was loaded. built[i] tells if mItems[i] got compiled.
+	void Save(FFunctionBuildList &list, const std::vector<bool> &built);
+
+private:
+	void MakeKey(FFunctionBuildList &list, uint8_t key[16]);
+
+	bool Active = false;
+	bool Loaded = false;
+	uint8_t Key[16];
+	int FirstName = 0;
+	unsigned TablesMark = 0;
+	TArray<uint8_t> Data;
+	TArray<unsigned> Entries;	// offset of each function in Data, 0 if not cached
+	unsigned NumLoaded = 0;
 };
 
 extern FFunctionBuildList FunctionBuildList;
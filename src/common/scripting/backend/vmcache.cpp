@@ -0,0 +1,648 @@
+/*
+** vmcache.cpp
+** Keeps the compiled bytecode of script functions between runs
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** The cache stores what FFunctionBuildList::Build produces for each
+** function: code, constant tables, line info and register counts. When
+** the next start has identical inputs, these functions are set up from the
+** cache and skip resolving and code generation. Parsing and class layout
+** still run, because the cached code refers to the classes, fields,
+** functions and defaults they create.
+**
+** The cache is only used if all of these match the run that wrote it:
+**	- the engine build
+**	- every script lump read through FScanner so far (ZScript, DECORATE,
+**	  CVARINFO, SNDINFO and so on)
+**	- the name table, the sound table and the lists of all classes and VM
+**	  functions
+**	- the list of functions to build
+**
+** Bytecode contains raw name indices and state label offsets. The names
+** and state labels created while compiling are stored in the cache and
+** recreated first, so those stay valid. Address constants are stored with
+** a tag saying what they refer to: a function, class, CVar, native global
+** variable or a constant block the code generator made. A function with any
+** other kind of address constant is not cached and always gets compiled.
+**
+** Every count read from the file is checked against the data that is left
+** before anything gets allocated for it, and opcodes must be valid, so a
+** damaged file is rejected instead of crashing.
+**
+** File layout:
+**		"ZSBC", version, key
+**		first new name index, count, names
+**		state label mark, size, data
+**		function count, then for each function: size, data
+**
+*/
+
+#include "vmbuilder.h"
+#include "codegen.h"
+#include "c_cvars.h"
+#include "sc_man.h"
+#include "md5.h"
+#include "cmdlib.h"
+#include "printf.h"
+#include "i_specialpaths.h"
+#include "engineerrors.h"
+#include "version.h"
+#include "s_soundinternal.h"
+
+CVAR(Bool, vm_bytecodecache, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+
+EXTERN_CVAR(Bool, vm_jit)
+
+static const char CacheMagic[4] = { 'Z', 'S', 'B', 'C' };
+static const uint32_t CACHE_VERSION = 2;
+
+enum EAddressKind : uint8_t
+{
+	AK_Null,
+	AK_Function,	// index into VMFunction::AllFunctions
+	AK_Class,		// index into PClass::AllClasses
+	AK_CVar,		// a CVar's value, by name
+	AK_Global,		// a native global variable, by name
+	AK_Blob,		// a block from ArenaConstants, by content
+};
+
+struct FAddressRef
+{
+	uint8_t Kind;
+	unsigned Index;
+};
+
+//==========================================================================
+//
+// Return types of anonymous functions that can be stored.
+//
+//==========================================================================
+
+static PType *ReturnType(unsigned index)
+{
+	PType *const types[] = { TypeSInt32, TypeUInt32, TypeBool, TypeFloat64, TypeName, TypeSound, TypeColor,
+		TypeString, TypeState, TypeStateLabel, TypeTextureID, TypeSpriteID, TypeVoidPtr };
+	return index < countof(types) ? types[index] : nullptr;
+}
+
+//==========================================================================
+//
+// Serialization helpers
+//
+//==========================================================================
+
+class FCacheWriter
+{
+public:
+	TArray<uint8_t> Data;
+
+	void Write(const void *data, size_t len)
+	{
+		if (len > 0) memcpy(&Data[Data.Reserve((unsigned)len)], data, len);
+	}
+	template<class T> void Write(T value)
+	{
+		Write(&value, sizeof(value));
+	}
+	void WriteString(const char *str)
+	{
+		uint32_t len = (uint32_t)strlen(str);
+		Write(len);
+		Write(str, len);
+	}
+};
+
+class FCacheReader
+{
+	const uint8_t *Pos, *End;
+
+public:
+	FCacheReader(const uint8_t *data, size_t size) : Pos(data), End(data + size) {}
+
+	size_t Remaining() const { return size_t(End - Pos); }
+
+	void Read(void *data, size_t len)
+	{
+		if (len > size_t(End - Pos)) throw CRecoverableError("Bytecode cache is truncated");
+		memcpy(data, Pos, len);
+		Pos += len;
+	}
+	template<class T> T Read()
+	{
+		T value;
+		Read(&value, sizeof(value));
+		return value;
+	}
+	// A count of items that take at least itemsize bytes each.
+	template<class T> T ReadCount(size_t itemsize)
+	{
+		T count = Read<T>();
+		if (count > Remaining() / itemsize) throw CRecoverableError("Bytecode cache is truncated");
+		return count;
+	}
+	FString ReadString()
+	{
+		uint32_t len = Read<uint32_t>();
+		if (len > size_t(End - Pos)) throw CRecoverableError("Bytecode cache is truncated");
+		FString str((const char *)Pos, len);
+		Pos += len;
+		return str;
+	}
+	const uint8_t *Skip(size_t len)
+	{
+		auto p = Pos;
+		if (len > size_t(End - Pos)) throw CRecoverableError("Bytecode cache is truncated");
+		Pos += len;
+		return p;
+	}
+};
+
+static FString CacheFileName(bool create)
+{
+	FString path = M_GetCachePath(create);
+	if (create) CreatePath(path.GetChars());
+	path << "/bytecode.zsbc";
+	return path;
+}
+
+//==========================================================================
+//
+// FBytecodeCache :: MakeKey
+//
+//==========================================================================
+
+void FBytecodeCache::MakeKey(FFunctionBuildList &list, uint8_t key[16])
+{
+	MD5Context md5;
+	auto addString = [&](const char *str) { md5.Update((const uint8_t *)str, (unsigned)strlen(str) + 1); };
+	auto addInt = [&](uint32_t value) { md5.Update((const uint8_t *)&value, sizeof(value)); };
+
+	addString(GetVersionString());
+	addString(GetGitHash());
+	addInt(sizeof(void *));
+	addInt(vm_jit);	// changes the emitted call instructions
+
+	uint8_t digest[16];
+	FScanner::GetSourceDigest(digest);
+	md5.Update(digest, 16);
+
+	int i;
+	for (i = 0; FName(ENamedName(i)).IsValidName(); i++)
+	{
+		addString(FName(ENamedName(i)).GetChars());
+	}
+	addInt(i);
+
+	if (soundEngine != nullptr)
+	{
+		for (unsigned j = 0; j < soundEngine->GetNumSounds(); j++)
+		{
+			addString(soundEngine->GetSoundName(FSoundID::fromInt(j)));
+		}
+	}
+	for (auto func : VMFunction::AllFunctions)
+	{
+		addString(func->QualifiedName ? func->QualifiedName : "");
+	}
+	for (auto cls : PClass::AllClasses)
+	{
+		addString(cls->TypeName.GetChars());
+	}
+	for (auto &item : list.mItems)
+	{
+		addString(item.PrintableName.GetChars());
+		addInt(item.Lump);
+		addInt(item.StateIndex);
+		addInt(item.FromDecorate);
+	}
+	addInt(TablesMark);
+	md5.Final(key);
+}
+
+//==========================================================================
+//
+// FBytecodeCache :: Open
+//
+//==========================================================================
+
+bool FBytecodeCache::Open(FFunctionBuildList &list)
+{
+	Active = vm_bytecodecache;
+	if (!Active) return false;
+
+	FirstName = 0;
+	while (FName(ENamedName(FirstName)).IsValidName()) FirstName++;
+	TablesMark = compileEnvironment.MarkTables ? compileEnvironment.MarkTables() : 0;
+	MakeKey(list, Key);
+
+	FileReader fr;
+	if (!fr.OpenFile(CacheFileName(false).GetChars())) return false;
+	auto filedata = fr.Read();
+	Data.Resize((unsigned)filedata.size());
+	if (Data.Size() > 0) memcpy(Data.Data(), filedata.data(), Data.Size());
+
+	try
+	{
+		FCacheReader reader(Data.Data(), Data.Size());
+		char magic[4];
+		uint8_t key[16];
+		reader.Read(magic, 4);
+		if (memcmp(magic, CacheMagic, 4) || reader.Read<uint32_t>() != CACHE_VERSION) return false;
+		reader.Read(key, 16);
+		if (memcmp(key, Key, 16)) return false;
+
+		if (reader.Read<int32_t>() != FirstName) return false;
+		uint32_t numnames = reader.ReadCount<uint32_t>(sizeof(uint32_t));
+		TArray<FString> names(numnames, true);
+		for (auto &name : names) name = reader.ReadString();
+
+		if (reader.Read<uint32_t>() != TablesMark) return false;
+		uint32_t tablesize = reader.ReadCount<uint32_t>(1);
+		TArray<uint8_t> tables(tablesize, true);
+		reader.Read(tables.Data(), tablesize);
+
+		uint32_t numfuncs = reader.ReadCount<uint32_t>(sizeof(uint32_t));
+		if (numfuncs != list.mItems.Size()) return false;
+		Entries.Resize(numfuncs);
+		for (auto &entry : Entries)
+		{
+			uint32_t size = reader.Read<uint32_t>();
+			entry = size == 0 ? 0 : unsigned(reader.Skip(size) - Data.Data());
+		}
+
+		// Everything checks out, so recreate the names and tables in the same order as the run that wrote them.
+		for (auto &name : names)
+		{
+			FName(name.GetChars());
+		}
+		if (tablesize > 0 && (compileEnvironment.RestoreTables == nullptr || !compileEnvironment.RestoreTables(TablesMark, tables)))
+		{
+			Printf(TEXTCOLOR_ORANGE "Unable to restore state labels from the bytecode cache\n");
+			Entries.Clear();
+			return false;
+		}
+	}
+	catch (CRecoverableError &)
+	{
+		Entries.Clear();
+		return false;
+	}
+	Loaded = true;
+	return true;
+}
+
+//==========================================================================
+//
+// FBytecodeCache :: Load
+//
+//==========================================================================
+
+bool FBytecodeCache::Load(unsigned index, FFunctionBuildList::Item &item)
+{
+	if (!Loaded || index >= Entries.Size() || Entries[index] == 0) return false;
+	try
+	{
+		FCacheReader reader(Data.Data() + Entries[index], Data.Size() - Entries[index]);
+		if (reader.ReadString().Compare(item.PrintableName) != 0) return false;
+
+		TArray<PType *> rets;
+		bool anonymous = reader.Read<uint8_t>() != 0;
+		if (anonymous)
+		{
+			unsigned count = reader.ReadCount<uint8_t>(1);
+			for (unsigned i = 0; i < count; i++)
+			{
+				auto type = ReturnType(reader.Read<uint8_t>());
+				if (type == nullptr) return false;
+				rets.Push(type);
+			}
+		}
+
+		auto codesize = reader.ReadCount<uint32_t>(sizeof(VMOP));
+		auto numlines = reader.ReadCount<uint32_t>(sizeof(FStatementInfo));
+		auto numkd = reader.ReadCount<uint16_t>(sizeof(int));
+		auto numkf = reader.ReadCount<uint16_t>(sizeof(double));
+		auto numks = reader.ReadCount<uint16_t>(sizeof(uint32_t));
+		auto numka = reader.ReadCount<uint16_t>(1);
+		uint8_t numregs[4];
+		reader.Read(numregs, 4);
+		auto maxparam = reader.Read<uint16_t>();
+		auto extraspace = reader.Read<int32_t>();
+		bool isunsafe = reader.Read<uint8_t>() != 0;
+		FString sourcefile = reader.ReadString();
+
+		if (codesize == 0) return false;
+		auto code = reader.Skip(codesize * sizeof(VMOP));
+		for (uint32_t i = 0; i < codesize; i++)
+		{
+			if (((const VMOP *)code)[i].op >= NUM_OPS) return false;
+		}
+		auto lines = reader.Skip(numlines * sizeof(FStatementInfo));
+		auto konstd = reader.Skip(numkd * sizeof(int));
+		auto konstf = reader.Skip(numkf * sizeof(double));
+		TArray<FString> konsts(numks, true);
+		for (auto &str : konsts) str = reader.ReadString();
+
+		TArray<void *> konsta(numka, true);
+		for (auto &ptr : konsta)
+		{
+			switch (reader.Read<uint8_t>())
+			{
+			case AK_Null:
+				ptr = nullptr;
+				break;
+
+			case AK_Function:
+			{
+				auto i = reader.Read<uint32_t>();
+				if (i >= VMFunction::AllFunctions.Size()) return false;
+				ptr = VMFunction::AllFunctions[i];
+				break;
+			}
+
+			case AK_Class:
+			{
+				auto i = reader.Read<uint32_t>();
+				if (i >= PClass::AllClasses.Size()) return false;
+				ptr = PClass::AllClasses[i];
+				break;
+			}
+
+			case AK_CVar:
+			{
+				FString name = reader.ReadString();
+				int type = reader.Read<uint8_t>();
+				auto cvar = FindCVar(name.GetChars(), nullptr);
+				if (cvar == nullptr || cvar->GetRealType() != type) return false;
+				ptr = FxCVar::ValueAddress(cvar);
+				break;
+			}
+
+			case AK_Global:
+			{
+				FName name(reader.ReadString(), true);
+				auto field = name == NAME_None ? nullptr : dyn_cast<PField>(Namespaces.GlobalNamespace->Symbols.FindSymbol(name, false));
+				if (field == nullptr || !(field->Flags & VARF_Native)) return false;
+				ptr = (void *)(intptr_t)field->Offset;
+				break;
+			}
+
+			case AK_Blob:
+			{
+				auto size = reader.ReadCount<uint32_t>(1);
+				auto data = reader.Skip(size);
+				ptr = ClassDataAllocator.Alloc(size);
+				memcpy(ptr, data, size);
+				FFunctionBuildList::ArenaConstants.Insert(ptr, size);
+				break;
+			}
+
+			default:
+				return false;
+			}
+		}
+
+		// Everything could be decoded, so the function can be set up.
+		VMScriptFunction *sfunc = item.Function;
+		sfunc->Alloc(codesize, numkd, numkf, numks, numka, numlines);
+		memcpy(sfunc->Code, code, codesize * sizeof(VMOP));
+		if (numlines > 0) memcpy(sfunc->LineInfo, lines, numlines * sizeof(FStatementInfo));
+		if (numkd > 0) memcpy(sfunc->KonstD, konstd, numkd * sizeof(int));
+		if (numkf > 0) memcpy(sfunc->KonstF, konstf, numkf * sizeof(double));
+		for (unsigned i = 0; i < numks; i++) sfunc->KonstS[i] = konsts[i];
+		for (unsigned i = 0; i < numka; i++) sfunc->KonstA[i].v = konsta[i];
+
+		sfunc->NumRegD = numregs[0];
+		sfunc->NumRegF = numregs[1];
+		sfunc->NumRegS = numregs[2];
+		sfunc->NumRegA = numregs[3];
+		sfunc->MaxParam = maxparam;
+		sfunc->ExtraSpace = extraspace;
+		sfunc->StackSize = VMFrame::FrameSize(sfunc->NumRegD, sfunc->NumRegF, sfunc->NumRegS, sfunc->NumRegA, sfunc->MaxParam, sfunc->ExtraSpace);
+		sfunc->Unsafe = isunsafe;
+		sfunc->SourceFileName = sourcefile;
+		if (anonymous && sfunc->Proto == nullptr)
+		{
+			sfunc->Proto = NewPrototype(rets, item.Func->Variants[0].Proto->ArgumentTypes);
+			sfunc->ArgFlags = item.Func->Variants[0].ArgFlags;
+		}
+		NumLoaded++;
+		return true;
+	}
+	catch (CRecoverableError &)
+	{
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// FBytecodeCache :: Save
+//
+//==========================================================================
+
+void FBytecodeCache::Save(FFunctionBuildList &list, const std::vector<bool> &built)
+{
+	if (Loaded)
+	{
+		DPrintf(DMSG_NOTIFY, "%u of %u script functions loaded from the bytecode cache\n", NumLoaded, list.mItems.Size());
+		return;
+	}
+	if (!Active || FScriptPosition::ErrorCounter > 0) return;
+
+	// Everything that compiled code may point to, with a way to find it again in the next run.
+	TMap<void *, FAddressRef> refs;
+	TArray<FBaseCVar *> cvars;
+	TArray<PField *> globals;
+	for (unsigned i = 0; i < VMFunction::AllFunctions.Size(); i++)
+	{
+		refs.Insert(VMFunction::AllFunctions[i], { AK_Function, i });
+	}
+	for (unsigned i = 0; i < PClass::AllClasses.Size(); i++)
+	{
+		refs.Insert(PClass::AllClasses[i], { AK_Class, i });
+	}
+	{
+		decltype(cvarMap)::Iterator it(cvarMap);
+		decltype(cvarMap)::Pair *pair;
+		while (it.NextPair(pair))
+		{
+			auto cvar = pair->Value;
+			auto addr = FxCVar::ValueAddress(cvar);
+			// Flag and mask CVars share the value of another CVar, which is stored instead.
+			if (addr != nullptr && cvar->GetRealType() != CVAR_Flag && cvar->GetRealType() != CVAR_Mask)
+			{
+				refs.Insert(addr, { AK_CVar, cvars.Push(cvar) });
+			}
+		}
+	}
+	{
+		auto it = Namespaces.GlobalNamespace->Symbols.GetIterator();
+		PSymbolTable::MapType::Pair *pair;
+		while (it.NextPair(pair))
+		{
+			auto field = dyn_cast<PField>(pair->Value);
+			if (field != nullptr && (field->Flags & VARF_Native))
+			{
+				refs.Insert((void *)(intptr_t)field->Offset, { AK_Global, globals.Push(field) });
+			}
+		}
+	}
+
+	FCacheWriter out;
+	out.Write(CacheMagic, 4);
+	out.Write(CACHE_VERSION);
+	out.Write(Key, 16);
+
+	out.Write<int32_t>(FirstName);
+	int lastname = FirstName;
+	while (FName(ENamedName(lastname)).IsValidName()) lastname++;
+	out.Write<uint32_t>(lastname - FirstName);
+	for (int i = FirstName; i < lastname; i++)
+	{
+		out.WriteString(FName(ENamedName(i)).GetChars());
+	}
+
+	TArray<uint8_t> tables;
+	if (compileEnvironment.SaveTables != nullptr && !compileEnvironment.SaveTables(TablesMark, tables))
+	{
+		return;
+	}
+	out.Write<uint32_t>(TablesMark);
+	out.Write<uint32_t>(tables.Size());
+	out.Write(tables.Data(), tables.Size());
+
+	unsigned numcached = 0;
+	out.Write<uint32_t>(list.mItems.Size());
+	for (unsigned n = 0; n < list.mItems.Size(); n++)
+	{
+		auto &item = list.mItems[n];
+		auto sfunc = item.Function;
+		bool anonymous = item.Func->SymbolName == NAME_None;
+
+		auto write = [&](FCacheWriter &w) -> bool
+		{
+			if (!built[n] || sfunc->Code == nullptr || sfunc->SpecialInits.Size() > 0) return false;
+
+			w.WriteString(item.PrintableName.GetChars());
+			w.Write<uint8_t>(anonymous);
+			if (anonymous)
+			{
+				auto &types = sfunc->Proto->ReturnTypes;
+				w.Write<uint8_t>(types.Size());
+				for (auto type : types)
+				{
+					unsigned i = 0;
+					while (ReturnType(i) != nullptr && ReturnType(i) != type) i++;
+					if (ReturnType(i) == nullptr) return false;
+					w.Write<uint8_t>(i);
+				}
+			}
+			w.Write<uint32_t>(sfunc->CodeSize);
+			w.Write<uint32_t>(sfunc->LineInfoCount);
+			w.Write<uint16_t>(sfunc->NumKonstD);
+			w.Write<uint16_t>(sfunc->NumKonstF);
+			w.Write<uint16_t>(sfunc->NumKonstS);
+			w.Write<uint16_t>(sfunc->NumKonstA);
+			w.Write<uint8_t>(sfunc->NumRegD);
+			w.Write<uint8_t>(sfunc->NumRegF);
+			w.Write<uint8_t>(sfunc->NumRegS);
+			w.Write<uint8_t>(sfunc->NumRegA);
+			w.Write<uint16_t>(sfunc->MaxParam);
+			w.Write<int32_t>(sfunc->ExtraSpace);
+			w.Write<uint8_t>(sfunc->Unsafe);
+			w.WriteString(sfunc->SourceFileName.GetChars());
+			w.Write(sfunc->Code, sfunc->CodeSize * sizeof(VMOP));
+			w.Write(sfunc->LineInfo, sfunc->LineInfoCount * sizeof(FStatementInfo));
+			w.Write(sfunc->KonstD, sfunc->NumKonstD * sizeof(int));
+			w.Write(sfunc->KonstF, sfunc->NumKonstF * sizeof(double));
+			for (unsigned i = 0; i < sfunc->NumKonstS; i++)
+			{
+				w.WriteString(sfunc->KonstS[i].GetChars());
+			}
+			for (unsigned i = 0; i < sfunc->NumKonstA; i++)
+			{
+				void *ptr = sfunc->KonstA[i].v;
+				if (ptr == nullptr)
+				{
+					w.Write<uint8_t>(AK_Null);
+				}
+				else if (auto ref = refs.CheckKey(ptr))
+				{
+					w.Write<uint8_t>(ref->Kind);
+					switch (ref->Kind)
+					{
+					case AK_CVar:
+						w.WriteString(cvars[ref->Index]->GetName());
+						w.Write<uint8_t>(cvars[ref->Index]->GetRealType());
+						break;
+
+					case AK_Global:
+						w.WriteString(globals[ref->Index]->SymbolName.GetChars());
+						break;
+
+					default:
+						w.Write<uint32_t>(ref->Index);
+						break;
+					}
+				}
+				else if (auto size = FFunctionBuildList::ArenaConstants.CheckKey(ptr))
+				{
+					w.Write<uint8_t>(AK_Blob);
+					w.Write<uint32_t>(*size);
+					w.Write(ptr, *size);
+				}
+				else
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		FCacheWriter entry;
+		if (write(entry))
+		{
+			out.Write<uint32_t>(entry.Data.Size());
+			out.Write(entry.Data.Data(), entry.Data.Size());
+			numcached++;
+		}
+		else
+		{
+			out.Write<uint32_t>(0);
+		}
+	}
+
+	std::unique_ptr<FileWriter> fw(FileWriter::Open(CacheFileName(true).GetChars()));
+	if (fw)
+	{
+		fw->Write(out.Data.Data(), out.Data.Size());
+		DPrintf(DMSG_NOTIFY, "Wrote %u of %u script functions to the bytecode cache\n", numcached, list.mItems.Size());
+	}
+}
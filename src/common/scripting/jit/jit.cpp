@@ -2,6 +2,7 @@
 #include "jit.h"
 #include "jitintern.h"
 #include "printf.h"
+#include "c_cvars.h"
 
 extern PString *TypeString;
 extern PStruct *TypeVector2;
@@ -10,9 +11,11 @@ extern PStruct* TypeVector4;
 extern PStruct* TypeQuaternion;
 extern PStruct* TypeFQuaternion;
 
+EXTERN_CVAR(Int, vm_jit_hotcalls)
+
 static void OutputJitLog(const asmjit::StringLogger &logger);
 
-JitFuncPtr JitCompile(VMScriptFunction *sfunc)
+JitFuncPtr JitCompile(VMScriptFunction *sfunc, bool optimize)
 {
 #if 0
 	if (strcmp(sfunc->PrintableName, "StatusScreen.drawNum") != 0)
@@ -29,7 +32,7 @@ JitFuncPtr JitCompile(VMScriptFunction *sfunc)
 		code.setErrorHandler(&errorHandler);
 		code.setLogger(&logger);
 
-		JitCompiler compiler(&code, sfunc);
+		JitCompiler compiler(&code, sfunc, optimize);
 		return reinterpret_cast<JitFuncPtr>(AddJitFunction(&code, &compiler));
 	}
 	catch (const CRecoverableError &e)
@@ -142,7 +145,19 @@ asmjit::CCFunc *JitCompiler::Codegen()
 
 		labels[i].cursor = cc.getCursor();
 		ResetTemp();
-		EmitOpcode();
+		BeginOpcodeSpills();
+		if (optimize)
+		{
+			const VMOP *oppc = pc;
+			if (jumpTargets[i]) ForgetValues();
+			if (!EmitOptimized()) EmitOpcode();
+			TrackValues(oppc);
+		}
+		else
+		{
+			EmitOpcode();
+		}
+		EndOpcodeSpills();
 
 		pc++;
 	}
@@ -271,6 +286,7 @@ void JitCompiler::Setup()
 	konsta = sfunc->KonstA;
 
 	labels.Resize(sfunc->CodeSize);
+	if (optimize) FindJumpTargets();
 
 	CreateRegisters();
 	IncrementVMCalls();
@@ -287,7 +303,7 @@ void JitCompiler::SetupFrame()
 	offsetD = offsetA + (int)(sfunc->NumRegA * sizeof(void*));
 	offsetExtra = (offsetD + (int)(sfunc->NumRegD * sizeof(int32_t)) + 15) & ~15;
 
-	if (sfunc->SpecialInits.Size() == 0 && sfunc->NumRegS == 0 && sfunc->ExtraSpace == 0)
+	if (!UsesFullVMFrame())
 	{
 		SetupSimpleFrame();
 	}
@@ -408,16 +424,17 @@ void JitCompiler::SetupFullVMFrame()
 	cc.mov(vmframe, x86::ptr(vmframe, VMFrameStack::OffsetLastFrame())); // Blocks->LastFrame
 	vmframeAllocated = true;
 
-	for (int i = 0; i < sfunc->NumRegD; i++)
+	// Spilled registers already are where they belong.
+	for (int i = 0; i < sfunc->NumRegD && regD.IsResident(i); i++)
 		cc.mov(regD[i], x86::dword_ptr(vmframe, offsetD + i * sizeof(int32_t)));
 
-	for (int i = 0; i < sfunc->NumRegF; i++)
+	for (int i = 0; i < sfunc->NumRegF && regF.IsResident(i); i++)
 		cc.movsd(regF[i], x86::qword_ptr(vmframe, offsetF + i * sizeof(double)));
 
-	for (int i = 0; i < sfunc->NumRegS; i++)
+	for (int i = 0; i < sfunc->NumRegS && regS.IsResident(i); i++)
 		cc.lea(regS[i], x86::ptr(vmframe, offsetS + i * sizeof(FString)));
 
-	for (int i = 0; i < sfunc->NumRegA; i++)
+	for (int i = 0; i < sfunc->NumRegA && regA.IsResident(i); i++)
 		cc.mov(regA[i], x86::ptr(vmframe, offsetA + i * sizeof(void*)));
 }
 
@@ -426,9 +443,14 @@ static void PopFullVMFrame(VMFrameStack *stack)
 	stack->PopFrame();
 }
 
+bool JitCompiler::UsesFullVMFrame() const
+{
+	return sfunc->SpecialInits.Size() != 0 || sfunc->NumRegS != 0 || sfunc->ExtraSpace != 0 || hasSpills;
+}
+
 void JitCompiler::EmitPopFrame()
 {
-	if (sfunc->SpecialInits.Size() != 0 || sfunc->NumRegS != 0 || sfunc->ExtraSpace != 0)
+	if (UsesFullVMFrame())
 	{
 		auto popFrame = CreateCall<void, VMFrameStack *>(PopFullVMFrame);
 		popFrame->setArg(0, stack);
@@ -444,40 +466,160 @@ void JitCompiler::IncrementVMCalls()
 	cc.mov(vmcalls, asmjit::x86::dword_ptr(vmcallsptr));
 	cc.add(vmcalls, (int)1);
 	cc.mov(asmjit::x86::dword_ptr(vmcallsptr), vmcalls);
+
+	if (!optimize && vm_jit_hotcalls > 0)
+	{
+		// sfunc->JitCalls++, and hand the function to the optimizing tier once it gets hot
+		auto skip = cc.newLabel();
+		cc.mov(vmcallsptr, asmjit::imm_ptr(&sfunc->JitCalls));
+		cc.mov(vmcalls, asmjit::x86::dword_ptr(vmcallsptr));
+		cc.add(vmcalls, (int)1);
+		cc.mov(asmjit::x86::dword_ptr(vmcallsptr), vmcalls);
+		cc.cmp(vmcalls, (int)vm_jit_hotcalls);
+		cc.jne(skip);
+		auto call = CreateCall<void, VMScriptFunction *>(&JitCompiler::TierUp);
+		call->setArg(0, asmjit::imm_ptr(sfunc));
+		cc.bind(skip);
+	}
+}
+
+void JitCompiler::TierUp(VMScriptFunction *func)
+{
+	// The current call finishes in the baseline code, all later ones use the new code.
+	// The baseline code is not freed: this call and any recursive ones further up the
+	// stack still return into it, and the JIT memory is a bump allocator that only
+	// JitRelease empties as a whole.
+	if (func->JitOptimized) return;
+	func->JitOptimized = true;
+	auto code = JitCompile(func, true);
+	if (code) func->ScriptCall = code;
 }
 
 void JitCompiler::CreateRegisters()
 {
-	regD.Resize(sfunc->NumRegD);
-	regF.Resize(sfunc->NumRegF);
-	regA.Resize(sfunc->NumRegA);
-	regS.Resize(sfunc->NumRegS);
+	// Asmjit has a 256 register limit. Stay safely away from it as the jit compiler uses a few for temporaries as well.
+	// Functions exceeding the limit keep the lowest registers of each type resident, in proportion to how many of
+	// that type they use, and spill the rest to the VM frame.
+	const int maxregs = 200;
+	const int budget = 160;
+
+	int total = sfunc->NumRegD + sfunc->NumRegF + sfunc->NumRegS + sfunc->NumRegA;
+	hasSpills = total >= maxregs;
+	auto resident = [=](int count) { return hasSpills ? count * budget / total : count; };
+
+	regD.Init(this, REGT_INT, sfunc->NumRegD, resident(sfunc->NumRegD));
+	regF.Init(this, REGT_FLOAT, sfunc->NumRegF, resident(sfunc->NumRegF));
+	regS.Init(this, REGT_STRING, sfunc->NumRegS, resident(sfunc->NumRegS));
+	regA.Init(this, REGT_POINTER, sfunc->NumRegA, resident(sfunc->NumRegA));
+}
 
-	for (int i = 0; i < sfunc->NumRegD; i++)
-	{
-		regname.Format("regD%d", i);
-		regD[i] = cc.newInt32(regname.GetChars());
-	}
+void JitCompiler::NewRegister(int regtype, asmjit::X86Gp &reg, const char *prefix, int index)
+{
+	regname.Format("%s%c%d", prefix, regtype == REGT_INT ? 'D' : regtype == REGT_STRING ? 'S' : 'A', index);
+	reg = regtype == REGT_INT ? cc.newInt32(regname.GetChars()) : cc.newIntPtr(regname.GetChars());
+}
 
-	for (int i = 0; i < sfunc->NumRegF; i++)
-	{
-		regname.Format("regF%d", i);
-		regF[i] = cc.newXmmSd(regname.GetChars());
-	}
+void JitCompiler::NewRegister(int regtype, asmjit::X86Xmm &reg, const char *prefix, int index)
+{
+	regname.Format("%sF%d", prefix, index);
+	reg = cc.newXmmSd(regname.GetChars());
+}
 
-	for (int i = 0; i < sfunc->NumRegS; i++)
-	{
-		regname.Format("regS%d", i);
-		regS[i] = cc.newIntPtr(regname.GetChars());
-	}
+void JitCompiler::BeginOpcodeSpills()
+{
+	opcodeSerial++;
+	spillCursor = cc.getCursor();
+}
 
-	for (int i = 0; i < sfunc->NumRegA; i++)
+// Branches to other opcodes go through a stub at the end of the opcode that
+// writes back the spilled registers first, as the target loads them again.
+asmjit::Label JitCompiler::GetBranchLabel(int pos)
+{
+	if (!hasSpills) return GetLabel(pos);
+
+	SpillBranch branch = { cc.newLabel(), pos };
+	spillBranches.Push(branch);
+	return branch.Label;
+}
+
+void JitCompiler::StoreSpills()
+{
+	regD.StoreBound();
+	regF.StoreBound();
+	regS.StoreBound();
+	regA.StoreBound();
+}
+
+void JitCompiler::EndOpcodeSpills()
+{
+	if (hasSpills)
 	{
-		regname.Format("regA%d", i);
-		regA[i] = cc.newIntPtr(regname.GetChars());
+		StoreSpills();
+		if (spillBranches.Size() > 0)
+		{
+			auto done = cc.newLabel();
+			cc.jmp(done);
+			for (auto &branch : spillBranches)
+			{
+				cc.bind(branch.Label);
+				StoreSpills();
+				cc.jmp(GetLabel(branch.Target));
+			}
+			cc.bind(done);
+			spillBranches.Clear();
+		}
+
+		regD.EndOpcode();
+		regF.EndOpcode();
+		regS.EndOpcode();
+		regA.EndOpcode();
 	}
 }
 
+void JitCompiler::LoadSpilled(int regtype, const asmjit::X86Gp &reg, int index)
+{
+	using namespace asmjit;
+
+	// Loads go in front of everything the opcode emitted so far, as that may already use the register.
+	auto cursor = cc.getCursor();
+	bool atStart = cursor == spillCursor;
+	cc.setCursor(spillCursor);
+	if (regtype == REGT_INT)
+		cc.mov(reg, x86::dword_ptr(vmframe, offsetD + index * sizeof(int32_t)));
+	else if (regtype == REGT_STRING)
+		cc.lea(reg, x86::ptr(vmframe, offsetS + index * sizeof(FString)));
+	else
+		cc.mov(reg, x86::ptr(vmframe, offsetA + index * sizeof(void*)));
+	spillCursor = cc.getCursor();
+	if (!atStart) cc.setCursor(cursor);
+}
+
+void JitCompiler::LoadSpilled(int regtype, const asmjit::X86Xmm &reg, int index)
+{
+	auto cursor = cc.getCursor();
+	bool atStart = cursor == spillCursor;
+	cc.setCursor(spillCursor);
+	cc.movsd(reg, asmjit::x86::qword_ptr(vmframe, offsetF + index * sizeof(double)));
+	spillCursor = cc.getCursor();
+	if (!atStart) cc.setCursor(cursor);
+}
+
+void JitCompiler::StoreSpilled(int regtype, const asmjit::X86Gp &reg, int index)
+{
+	using namespace asmjit;
+
+	// String registers only hold the address of the string in the frame.
+	if (regtype == REGT_INT)
+		cc.mov(x86::dword_ptr(vmframe, offsetD + index * sizeof(int32_t)), reg);
+	else if (regtype == REGT_POINTER)
+		cc.mov(x86::ptr(vmframe, offsetA + index * sizeof(void*)), reg);
+}
+
+void JitCompiler::StoreSpilled(int regtype, const asmjit::X86Xmm &reg, int index)
+{
+	cc.movsd(asmjit::x86::qword_ptr(vmframe, offsetF + index * sizeof(double)), reg);
+}
+
 void JitCompiler::EmitNullPointerThrow(int index, EVMAbortException reason)
 {
 	auto label = EmitThrowExceptionLabel(reason);
@@ -506,7 +648,7 @@ asmjit::Label JitCompiler::EmitThrowExceptionLabel(EVMAbortException reason)
 
 	JitLineInfo info;
 	info.Label = label;
-	info.LineNumber = sfunc->PCToLine(pc);
+	info.LineNumber = inlineCaller ? inlineCaller->PCToLine(inlineCallerPC) : sfunc->PCToLine(pc);
 	LineInfo.Push(info);
 
 	return label;
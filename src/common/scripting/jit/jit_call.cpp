@@ -25,9 +25,18 @@ void JitCompiler::EmitVTBL()
 	// This instruction is handled in the CALL/CALL_K instruction following it
 }
 
-void JitCompiler::EmitVtbl(const VMOP *op)
+static VMFunction *CallSiteLookup(VMCallSite *site, PClass *cls, int index)
 {
-	int a = op->a;
+	return site->Lookup(cls, index);
+}
+
+// Returns the call target in a new register. The VTBL destination register
+// is not written because the code generator may have given it to a register
+// that still holds one of the call's parameters.
+asmjit::X86Gp JitCompiler::EmitVtbl(const VMOP *op)
+{
+	using namespace asmjit;
+
 	int b = op->b;
 	int c = op->c;
 
@@ -35,14 +44,46 @@ void JitCompiler::EmitVtbl(const VMOP *op)
 	cc.test(regA[b], regA[b]);
 	cc.jz(label);
 
-	cc.mov(regA[a], asmjit::x86::qword_ptr(regA[b], myoffsetof(DObject, Class)));
-	cc.mov(regA[a], asmjit::x86::qword_ptr(regA[a], myoffsetof(PClass, Virtuals) + myoffsetof(FArray, Array)));
-	cc.mov(regA[a], asmjit::x86::qword_ptr(regA[a], c * (int)sizeof(void*)));
+	// Inline cache: the first class seen here is checked inline, all others go through VMCallSite::Lookup.
+	VMCallSite *site = sfunc->GetCallSite(op);
+	auto cls = newTempIntPtr();
+	auto siteptr = newTempIntPtr();
+	auto target = newTempIntPtr();
+	auto miss = cc.newLabel();
+	auto done = cc.newLabel();
+	cc.mov(cls, x86::qword_ptr(regA[b], myoffsetof(DObject, Class)));
+	cc.mov(siteptr, imm_ptr(site));
+	cc.cmp(cls, x86::qword_ptr(siteptr, myoffsetof(VMCallSite, Classes)));
+	cc.jne(miss);
+	cc.mov(target, x86::qword_ptr(siteptr, myoffsetof(VMCallSite, Targets)));
+	cc.add(x86::dword_ptr(siteptr, myoffsetof(VMCallSite, Hits)), 1);
+	cc.jmp(done);
+
+	cc.bind(miss);
+	auto result = newResultIntPtr();
+	auto call = CreateCall<VMFunction *, VMCallSite *, PClass *, int>(CallSiteLookup);
+	call->setRet(0, result);
+	call->setArg(0, siteptr);
+	call->setArg(1, cls);
+	call->setArg(2, imm(c));
+	cc.mov(target, result);
+	cc.bind(done);
+	return target;
 }
 
 void JitCompiler::EmitCALL()
 {
-	EmitVMCall(regA[A], nullptr);
+	if (pc > sfunc->Code && (pc - 1)->op == OP_VTBL)
+	{
+		if (!optimize || !EmitCachedVirtualCall(pc - 1))
+		{
+			EmitVMCall(EmitVtbl(pc - 1), nullptr);
+		}
+	}
+	else
+	{
+		EmitVMCall(regA[A], nullptr);
+	}
 	pc += C; // Skip RESULTs
 }
 
@@ -58,6 +99,10 @@ void JitCompiler::EmitCALL_K()
 	{
 		EmitNativeCall(ntarget);
 	}
+	else if (optimize && target && !(target->VarFlags & VARF_Native) && CanInline(static_cast<VMScriptFunction *>(target)))
+	{
+		EmitInlineCall(static_cast<VMScriptFunction *>(target));
+	}
 	else
 	{
 		auto ptr = newTempIntPtr();
@@ -68,6 +113,316 @@ void JitCompiler::EmitCALL_K()
 	pc += C; // Skip RESULTs
 }
 
+// Optimizing tier: calls each class recorded in the call site's inline cache
+// directly, which allows native calls without the VM calling convention and
+// inlining. Other classes take the normal virtual call.
+bool JitCompiler::EmitCachedVirtualCall(const VMOP *vtbl)
+{
+	using namespace asmjit;
+
+	VMCallSite *site = sfunc->GetCallSite(vtbl);
+	if (site->Megamorphic || site->Classes[0] == nullptr)
+		return false;
+
+	auto label = EmitThrowExceptionLabel(X_READ_NIL);
+	cc.test(regA[vtbl->b], regA[vtbl->b]);
+	cc.jz(label);
+
+	auto cls = cc.newIntPtr("callsiteClass");
+	cc.mov(cls, x86::qword_ptr(regA[vtbl->b], myoffsetof(DObject, Class)));
+
+	auto done = cc.newLabel();
+	TArray<const VMOP *> params = ParamOpcodes;
+	for (int i = 0; i < VMCallSite::MaxClasses && site->Classes[i] != nullptr; i++)
+	{
+		auto next = cc.newLabel();
+		auto expected = newTempIntPtr();
+		cc.mov(expected, imm_ptr(site->Classes[i]));
+		cc.cmp(cls, expected);
+		cc.jne(next);
+
+		VMFunction *target = site->Targets[i];
+		ParamOpcodes = params;
+		if ((target->VarFlags & VARF_Native) && static_cast<VMNativeFunction *>(target)->DirectNativeCall)
+		{
+			EmitNativeCall(static_cast<VMNativeFunction *>(target));
+		}
+		else if (!(target->VarFlags & VARF_Native) && CanInline(static_cast<VMScriptFunction *>(target)))
+		{
+			EmitInlineCall(static_cast<VMScriptFunction *>(target));
+		}
+		else
+		{
+			auto ptr = newTempIntPtr();
+			cc.mov(ptr, imm_ptr(target));
+			EmitVMCall(ptr, target);
+		}
+		cc.jmp(done);
+		cc.bind(next);
+	}
+
+	ParamOpcodes = params;
+	EmitVMCall(EmitVtbl(vtbl), nullptr);
+	cc.bind(done);
+
+	JitDirectCalls++;
+	return true;
+}
+
+static bool IsInlineableOp(VM_UBYTE op)
+{
+	switch (op)
+	{
+	case OP_NOP: case OP_LI: case OP_LK: case OP_LKF: case OP_LKP:
+	case OP_LB: case OP_LB_R: case OP_LH: case OP_LH_R: case OP_LW: case OP_LW_R: case OP_LBU: case OP_LBU_R:
+	case OP_LHU: case OP_LHU_R: case OP_LSP: case OP_LSP_R: case OP_LDP: case OP_LDP_R: case OP_LP: case OP_LP_R: case OP_LBIT:
+	case OP_SB: case OP_SB_R: case OP_SH: case OP_SH_R: case OP_SW: case OP_SW_R:
+	case OP_SSP: case OP_SSP_R: case OP_SDP: case OP_SDP_R: case OP_SP: case OP_SP_R:
+	case OP_MOVE: case OP_MOVEF: case OP_MOVEA: case OP_NULLCHECK:
+	case OP_ADD_RR: case OP_ADD_RK: case OP_ADDI: case OP_SUB_RR: case OP_SUB_RK: case OP_SUB_KR:
+	case OP_MUL_RR: case OP_MUL_RK: case OP_AND_RR: case OP_AND_RK: case OP_OR_RR: case OP_OR_RK:
+	case OP_XOR_RR: case OP_XOR_RK: case OP_SLL_RR: case OP_SLL_RI: case OP_SRL_RR: case OP_SRL_RI:
+	case OP_SRA_RR: case OP_SRA_RI: case OP_MIN_RR: case OP_MIN_RK: case OP_MAX_RR: case OP_MAX_RK:
+	case OP_ABS: case OP_NEG: case OP_NOT:
+	case OP_ADDF_RR: case OP_ADDF_RK: case OP_SUBF_RR: case OP_SUBF_RK: case OP_SUBF_KR:
+	case OP_MULF_RR: case OP_MULF_RK: case OP_DIVF_RR: case OP_DIVF_RK: case OP_DIVF_KR:
+	case OP_MINF_RR: case OP_MINF_RK: case OP_MAXF_RR: case OP_MAXF_RK: case OP_FLOP:
+	case OP_EQ_R: case OP_EQ_K: case OP_LT_RR: case OP_LT_RK: case OP_LT_KR: case OP_LE_RR: case OP_LE_RK: case OP_LE_KR:
+	case OP_EQF_R: case OP_EQF_K: case OP_LTF_RR: case OP_LTF_RK: case OP_LTF_KR: case OP_LEF_RR: case OP_LEF_RK: case OP_LEF_KR:
+	case OP_EQA_R: case OP_EQA_K: case OP_TEST: case OP_TESTN: case OP_JMP:
+	case OP_RET: case OP_RETI:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Small leaf functions without strings or frame storage can be compiled into
+// the caller. The current opcode must be the call.
+bool JitCompiler::CanInline(VMScriptFunction *target)
+{
+	const int maxInlineSize = 24;
+
+	if (target == sfunc || inlineCaller != nullptr || target->Code == nullptr || target->blockJit || (target->VarFlags & VARF_Abstract))
+		return false;
+	if (target->CodeSize > maxInlineSize || target->NumRegS != 0 || target->ExtraSpace != 0 || target->SpecialInits.Size() != 0)
+		return false;
+	if (B != target->NumArgs || (unsigned)B != ParamOpcodes.Size() || C > 1)
+		return false;
+
+	int rettype = REGT_NIL;
+	if (C == 1)
+	{
+		rettype = pc[1].b;
+		if (rettype != REGT_INT && rettype != REGT_FLOAT && rettype != REGT_POINTER)
+			return false;
+	}
+
+	// The arguments must end up in the same registers SetupSimpleFrame would put them in.
+	int regd = 0, regf = 0, rega = 0;
+	for (unsigned i = 0; i < target->Proto->ArgumentTypes.Size(); i++)
+	{
+		if (i >= ParamOpcodes.Size() || (target->ArgFlags.Size() && (target->ArgFlags[i] & (VARF_Out | VARF_Ref))))
+			return false;
+
+		const PType *type = target->Proto->ArgumentTypes[i];
+		const VMOP *param = ParamOpcodes[i];
+		int paramtype = param->op == OP_PARAMI ? REGT_INT : (param->a & ~REGT_KONST);
+		if (type == TypeFloat64)
+		{
+			if (paramtype != REGT_FLOAT) return false;
+			regf++;
+		}
+		else if (type->isIntCompatible())
+		{
+			if (paramtype != REGT_INT) return false;
+			regd++;
+		}
+		else if (type->isPointer() || type->isObjectPointer() || type->isClassPointer())
+		{
+			if (paramtype != REGT_POINTER && paramtype != REGT_NIL) return false;
+			rega++;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	if (regd > target->NumRegD || regf > target->NumRegF || rega > target->NumRegA)
+		return false;
+
+	for (int i = 0; i < target->CodeSize; i++)
+	{
+		const VMOP &op = target->Code[i];
+		if (!IsInlineableOp(op.op))
+			return false;
+
+		// Returns may only hand over a single value of the type the caller expects.
+		if (op.op == OP_RET && op.b != REGT_NIL && (op.a & ~RET_FINAL) < C && (op.b & ~REGT_KONST) != rettype)
+			return false;
+		if (op.op == OP_RETI && (op.a & ~RET_FINAL) < C && rettype != REGT_INT)
+			return false;
+	}
+	return true;
+}
+
+void JitCompiler::EmitInlineCall(VMScriptFunction *target)
+{
+	using namespace asmjit;
+
+	const VMOP *callpc = pc;
+	int numret = C;
+	int rettype = numret > 0 ? pc[1].b : REGT_NIL;
+	int retreg = numret > 0 ? pc[1].c : 0;
+
+	// The callee gets registers of its own, set up like SetupSimpleFrame does.
+	JitRegisterBank<X86Gp> calleeD, calleeS, calleeA;
+	JitRegisterBank<X86Xmm> calleeF;
+	calleeD.Init(this, REGT_INT, target->NumRegD, target->NumRegD);
+	calleeF.Init(this, REGT_FLOAT, target->NumRegF, target->NumRegF);
+	calleeS.Init(this, REGT_STRING, 0, 0);
+	calleeA.Init(this, REGT_POINTER, target->NumRegA, target->NumRegA);
+
+	int regd = 0, regf = 0, rega = 0;
+	for (const VMOP *param : ParamOpcodes)
+	{
+		if (param->op == OP_PARAMI)
+		{
+			cc.mov(calleeD[regd++], param->i24);
+			continue;
+		}
+
+		int bc = param->i16u;
+		switch (param->a)
+		{
+		case REGT_NIL:
+			cc.xor_(calleeA[rega], calleeA[rega]);
+			rega++;
+			break;
+		case REGT_INT:
+			cc.mov(calleeD[regd++], regD[bc]);
+			break;
+		case REGT_INT | REGT_KONST:
+			cc.mov(calleeD[regd++], konstd[bc]);
+			break;
+		case REGT_POINTER:
+			cc.mov(calleeA[rega++], regA[bc]);
+			break;
+		case REGT_POINTER | REGT_KONST:
+			cc.mov(calleeA[rega++], imm_ptr(konsta[bc].v));
+			break;
+		case REGT_FLOAT:
+			cc.movsd(calleeF[regf++], regF[bc]);
+			break;
+		case REGT_FLOAT | REGT_KONST:
+		{
+			auto tmp = newTempIntPtr();
+			cc.mov(tmp, imm_ptr(konstf + bc));
+			cc.movsd(calleeF[regf++], x86::qword_ptr(tmp));
+			break;
+		}
+		}
+	}
+	for (int i = regd; i < target->NumRegD; i++)
+		cc.xor_(calleeD[i], calleeD[i]);
+	for (int i = regf; i < target->NumRegF; i++)
+		cc.xorpd(calleeF[i], calleeF[i]);
+	for (int i = rega; i < target->NumRegA; i++)
+		cc.xor_(calleeA[i], calleeA[i]);
+	ParamOpcodes.Clear();
+
+	X86Gp resultGp;
+	X86Xmm resultXmm;
+	if (rettype == REGT_INT) resultGp = cc.newInt32("inlineResult");
+	else if (rettype == REGT_POINTER) resultGp = cc.newIntPtr("inlineResult");
+	else if (rettype == REGT_FLOAT) resultXmm = cc.newXmmSd("inlineResult");
+	auto exit = cc.newLabel();
+
+	// Switch to the callee and emit its code. Returns become jumps to the end.
+	TArray<OpcodeLabel> calleeLabels;
+	calleeLabels.Resize(target->CodeSize);
+	std::swap(labels, calleeLabels);
+	std::swap(regD, calleeD);
+	std::swap(regF, calleeF);
+	std::swap(regS, calleeS);
+	std::swap(regA, calleeA);
+	inlineCaller = sfunc;
+	inlineCallerPC = callpc;
+	sfunc = target;
+	konstd = target->KonstD;
+	konstf = target->KonstF;
+	konsts = target->KonstS;
+	konsta = target->KonstA;
+
+	pc = target->Code;
+	auto end = pc + target->CodeSize;
+	while (pc != end)
+	{
+		int i = (int)(ptrdiff_t)(pc - target->Code);
+		op = pc->op;
+		labels[i].cursor = cc.getCursor();
+		ResetTemp();
+
+		if (op == OP_RET || op == OP_RETI)
+		{
+			int retnum = A & ~RET_FINAL;
+			if (retnum < numret)
+			{
+				if (op == OP_RETI)
+				{
+					cc.mov(resultGp, BCs);
+				}
+				else switch (B)
+				{
+				case REGT_INT: cc.mov(resultGp, regD[C]); break;
+				case REGT_INT | REGT_KONST: cc.mov(resultGp, konstd[C]); break;
+				case REGT_POINTER: cc.mov(resultGp, regA[C]); break;
+				case REGT_POINTER | REGT_KONST: cc.mov(resultGp, imm_ptr(konsta[C].v)); break;
+				case REGT_FLOAT: cc.movsd(resultXmm, regF[C]); break;
+				case REGT_FLOAT | REGT_KONST:
+				{
+					auto tmp = newTempIntPtr();
+					cc.mov(tmp, imm_ptr(konstf + C));
+					cc.movsd(resultXmm, x86::qword_ptr(tmp));
+					break;
+				}
+				default: break;
+				}
+			}
+			if (B == REGT_NIL || (A & RET_FINAL))
+				cc.jmp(exit);
+		}
+		else
+		{
+			EmitOpcode();
+		}
+		pc++;
+	}
+	BindLabels();
+	cc.bind(exit);
+
+	std::swap(labels, calleeLabels);
+	std::swap(regD, calleeD);
+	std::swap(regF, calleeF);
+	std::swap(regS, calleeS);
+	std::swap(regA, calleeA);
+	sfunc = inlineCaller;
+	inlineCaller = nullptr;
+	inlineCallerPC = nullptr;
+	konstd = sfunc->KonstD;
+	konstf = sfunc->KonstF;
+	konsts = sfunc->KonstS;
+	konsta = sfunc->KonstA;
+	pc = callpc;
+	op = pc->op;
+
+	if (rettype == REGT_INT) cc.mov(regD[retreg], resultGp);
+	else if (rettype == REGT_POINTER) cc.mov(regA[retreg], resultGp);
+	else if (rettype == REGT_FLOAT) cc.movsd(regF[retreg], resultXmm);
+
+	JitInlinedCalls++;
+}
+
 void JitCompiler::EmitVMCall(asmjit::X86Gp vmfunc, VMFunction *target)
 {
 	using namespace asmjit;
@@ -78,9 +433,6 @@ void JitCompiler::EmitVMCall(asmjit::X86Gp vmfunc, VMFunction *target)
 	if (numparams != B)
 		I_Error("OP_CALL parameter count does not match the number of preceding OP_PARAM instructions");
 
-	if (pc > sfunc->Code && (pc - 1)->op == OP_VTBL)
-		EmitVtbl(pc - 1);
-
 	FillReturns(pc + 1, C);
 
 	X86Gp paramsptr = newTempIntPtr();
@@ -331,11 +683,6 @@ void JitCompiler::EmitNativeCall(VMNativeFunction *target)
 {
 	using namespace asmjit;
 
-	if (pc > sfunc->Code && (pc - 1)->op == OP_VTBL)
-	{
-		I_Error("Native direct member function calls not implemented\n");
-	}
-
 	if (target->ImplicitArgs > 0)
 	{
 		auto label = EmitThrowExceptionLabel(X_READ_NIL);
@@ -5,7 +5,7 @@ void JitCompiler::EmitTEST()
 {
 	int i = (int)(ptrdiff_t)(pc - sfunc->Code);
 	cc.cmp(regD[A], BC);
-	cc.jne(GetLabel(i + 2));
+	cc.jne(GetBranchLabel(i + 2));
 }
 
 void JitCompiler::EmitTESTN()
@@ -13,14 +13,14 @@ void JitCompiler::EmitTESTN()
 	int bc = BC;
 	int i = (int)(ptrdiff_t)(pc - sfunc->Code);
 	cc.cmp(regD[A], -bc);
-	cc.jne(GetLabel(i + 2));
+	cc.jne(GetBranchLabel(i + 2));
 }
 
 void JitCompiler::EmitJMP()
 {
 	auto dest = pc + JMPOFS(pc) + 1;
 	int i = (int)(ptrdiff_t)(dest - sfunc->Code);
-	cc.jmp(GetLabel(i));
+	cc.jmp(GetBranchLabel(i));
 }
 
 void JitCompiler::EmitIJMP()
@@ -36,7 +36,7 @@ void JitCompiler::EmitIJMP()
 			int target = base + i + JMPOFS(&sfunc->Code[base + i]) + 1;
 
 			cc.cmp(val, i);
-			cc.je(GetLabel(target));
+			cc.je(GetBranchLabel(target));
 		}
 	}
 	pc += BCs;
@@ -0,0 +1,300 @@
+#include "jitintern.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Optimizing tier.
+//
+// Hot functions get compiled a second time with some knowledge carried from
+// one opcode to the next:
+//
+// - integer registers holding a known constant, so that arithmetic on them
+//   can be folded into a single move
+// - fields already loaded from or stored to an unchanged base register
+//   (mostly self), so that loading them again becomes a register move and
+//   storing the same register to them again is dropped
+//
+// Everything is forgotten at jump targets and at any opcode not known to
+// be free of side effects. A store only keeps what is known about other,
+// non-overlapping fields of the same base, since any other base may
+// point to the same memory.
+
+void JitCompiler::FindJumpTargets()
+{
+	jumpTargets.Resize(sfunc->CodeSize);
+	memset(jumpTargets.Data(), 0, jumpTargets.Size());
+
+	auto mark = [&](ptrdiff_t target)
+	{
+		if (target >= 0 && target < sfunc->CodeSize) jumpTargets[target] = true;
+	};
+
+	// Conditional branches and jump tables are all followed by JMP instructions.
+	for (int i = 0; i < sfunc->CodeSize; i++)
+	{
+		const VMOP *op = &sfunc->Code[i];
+		if (op->op == OP_JMP) mark(i + 1 + JMPOFS(op));
+		else if (op->op == OP_TEST || op->op == OP_TESTN) mark(i + 2);
+	}
+
+	knownD.Resize(sfunc->NumRegD);
+	constD.Resize(sfunc->NumRegD);
+	ForgetValues();
+}
+
+void JitCompiler::ForgetValues()
+{
+	if (knownD.Size() > 0) memset(knownD.Data(), 0, knownD.Size());
+	knownLoads.Clear();
+}
+
+void JitCompiler::ForgetRegister(int regtype, int regnum)
+{
+	if (regtype == REGT_INT) knownD[regnum] = false;
+
+	for (unsigned i = knownLoads.Size(); i-- > 0;)
+	{
+		auto &load = knownLoads[i];
+		int desttype = (load.Op == OP_LSP || load.Op == OP_LDP) ? REGT_FLOAT : load.Op == OP_LP ? REGT_POINTER : REGT_INT;
+		if ((desttype == regtype && load.Dest == regnum) || (regtype == REGT_POINTER && load.Base == regnum))
+		{
+			knownLoads.Delete(i);
+		}
+	}
+}
+
+// Size of the field accessed by a load or store with a constant offset.
+static int FieldSize(int op)
+{
+	switch (op)
+	{
+	case OP_LB: case OP_LBU: case OP_SB:	return 1;
+	case OP_LH: case OP_LHU: case OP_SH:	return 2;
+	case OP_LW: case OP_SW:
+	case OP_LSP: case OP_SSP:				return 4;
+	case OP_LDP: case OP_SDP:				return 8;
+	case OP_LP: case OP_SP:					return sizeof(void *);
+	default:								return 0;
+	}
+}
+
+// The load that gives back exactly what a store wrote, if any.
+static int MatchingLoad(int op)
+{
+	switch (op)
+	{
+	case OP_SW:		return OP_LW;
+	case OP_SDP:	return OP_LDP;
+	case OP_SP:		return OP_LP;
+	default:		return -1;
+	}
+}
+
+bool JitCompiler::EmitOptimized()
+{
+	switch (op)
+	{
+	case OP_SW:
+	case OP_SDP:
+	case OP_SP:
+		for (auto &load : knownLoads)
+		{
+			// The field already holds this register's value.
+			if (load.Op == MatchingLoad(op) && load.Base == A && load.Offset == konstd[C] && load.Dest == B)
+			{
+				return true;
+			}
+		}
+		return false;
+
+	case OP_LB:
+	case OP_LH:
+	case OP_LW:
+	case OP_LBU:
+	case OP_LHU:
+	case OP_LSP:
+	case OP_LDP:
+	case OP_LP:
+		for (auto &load : knownLoads)
+		{
+			if (load.Op == op && load.Base == B && load.Offset == konstd[C])
+			{
+				// The base was already checked for null when this was loaded.
+				if (load.Dest == A) return true;
+				if (op == OP_LSP || op == OP_LDP) cc.movsd(regF[A], regF[load.Dest]);
+				else if (op == OP_LP) cc.mov(regA[A], regA[load.Dest]);
+				else cc.mov(regD[A], regD[load.Dest]);
+				return true;
+			}
+		}
+		return false;
+
+	default:
+		break;
+	}
+
+	int32_t result;
+	if (FoldConstant(pc, result))
+	{
+		cc.mov(regD[A], result);
+		return true;
+	}
+	return false;
+}
+
+// Integer arithmetic on known values.
+bool JitCompiler::FoldConstant(const VMOP *pc, int32_t &result)
+{
+	// B and C may also be constant indices here, which the switch below never reads as registers.
+	auto known = [&](int reg) { return reg < (int)knownD.Size() && knownD[reg] != 0; };
+	uint32_t b = known(B) ? (uint32_t)constD[B] : 0;
+	uint32_t c = known(C) ? (uint32_t)constD[C] : 0;
+	uint32_t r;
+	bool folded;
+	switch (pc->op)
+	{
+	case OP_MOVE:	folded = known(B); r = b; break;
+	case OP_ADD_RR:	folded = known(B) && known(C); r = b + c; break;
+	case OP_ADD_RK:	folded = known(B); r = b + konstd[C]; break;
+	case OP_ADDI:	folded = known(B); r = b + Cs; break;
+	case OP_SUB_RR:	folded = known(B) && known(C); r = b - c; break;
+	case OP_SUB_RK:	folded = known(B); r = b - konstd[C]; break;
+	case OP_SUB_KR:	folded = known(C); r = konstd[B] - c; break;
+	case OP_MUL_RR:	folded = known(B) && known(C); r = b * c; break;
+	case OP_MUL_RK:	folded = known(B); r = b * konstd[C]; break;
+	case OP_AND_RR:	folded = known(B) && known(C); r = b & c; break;
+	case OP_AND_RK:	folded = known(B); r = b & konstd[C]; break;
+	case OP_OR_RR:	folded = known(B) && known(C); r = b | c; break;
+	case OP_OR_RK:	folded = known(B); r = b | konstd[C]; break;
+	case OP_XOR_RR:	folded = known(B) && known(C); r = b ^ c; break;
+	case OP_XOR_RK:	folded = known(B); r = b ^ konstd[C]; break;
+	case OP_SLL_RI:	folded = known(B); r = b << (C & 31); break;
+	case OP_SRL_RI:	folded = known(B); r = b >> (C & 31); break;
+	case OP_SRA_RI:	folded = known(B); r = (uint32_t)((int32_t)b >> (C & 31)); break;
+	default:		folded = false; r = 0; break;
+	}
+	result = (int32_t)r;
+	return folded;
+}
+
+void JitCompiler::TrackValues(const VMOP *pc)
+{
+	int a = A;
+	switch (pc->op)
+	{
+	case OP_LI:
+		ForgetRegister(REGT_INT, a);
+		knownD[a] = true;
+		constD[a] = BCs;
+		break;
+
+	case OP_LK:
+		ForgetRegister(REGT_INT, a);
+		knownD[a] = true;
+		constD[a] = konstd[BC];
+		break;
+
+	case OP_MOVE:
+	case OP_ADD_RR: case OP_ADD_RK: case OP_ADDI:
+	case OP_SUB_RR: case OP_SUB_RK: case OP_SUB_KR:
+	case OP_MUL_RR: case OP_MUL_RK:
+	case OP_AND_RR: case OP_AND_RK:
+	case OP_OR_RR: case OP_OR_RK:
+	case OP_XOR_RR: case OP_XOR_RK:
+	case OP_SLL_RI: case OP_SRL_RI: case OP_SRA_RI:
+	{
+		int32_t value;
+		bool folded = FoldConstant(pc, value);
+		ForgetRegister(REGT_INT, a);
+		if (folded)
+		{
+			knownD[a] = true;
+			constD[a] = value;
+		}
+		break;
+	}
+
+	case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+	case OP_LSP: case OP_LDP: case OP_LP:
+	{
+		bool isfloat = pc->op == OP_LSP || pc->op == OP_LDP;
+		ForgetRegister(isfloat ? REGT_FLOAT : pc->op == OP_LP ? REGT_POINTER : REGT_INT, a);
+		if (pc->op != OP_LP || a != B)
+		{
+			knownLoads.Push({ pc->op, B, konstd[C], a });
+		}
+		break;
+	}
+
+	case OP_LK_R: case OP_LB_R: case OP_LH_R: case OP_LW_R: case OP_LBU_R: case OP_LHU_R: case OP_LBIT:
+	case OP_SLL_RR: case OP_SLL_KR: case OP_SRL_RR: case OP_SRL_KR: case OP_SRA_RR: case OP_SRA_KR:
+	case OP_DIV_RR: case OP_DIV_RK: case OP_DIV_KR: case OP_DIVU_RR: case OP_DIVU_RK: case OP_DIVU_KR:
+	case OP_MOD_RR: case OP_MOD_RK: case OP_MOD_KR: case OP_MODU_RR: case OP_MODU_RK: case OP_MODU_KR:
+	case OP_MIN_RR: case OP_MIN_RK: case OP_MAX_RR: case OP_MAX_RK:
+	case OP_MINU_RR: case OP_MINU_RK: case OP_MAXU_RR: case OP_MAXU_RK:
+	case OP_ABS: case OP_NEG: case OP_NOT:
+		ForgetRegister(REGT_INT, a);
+		break;
+
+	case OP_LKF: case OP_LKF_R: case OP_MOVEF: case OP_LSP_R: case OP_LDP_R:
+	case OP_ADDF_RR: case OP_ADDF_RK: case OP_SUBF_RR: case OP_SUBF_RK: case OP_SUBF_KR:
+	case OP_MULF_RR: case OP_MULF_RK: case OP_DIVF_RR: case OP_DIVF_RK: case OP_DIVF_KR:
+	case OP_MODF_RR: case OP_MODF_RK: case OP_MODF_KR: case OP_POWF_RR: case OP_POWF_RK: case OP_POWF_KR:
+	case OP_MINF_RR: case OP_MINF_RK: case OP_MAXF_RR: case OP_MAXF_RK: case OP_ATAN2: case OP_FLOP:
+		ForgetRegister(REGT_FLOAT, a);
+		break;
+
+	case OP_LKP: case OP_LKP_R: case OP_MOVEA: case OP_LP_R: case OP_META: case OP_CLSS: case OP_LFP:
+		ForgetRegister(REGT_POINTER, a);
+		break;
+
+	case OP_VTBL:
+		ForgetRegister(REGT_POINTER, a);
+		break;
+
+	case OP_RESULT:
+		// These registers get written by the call before, which has forgotten everything already.
+		ForgetRegister(B & REGT_TYPE, a);
+		if (B & REGT_MULTIREG)
+		{
+			int count = (B & REGT_MULTIREG4) ? 4 : (B & REGT_MULTIREG3) ? 3 : 2;
+			for (int i = 1; i < count; i++) ForgetRegister(B & REGT_TYPE, a + i);
+		}
+		break;
+
+	case OP_NOP: case OP_JMP: case OP_TEST: case OP_TESTN: case OP_PARAM: case OP_PARAMI:
+	case OP_EQ_R: case OP_EQ_K: case OP_LT_RR: case OP_LT_RK: case OP_LT_KR: case OP_LE_RR: case OP_LE_RK: case OP_LE_KR:
+	case OP_LTU_RR: case OP_LTU_RK: case OP_LTU_KR: case OP_LEU_RR: case OP_LEU_RK: case OP_LEU_KR:
+	case OP_EQF_R: case OP_EQF_K: case OP_LTF_RR: case OP_LTF_RK: case OP_LTF_KR: case OP_LEF_RR: case OP_LEF_RK: case OP_LEF_KR:
+	case OP_EQA_R: case OP_EQA_K:
+		// Parameters are only read by the following call, which forgets everything.
+		break;
+
+	case OP_SB: case OP_SH: case OP_SW: case OP_SSP: case OP_SDP: case OP_SP:
+	{
+		int offset = konstd[C];
+		int size = FieldSize(pc->op);
+		for (unsigned i = knownLoads.Size(); i-- > 0;)
+		{
+			auto &load = knownLoads[i];
+			if (load.Base != a || (load.Offset < offset + size && offset < load.Offset + FieldSize(load.Op)))
+			{
+				knownLoads.Delete(i);
+			}
+		}
+		int loadop = MatchingLoad(pc->op);
+		if (loadop >= 0)
+		{
+			knownLoads.Push({ (VM_UBYTE)loadop, a, offset, B });
+		}
+		break;
+	}
+
+	case OP_SB_R: case OP_SH_R: case OP_SW_R: case OP_SSP_R: case OP_SDP_R: case OP_SP_R:
+		// Stores may hit any field, but registers stay as they are.
+		knownLoads.Clear();
+		break;
+
+	default:
+		ForgetValues();
+		break;
+	}
+}
@@ -15,6 +15,7 @@
 
 extern cycle_t VMCycles[10];
 extern int VMCalls[10];
+extern int JitDirectCalls, JitInlinedCalls;
 
 #define A				(pc[0].a)
 #define B				(pc[0].b)
@@ -32,10 +33,43 @@ struct JitLineInfo
 	asmjit::Label Label;
 };
 
+class JitCompiler;
+
+// The VM registers of one type.
+//
+// Asmjit cannot handle an unlimited number of virtual registers, so for big
+// functions only the first registers of each type get one of their own. The
+// others stay in the VM frame. They are loaded into a temporary register at
+// the start of each opcode that uses them and written back at its end, or
+// before the opcode branches to another one.
+template<typename T>
+class JitRegisterBank
+{
+public:
+	void Init(JitCompiler *compiler, int regtype, int count, int resident);
+
+	T &operator[](size_t index);
+	unsigned Size() const { return Regs.Size(); }
+	bool IsResident(int index) const { return index < NumResident; }
+
+	// Writes back all spilled registers the current opcode used.
+	void StoreBound();
+	void EndOpcode() { Bound.Clear(); }
+
+private:
+	JitCompiler *Compiler = nullptr;
+	int RegType = 0;
+	int NumResident = 0;
+	TArray<T> Regs;
+	TArray<int> BoundSerial;	// the opcode a spilled register was last loaded for
+	TArray<int> Bound;			// spilled registers used by the current opcode
+	TArray<T> Pool;				// temporaries for spilled registers
+};
+
 class JitCompiler
 {
 public:
-	JitCompiler(asmjit::CodeHolder *code, VMScriptFunction *sfunc) : cc(code), sfunc(sfunc) { }
+	JitCompiler(asmjit::CodeHolder *code, VMScriptFunction *sfunc, bool optimize = false) : optimize(optimize), cc(code), sfunc(sfunc) { }
 
 	asmjit::CCFunc *Codegen();
 	VMScriptFunction *GetScriptFunction() { return sfunc; }
@@ -59,10 +93,63 @@ private:
 	void BindLabels();
 	void EmitOpcode();
 	void EmitPopFrame();
+	bool UsesFullVMFrame() const;
+
+	// Spilled registers (see JitRegisterBank)
+	template<typename T> friend class JitRegisterBank;
+	bool hasSpills = false;
+	int opcodeSerial = 0;
+	asmjit::CBNode *spillCursor = nullptr;
+	struct SpillBranch
+	{
+		asmjit::Label Label;
+		int Target;
+	};
+	TArray<SpillBranch> spillBranches;
+	asmjit::Label GetBranchLabel(int pos);
+	void StoreSpills();
+	void BeginOpcodeSpills();
+	void EndOpcodeSpills();
+	void NewRegister(int regtype, asmjit::X86Gp &reg, const char *prefix, int index);
+	void NewRegister(int regtype, asmjit::X86Xmm &reg, const char *prefix, int index);
+	void LoadSpilled(int regtype, const asmjit::X86Gp &reg, int index);
+	void LoadSpilled(int regtype, const asmjit::X86Xmm &reg, int index);
+	void StoreSpilled(int regtype, const asmjit::X86Gp &reg, int index);
+	void StoreSpilled(int regtype, const asmjit::X86Xmm &reg, int index);
+
+	// Optimizing tier (jit_opt.cpp)
+	struct KnownLoad
+	{
+		VM_UBYTE Op;
+		int Base;
+		int Offset;
+		int Dest;
+	};
+
+	bool optimize;
+	TArray<uint8_t> jumpTargets;
+	TArray<uint8_t> knownD;
+	TArray<int> constD;
+	TArray<KnownLoad> knownLoads;
+
+	void FindJumpTargets();
+	void ForgetValues();
+	void ForgetRegister(int regtype, int regnum);
+	bool EmitOptimized();
+	bool FoldConstant(const VMOP *pc, int32_t &result);
+	void TrackValues(const VMOP *op);
+	static void TierUp(VMScriptFunction *func);
 
 	void EmitNativeCall(VMNativeFunction *target);
 	void EmitVMCall(asmjit::X86Gp ptr, VMFunction *target);
-	void EmitVtbl(const VMOP *op);
+	asmjit::X86Gp EmitVtbl(const VMOP *op);
+	bool EmitCachedVirtualCall(const VMOP *vtbl);
+	bool CanInline(VMScriptFunction *target);
+	void EmitInlineCall(VMScriptFunction *target);
+
+	// Set while the code of an inlined function is emitted.
+	VMScriptFunction *inlineCaller = nullptr;
+	const VMOP *inlineCallerPC = nullptr;
 
 	int StoreCallParams();
 	void LoadInOuts();
@@ -79,7 +166,7 @@ private:
 
 		auto successLabel = cc.newLabel();
 
-		auto failLabel = GetLabel(i + 2 + JMPOFS(pc + 1));
+		auto failLabel = GetBranchLabel(i + 2 + JMPOFS(pc + 1));
 
 		jmpFunc(static_cast<bool>(A & CMP_CHECK), failLabel, successLabel);
 
@@ -286,10 +373,10 @@ private:
 	const FString *konsts;
 	const FVoidObj *konsta;
 
-	TArray<asmjit::X86Gp> regD;
-	TArray<asmjit::X86Xmm> regF;
-	TArray<asmjit::X86Gp> regA;
-	TArray<asmjit::X86Gp> regS;
+	JitRegisterBank<asmjit::X86Gp> regD;
+	JitRegisterBank<asmjit::X86Xmm> regF;
+	JitRegisterBank<asmjit::X86Gp> regA;
+	JitRegisterBank<asmjit::X86Gp> regS;
 
 	struct OpcodeLabel
 	{
@@ -328,6 +415,48 @@ private:
 	VM_UBYTE op;
 };
 
+template<typename T>
+void JitRegisterBank<T>::Init(JitCompiler *compiler, int regtype, int count, int resident)
+{
+	Compiler = compiler;
+	RegType = regtype;
+	NumResident = resident;
+	Regs.Resize(count);
+	BoundSerial.Resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		if (i < resident) Compiler->NewRegister(regtype, Regs[i], "reg", i);
+		BoundSerial[i] = -1;
+	}
+}
+
+template<typename T>
+T &JitRegisterBank<T>::operator[](size_t index)
+{
+	if ((int)index >= NumResident && BoundSerial[index] != Compiler->opcodeSerial)
+	{
+		if (Bound.Size() == Pool.Size())
+		{
+			Pool.Push(T());
+			Compiler->NewRegister(RegType, Pool.Last(), "spill", Pool.Size() - 1);
+		}
+		Regs[index] = Pool[Bound.Size()];
+		BoundSerial[index] = Compiler->opcodeSerial;
+		Bound.Push((int)index);
+		Compiler->LoadSpilled(RegType, Regs[index], (int)index);
+	}
+	return Regs[index];
+}
+
+template<typename T>
+void JitRegisterBank<T>::StoreBound()
+{
+	for (int index : Bound)
+	{
+		Compiler->StoreSpilled(RegType, Regs[index], index);
+	}
+}
+
 class AsmJitException : public std::exception
 {
 public:
@@ -59,6 +59,8 @@ CUSTOM_CVAR(Bool, vm_jit_aot, true, CVAR_NOINITCALL)
 	Printf("You must restart " GAMENAME " for this change to take effect.\n");
 	Printf("This cvar is currently not saved. You must specify it on the command line.");
 }
+// Number of calls after which a function gets recompiled by the optimizing jit tier. 0 disables it.
+CVAR(Int, vm_jit_hotcalls, 1000, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
 #else
 CVAR(Bool, vm_jit, false, CVAR_NOINITCALL|CVAR_NOSET)
 CVAR(Bool, vm_jit_aot, false, CVAR_NOINITCALL|CVAR_NOSET)
@@ -68,6 +70,7 @@ void JitRelease() {}
 
 cycle_t VMCycles[10];
 int VMCalls[10];
+int JitDirectCalls, JitInlinedCalls;
 
 #if 0
 IMPLEMENT_CLASS(VMException, false, false)
@@ -157,6 +160,70 @@ VMScriptFunction::~VMScriptFunction()
 	}
 }
 
+//===========================================================================
+//
+// VMScriptFunction :: GetCallSite
+//
+// Returns the inline cache for the VTBL instruction at pc.
+//
+//===========================================================================
+
+VMCallSite *VMScriptFunction::GetCallSite(const VMOP *pc)
+{
+	if (!CallSitesCreated)
+	{
+		for (int i = 0; i < CodeSize; i++)
+		{
+			if (Code[i].op == OP_VTBL)
+			{
+				auto &site = CallSites[CallSites.Reserve(1)];
+				memset(&site, 0, sizeof(site));
+				site.Pos = i;
+			}
+		}
+		CallSitesCreated = true;
+	}
+
+	int pos = int(pc - Code);
+	unsigned lo = 0, hi = CallSites.Size();
+	while (lo + 1 < hi)
+	{
+		unsigned mid = (lo + hi) / 2;
+		if (CallSites[mid].Pos <= pos) lo = mid;
+		else hi = mid;
+	}
+	assert(lo < CallSites.Size() && CallSites[lo].Pos == pos);
+	return &CallSites[lo];
+}
+
+//===========================================================================
+//
+// VMCallSite :: Miss
+//
+// Looks up a class not in the cache yet and adds it if there is room.
+//
+//===========================================================================
+
+VMFunction *VMCallSite::Miss(PClass *cls, int index)
+{
+	if (cls->Virtuals.Size() <= 0) ThrowAbortException(X_OTHER, "Attempted to call an invalid virtual function in class %s", cls->TypeName.GetChars());
+	assert((unsigned)index < cls->Virtuals.Size());
+	auto func = cls->Virtuals[index];
+
+	Misses++;
+	for (int i = 0; i < MaxClasses; i++)
+	{
+		if (Classes[i] == nullptr)
+		{
+			Targets[i] = func;
+			Classes[i] = cls;
+			return func;
+		}
+	}
+	Megamorphic = true;
+	return func;
+}
+
 void VMScriptFunction::Alloc(int numops, int numkonstd, int numkonstf, int numkonsts, int numkonsta, int numlinenumbers)
 {
 	assert(Code == NULL);
@@ -276,18 +343,8 @@ int VMScriptFunction::PCToLine(const VMOP *pc)
 
 static bool CanJit(VMScriptFunction *func)
 {
-	// Asmjit has a 256 register limit. Stay safely away from it as the jit compiler uses a few for temporaries as well.
-	// Any function exceeding the limit will use the VM - a fair punishment to someone for writing a function so bloated ;)
-
-	if(func->blockJit) return false;
-
-	int maxregs = 200;
-	if (func->NumRegA + func->NumRegD + func->NumRegF + func->NumRegS < maxregs)
-		return true;
-
-	Printf(TEXTCOLOR_ORANGE "%s is using too many registers (%d of max %d)! Function will not use native code.\n", func->PrintableName, func->NumRegA + func->NumRegD + func->NumRegF + func->NumRegS, maxregs);
-
-	return false;
+	// Functions using too many registers for asmjit get some of them spilled to the VM frame by the jit compiler.
+	return !func->blockJit;
 }
 
 void VMScriptFunction::JitCompile()
@@ -769,6 +826,28 @@ ADD_STAT(VM)
 	return FStringf("VM time in last 10 tics: %f ms, %d calls, peak = %f ms", added, addedc, peak);
 }
 
+ADD_STAT(vmcallsites)
+{
+	uint64_t hits = 0, misses = 0;
+	int sites[3] = {};
+	for (auto func : VMFunction::AllFunctions)
+	{
+		if (func->VarFlags & VARF_Native) continue;
+		for (auto &site : static_cast<VMScriptFunction *>(func)->CallSites)
+		{
+			hits += site.Hits;
+			misses += site.Misses;
+			if (site.Megamorphic) sites[2]++;
+			else if (site.Classes[1] != nullptr) sites[1]++;
+			else if (site.Classes[0] != nullptr) sites[0]++;
+		}
+	}
+	double rate = hits + misses > 0 ? hits * 100. / (hits + misses) : 0;
+	return FStringf("Virtual call cache: %.2f%% hits (%llu calls), sites: %d monomorphic, %d polymorphic, %d megamorphic\n"
+		"JIT: %d guarded direct calls, %d inlined calls",
+		rate, (unsigned long long)(hits + misses), sites[0], sites[1], sites[2], JitDirectCalls, JitInlinedCalls);
+}
+
 //-----------------------------------------------------------------------------
 //
 //
@@ -348,6 +348,37 @@ struct FStatementInfo
 	uint16_t LineNumber;
 };
 
+// Inline cache for the virtual call at one VTBL instruction. The baseline
+// jit code looks its targets up here, and the optimizing jit tier turns the
+// classes recorded here into guarded direct calls. The interpreter keeps
+// loading from the vtable directly, which is cheaper than any lookup.
+struct VMCallSite
+{
+	enum { MaxClasses = 4 };
+
+	PClass *Classes[MaxClasses];
+	VMFunction *Targets[MaxClasses];
+	unsigned Hits;
+	unsigned Misses;
+	int Pos;				// index of the VTBL instruction
+	bool Megamorphic;		// has seen more classes than fit
+
+	VMFunction *Lookup(PClass *cls, int index)
+	{
+		for (int i = 0; i < MaxClasses && Classes[i] != nullptr; i++)
+		{
+			if (Classes[i] == cls)
+			{
+				Hits++;
+				return Targets[i];
+			}
+		}
+		return Miss(cls, index);
+	}
+
+	VMFunction *Miss(PClass *cls, int index);
+};
+
 class VMFrameStack
 {
 public:
@@ -475,6 +506,12 @@ public:
 	TArray<FTypeAndOffset> SpecialInits;	// list of all contents on the extra stack which require construction and destruction
 
 	bool blockJit = false; // function triggers Jit bugs, block compilation until bugs are fixed
+	int JitCalls = 0; // calls of the baseline native code, to find the functions worth optimizing
+	bool JitOptimized = false; // has been recompiled by the optimizing jit tier
+
+	TArray<VMCallSite> CallSites;	// one per VTBL instruction, created on first use
+	bool CallSitesCreated = false;
+	VMCallSite *GetCallSite(const VMOP *pc);
 
 	void InitExtra(void *addr);
 	void DestroyExtra(void *addr);
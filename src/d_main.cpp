@@ -60,6 +60,7 @@
 #include "i_sound.h"
 #include "i_video.h"
 #include "g_game.h"
+#include "g_benchmark.h"
 #include "hu_stuff.h"
 #include "wi_stuff.h"
 #include "st_stuff.h"
@@ -278,6 +279,8 @@ CUSTOM_CVAR (Int, fraglimit, 0, CVAR_SERVERINFO)
 CVAR (Float, timelimit, 0.f, CVAR_SERVERINFO);
 CVAR (Int, wipetype, 1, CVAR_ARCHIVE);
 CVAR (Int, snd_drawoutput, 0, 0);
+CVAR (Bool, fs_lumpcache, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);	// keep decompressed lumps on disk between runs
+CVAR (Int, fs_lumpcachesize, 256, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);		// in MB
 CUSTOM_CVAR (String, vid_cursor, "None", CVAR_ARCHIVE | CVAR_NOINITCALL)
 {
 	bool res = false;
@@ -3208,6 +3211,11 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 
 	bool allowduplicates = Args->CheckParm("-allowduplicates");
 	auto hashfile = D_GetHashFile();
+	if (fs_lumpcache)
+	{
+		FString cachefile = M_GetCachePath(true) + "/lumpcache.bin";
+		FileSys::OpenLumpCache(cachefile.GetChars(), size_t(max(0, *fs_lumpcachesize)) << 20);
+	}
 	if (!fileSystem.InitMultipleFiles(allwads, &lfi, FileSystemPrintf, allowduplicates, hashfile))
 	{
 		I_FatalError("FileSystem: no files found");
@@ -3224,7 +3232,7 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 
 	int max_progress = TexMan.GuesstimateNumTextures();
 	int per_shader_progress = 0;//screen->GetShaderCount()? (max_progress / 10 / screen->GetShaderCount()) : 0;
-	bool nostartscreen = batchrun || restart || Args->CheckParm("-join") || Args->CheckParm("-host") || Args->CheckParm("-norun");
+	bool nostartscreen = batchrun || restart || G_Benchmarking() || Args->CheckParm("-join") || Args->CheckParm("-host") || Args->CheckParm("-norun");
 
 	if (GameStartupInfo.Type == FStartupInfo::DefaultStartup)
 	{
@@ -3251,7 +3259,8 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 		exec = NULL;
 	}
 
-	if (!restart)
+	// The benchmark keeps the dummy framebuffer so that it can run without a window.
+	if (!restart && !G_Benchmarking())
 		V_Init2();
 
 	// [RH] Initialize localizable strings. 
@@ -3557,6 +3566,7 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 		else
 		{
 			v = Args->CheckValue("-timedemo");
+			if (v == nullptr) v = G_BenchmarkDemo();
 			if (v)
 			{
 				G_TimeDemo(v);
@@ -3565,7 +3575,7 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 			{
 				if (gameaction != ga_loadgame && gameaction != ga_loadgamehidecon)
 				{
-					if (autostart || netgame)
+					if (autostart || netgame || G_Benchmarking())
 					{
 						// Do not do any screenwipes when autostarting a game.
 						if (!Args->CheckParm("-warpwipe"))
@@ -3677,6 +3687,9 @@ static int D_DoomMain_Internal (void)
 	std::set_new_handler(NewFailure);
 	const char *batchout = Args->CheckValue("-errorlog");
 
+	// Resource files get memory mapped instead of read unless this is given.
+	FileSys::SetFileMapping(!Args->CheckParm("-nofilemapping"));
+
 	D_DoomInit();
 	
 	// [RH] Make sure zdoom.pk3 is always loaded,
@@ -3711,6 +3724,8 @@ static int D_DoomMain_Internal (void)
 		Printf("\n");
 	}
 
+	G_InitBenchmark();
+
 	Printf("%s version %s\n", GAMENAME, GetVersionString());
 
 	extern void D_ConfirmSendStats();
@@ -3775,6 +3790,7 @@ static int D_DoomMain_Internal (void)
 
 		D_DoAnonStats();
 		I_UpdateWindowTitle();
+		FileSys::WriteLumpCache();	// everything needed for startup has been read by now.
 		D_DoomLoop ();		// this only returns if a 'restart' CCMD is given.
 		// 
 		// Clean up after a restart
@@ -4031,6 +4047,20 @@ CCMD(fs_dir)
 	}
 }
 
+//==========================================================================
+//
+// CCMD fs_lookupbench [passes]
+//
+// Measures lump lookup throughput of the file system's hash index.
+//
+//==========================================================================
+
+CCMD(fs_lookupbench)
+{
+	int passes = argv.argc() > 1 ? (int)strtol(argv[1], nullptr, 10) : 10;
+	fileSystem.BenchmarkLookups(passes, FileSystemPrintf);
+}
+
 CCMD(type)
 {
 	if (argv.argc() < 2) return;
@@ -0,0 +1,461 @@
+/*
+** g_benchmark.cpp
+** Headless, deterministic playsim benchmark
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** The benchmark runs the playsim with singletics, no drawers and no sound,
+** and samples the same cycle counters the 'stat think', 'stat sight',
+** 'stat VM' and 'stat gc' displays are based on after every tic.
+** At the end a JSON report is written that can be compared between builds.
+**
+*/
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "g_benchmark.h"
+#include "doomstat.h"
+#include "g_levellocals.h"
+#include "m_argv.h"
+#include "files.h"
+#include "i_time.h"
+#include "stats.h"
+#include "dobjgc.h"
+#include "printf.h"
+#include "version.h"
+#include "engineerrors.h"
+
+extern int ThinkCount;
+extern cycle_t ThinkCycles;
+extern cycle_t ActionCycles;
+extern int SightChecks;
+extern cycle_t SightCycles;
+extern cycle_t VMCycles[10];
+extern int VMCalls[10];
+
+// One sample per tic. All times are in milliseconds.
+struct FBenchmarkTic
+{
+	double Frame;		// wall time since the previous tic ended
+	double Playsim;		// time spent in the game ticker
+	double Think;
+	double Action;
+	double VM;
+	double GC;
+	double Sight;
+	int Thinkers;
+	int SightChecks;
+	int VMCalls;
+	int Map;			// index into BenchMaps, -1 if no level was ticking
+};
+
+struct FBenchmarkResult
+{
+	FString Name;
+	double Value;
+};
+
+static bool Benchmarking;
+static FString BenchDemo;
+static FString BenchOut;
+static int BenchTicLimit;
+
+static TArray<FBenchmarkTic> BenchTics;
+static TArray<FString> BenchMaps;
+static TArray<FBenchmarkResult> BenchResults;
+
+static uint64_t BenchStartTime;
+static uint64_t LastTicEnd;
+static uint64_t TicStart;
+static double LastVMTime;
+static int LastVMCalls;
+static double LastGCTime;
+static double StartupRSS;
+
+//==========================================================================
+//
+// Resident set size of the process in MB, current and peak.
+//
+//==========================================================================
+
+static void GetProcessRSS(double &current, double &peak)
+{
+	current = peak = 0;
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		current = pmc.WorkingSetSize / 1048576.;
+		peak = pmc.PeakWorkingSetSize / 1048576.;
+	}
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+	{
+		current = info.resident_size / 1048576.;
+	}
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		peak = usage.ru_maxrss / 1048576.;	// bytes on macOS
+	}
+#else
+	if (FILE *f = fopen("/proc/self/statm", "r"))
+	{
+		long pages, resident;
+		if (fscanf(f, "%ld %ld", &pages, &resident) == 2)
+		{
+			current = resident * (double)sysconf(_SC_PAGESIZE) / 1048576.;
+		}
+		fclose(f);
+	}
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		peak = usage.ru_maxrss / 1024.;	// KB elsewhere
+	}
+#endif
+}
+
+//==========================================================================
+//
+// G_InitBenchmark
+//
+// Must be called before the sound and video systems get initialized.
+//
+//==========================================================================
+
+void G_InitBenchmark()
+{
+	if (!Args->CheckParm("-benchmark"))
+	{
+		return;
+	}
+	Benchmarking = true;
+
+	const char *v = Args->CheckValue("-benchmark");
+	if (v != nullptr)
+	{
+		BenchDemo = v;
+	}
+	v = Args->CheckValue("-benchtics");
+	BenchTicLimit = v != nullptr ? (int)strtol(v, nullptr, 10) : BenchDemo.IsEmpty() ? 60 * TICRATE : 0;
+	v = Args->CheckValue("-benchout");
+	BenchOut = v != nullptr ? v : "benchmark.json";
+
+	// No output device of any kind, and never wait for real time to pass.
+	if (!Args->CheckParm("-nosound"))
+	{
+		Args->AppendArg("-nosound");
+	}
+	// Without a demo there's no stored seed, so make the random number generators reproducible.
+	if (BenchDemo.IsEmpty() && !Args->CheckParm("-rngseed"))
+	{
+		Args->AppendArg("-rngseed");
+		Args->AppendArg("0");
+	}
+	nodrawers = true;
+	noblit = true;
+	singletics = true;
+}
+
+bool G_Benchmarking()
+{
+	return Benchmarking;
+}
+
+const char *G_BenchmarkDemo()
+{
+	return BenchDemo.IsNotEmpty() ? BenchDemo.GetChars() : nullptr;
+}
+
+void G_AddBenchmarkResult(const char *name, double value)
+{
+	if (Benchmarking)
+	{
+		BenchResults.Push({ name, value });
+	}
+}
+
+//==========================================================================
+//
+// G_BenchmarkStartTic / G_BenchmarkEndTic
+//
+// Wrapped around the game ticker by G_Ticker.
+//
+//==========================================================================
+
+void G_BenchmarkStartTic()
+{
+	if (!Benchmarking) return;
+
+	TicStart = I_nsTime();
+	if (BenchTics.Size() == 0)
+	{
+		BenchStartTime = LastTicEnd = TicStart;
+		LastVMTime = VMCycles[0].TimeMS();
+		LastVMCalls = VMCalls[0];
+		LastGCTime = GC::TotalTime;
+
+		// Everything has been loaded by the time the first tic runs.
+		double peak;
+		GetProcessRSS(StartupRSS, peak);
+	}
+}
+
+void G_BenchmarkEndTic(bool playsim)
+{
+	if (!Benchmarking) return;
+
+	uint64_t now = I_nsTime();
+	FBenchmarkTic &tic = BenchTics[BenchTics.Reserve(1)];
+
+	tic.Frame = (now - LastTicEnd) * 1e-6;
+	tic.Playsim = (now - TicStart) * 1e-6;
+	LastTicEnd = now;
+
+	// The VM counters only get rotated when 'stat VM' is shown, which cannot happen here, but be safe anyway.
+	double vmtime = VMCycles[0].TimeMS();
+	tic.VM = vmtime >= LastVMTime ? vmtime - LastVMTime : vmtime;
+	tic.VMCalls = VMCalls[0] >= LastVMCalls ? VMCalls[0] - LastVMCalls : VMCalls[0];
+	LastVMTime = vmtime;
+	LastVMCalls = VMCalls[0];
+
+	// GC steps run after the ticker so this is the collection time since the last tic.
+	tic.GC = (GC::TotalTime - LastGCTime) * 1e3;
+	LastGCTime = GC::TotalTime;
+
+	if (playsim)
+	{
+		// These counters get reset at the start of each P_Ticker call.
+		tic.Think = ThinkCycles.TimeMS();
+		tic.Action = ActionCycles.TimeMS();
+		tic.Sight = SightCycles.TimeMS();
+		tic.Thinkers = ThinkCount;
+		tic.SightChecks = SightChecks;
+
+		FString mapname = primaryLevel->MapName;
+		if (BenchMaps.Size() == 0 || BenchMaps.Last().CompareNoCase(mapname) != 0)
+		{
+			BenchMaps.Push(mapname);
+		}
+		tic.Map = BenchMaps.Size() - 1;
+	}
+	else
+	{
+		tic.Think = tic.Action = tic.Sight = 0;
+		tic.Thinkers = tic.SightChecks = 0;
+		tic.Map = -1;
+	}
+
+	if (BenchTicLimit > 0 && (int)BenchTics.Size() >= BenchTicLimit)
+	{
+		G_FinishBenchmark();
+	}
+}
+
+//==========================================================================
+//
+// Report writing
+//
+//==========================================================================
+
+static void WriteString(FileWriter *fw, const char *str)
+{
+	fw->Printf("\"");
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\') fw->Printf("\\%c", *str);
+		else if ((uint8_t)*str >= 32) fw->Printf("%c", *str);
+	}
+	fw->Printf("\"");
+}
+
+static void WriteDistribution(FileWriter *fw, const char *name, TArray<double> &values, bool last)
+{
+	double sum = 0, mean = 0;
+	for (auto v : values) sum += v;
+	if (values.Size() > 0) mean = sum / values.Size();
+
+	std::sort(values.begin(), values.end());
+	auto pct = [&](double p) -> double
+	{
+		if (values.Size() == 0) return 0;
+		unsigned index = (unsigned)(p * (values.Size() - 1) + 0.5);
+		return values[index];
+	};
+
+	fw->Printf("\t\t\t\"%s\": { \"total\": %.4f, \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+		name, sum, mean, pct(0), pct(0.5), pct(0.9), pct(0.95), pct(0.99), pct(1), last ? "" : ",");
+}
+
+static void WriteSummary(FileWriter *fw, int map)
+{
+	static const struct { const char *name; double FBenchmarkTic::*field; } fields[] =
+	{
+		{ "frame", &FBenchmarkTic::Frame },
+		{ "playsim", &FBenchmarkTic::Playsim },
+		{ "think", &FBenchmarkTic::Think },
+		{ "action", &FBenchmarkTic::Action },
+		{ "vm", &FBenchmarkTic::VM },
+		{ "gc", &FBenchmarkTic::GC },
+		{ "sight", &FBenchmarkTic::Sight },
+	};
+
+	TArray<double> values;
+	int64_t sightchecks = 0, vmcalls = 0, thinkers = 0;
+	unsigned count = 0;
+
+	for (auto &tic : BenchTics)
+	{
+		if (map >= 0 && tic.Map != map) continue;
+		sightchecks += tic.SightChecks;
+		vmcalls += tic.VMCalls;
+		thinkers = std::max<int64_t>(thinkers, tic.Thinkers);
+		count++;
+	}
+	fw->Printf("\t\t\t\"tics\": %u,\n", count);
+	fw->Printf("\t\t\t\"sight_checks\": %lld,\n", (long long)sightchecks);
+	fw->Printf("\t\t\t\"vm_calls\": %lld,\n", (long long)vmcalls);
+	fw->Printf("\t\t\t\"max_thinkers\": %lld,\n", (long long)thinkers);
+
+	for (unsigned i = 0; i < countof(fields); i++)
+	{
+		values.Clear();
+		for (auto &tic : BenchTics)
+		{
+			if (map >= 0 && tic.Map != map) continue;
+			values.Push(tic.*fields[i].field);
+		}
+		WriteDistribution(fw, fields[i].name, values, i == countof(fields) - 1);
+	}
+}
+
+static bool WriteReport(const char *filename)
+{
+	FileWriter *fw = FileWriter::Open(filename);
+	if (fw == nullptr)
+	{
+		return false;
+	}
+
+	fw->Printf("{\n");
+	fw->Printf("\t\"engine\": ");
+	WriteString(fw, GetVersionString());
+	fw->Printf(",\n\t\"demo\": ");
+	if (BenchDemo.IsNotEmpty()) WriteString(fw, BenchDemo.GetChars());
+	else fw->Printf("null");
+	fw->Printf(",\n\t\"wall_ms\": %.4f,\n", BenchTics.Size() > 0 ? (LastTicEnd - BenchStartTime) * 1e-6 : 0.);
+
+	fw->Printf("\t\"summary\":\n\t{\n\t\t\"all\":\n\t\t{\n");
+	WriteSummary(fw, -1);
+	fw->Printf("\t\t}%s\n", BenchMaps.Size() > 0 ? "," : "");
+	for (unsigned i = 0; i < BenchMaps.Size(); i++)
+	{
+		fw->Printf("\t\t");
+		WriteString(fw, BenchMaps[i].GetChars());
+		fw->Printf(":\n\t\t{\n");
+		WriteSummary(fw, i);
+		fw->Printf("\t\t}%s\n", i == BenchMaps.Size() - 1 ? "" : ",");
+	}
+	fw->Printf("\t},\n");
+
+	fw->Printf("\t\"results\":\n\t{\n");
+	for (unsigned i = 0; i < BenchResults.Size(); i++)
+	{
+		fw->Printf("\t\t");
+		WriteString(fw, BenchResults[i].Name.GetChars());
+		fw->Printf(": %.4f%s\n", BenchResults[i].Value, i == BenchResults.Size() - 1 ? "" : ",");
+	}
+	fw->Printf("\t},\n");
+
+	fw->Printf("\t\"tic_fields\": [ \"map\", \"frame\", \"playsim\", \"think\", \"action\", \"vm\", \"gc\", \"sight\", \"thinkers\", \"sight_checks\", \"vm_calls\" ],\n");
+	fw->Printf("\t\"tics\":\n\t[\n");
+	for (unsigned i = 0; i < BenchTics.Size(); i++)
+	{
+		auto &tic = BenchTics[i];
+		fw->Printf("\t\t[ %d, %.4f, %.4f, %.4f, %.4f, %.4f, %.4f, %.4f, %d, %d, %d ]%s\n",
+			tic.Map, tic.Frame, tic.Playsim, tic.Think, tic.Action, tic.VM, tic.GC, tic.Sight,
+			tic.Thinkers, tic.SightChecks, tic.VMCalls, i == BenchTics.Size() - 1 ? "" : ",");
+	}
+	fw->Printf("\t]\n}\n");
+	delete fw;
+	return true;
+}
+
+//==========================================================================
+//
+// G_FinishBenchmark
+//
+// Writes the report and exits. Like a timedemo, this does not even try
+// to get back to a playable state.
+//
+//==========================================================================
+
+void G_FinishBenchmark()
+{
+	double current, peak;
+	GetProcessRSS(current, peak);
+	G_AddBenchmarkResult("startup_rss_mb", StartupRSS);
+	G_AddBenchmarkResult("final_rss_mb", current);
+	G_AddBenchmarkResult("peak_rss_mb", peak);
+	G_AddBenchmarkResult("file_mapping", !Args->CheckParm("-nofilemapping"));
+
+	size_t slabbytes, livebytes, unpooledbytes;
+	GC::GetPoolStats(slabbytes, livebytes, unpooledbytes);
+	G_AddBenchmarkResult("object_pools", !Args->CheckParm("-noobjectpools"));
+	G_AddBenchmarkResult("object_allocs", (double)GC::ObjectAllocs);
+	G_AddBenchmarkResult("object_frees", (double)GC::ObjectFrees);
+	G_AddBenchmarkResult("object_pool_mb", slabbytes / 1048576.);
+	G_AddBenchmarkResult("object_live_mb", (livebytes + unpooledbytes) / 1048576.);
+
+	// The part of AActor the tick loop works on, so layout changes show up next to the think times.
+	G_AddBenchmarkResult("actor_bytes", (double)sizeof(AActor));
+	G_AddBenchmarkResult("actor_hot_bytes", (double)(myoffsetof(AActor, validcount) + sizeof(int)));
+
+	Benchmarking = false;
+	if (!WriteReport(BenchOut.GetChars()))
+	{
+		I_FatalError("Unable to write benchmark report to %s\n", BenchOut.GetChars());
+	}
+	Printf("Benchmark: %u tics written to %s\n", BenchTics.Size(), BenchOut.GetChars());
+	throw CExitEvent(0);
+}
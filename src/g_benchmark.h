@@ -0,0 +1,24 @@
+#ifndef __G_BENCHMARK_H
+#define __G_BENCHMARK_H
+
+// Headless benchmark mode.
+//
+// -benchmark [demo]	Plays the given demo, or runs the start map (-warp, +map)
+//						without any input, with no window and no sound device.
+// -benchtics <n>		Stops after <n> tics (default: end of demo, or 2100 tics
+//						when no demo is given).
+// -benchout <file>		Where to write the JSON report (default: benchmark.json).
+
+void G_InitBenchmark();
+bool G_Benchmarking();
+const char *G_BenchmarkDemo();
+
+void G_BenchmarkStartTic();
+void G_BenchmarkEndTic(bool playsim);
+[[noreturn]] void G_FinishBenchmark();
+
+// Adds a named value to the "results" section of the report. Subsystems
+// use this to attach their own measurements to a benchmark run.
+void G_AddBenchmarkResult(const char *name, double value);
+
+#endif
@@ -91,6 +91,8 @@
 #include "screenjob.h"
 #include "i_interface.h"
 #include "fs_findfile.h"
+#include "g_benchmark.h"
+#include "p_statehash.h"
 
 
 static FRandom pr_dmspawn ("DMSpawn");
@@ -1303,6 +1305,7 @@ void G_Ticker ()
 	C_RunDelayedCommands();
 
 	// do main actions
+	G_BenchmarkStartTic();
 	switch (gamestate)
 	{
 	case GS_LEVEL:
@@ -1338,6 +1341,7 @@ void G_Ticker ()
 	default:
 		break;
 	}
+	G_BenchmarkEndTic(gamestate == GS_LEVEL || gamestate == GS_TITLELEVEL);
 
 	// [MK] Additional ticker for UI events right after all others
 	primaryLevel->localEventManager->PostUiTick();
@@ -2672,6 +2676,8 @@ void G_BeginRecording (const char *startmap)
 	// Begin BODY chunk
 	StartChunk (BODY_ID, &demo_p);
 	demobodyspot = demo_p;
+
+	P_StartStateHashRecording();
 }
 
 
@@ -2817,6 +2823,7 @@ bool G_ProcessIFFDemo (FString &mapname)
 		case BODY_ID:
 			bodyHit = true;
 			zdembodyend = demo_p + len;
+			P_ReadStateHashChunk(nextchunk, int(zdemformend - nextchunk));
 			break;
 
 		case COMP_ID:
@@ -2956,8 +2963,8 @@ void G_DoPlayDemo (void)
 //
 void G_TimeDemo (const char* name)
 {
-	nodrawers = !!Args->CheckParm ("-nodraw");
-	noblit = !!Args->CheckParm ("-noblit");
+	nodrawers = G_Benchmarking() || !!Args->CheckParm ("-nodraw");
+	noblit = G_Benchmarking() || !!Args->CheckParm ("-noblit");
 	timingdemo = true;
 	singletics = true;
 
@@ -2994,6 +3001,7 @@ bool G_CheckDemoStatus (void)
 		C_RestoreCVars ();		// [RH] Restore cvars demo might have changed
 		M_Free (demobuffer);
 		demobuffer = NULL;
+		P_ClearStateHashes();
 
 		P_SetupWeapons_ntohton();
 		demoplayback = false;
@@ -3010,7 +3018,11 @@ bool G_CheckDemoStatus (void)
 		}
 		if (singledemo || timingdemo)
 		{
-			if (timingdemo)
+			if (G_Benchmarking())
+			{
+				G_FinishBenchmark();
+			}
+			else if (timingdemo)
 			{
 				// Trying to get back to a stable state after timing a demo
 				// seems to cause problems. I don't feel like fixing that
@@ -3060,6 +3072,18 @@ bool G_CheckDemoStatus (void)
 			}
 		}
 		FinishChunk (&demo_p);
+
+		// The state hashes go after the BODY, where older versions do not look.
+		size_t hashsize = P_StateHashChunkSize();
+		if (demo_p + hashsize > demobuffer + maxdemosize)
+		{
+			ptrdiff_t pos = demo_p - demobuffer;
+			maxdemosize = pos + hashsize;
+			demobuffer = (uint8_t *)M_Realloc (demobuffer, maxdemosize);
+			demo_p = demobuffer + pos;
+		}
+		P_WriteStateHashChunk (&demo_p);
+
 		formlen = demobuffer + 4;
 		WriteInt32 (int(demo_p - demobuffer - 8), &formlen);
 
@@ -2218,9 +2218,7 @@ size_t DSectorMarker::PropagateMark()
 	// If there are more items to mark, put ourself back into the gray list.
 	if (moretodo)
 	{
-		Black2Gray();
-		GCNext = GC::Gray;
-		GC::Gray = this;
+		GC::Regray(this);
 	}
 	return marked;
 }
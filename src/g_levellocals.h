@@ -424,11 +424,12 @@ public:
 
 	DThinker *CreateThinker(PClass *cls, int statnum = STAT_DEFAULT)
 	{
-		DThinker *thinker = static_cast<DThinker*>(cls->CreateNew());
+		if (cls->IsDescendantOf(RUNTIME_CLASS(DVisualThinker))) // [MC] This absolutely must happen for this class!
+			statnum = STAT_VISUALTHINKER;
+		// Thinkers that get run together are allocated together.
+		DThinker *thinker = static_cast<DThinker*>(cls->CreateNew(statnum));
 		assert(thinker->IsKindOf(RUNTIME_CLASS(DThinker)));
 		thinker->ObjectFlags |= OF_JustSpawned;
-		if (thinker->IsKindOf(RUNTIME_CLASS(DVisualThinker))) // [MC] This absolutely must happen for this class!
-			statnum = STAT_VISUALTHINKER;
 		Thinkers.Link(thinker, statnum);
 		thinker->Level = this;
 		return thinker;
@@ -672,7 +673,8 @@ public:
 	uint32_t			ActiveParticles;
 	uint32_t			InactiveParticles;
 	TArray<particle_t>	Particles;
-	TArray<uint16_t>	ParticlesInSubsec;
+	TArray<uint32_t>	ParticlesInSubsec;
+	TArray<uint32_t>	ParticleSubsecNext;	// per particle: next particle in the same subsector
 	FThinkerCollection Thinkers;
 
 	TArray<DVector2>	Scrolls;		// NULL if no DScrollers in this level
@@ -22,6 +22,16 @@ struct FBlockNode
 	static FBlockNode *FreeBlocks;
 };
 
+// Entry in the optional dense per-block actor index. Entries are stored
+// oldest first so that iterating backwards yields the same order as the
+// FBlockNode chain, which links new actors in at the front.
+struct FBlockEntry
+{
+	AActor *Me;						// nullptr if unlinked while an iterator was active
+	FBlockNode *Node;				// the chain node this entry mirrors
+	bool Single;					// actor is linked into this block only
+};
+
 // BLOCKMAP
 // Created from axis aligned bounding box
 // of the map, a rectangular array of
@@ -40,6 +50,7 @@ struct FBlockmap
 	double				bmaporgx;
 	double				bmaporgy;		// origin of block map
 	FBlockNode**		blocklinks; 	// for thing chains
+	TArray<FBlockEntry>* blockactors = nullptr;	// dense copy of blocklinks, if enabled at map load
 
 	// mapblocks are used to check movement
 	// against lines and things
@@ -72,6 +83,10 @@ struct FBlockmap
 
 	bool VerifyBlockMap(int count, unsigned numlines);
 
+	void AddToBlock(FBlockNode *node);
+	void RemoveFromBlock(FBlockNode *node);
+	void RebuildBlock(int index);
+
 	void Clear()
 	{
 		if (blockmaplump != nullptr)
@@ -84,6 +99,11 @@ struct FBlockmap
 			delete[] blocklinks;
 			blocklinks = nullptr;
 		}
+		if (blockactors != nullptr)
+		{
+			delete[] blockactors;
+			blockactors = nullptr;
+		}
 	}
 
 	~FBlockmap()
@@ -93,6 +93,7 @@ enum
 
 CVAR (Bool, genblockmap, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
 CVAR (Bool, gennodes, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
+CVAR (Bool, blockmap_arrays, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);	// takes effect at the next map load
 
 inline bool P_LoadBuildMap(uint8_t *mapdata, size_t len, FMapThing **things, int *numthings)
 {
@@ -2641,6 +2642,10 @@ void MapLoader::LoadBlockMap (MapData * map)
 	count = Level->blockmap.bmapwidth*Level->blockmap.bmapheight;
 	Level->blockmap.blocklinks = new FBlockNode *[count];
 	memset (Level->blockmap.blocklinks, 0, count*sizeof(*Level->blockmap.blocklinks));
+	if (blockmap_arrays)
+	{
+		Level->blockmap.blockactors = new TArray<FBlockEntry>[count];
+	}
 	Level->blockmap.blockmap = Level->blockmap.blockmaplump+4;
 }
 
@@ -3242,7 +3247,8 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 
 	InitRenderInfo();				// create hardware independent renderer resources for the level. This must be done BEFORE the PolyObj Spawn!!!
 	Level->ClearDynamic3DFloorData();	// CreateVBO must be run on the plain 3D floor data.
-	CreateVBO(screen->mVertexData, Level->sectors);
+	if (screen->mVertexData != nullptr)	// not present with the headless benchmark's dummy framebuffer.
+		CreateVBO(screen->mVertexData, Level->sectors);
 
 	screen->InitLightmap(Level->LMTextureSize, Level->LMTextureCount, Level->LMTextureData);
 
@@ -39,6 +39,7 @@
 #include "actorinlines.h"
 #include "g_game.h"
 #include "i_interface.h"
+#include "p_statehash.h"
 
 extern gamestate_t wipegamestate;
 extern uint8_t globalfreeze, globalchangefreeze;
@@ -183,6 +184,7 @@ void P_Ticker (void)
 		Level->maptime++;
 		Level->totaltime++;
 	}
+	P_StateHashTic();
 	if (players[consoleplayer].mo != NULL) {
 		if (players[consoleplayer].mo->Vel.Length() > primaryLevel->max_velocity) { primaryLevel->max_velocity = players[consoleplayer].mo->Vel.Length(); }
 		primaryLevel->avg_velocity += (players[consoleplayer].mo->Vel.Length() - primaryLevel->avg_velocity) / primaryLevel->maptime;
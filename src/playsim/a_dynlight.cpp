@@ -64,9 +64,15 @@
 #include "a_dynlight.h"
 #include "actorinlines.h"
 #include "memarena.h"
+#include "parallel_for.h"
+#include "hw_clock.h"
 
 static FMemArena DynLightArena(sizeof(FDynamicLight) * 200);
 static TArray<FDynamicLight*> FreeList;
+static FMemArena LightNodeArena(sizeof(FLightNode) * 1024);
+static FLightNode *FreeLightNodes;
+static TArray<FDynamicLight*> PendingLinks;
+static bool DeferLinking;
 static FRandom randLight;
 
 extern TArray<FLightDefaults *> StateLights;
@@ -209,6 +215,12 @@ void FDynamicLight::ReleaseLight()
 	else Level->lights = next;
 	if (next != nullptr) next->prev = prev;
 	next = prev = nullptr;
+	if (linkpending)
+	{
+		auto index = PendingLinks.Find(this);
+		if (index < PendingLinks.Size()) PendingLinks.Delete(index);
+		linkpending = false;
+	}
 	FreeList.Push(this);
 }
 
@@ -412,6 +424,29 @@ void FDynamicLight::UpdateLocation()
 	}
 }
 
+//=============================================================================
+//
+// Light nodes come and go all the time with moving lights, so they are
+// recycled through a free list instead of going through the heap.
+//
+//=============================================================================
+
+static FLightNode *NewLightNode()
+{
+	FLightNode *node = FreeLightNodes;
+	if (node != nullptr) FreeLightNodes = node->nextTarget;
+	else node = (FLightNode *)LightNodeArena.Alloc(sizeof(FLightNode));
+	dlight_nodes++;
+	return node;
+}
+
+static void FreeLightNode(FLightNode *node)
+{
+	node->nextTarget = FreeLightNodes;
+	FreeLightNodes = node;
+	dlight_nodes--;
+}
+
 //=============================================================================
 //
 // These have been copied from the secnode code and modified for the light links
@@ -441,7 +476,7 @@ FLightNode * AddLightNode(FLightNode ** thread, void * linkto, FDynamicLight * l
 	// Couldn't find an existing node for this sector. Add one at the head
 	// of the list.
 	
-	node = new FLightNode;
+	node = NewLightNode();
 	
 	node->targ = linkto;
 	node->lightsource = light; 
@@ -484,7 +519,7 @@ static FLightNode * DeleteLightNode(FLightNode * node)
 		
 		// Return this node to the freelist
 		tn=node->nextTarget;
-		delete node;
+		FreeLightNode(node);
 		return(tn);
 	}
 	return(nullptr);
@@ -522,23 +557,76 @@ double FDynamicLight::DistToSeg(const DVector3 &pos, vertex_t *start, vertex_t *
 
 //==========================================================================
 //
-// Collect all touched sidedefs and subsectors
-// to sidedefs and sector parts.
+// Finding what a light touches only reads the level. The marks that keep
+// sections and lines from being processed twice are therefore kept by
+// the collector and not in the map data, so that several lights can be
+// collected at the same time.
+//
+// Sections get marked in two different ways, each using its own value,
+// just like the validcount and dl_validcount marks this replaces.
 //
 //==========================================================================
+
 struct LightLinkEntry
 {
 	FSection *sect;
 	DVector3 pos;
 };
-static TArray<LightLinkEntry> collected_ss;
 
-void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section, float radius)
+struct FLightCollector
+{
+	TArray<int> sectionMarks;
+	TArray<int> lineMarks;
+	TArray<LightLinkEntry> collected_ss;
+	int mark = 0;
+
+	void Start(FLevelLocals *Level)
+	{
+		unsigned numsections = Level->sections.allSections.Size();
+		unsigned numlines = Level->lines.Size();
+		if (sectionMarks.Size() < numsections || lineMarks.Size() < numlines || mark >= INT_MAX / 2 - 1)
+		{
+			sectionMarks.Resize(max(sectionMarks.Size(), numsections));
+			lineMarks.Resize(max(lineMarks.Size(), numlines));
+			memset(sectionMarks.Data(), 0, sectionMarks.Size() * sizeof(int));
+			memset(lineMarks.Data(), 0, lineMarks.Size() * sizeof(int));
+			mark = 0;
+		}
+		mark++;
+	}
+
+	int SectionMark() const { return mark * 2; }
+	int PortalMark() const { return mark * 2 + 1; }
+};
+
+struct FLightLinkResult
+{
+	TArray<FSection *> sections;
+	TArray<side_t *> sides;
+	bool collected;
+	bool shadowmapped;
+};
+
+//==========================================================================
+//
+// Collect all touched sidedefs and subsectors
+// to sidedefs and sector parts.
+//
+//==========================================================================
+
+void FDynamicLight::CollectWithinRadius(FLightCollector &collector, FLightLinkResult &result, const DVector3 &opos, FSection *section, float radius)
 {
 	if (!section) return;
+	auto &collected_ss = collector.collected_ss;
+	auto &sectionMarks = collector.sectionMarks;
+	auto &lineMarks = collector.lineMarks;
+	const int sectionmark = collector.SectionMark();
+	const int portalmark = collector.PortalMark();
+	const int linemark = collector.mark;
+
 	collected_ss.Clear();
 	collected_ss.Push({ section, opos });
-	section->validcount = dl_validcount;
+	sectionMarks[Level->sections.SectionIndex(section)] = sectionmark;
 
 	bool hitonesidedback = false;
 	for (unsigned i = 0; i < collected_ss.Size(); i++)
@@ -546,19 +634,19 @@ void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section,
 		auto pos = collected_ss[i].pos;
 		section = collected_ss[i].sect;
 
-		touching_sector = AddLightNode(&section->lighthead, section, this, touching_sector);
+		result.sections.Push(section);
 
 
 		auto processSide = [&](side_t *sidedef, const vertex_t *v1, const vertex_t *v2)
 		{
 			auto linedef = sidedef->linedef;
-			if (linedef && linedef->validcount != ::validcount)
+			if (linedef && lineMarks[linedef->Index()] != linemark)
 			{
 				// light is in front of the seg
 				if ((pos.Y - v1->fY()) * (v2->fX() - v1->fX()) + (v1->fX() - pos.X) * (v2->fY() - v1->fY()) <= 0)
 				{
-					linedef->validcount = ::validcount;
-					touching_sides = AddLightNode(&sidedef->lighthead, sidedef, this, touching_sides);
+					lineMarks[linedef->Index()] = linemark;
+					result.sides.Push(sidedef);
 				}
 				else if (linedef->sidedef[0] == sidedef && linedef->sidedef[1] == nullptr)
 				{
@@ -571,13 +659,14 @@ void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section,
 				if (port && port->mType == PORTT_LINKED)
 				{
 					line_t *other = port->mDestination;
-					if (other->validcount != ::validcount)
+					if (lineMarks[other->Index()] != linemark)
 					{
 						subsector_t *othersub = Level->PointInRenderSubsector(other->v1->fPos() + other->Delta() / 2);
 						FSection *othersect = othersub->section;
-						if (othersect->validcount != ::validcount)
+						int &othermark = sectionMarks[Level->sections.SectionIndex(othersect)];
+						if (othermark != portalmark)
 						{
-							othersect->validcount = ::validcount;
+							othermark = portalmark;
 							collected_ss.Push({ othersect, PosRelative(other->frontsector->PortalGroup) });
 						}
 					}
@@ -601,9 +690,9 @@ void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section,
 				if (partner)
 				{
 					FSection *sect = partner->section;
-					if (sect != nullptr && sect->validcount != dl_validcount)
+					if (sect != nullptr && sectionMarks[Level->sections.SectionIndex(sect)] != sectionmark)
 					{
-						sect->validcount = dl_validcount;
+						sectionMarks[Level->sections.SectionIndex(sect)] = sectionmark;
 						collected_ss.Push({ sect, pos });
 					}
 				}
@@ -626,9 +715,10 @@ void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section,
 				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::ceiling);
 				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
 				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
+				int &othermark = sectionMarks[Level->sections.SectionIndex(othersect)];
+				if (othermark != sectionmark)
 				{
-					othersect->validcount = dl_validcount;
+					othermark = sectionmark;
 					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
 				}
 			}
@@ -641,24 +731,48 @@ void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section,
 				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::floor);
 				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
 				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
+				int &othermark = sectionMarks[Level->sections.SectionIndex(othersect)];
+				if (othermark != sectionmark)
 				{
-					othersect->validcount = dl_validcount;
+					othermark = sectionmark;
 					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
 				}
 			}
 		}
 	}
-	shadowmapped = hitonesidedback && !DontShadowmap();
+	result.collected = true;
+	result.shadowmapped = hitonesidedback && !DontShadowmap();
 }
 
 //==========================================================================
 //
-// Link the light into the world
+// Finds everything the light touches at its current position
 //
 //==========================================================================
 
-void FDynamicLight::LinkLight()
+void FDynamicLight::CollectLinks(FLightCollector &collector, FLightLinkResult &result)
+{
+	result.sections.Clear();
+	result.sides.Clear();
+	result.collected = false;
+
+	if (radius>0)
+	{
+		// passing in radius*radius allows us to do a distance check without any calls to sqrt
+		FSection *sect = Level->PointInRenderSubsector(Pos)->section;
+
+		collector.Start(Level);
+		CollectWithinRadius(collector, result, Pos, sect, float(radius*radius));
+	}
+}
+
+//==========================================================================
+//
+// Replaces the light's links with the collected ones
+//
+//==========================================================================
+
+void FDynamicLight::ApplyLinks(const FLightLinkResult &result)
 {
 	// mark the old light nodes
 	FLightNode * node;
@@ -676,16 +790,15 @@ void FDynamicLight::LinkLight()
 		node = node->nextTarget;
 	}
 
-	if (radius>0)
+	for (auto section : result.sections)
 	{
-		// passing in radius*radius allows us to do a distance check without any calls to sqrt
-		FSection *sect = Level->PointInRenderSubsector(Pos)->section;
-
-		dl_validcount++;
-		::validcount++;
-		CollectWithinRadius(Pos, sect, float(radius*radius));
-
+		touching_sector = AddLightNode(&section->lighthead, section, this, touching_sector);
+	}
+	for (auto sidedef : result.sides)
+	{
+		touching_sides = AddLightNode(&sidedef->lighthead, sidedef, this, touching_sides);
 	}
+	if (result.collected) shadowmapped = result.shadowmapped;
 		
 	// Now delete any nodes that won't be used. These are the ones where
 	// m_thing is still nullptr.
@@ -713,6 +826,99 @@ void FDynamicLight::LinkLight()
 	}
 }
 
+//==========================================================================
+//
+// Link the light into the world
+//
+//==========================================================================
+
+void FDynamicLight::LinkLight()
+{
+	if (DeferLinking)
+	{
+		if (!linkpending)
+		{
+			linkpending = true;
+			PendingLinks.Push(this);
+		}
+		return;
+	}
+
+	static FLightCollector collector;
+	static FLightLinkResult result;
+	CollectLinks(collector, result);
+	ApplyLinks(result);
+}
+
+//==========================================================================
+//
+// Relinking many lights at once
+//
+// The collection runs in parallel over all lights that moved. Linking
+// the results in is done afterwards in the order the lights moved in,
+// which makes the light lists come out exactly as if each light had
+// been linked right away.
+//
+//==========================================================================
+
+CVAR(Bool, r_parallellightlinks, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+
+enum
+{
+	ParallelLinkMinLights = 32,
+	LinkChunk = 8,
+};
+
+void BeginLightLinking()
+{
+	DeferLinking = true;
+}
+
+void FinishLightLinking()
+{
+	static TArray<FLightLinkResult> results;
+	static thread_local FLightCollector collector;
+
+	DeferLinking = false;
+
+	const uint32_t count = PendingLinks.Size();
+	relinked_dlight = count;
+	LinkDLight.Reset();
+	if (count == 0) return;
+
+	LinkDLight.Clock();
+	// Never shrink this so that the result arrays keep their memory.
+	if (results.Size() < count) results.Resize(count);
+
+	if (r_parallellightlinks && count >= ParallelLinkMinLights)
+	{
+		const uint32_t numchunks = (count + LinkChunk - 1) / LinkChunk;
+		parallel_for(0u, numchunks, 1u, [&](uint32_t chunk)
+		{
+			uint32_t end = min<uint32_t>(count, (chunk + 1) * LinkChunk);
+			for (uint32_t i = chunk * LinkChunk; i < end; i++)
+			{
+				PendingLinks[i]->CollectLinks(collector, results[i]);
+			}
+		});
+	}
+	else
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			PendingLinks[i]->CollectLinks(collector, results[i]);
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		PendingLinks[i]->linkpending = false;
+		PendingLinks[i]->ApplyLinks(results[i]);
+	}
+	PendingLinks.Clear();
+	LinkDLight.Unclock();
+}
+
 
 //==========================================================================
 //
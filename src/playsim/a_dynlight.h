@@ -195,6 +195,9 @@ struct FLightNode
 	};
 };
 
+struct FLightCollector;
+struct FLightLinkResult;
+
 struct FDynamicLight
 {
 	friend class FLightDefaults;
@@ -249,9 +252,12 @@ struct FDynamicLight
 	void UnlinkLight();
 	void ReleaseLight();
 
+	void CollectLinks(FLightCollector &collector, FLightLinkResult &result);
+	void ApplyLinks(const FLightLinkResult &result);
+
 private:
 	double DistToSeg(const DVector3 &pos, vertex_t *start, vertex_t *end);
-	void CollectWithinRadius(const DVector3 &pos, FSection *section, float radius);
+	void CollectWithinRadius(FLightCollector &collector, FLightLinkResult &result, const DVector3 &pos, FSection *section, float radius);
 
 public:
 	FCycler m_cycler;
@@ -278,6 +284,10 @@ public:
 	int m_tickCount;
 	int m_lastUpdate;
 	int mShadowmapIndex;
+	int mRenderDataList;	// light buffer data prepared by the renderer for the current frame
+	int mRenderDataFrame;
+	float mRenderData[16];
+	int mLightIndex;		// position in the renderer's light index for the current viewpoint
 	bool m_active;
 	bool visibletoplayer;
 	bool shadowmapped;
@@ -285,7 +295,12 @@ public:
 	bool owned;
 	bool swapped;
 	bool explicitpitch;
+	bool linkpending;
 
 };
 
+// Lights that move while these are active get relinked together in FinishLightLinking.
+void BeginLightLinking();
+void FinishLightLinking();
+
 
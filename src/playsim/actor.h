@@ -1116,10 +1116,45 @@ public:
 	AActor			*snext, **sprev;	// links in sector (if needed)
 	DVector3		__Pos;		// double underscores so that it won't get used by accident. Access to this should be exclusively through the designated access functions.
 
+// Hot state. Everything the thinker loop, movement and blockmap searches
+// look at on every tic is kept together at the start of the object, so
+// ticking an actor only touches a few cache lines of it.
+	DVector3		Vel;
+	DVector3		Prev;				// [RH] Used to interpolate the view to get >35 FPS
+	DRotator		Angles;
+	double			radius, Height;		// for movement checking
+	double			floorz, ceilingz;	// closest together of contacted secs
+	double			dropoffz;		// killough 11/98: the lowest floor over all contacted Sectors.
+	double			Speed;
+	double			Gravity;		// [GRB] Gravity factor
+	double			Friction;
+	ActorFlags		flags;
+	ActorFlags2		flags2;			// Heretic flags
+	ActorFlags3		flags3;			// [RH] Hexen/Heretic actor-dependant behavior made flaggable
+	ActorFlags4		flags4;			// [RH] Even more flags!
+	ActorFlags5		flags5;			// OMG! We need another one.
+	ActorFlags6		flags6;			// Shit! Where did all the flags go?
+	ActorFlags7		flags7;			// WHO WANTS TO BET ON 8!?
+	ActorFlags8		flags8;			// I see your 8, and raise you a bet for 9.
+	ActorFlags9		flags9;			// Happy ninth actor flag field GZDoom !
+	int32_t			tics;				// state tic counter
+	FState			*state;
+	int 			health;
+	uint32_t		freezetics;	// actor has actions completely frozen (including movement) for this many tics, but they still get Tick() calls
+	TObjPtr<AActor*> target;			// thing being chased/attacked (or NULL)
+									// also the originator for missiles
+	struct sector_t	*Sector;
+	subsector_t *		subsector;
+	FSection *			section;
+	FBlockNode		*BlockNode;			// links in blocks (if needed)
+	uint32_t		BlockIterStamp;		// dedup generation for FBlockThingsIterator
+	int				validcount;
+
+// Everything below is only needed now and then.
+
 	DAngle			SpriteAngle;
 	DAngle			SpriteRotation;
 	DVector2		AutomapOffsets;		// Offset the actors' sprite view on the automap by these coordinates.
-	DRotator		Angles;
 	DRotator		ViewAngles;			// Angle offsets for cameras
 	TObjPtr<DViewPosition*> ViewPos;			// Position offsets for cameras
 	DVector2		Scale;				// Scaling values; 1 is normal size
@@ -1140,17 +1175,7 @@ public:
 	bool				NoLocalRender;		// DO NOT EXPORT THIS! This is a way to disable rendering such that the playsim cannot access it.
 	ActorRenderFlags	renderflags;		// Different rendering flags
 	ActorRenderFlags2	renderflags2;		// More rendering flags...
-	ActorFlags		flags;
-	ActorFlags2		flags2;			// Heretic flags
-	ActorFlags3		flags3;			// [RH] Hexen/Heretic actor-dependant behavior made flaggable
-	ActorFlags4		flags4;			// [RH] Even more flags!
-	ActorFlags5		flags5;			// OMG! We need another one.
-	ActorFlags6		flags6;			// Shit! Where did all the flags go?
-	ActorFlags7		flags7;			// WHO WANTS TO BET ON 8!?
-	ActorFlags8		flags8;			// I see your 8, and raise you a bet for 9.
-	ActorFlags9		flags9;			// Happy ninth actor flag field GZDoom !
 	double			Floorclip;		// value to use for floor clipping
-	double			radius, Height;		// for movement checking
 
 	FAngle			VisibleStartAngle;
 	FAngle			VisibleStartPitch;
@@ -1158,22 +1183,13 @@ public:
 	FAngle			VisibleEndPitch;
 
 	DVector3		OldRenderPos;
-	DVector3		Vel;
 	DVector2		SpriteOffset;
 	DVector3		WorldOffset;
-	double			Speed;
 	double			FloatSpeed;
 	TObjPtr<DActorModelData*>		modelData;
 	TObjPtr<DBoneComponents*>		boneComponentData;
 
 // interaction info
-	FBlockNode		*BlockNode;			// links in blocks (if needed)
-	struct sector_t	*Sector;
-	subsector_t *		subsector;
-	FSection *			section;
-	double			floorz, ceilingz;	// closest together of contacted secs
-	double			dropoffz;		// killough 11/98: the lowest floor over all contacted Sectors.
-
 	uint32_t		ThruBits;
 	FTextureID		floorpic;			// contacted sec floorpic
 	int				floorterrain;
@@ -1192,8 +1208,6 @@ public:
 	double			StealthAlpha;	// Minmum alpha for MF_STEALTH.
 	int				WoundHealth;		// Health needed to enter wound state
 
-	int32_t			tics;				// state tic counter
-	FState			*state;
 	//VMFunction		*Damage;			// For missiles and monster railgun
 	int				DamageVal;
 	int				projectileKickback;
@@ -1208,7 +1222,6 @@ public:
 
 	uint32_t			VisibleToTeam;
 	int				weaponspecial;	// Special info for weapons.
-	int 			health;
 	int32_t			reactiontime;	// if non 0, don't attack yet; used by
 									// player to freeze a bit after teleporting
 	int32_t			threshold;		// if > 0, the target will be chased
@@ -1222,8 +1235,6 @@ public:
 	int16_t			LightLevel;		// Allows for overriding sector light levels.
 	uint16_t			SpawnAngle;
 
-	TObjPtr<AActor*> target;			// thing being chased/attacked (or NULL)
-									// also the originator for missiles
 	TObjPtr<AActor*>	lastenemy;		// Last known enemy -- killough 2/15/98
 	TObjPtr<AActor*> LastHeard;		// [RH] Last actor this one heard
 									// no matter what (even if shot)
@@ -1262,8 +1273,6 @@ public:
 	double			maxtargetrange;	// any target farther away cannot be attacked
 	double			bouncefactor;	// Strife's grenades use 50%, Hexen's Flechettes 70.
 	double			wallbouncefactor;	// The bounce factor for walls can be different.
-	double			Gravity;		// [GRB] Gravity factor
-	double			Friction;
 	double			pushfactor;
 	double			ShadowAimFactor;	// [inkoalawetrust] How much the actors' aim is affected when attacking shadow actors. 
 	double			ShadowPenaltyFactor;// [inkoalawetrust] How much the shadow actor affects its' shooters' aim.
@@ -1284,8 +1293,6 @@ public:
 	sector_t		*BlockingCeiling;	// Sector that blocked the last move (ceiling plane slope)
 	sector_t		*BlockingFloor;		// Sector that blocked the last move (floor plane slope)
 
-	uint32_t		freezetics;	// actor has actions completely frozen (including movement) for this many tics, but they still get Tick() calls
-
 	int PoisonDamage; // Damage received per tic from poison.
 	FName PoisonDamageType; // Damage type dealt by poison.
 	int PoisonDuration; // Duration left for receiving poison damage.
@@ -1302,7 +1309,6 @@ public:
 	struct msecnode_t	*touching_sectorportallist;		// same for cross-sectorportal rendering
 	struct portnode_t	*touching_lineportallist;		// and for cross-lineportal
 	struct msecnode_t	*touching_rendersectors; // this is the list of sectors that this thing interesects with it's max(radius, renderradius).
-	int validcount;
 
 
 	TObjPtr<AActor*>	Inventory;		// [RH] This actor's inventory
@@ -1359,7 +1365,6 @@ public:
 	FDecalBase *DecalGenerator;
 
 	// [RH] Used to interpolate the view to get >35 FPS
-	DVector3 Prev;
 	DRotator PrevAngles;
 	DAngle   PrevFOV;
 	int PrevPortalGroup;
@@ -46,8 +46,8 @@
 #include "g_cvars.h"
 #include "d_main.h"
 
-static int ThinkCount;
-static cycle_t ThinkCycles;
+int ThinkCount;
+cycle_t ThinkCycles;
 extern cycle_t BotSupportCycles;
 extern cycle_t ActionCycles;
 extern int BotWTG;
@@ -68,6 +68,7 @@ struct ProfileInfo
 static TMap<FName, ProfileInfo> Profiles;
 static unsigned int profilethinkers, profilelimit;
 DThinker *NextToThink;
+static bool RestingActors;
 
 //==========================================================================
 //
@@ -141,6 +142,8 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 
 	if (!profilethinkers)
 	{
+		RestingActors = BeginRestingActors(Level);
+
 		// Tick every thinker left from last time
 		for (i = STAT_FIRST_THINKING; i <= MAX_STATNUM; ++i)
 		{
@@ -156,16 +159,19 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 				count += FreshThinkers[i].TickThinkers(&Thinkers[i]);
 			}
 		} while (count != 0);
+		RestingActors = false;
 
 		recreateLights();
 		if (dolights)
 		{
+			BeginLightLinking();
 			for (auto light = Level->lights; light;)
 			{
 				auto next = light->next;
 				light->Tick();
 				light = next;
 			}
+			FinishLightLinking();
 		}
 	}
 	else
@@ -193,6 +199,7 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 			// Also profile the internal dynamic lights, even though they are not implemented as thinkers.
 			auto &prof = Profiles[NAME_InternalDynamicLight];
 			prof.timer.Clock();
+			BeginLightLinking();
 			for (auto light = Level->lights; light;)
 			{
 				prof.numcalls++;
@@ -200,6 +207,7 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 				light->Tick();
 				light = next;
 			}
+			FinishLightLinking();
 			prof.timer.Unclock();
 		}
 
@@ -615,7 +623,11 @@ int FThinkerList::TickThinkers(FThinkerList *dest)
 		if (!(node->ObjectFlags & OF_EuthanizeMe))
 		{ // Only tick thinkers not scheduled for destruction
 			ThinkCount++;
-			node->CallTick();
+			// A resting actor only needs to count down its state.
+			if (!RestingActors || !TickRestingActor(node))
+			{
+				node->CallTick();
+			}
 			node->ObjectFlags &= ~OF_JustSpawned;
 		}
 		node = NextToThink;
@@ -50,6 +50,9 @@ class FThinkerIterator;
 
 enum { MAX_STATNUM = 127 };
 
+bool BeginRestingActors(FLevelLocals *Level);
+bool TickRestingActor(DThinker *node);
+
 // Doubly linked ring list of thinkers
 struct FThinkerList
 {
@@ -2139,6 +2139,7 @@ void FParser::SF_SetLineBlocking(void)
 			while ((i = itr.Next()) >= 0)
 			{
 				Level->lines[i].flags = (Level->lines[i].flags & ~(ML_BLOCKING | ML_BLOCKEVERYTHING)) | blocking;
+				P_InvalidateSight(&Level->lines[i]);
 			}
 		}
 	}
@@ -3802,6 +3803,7 @@ void FParser::SF_SetLineTrigger()
 			Level->TranslateLineDef(&Level->lines[i], &mld);
 			Level->lines[i].flags = (Level->lines[i].flags & (ML_MONSTERSCANACTIVATE | ML_REPEAT_SPECIAL | ML_SPAC_MASK | ML_FIRSTSIDEONLY)) |
 				(f & ~(ML_MONSTERSCANACTIVATE | ML_REPEAT_SPECIAL | ML_SPAC_MASK | ML_FIRSTSIDEONLY));
+			P_InvalidateSight(&Level->lines[i]);
 
 		}
 	}
@@ -6257,6 +6257,7 @@ doplaysound:			if (funcIndex == ACSF_PlayActorSound)
 				while ((line = itr.Next()) >= 0)
 				{
 					Level->lines[line].activation = args[1];
+					P_InvalidateSight(&Level->lines[line]);
 					if (repeat > 0) Level->lines[line].flags |= ML_REPEAT_SPECIAL;
 					else if (repeat == 0) Level->lines[line].flags &= ~ML_REPEAT_SPECIAL;
 				}
@@ -8445,6 +8446,7 @@ scriptwait:
 			if (activationline != NULL)
 			{
 				activationline->special = 0;
+				P_InvalidateSight(activationline);
 				DPrintf(DMSG_SPAMMY, "Cleared line special on line %d\n", activationline->Index());
 			}
 			break;
@@ -9051,6 +9053,7 @@ scriptwait:
 						line.flags |= ML_BLOCK_PLAYERS;
 						break;
 					}
+					P_InvalidateSight(&line);
 				}
 
 				sp -= 2;
@@ -9092,6 +9095,7 @@ scriptwait:
 				{
 					line_t *line = &Level->lines[linenum];
 					line->special = specnum;
+					P_InvalidateSight(line);
 					line->args[0] = arg0;
 					line->args[1] = STACK(4);
 					line->args[2] = STACK(3);
@@ -52,6 +52,7 @@
 #include "serializer_doom.h"
 
 #include "hwrenderer/scene/hw_drawstructs.h"
+#include "parallel_for.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable: 6011) // dereference null pointer in thinker iterator
@@ -68,6 +69,9 @@ FRandom pr_railtrail("RailTrail");
 
 #define FADEFROMTTL(a)	(1.f/(a))
 
+// Number of particles each P_ThinkParticles job processes.
+enum { PARTICLE_CHUNK = 1024 };
+
 static int grey1, grey2, grey3, grey4, red, green, blue, yellow, black,
 		   red1, green1, blue1, yellow1, purple, purple1, white,
 		   rblue1, rblue2, rblue3, rblue4, orange, yorange, dred, grey5,
@@ -184,9 +188,10 @@ void P_InitParticles (FLevelLocals *Level)
 		num = r_maxparticles;
 
 	// This should be good, but eh...
-	int NumParticles = clamp<int>(num, 100, 65535);
+	int NumParticles = clamp<int>(num, 100, MAX_PARTICLES);
 
 	Level->Particles.Resize(NumParticles);
+	Level->ParticleSubsecNext.Resize(NumParticles);
 	P_ClearParticles (Level);
 }
 
@@ -234,18 +239,24 @@ void P_FindParticleSubsectors (FLevelLocals *Level)
 		Level->ParticlesInSubsec.Reserve (Level->subsectors.Size() - Level->ParticlesInSubsec.Size());
 	}
 
-	fillshort (&Level->ParticlesInSubsec[0], Level->subsectors.Size(), NO_PARTICLE);
+	for (unsigned i = 0; i < Level->subsectors.Size(); i++)
+	{
+		Level->ParticlesInSubsec[i] = NO_PARTICLE;
+	}
 
 	if (!r_particles)
 	{
 		return;
 	}
-	for (uint16_t i = Level->ActiveParticles; i != NO_PARTICLE; i = Level->Particles[i].tnext)
+	auto &next = Level->ParticleSubsecNext;
+	for (uint32_t i = Level->ActiveParticles; i != NO_PARTICLE; i = Level->Particles[i].tnext)
 	{
+		particle_t &particle = Level->Particles[i];
+
 		 // Try to reuse the subsector from the last portal check, if still valid.
-		if (Level->Particles[i].subsector == nullptr) Level->Particles[i].subsector = Level->PointInRenderSubsector(Level->Particles[i].Pos);
-		int ssnum = Level->Particles[i].subsector->Index();
-		Level->Particles[i].snext = Level->ParticlesInSubsec[ssnum];
+		if (particle.subsector == nullptr) particle.subsector = Level->PointInRenderSubsector(particle.Pos);
+		int ssnum = particle.subsector->Index();
+		next[i] = Level->ParticlesInSubsec[ssnum];
 		Level->ParticlesInSubsec[ssnum] = i;
 	}
 }
@@ -287,78 +298,167 @@ void P_InitEffects ()
 	blood2 = ParticleColor(RPART(kind)/3, GPART(kind)/3, BPART(kind)/3);
 }
 
-void P_ThinkParticles (FLevelLocals *Level)
+//==========================================================================
+//
+// ThinkParticle
+//
+// Moves a single particle. This only reads level data, so it is safe
+// to call from multiple threads as long as no line portals are involved.
+// Returns false if the particle has expired.
+//
+//==========================================================================
+
+static bool ThinkParticle(FLevelLocals *Level, particle_t *particle, bool frozen)
 {
-	int i = Level->ActiveParticles;
-	particle_t *particle = nullptr, *prev = nullptr;
-	while (i != NO_PARTICLE)
+	if (frozen && !(particle->flags & SPF_NOTIMEFREEZE))
 	{
-		particle = &Level->Particles[i];
-		i = particle->tnext;
-		if (Level->isFrozen() && !(particle->flags &SPF_NOTIMEFREEZE))
+		if (particle->flags & SPF_LOCAL_ANIM)
 		{
-			if(particle->flags & SPF_LOCAL_ANIM)
-			{
-				particle->animData.SwitchTic++;
-			}
-
-			prev = particle;
-			continue;
-		}
-		
-		particle->alpha -= particle->fadestep;
-		particle->size += particle->sizestep;
-		if (particle->alpha <= 0 || --particle->ttl <= 0 || (particle->size <= 0))
-		{ // The particle has expired, so free it
-			*particle = {};
-			if (prev)
-				prev->tnext = i;
-			else
-				Level->ActiveParticles = i;
-
-			if (i != NO_PARTICLE)
-			{
-				particle_t *next = &Level->Particles[i];
-				next->tprev = particle->tprev;
-			}
-			particle->tnext = Level->InactiveParticles;
-			Level->InactiveParticles = (int)(particle - Level->Particles.Data());
-			continue;
+			particle->animData.SwitchTic++;
 		}
+		return true;
+	}
+
+	particle->alpha -= particle->fadestep;
+	particle->size += particle->sizestep;
+	if (particle->alpha <= 0 || --particle->ttl <= 0 || (particle->size <= 0))
+	{
+		return false;
+	}
+
+	// Handle crossing a line portal
+	DVector2 newxy = Level->GetPortalOffsetPosition(particle->Pos.X, particle->Pos.Y, particle->Vel.X, particle->Vel.Y);
+	particle->Pos.X = newxy.X;
+	particle->Pos.Y = newxy.Y;
+	particle->Pos.Z += particle->Vel.Z;
+	particle->Vel += particle->Acc;
 
-		// Handle crossing a line portal
-		DVector2 newxy = Level->GetPortalOffsetPosition(particle->Pos.X, particle->Pos.Y, particle->Vel.X, particle->Vel.Y);
-		particle->Pos.X = newxy.X;
-		particle->Pos.Y = newxy.Y;
-		particle->Pos.Z += particle->Vel.Z;
-		particle->Vel += particle->Acc;
+	if (particle->flags & SPF_ROLL)
+	{
+		particle->Roll += particle->RollVel;
+		particle->RollVel += particle->RollAcc;
+	}
 
-		if(particle->flags & SPF_ROLL)
+	particle->subsector = Level->PointInRenderSubsector(particle->Pos);
+	sector_t *s = particle->subsector->sector;
+	// Handle crossing a sector portal.
+	if (!s->PortalBlocksMovement(sector_t::ceiling))
+	{
+		if (particle->Pos.Z > s->GetPortalPlaneZ(sector_t::ceiling))
 		{
-			particle->Roll += particle->RollVel;
-			particle->RollVel += particle->RollAcc;
+			particle->Pos += s->GetPortalDisplacement(sector_t::ceiling);
+			particle->subsector = NULL;
 		}
-		
-		particle->subsector = Level->PointInRenderSubsector(particle->Pos);
-		sector_t *s = particle->subsector->sector;
-		// Handle crossing a sector portal.
-		if (!s->PortalBlocksMovement(sector_t::ceiling))
+	}
+	else if (!s->PortalBlocksMovement(sector_t::floor))
+	{
+		if (particle->Pos.Z < s->GetPortalPlaneZ(sector_t::floor))
 		{
-			if (particle->Pos.Z > s->GetPortalPlaneZ(sector_t::ceiling))
-			{
-				particle->Pos += s->GetPortalDisplacement(sector_t::ceiling);
-				particle->subsector = NULL;
-			}
+			particle->Pos += s->GetPortalDisplacement(sector_t::floor);
+			particle->subsector = NULL;
 		}
-		else if (!s->PortalBlocksMovement(sector_t::floor))
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FreeParticle
+//
+// Unlinks an expired particle from the active list and puts it on the
+// inactive list.
+//
+//==========================================================================
+
+static void FreeParticle(FLevelLocals *Level, uint32_t index)
+{
+	particle_t *particle = &Level->Particles[index];
+	uint32_t next = particle->tnext;
+	uint32_t prev = particle->tprev;
+
+	if (prev != NO_PARTICLE) Level->Particles[prev].tnext = next;
+	else Level->ActiveParticles = next;
+
+	if (next != NO_PARTICLE) Level->Particles[next].tprev = prev;
+	else Level->OldestParticle = prev;
+
+	*particle = {};
+	particle->tnext = Level->InactiveParticles;
+	particle->tprev = NO_PARTICLE;
+	Level->InactiveParticles = index;
+}
+
+//==========================================================================
+//
+// P_ThinkParticles
+//
+// The active list gets collected into an array first, which is then
+// processed in chunks. The chunks are run in parallel unless the level has
+// line portals (whose traversal uses shared state). Expired particles are
+// collected per chunk and unlinked afterward in list order, so the result
+// does not depend on how the chunks were scheduled.
+//
+//==========================================================================
+
+void P_ThinkParticles (FLevelLocals *Level)
+{
+	static TArray<TArray<uint32_t>> Expired;
+	static TArray<uint32_t> Active;
+
+	if (Level->ActiveParticles == NO_PARTICLE)
+	{
+		return;
+	}
+
+	Active.Clear();
+	for (uint32_t i = Level->ActiveParticles; i != NO_PARTICLE; i = Level->Particles[i].tnext)
+	{
+		Active.Push(i);
+	}
+
+	const uint32_t count = Active.Size();
+	const uint32_t numchunks = (count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+	const bool frozen = Level->isFrozen();
+
+	if (Expired.Size() < numchunks)
+	{
+		Expired.Resize(numchunks);
+	}
+
+	auto thinkchunk = [&](uint32_t chunk)
+	{
+		if (chunk >= numchunks) return;
+		auto &expired = Expired[chunk];
+		expired.Clear();
+
+		uint32_t end = min<uint32_t>(count, (chunk + 1) * PARTICLE_CHUNK);
+		for (uint32_t i = chunk * PARTICLE_CHUNK; i < end; i++)
 		{
-			if (particle->Pos.Z < s->GetPortalPlaneZ(sector_t::floor))
+			if (!ThinkParticle(Level, &Level->Particles[Active[i]], frozen))
 			{
-				particle->Pos += s->GetPortalDisplacement(sector_t::floor);
-				particle->subsector = NULL;
+				expired.Push(Active[i]);
 			}
 		}
-		prev = particle;
+	};
+
+	if (numchunks > 1 && !Level->PortalBlockmap.containsLines)
+	{
+		parallel_for(0u, numchunks, 1u, thinkchunk);
+	}
+	else
+	{
+		for (uint32_t chunk = 0; chunk < numchunks; chunk++)
+		{
+			thinkchunk(chunk);
+		}
+	}
+
+	for (uint32_t chunk = 0; chunk < numchunks; chunk++)
+	{
+		for (auto index : Expired[chunk])
+		{
+			FreeParticle(Level, index);
+		}
 	}
 }
 
@@ -81,15 +81,17 @@ struct particle_t
     FTextureID texture; // +4 = 84
     ERenderStyle style; //+4 = 88
     float Roll, RollVel, RollAcc; //+12 = 100
-    uint16_t    tnext, snext, tprev; //+6 = 106
-	uint16_t flags; //+2 = 108
-	// uint32_t padding; //+4 = 112
+    uint32_t    tnext, tprev; //+8 = 108
+	uint16_t flags; //+2 = 110
+	// uint16_t padding; //+2 = 112
 	FStandaloneAnimation animData; //+16 = 128
 };
 
 static_assert(sizeof(particle_t) == 128);
 
-const uint16_t NO_PARTICLE = 0xffff;
+// The subsector links are kept outside particle_t in FLevelLocals::ParticleSubsecNext.
+const uint32_t NO_PARTICLE = 0xffffffff;
+const int MAX_PARTICLES = 1 << 20;
 
 void P_InitParticles(FLevelLocals *);
 void P_ClearParticles (FLevelLocals *Level);
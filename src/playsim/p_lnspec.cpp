@@ -2783,6 +2783,7 @@ FUNC(LS_Line_SetBlocking)
         Level->lines[line].flags = (Level->lines[line].flags & ~clearflags[0]) | setflags[0];
         Level->lines[line].flags2 = (Level->lines[line].flags2 & ~clearflags[1]) | setflags[1];
     }
+    P_InvalidateSight();
     return true;
 }
 
@@ -3306,6 +3307,7 @@ FUNC(LS_GlassBreak)
 	ln->flags &= ~(ML_BLOCKING|ML_BLOCKEVERYTHING);
 	switched = P_ChangeSwitchTexture (ln->sidedef[0], false, 0, &quest1);
 	ln->special = 0;
+	P_InvalidateSight(ln);
 	if (ln->sidedef[1] != NULL)
 	{
 		switched |= P_ChangeSwitchTexture (ln->sidedef[1], false, 0, &quest2);
@@ -147,6 +147,7 @@ void InitSpawnablesFromMapinfo();
 int P_Thing_CheckInputNum(player_t *p, int inputnum);
 int P_Thing_Warp(AActor *caller, AActor *reference, double xofs, double yofs, double zofs, DAngle angle, int flags, double heightoffset, double radiusoffset, DAngle pitch);
 struct FLevelLocals;
+class FBoundingBox;
 int P_Thing_CheckProximity(FLevelLocals *Level, AActor *self, PClass *classname, double distance, int count, int flags, int ptr, bool counting = false);
 
 enum
@@ -271,6 +272,8 @@ bool	P_BounceWall (AActor *mo);
 bool	P_BounceActor (AActor *mo, AActor *BlockingMobj, bool ontop);
 bool    P_ReflectOffActor(AActor* mo, AActor* blocking);
 int	P_CheckSight (AActor *t1, AActor *t2, int flags=0);
+int	P_CheckSightMulti (AActor *looker, AActor *const *targets, unsigned count, int flags, bool *results);
+int	P_CheckSeenByMulti (AActor *const *lookers, unsigned count, AActor *target, int flags, bool *results);
 
 enum ESightFlags
 {
@@ -281,6 +284,11 @@ enum ESightFlags
 };
 
 void	P_ResetSightCounters (bool full);
+void	P_InvalidateSight ();
+void	P_InvalidateSight (sector_t *sector);
+void	P_InvalidateSight (line_t *line);
+void	P_InvalidateSight (FLevelLocals *Level, const FBoundingBox &box);
+void	P_InvalidateSightBlocks (FLevelLocals *Level, int x1, int y1, int x2, int y2);
 bool	P_TalkFacing (AActor *player);
 void	P_UseLines (player_t* player);
 int	P_UsePuzzleItem (AActor *actor, int itemType);
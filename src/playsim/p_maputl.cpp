@@ -340,6 +340,10 @@ void AActor::UnlinkFromWorld (FLinkContext *ctx)
 				block->NextActor->PrevActor = block->PrevActor;
 			}
 			*(block->PrevActor) = block->NextActor;
+			if (Level->blockmap.blockactors != nullptr)
+			{
+				Level->blockmap.RemoveFromBlock(block);
+			}
 			FBlockNode *next = block->NextBlock;
 			block->Release ();
 			block = next;
@@ -551,10 +555,19 @@ void AActor::LinkToWorld(FLinkContext *ctx, bool spawningmapthing, sector_t *sec
 						node->NextBlock = NULL;
 						(*alink) = node;
 						alink = &node->NextBlock;
+
+						if (Level->blockmap.blockactors != nullptr)
+						{
+							Level->blockmap.AddToBlock(node);
+						}
 					}
 				}
 			}
 		}
+		if (Level->blockmap.blockactors != nullptr && BlockNode != nullptr && BlockNode->NextBlock == nullptr)
+		{
+			Level->blockmap.blockactors[BlockNode->BlockIndex].Last().Single = true;
+		}
 	}
 	// Portal links cannot be done unless the level is fully initialized.
 	if (!spawningmapthing) UpdateRenderSectorList();
@@ -888,10 +901,22 @@ void FMultiBlockLinesIterator::Reset()
 //
 //===========================================================================
 
+int FBlockThingsIterator::ActiveCount;
+uint32_t FBlockThingsIterator::LastStamp;
+
+void FBlockThingsIterator::Init(FLevelLocals *l)
+{
+	Level = l;
+	Dense = Level->blockmap.blockactors != nullptr;
+	if (Dense) ActiveCount++;
+	blockentries = nullptr;
+	entryindex = 0;
+}
+
 FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l)
 : DynHash()
 {
-	Level = l;
+	Init(l);
 	minx = maxx = 0;
 	miny = maxy = 0;
 	ClearHash();
@@ -901,7 +926,7 @@ FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l)
 FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, int _minx, int _miny, int _maxx, int _maxy)
 : DynHash()
 {
-	Level = l;
+	Init(l);
 	minx = _minx;
 	maxx = _maxx;
 	miny = _miny;
@@ -910,6 +935,18 @@ FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, int _minx, int _miny
 	Reset();
 }
 
+FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box)
+: DynHash()
+{
+	Init(l);
+	init(box);
+}
+
+FBlockThingsIterator::~FBlockThingsIterator()
+{
+	if (Dense) ActiveCount--;
+}
+
 void FBlockThingsIterator::init(const FBoundingBox &box, bool clearhash)
 {
 	maxy = Level->blockmap.GetBlockY(box.Top());
@@ -920,6 +957,29 @@ void FBlockThingsIterator::init(const FBoundingBox &box, bool clearhash)
 	Reset();
 }
 
+//===========================================================================
+//
+// FBlockThingsIterator :: UseChains
+//
+// Makes the iterator walk the FBlockNode chains even if the level has a
+// dense index. Needed for iterators that can stay alive for an unknown
+// time, like the ones handed out to scripts, because as long as a dense
+// iterator exists, unlinked entries cannot be removed from the index.
+// This restarts the iteration.
+//
+//===========================================================================
+
+void FBlockThingsIterator::UseChains()
+{
+	if (Dense)
+	{
+		Dense = false;
+		ActiveCount--;
+	}
+	ClearHash();
+	Reset();
+}
+
 //===========================================================================
 //
 // FBlockThingsIterator :: ClearHash
@@ -931,6 +991,115 @@ void FBlockThingsIterator::ClearHash()
 	memset(Buckets, -1, sizeof(Buckets));
 	NumFixedHash = 0;
 	DynHash.Clear();
+
+	if (Dense)
+	{
+		if (++LastStamp == 0) LastStamp = 1;
+		Stamp = LastStamp;
+		UseHash = false;
+		Visited.Clear();
+	}
+	else
+	{
+		UseHash = true;
+	}
+}
+
+//===========================================================================
+//
+// FBlockThingsIterator :: CheckHash
+//
+// Returns true if the actor had not been returned yet and records it.
+//
+//===========================================================================
+
+bool FBlockThingsIterator::CheckHash(AActor *me)
+{
+	HashEntry *entry;
+	int i;
+
+	size_t hash = ((size_t)me >> 3) % countof(Buckets);
+	for (i = Buckets[hash]; i >= 0; )
+	{
+		entry = GetHashEntry(i);
+		if (entry->Actor == me)
+		{ // I've already been checked. Skip to the next actor.
+			return false;
+		}
+		i = entry->Next;
+	}
+	// Add me to the hash table.
+	if (NumFixedHash < (int)countof(FixedHash))
+	{
+		entry = &FixedHash[NumFixedHash];
+		entry->Next = Buckets[hash];
+		Buckets[hash] = NumFixedHash++;
+	}
+	else
+	{
+		if (DynHash.Size() == 0)
+		{
+			DynHash.Grow(50);
+		}
+		i = DynHash.Reserve(1);
+		entry = &DynHash[i];
+		entry->Next = Buckets[hash];
+		Buckets[hash] = i + countof(FixedHash);
+	}
+	entry->Actor = me;
+	return true;
+}
+
+//===========================================================================
+//
+// FBlockThingsIterator :: CheckStamp
+//
+// Same as CheckHash, but marks the actor itself instead, which is a lot
+// cheaper for crowded areas. If another iterator has been started since
+// this one, the marks may have been overwritten, so everything seen so far
+// gets moved into the hash and that is used from here on.
+//
+//===========================================================================
+
+bool FBlockThingsIterator::CheckStamp(AActor *me)
+{
+	if (!UseHash)
+	{
+		if (LastStamp == Stamp)
+		{
+			if (me->BlockIterStamp == Stamp) return false;
+			me->BlockIterStamp = Stamp;
+			Visited.Push(me);
+			return true;
+		}
+		UseHash = true;
+		for (auto seen : Visited)
+		{
+			CheckHash(seen);
+		}
+		Visited.Clear();
+	}
+	return CheckHash(me);
+}
+
+//===========================================================================
+//
+// FBlockThingsIterator :: InBlock
+//
+// Block boundaries for compatibility mode
+//
+//===========================================================================
+
+bool FBlockThingsIterator::InBlock(AActor *me) const
+{
+	double blockleft = (curx * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgx;
+	double blockright = blockleft + FBlockmap::MAPBLOCKUNITS;
+	double blockbottom = (cury * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgy;
+	double blocktop = blockbottom + FBlockmap::MAPBLOCKUNITS;
+
+	// only return actors with the center in this block
+	return (me->X() >= blockleft && me->X() < blockright &&
+		me->Y() >= blockbottom && me->Y() < blocktop);
 }
 
 //===========================================================================
@@ -945,12 +1114,23 @@ void FBlockThingsIterator::StartBlock(int x, int y)
 	cury = y;
 	if (Level->blockmap.isValidBlock(x, y))
 	{
-		block = Level->blockmap.blocklinks[y*Level->blockmap.bmapwidth + x];
+		int index = y*Level->blockmap.bmapwidth + x;
+		if (Dense)
+		{
+			blockentries = &Level->blockmap.blockactors[index];
+			entryindex = blockentries->Size();
+		}
+		else
+		{
+			block = Level->blockmap.blocklinks[index];
+		}
 	}
 	else
 	{
 		// invalid block
 		block = NULL;
+		blockentries = nullptr;
+		entryindex = 0;
 	}
 }
 
@@ -977,66 +1157,43 @@ AActor *FBlockThingsIterator::Next(bool centeronly)
 {
 	for (;;)
 	{
-		while (block != NULL)
+		if (Dense)
 		{
-			AActor *me = block->Me;
-			FBlockNode *mynode = block;
-			HashEntry *entry;
-			int i;
-
-			block = block->NextActor;
-			// Don't recheck things that were already checked
-			if (mynode->NextBlock == NULL && mynode->PrevBlock == &me->BlockNode)
-			{ // This actor doesn't span blocks, so we know it can only ever be checked once.
-				return me;
-			}
-			if (centeronly)
+			// Walk backwards so that the order is the same as the chain's.
+			while (entryindex > 0)
 			{
-				// Block boundaries for compatibility mode
-				double blockleft = (curx * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgx;
-				double blockright = blockleft + FBlockmap::MAPBLOCKUNITS;
-				double blockbottom = (cury * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgy;
-				double blocktop = blockbottom + FBlockmap::MAPBLOCKUNITS;
-
-				// only return actors with the center in this block
-				if (me->X() >= blockleft && me->X() < blockright &&
-					me->Y() >= blockbottom && me->Y() < blocktop)
+				const FBlockEntry &entry = (*blockentries)[--entryindex];
+				AActor *me = entry.Me;
+
+				if (me == nullptr)
+				{ // unlinked while we were iterating
+					continue;
+				}
+				if (entry.Single)
+				{ // This actor doesn't span blocks, so we know it can only ever be checked once.
+					return me;
+				}
+				if (centeronly ? InBlock(me) : CheckStamp(me))
 				{
 					return me;
 				}
 			}
-			else
+		}
+		else
+		{
+			while (block != NULL)
 			{
-				size_t hash = ((size_t)me >> 3) % countof(Buckets);
-				for (i = Buckets[hash]; i >= 0; )
-				{
-					entry = GetHashEntry(i);
-					if (entry->Actor == me)
-					{ // I've already been checked. Skip to the next actor.
-						break;
-					}
-					i = entry->Next;
+				AActor *me = block->Me;
+				FBlockNode *mynode = block;
+
+				block = block->NextActor;
+				// Don't recheck things that were already checked
+				if (mynode->NextBlock == NULL && mynode->PrevBlock == &me->BlockNode)
+				{ // This actor doesn't span blocks, so we know it can only ever be checked once.
+					return me;
 				}
-				if (i < 0)
-				{ // Add me to the hash table and return me.
-					if (NumFixedHash < (int)countof(FixedHash))
-					{
-						entry = &FixedHash[NumFixedHash];
-						entry->Next = Buckets[hash];
-						Buckets[hash] = NumFixedHash++;
-					}
-					else
-					{
-						if (DynHash.Size() == 0)
-						{
-							DynHash.Grow(50);
-						}
-						i = DynHash.Reserve(1);
-						entry = &DynHash[i];
-						entry->Next = Buckets[hash];
-						Buckets[hash] = i + countof(FixedHash);
-					}
-					entry->Actor = me;
+				if (centeronly ? InBlock(me) : CheckHash(me))
+				{
 					return me;
 				}
 			}
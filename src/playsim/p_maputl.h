@@ -10,6 +10,7 @@
 
 extern int validcount;
 struct FBlockNode;
+struct FBlockEntry;
 
 struct divline_t
 {
@@ -293,6 +294,11 @@ class FBlockThingsIterator
 
 	FBlockNode *block;
 
+	// Used instead of 'block' when the level has a dense blockmap index.
+	bool Dense;
+	TArray<FBlockEntry> *blockentries;
+	int entryindex;
+
 	int Buckets[32];
 
 	struct HashEntry
@@ -304,11 +310,25 @@ class FBlockThingsIterator
 	int NumFixedHash;
 	TArray<HashEntry> DynHash;
 
+	// Generation stamp dedup, used with the dense index. If a newer
+	// generation gets started while this one is still running, the stamps
+	// can no longer be trusted and the actors recorded in Visited get moved
+	// into the hash.
+	uint32_t Stamp;
+	bool UseHash;
+	TArray<AActor *> Visited;
+
+	static uint32_t LastStamp;
+
 	HashEntry *GetHashEntry(int i) { return i < (int)countof(FixedHash) ? &FixedHash[i] : &DynHash[i - countof(FixedHash)]; }
 
 	void StartBlock(int x, int y);
 	void SwitchBlock(int x, int y);
 	void ClearHash();
+	void Init(FLevelLocals *l);
+	bool CheckHash(AActor *me);
+	bool CheckStamp(AActor *me);
+	bool InBlock(AActor *me) const;
 
 	// The following is only for use in the path traverser 
 	// and therefore declared private.
@@ -318,15 +338,19 @@ class FBlockThingsIterator
 	friend class FMultiBlockThingsIterator;
 
 public:
+	// Number of iterators walking the dense index. While this is non-zero,
+	// entries for unlinked actors may not be removed from the arrays.
+	static int ActiveCount;
+
 	FBlockThingsIterator(FLevelLocals *Level, int minx, int miny, int maxx, int maxy);
-	FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box)
-	{
-		Level = l;
-		init(box);
-	}
+	FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box);
+	FBlockThingsIterator(const FBlockThingsIterator &) = delete;
+	FBlockThingsIterator &operator=(const FBlockThingsIterator &) = delete;
+	~FBlockThingsIterator();
 	void init(const FBoundingBox &box, bool clearhash = true);
 	AActor *Next(bool centeronly = false);
 	void Reset() { StartBlock(minx, miny); }
+	void UseChains();
 };
 
 class FMultiBlockThingsIterator
@@ -356,6 +380,7 @@ public:
 	FMultiBlockThingsIterator(FPortalGroupArray &check, FLevelLocals *Level, double checkx, double checky, double checkz, double checkh, double checkradius, bool ignorerestricted, sector_t *newsec);
 	bool Next(CheckResult *item);
 	void Reset();
+	void UseChains() { blockIterator.UseChains(); Reset(); }
 	const FBoundingBox &Box() const
 	{
 		return bbox;
@@ -0,0 +1,319 @@
+/*
+** p_restingactors.cpp
+** Lets actors that are doing nothing but waiting for their current state
+** to run out skip the rest of AActor::Tick
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Most actors in a big level spend most tics standing still in a state
+** that has not run out yet. For those, AActor::Tick walks through all its
+** checks only to end up decrementing tics. IsResting lists the conditions
+** under which that is provably all it does, i.e. every step of Tick is a
+** no-op that only reads the actor and the level geometry around it.
+**
+** With sv_restingactors on, TickThinkers asks TickRestingActor first at the
+** actor's regular turn, so anything that ran before it this tic has already
+** happened and the result stays identical to the full Tick.
+**
+** sv_restingactorcheck ticks every actor normally and reports each resting
+** actor that Tick changed in any other way than counting down its state.
+**
+*/
+
+#include "actor.h"
+#include "actorinlines.h"
+#include "p_local.h"
+#include "p_maputl.h"
+#include "d_player.h"
+#include "g_levellocals.h"
+#include "vm.h"
+#include "types.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "printf.h"
+#include "v_text.h"
+#include "doomstat.h"
+
+CVAR(Bool, sv_restingactors, false, CVAR_SERVERINFO)
+CVAR(Bool, sv_restingactorcheck, false, 0)
+
+static int NumCandidates, NumRested, Mismatches, TotalMismatches;
+static bool RestingBots;
+
+//==========================================================================
+//
+// HasNativeTick
+//
+// Actors whose class overrides Tick in ZScript can do anything.
+//
+//==========================================================================
+
+static bool HasNativeTick(AActor *actor)
+{
+	IFVIRTUALPTR(actor, DThinker, Tick)
+	{
+		return !!(func->VarFlags & VARF_Native);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// IsQuietSector
+//
+// Nothing in this sector can move the actor or change its water level.
+//
+//==========================================================================
+
+static bool IsQuietSector(sector_t *sec)
+{
+	return sec->floordata.ForceGet() == nullptr && sec->ceilingdata.ForceGet() == nullptr &&
+		sec->PortalBlocksMovement(sector_t::ceiling) && sec->PortalBlocksMovement(sector_t::floor) &&
+		!(sec->MoreFlags & SECMF_UNDERWATER) && sec->GetHeightSec() == nullptr &&
+		sec->e->XFloor.ffloors.Size() == 0;
+}
+
+//==========================================================================
+//
+// IsResting
+//
+// Follows AActor::Tick from top to bottom. Only reads the actor and the
+// sectors it touches.
+//
+//==========================================================================
+
+static bool IsResting(AActor *actor, bool bots)
+{
+	if (actor->alternative.ForceGet() != nullptr || actor->player != nullptr || actor->Inventory.ForceGet() != nullptr ||
+		actor->freezetics > 0 || actor->state == nullptr || actor->isFrozen())
+	{
+		return false;
+	}
+	if ((actor->flags & (MF_UNMORPHED | MF_STEALTH | MF_MISSILE | MF_SKULLFLY)) ||
+		(actor->flags2 & (MF2_BLASTED | MF2_WINDTHRUST)) ||
+		(actor->flags4 & (MF4_VFRICTION | MF4_SCROLLMOVE)) ||
+		(actor->flags5 & MF5_NOINTERACTION) ||
+		(actor->flags7 & MF7_HANDLENODELAY) ||
+		(actor->flags8 & MF8_INSCROLLSEC) ||
+		(actor->effects & (FX_ROCKET | FX_GRENADE | FX_VISIBILITYPULSE)))
+	{
+		return false;
+	}
+	if (bots && ((actor->flags & (MF_SPECIAL | MF_MISSILE)) || (actor->flags3 & MF3_ISMONSTER)))
+	{
+		return false;
+	}
+
+	// Standing on a flat floor without velocity, so P_XYMovement, P_ZMovement
+	// and the slope check are no-ops.
+	if (!actor->Vel.isZero() || actor->Z() != actor->floorz || actor->floorsector == nullptr ||
+		actor->floorsector->floorplane.isSlope() || actor->floorsector->e->XFloor.ffloors.Size() > 0)
+	{
+		return false;
+	}
+	if (actor->BlockingMobj != nullptr || actor->MovementBlockingLine != nullptr ||
+		actor->Blocking3DFloor != nullptr || actor->BlockingFloor != nullptr || actor->BlockingCeiling != nullptr)
+	{
+		return false;
+	}
+	if ((actor->flags6 & MF6_TOUCHY) && !(actor->flags6 & MF6_ARMED))
+	{
+		return false;
+	}
+
+	// Crash() would not do anything.
+	if (!(actor->flags6 & MF6_DONTCORPSE) && ((actor->flags & MF_CORPSE) || (actor->flags6 & MF6_KILLED)) &&
+		!(actor->flags3 & MF3_CRASHED) && !(actor->flags & MF_ICECORPSE))
+	{
+		return false;
+	}
+
+	// No portal transitions, no water and no sector that damages it.
+	if (actor->waterlevel != 0 || actor->waterdepth != 0 || actor->boomwaterlevel != 0 ||
+		actor->PoisonDurationReceived != 0 || (actor->Sector->Flags & SECF_KILLMONSTERS))
+	{
+		return false;
+	}
+	for (auto node = actor->touching_sectorlist; node; node = node->m_tnext)
+	{
+		if (!IsQuietSector(node->m_sector)) return false;
+	}
+	if (!IsQuietSector(actor->Sector))
+	{
+		return false;
+	}
+
+	// UpdateRenderSectorList has nothing to do.
+	if (actor->Pos() != actor->OldRenderPos && !(actor->flags & MF_NOSECTOR))
+	{
+		return false;
+	}
+
+	// And finally, the state does not run out, so no action function gets called.
+	return actor->tics > 1 && !actor->state->GetCanRaise();
+}
+
+//==========================================================================
+//
+// HashActor
+//
+// Everything AActor::Tick could have changed on a resting actor.
+//
+//==========================================================================
+
+static inline void HashBytes(uint32_t &hash, const void *data, size_t len)
+{
+	auto p = (const uint8_t *)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ p[i]) * 16777619u;
+	}
+}
+
+template<class T> static inline void HashValue(uint32_t &hash, const T &value)
+{
+	HashBytes(hash, &value, sizeof(value));
+}
+
+static uint32_t HashActor(AActor *actor, int tics)
+{
+	uint32_t hash = 2166136261u;
+	HashValue(hash, actor->Pos());
+	HashValue(hash, actor->Vel);
+	HashValue(hash, actor->Angles);
+	HashValue(hash, actor->floorz);
+	HashValue(hash, actor->ceilingz);
+	HashValue(hash, actor->state);
+	HashValue(hash, tics);
+	HashValue(hash, actor->health);
+	HashValue(hash, actor->flags);
+	HashValue(hash, actor->flags2);
+	HashValue(hash, actor->flags3);
+	HashValue(hash, actor->flags4);
+	HashValue(hash, actor->flags5);
+	HashValue(hash, actor->flags6);
+	HashValue(hash, actor->flags7);
+	HashValue(hash, actor->flags8);
+	HashValue(hash, actor->waterlevel);
+	HashValue(hash, actor->movecount);
+	HashValue(hash, actor->Sector);
+	HashValue(hash, actor->BlockingMobj);
+	HashValue(hash, actor->MovementBlockingLine);
+	return hash;
+}
+
+//==========================================================================
+//
+// BeginRestingActors
+//
+// Called by RunThinkers before the thinker lists get ticked. Returns
+// whether TickThinkers should ask TickRestingActor first.
+//
+//==========================================================================
+
+bool BeginRestingActors(FLevelLocals *Level)
+{
+	NumCandidates = NumRested = Mismatches = 0;
+	RestingBots = Level->BotInfo.botnum > 0 && !demoplayback;
+	return sv_restingactors || sv_restingactorcheck;
+}
+
+//==========================================================================
+//
+// TickRestingActor
+//
+// Called by TickThinkers at the thinker's regular turn. If all Tick would
+// do is count down the actor's state, does only that and returns true.
+// In check mode the actor gets its full Tick and is compared with what
+// resting would have left behind.
+//
+//==========================================================================
+
+bool TickRestingActor(DThinker *node)
+{
+	// Fresh actors get to call PostBeginPlay first.
+	if ((node->ObjectFlags & OF_JustSpawned) || !node->IsKindOf(NAME_Actor))
+	{
+		return false;
+	}
+	auto actor = static_cast<AActor *>(node);
+	NumCandidates++;
+	if (!IsResting(actor, RestingBots) || !HasNativeTick(actor))
+	{
+		return false;
+	}
+	NumRested++;
+
+	if (!sv_restingactorcheck)
+	{
+		// This is all AActor::Tick would have done.
+		actor->tics--;
+		return true;
+	}
+
+	uint32_t expected = HashActor(actor, actor->tics - 1);
+	actor->CallTick();
+	bool destroyed = !!(actor->ObjectFlags & OF_EuthanizeMe);
+	if (destroyed || HashActor(actor, actor->tics) != expected)
+	{
+		if (TotalMismatches + Mismatches < 100)
+		{
+			Printf(TEXTCOLOR_RED "Tic %d: resting %s at (%.2f, %.2f) was changed by its tic%s\n",
+				actor->Level->maptime, actor->GetClass()->TypeName.GetChars(), actor->X(), actor->Y(),
+				destroyed ? ", which destroyed it" : "");
+		}
+		Mismatches++;
+		TotalMismatches++;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+ADD_STAT(resting)
+{
+	FString out;
+	out.Format("%s: rested %d of %d actors",
+		sv_restingactorcheck ? "Checking" : sv_restingactors ? "On" : "Off",
+		NumRested, NumCandidates);
+	if (sv_restingactorcheck)
+	{
+		out.AppendFormat("\nMismatches: %d this tic, %d total", Mismatches, TotalMismatches);
+	}
+	return out;
+}
+
+CCMD(resetrestingcheck)
+{
+	TotalMismatches = Mismatches = 0;
+}
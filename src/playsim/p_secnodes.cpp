@@ -27,6 +27,8 @@
 #include "g_levellocals.h"
 #include "p_maputl.h"
 #include "actor.h"
+#include "c_dispatch.h"
+#include "printf.h"
 
 //=============================================================================
 // phares 3/21/98
@@ -480,3 +482,125 @@ void FBlockNode::Release()
 	NextBlock = FreeBlocks;
 	FreeBlocks = this;
 }
+
+//===========================================================================
+//
+// FBlockmap :: AddToBlock
+//
+// Mirrors a newly linked FBlockNode in the dense per-block actor index.
+//
+//===========================================================================
+
+void FBlockmap::AddToBlock(FBlockNode *node)
+{
+	FBlockEntry entry = { node->Me, node, false };
+	blockactors[node->BlockIndex].Push(entry);
+}
+
+//===========================================================================
+//
+// FBlockmap :: RemoveFromBlock
+//
+// While an iterator is walking the index the entry only gets cleared so
+// that the iterator's position stays valid. Cleared entries are dropped
+// the next time something gets removed from the block with no iterator
+// running.
+//
+//===========================================================================
+
+void FBlockmap::RemoveFromBlock(FBlockNode *node)
+{
+	auto &block = blockactors[node->BlockIndex];
+
+	if (FBlockThingsIterator::ActiveCount > 0)
+	{
+		for (auto &entry : block)
+		{
+			if (entry.Node == node && entry.Me != nullptr)
+			{
+				entry.Me = nullptr;
+				entry.Node = nullptr;
+				break;
+			}
+		}
+		return;
+	}
+
+	unsigned j = 0;
+	for (unsigned i = 0; i < block.Size(); i++)
+	{
+		if (block[i].Me != nullptr && block[i].Node != node)
+		{
+			block[j++] = block[i];
+		}
+	}
+	block.Clamp(j);
+}
+
+//===========================================================================
+//
+// FBlockmap :: RebuildBlock
+//
+// Recreates one block's entries from its FBlockNode chain, for code that
+// manipulates the chains directly.
+//
+//===========================================================================
+
+void FBlockmap::RebuildBlock(int index)
+{
+	auto &block = blockactors[index];
+	block.Clear();
+	for (FBlockNode *node = blocklinks[index]; node != nullptr; node = node->NextActor)
+	{
+		block.Push({ node->Me, node, node->NextBlock == nullptr && node->PrevBlock == &node->Me->BlockNode });
+	}
+	// The chain is newest first, the array oldest first.
+	for (unsigned i = 0, j = block.Size(); i + 1 < j; i++, j--)
+	{
+		std::swap(block[i], block[j - 1]);
+	}
+}
+
+//===========================================================================
+//
+// Checks the dense blockmap index against the FBlockNode chains.
+//
+//===========================================================================
+
+CCMD(checkblockmap)
+{
+	auto &bmap = primaryLevel->blockmap;
+	if (bmap.blockactors == nullptr)
+	{
+		Printf("The dense blockmap index is not active. Set blockmap_arrays and restart the map.\n");
+		return;
+	}
+
+	int count = bmap.bmapwidth * bmap.bmapheight;
+	int errors = 0;
+	for (int i = 0; i < count; i++)
+	{
+		auto &block = bmap.blockactors[i];
+		unsigned j = block.Size();
+		for (FBlockNode *node = bmap.blocklinks[i]; node != nullptr; node = node->NextActor)
+		{
+			while (j > 0 && block[j - 1].Me == nullptr) j--;
+			bool single = node->NextBlock == nullptr && node->PrevBlock == &node->Me->BlockNode;
+			if (j == 0 || block[j - 1].Node != node || block[j - 1].Me != node->Me || block[j - 1].Single != single)
+			{
+				Printf("Block %d (%d, %d): index does not match chain\n", i, i % bmap.bmapwidth, i / bmap.bmapwidth);
+				errors++;
+				j = 0;
+				break;
+			}
+			j--;
+		}
+		while (j > 0 && block[j - 1].Me == nullptr) j--;
+		if (j > 0)
+		{
+			Printf("Block %d (%d, %d): index has %u stale entries\n", i, i % bmap.bmapwidth, i / bmap.bmapwidth, j);
+			errors++;
+		}
+	}
+	Printf("%d blocks checked, %d mismatches\n", count, errors);
+}
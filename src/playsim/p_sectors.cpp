@@ -1140,6 +1140,7 @@ double GetFriction(const sector_t *self, int plane, double *pMoveFac)
 		 {
 			 line->flags &= ~(ML_BLOCKING | ML_BLOCKEVERYTHING);
 			 line->special = 0;
+			 P_InvalidateSight(line);
 			 line->sidedef[0]->SetTexture(side_t::mid, FNullTextureID());
 			 line->sidedef[1]->SetTexture(side_t::mid, FNullTextureID());
 		 }
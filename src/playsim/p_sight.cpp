@@ -33,6 +33,7 @@
 #include "b_bot.h"
 #include "p_spec.h"
 #include "vm.h"
+#include "c_cvars.h"
 
 #include "g_levellocals.h"
 #include "actorinlines.h"
@@ -52,7 +53,8 @@ This uses specialized forms of the maputils routines for optimized performance
 
 // Performance meters
 static int sightcounts[6];
-static cycle_t SightCycles;
+int SightChecks;
+cycle_t SightCycles;
 static cycle_t MaxSightCycles;
 
 enum
@@ -90,6 +92,252 @@ struct SightTask
 static TArray<intercept_t> intercepts (128);
 static TArray<SightTask> portals(32);
 
+//==========================================================================
+//
+// Batched sight checks
+//
+// The traces of a batch all start at the same looker or all end at the
+// same target, so some of the work for a line is done once per batch:
+// the line's divline and whether its flags block sight, and for a shared
+// looker which side of the line the trace starts on. The end side is
+// never shared, because each trace computes its end point as start plus
+// delta, which need not be exactly the target's position, and a batched
+// check must give the same result as a single one.
+// The blockmap walk and the line openings along each trace still have to
+// be done per trace, because the traces go through different blocks.
+//
+//==========================================================================
+
+struct SightBatch
+{
+	DVector2 point;			// the shared end of all traces
+	bool atstart;			// looker (start) or target (end)
+	unsigned stamp;
+};
+
+struct SightLineMemo
+{
+	unsigned stamp;
+	int8_t side;			// side of the shared start point, only for a looker batch
+	int8_t blocks;			// LineBlocksSight, -1 if not checked yet
+	divline_t dl;
+};
+
+static TArray<SightLineMemo> SightLineMemos;
+static unsigned SightBatchStamp;
+
+static void P_StartSightBatch(SightBatch &batch, FLevelLocals *Level, const DVector2 &point, bool atstart)
+{
+	unsigned oldsize = SightLineMemos.Size();
+	if (oldsize < Level->lines.Size())
+	{
+		SightLineMemos.Resize(Level->lines.Size());
+		for (unsigned i = oldsize; i < SightLineMemos.Size(); i++) SightLineMemos[i].stamp = 0;
+	}
+	if (++SightBatchStamp == 0)
+	{
+		for (auto &memo : SightLineMemos) memo.stamp = 0;
+		SightBatchStamp = 1;
+	}
+	batch.point = point;
+	batch.atstart = atstart;
+	batch.stamp = SightBatchStamp;
+}
+
+//==========================================================================
+//
+// Sight check cache
+//
+// Remembers the result of the line of sight trace for an exact pair of
+// positions, so that repeated checks between actors that did not move
+// need not traverse the blockmap again. Whatever may change the outcome
+// of a trace has to call one of the P_InvalidateSight functions: moving
+// planes and polyobjects invalidate the blocks they cover, as do line
+// specials and ACS functions that change a line's blocking flags, special
+// or activation. Everything else (3D floor and Transfer_Heights control
+// sectors) clears all.
+//
+// Changes that do not go through the engine, like ZScript writing plane
+// heights, line flags or 3D floor flags directly, are not seen, so the
+// cache is off by default.
+//
+// 0: off
+// 1: results are kept for the current tic only
+// 2: results are kept until something invalidates them
+//
+//==========================================================================
+
+CVAR(Int, sv_sightcache, 0, CVAR_SERVERINFO)
+
+struct SightCacheEntry
+{
+	DVector3 pos1, pos2;
+	double height1, height2;
+	sector_t *sec1, *sec2;
+	int flags;
+	int generation;
+	int time;					// SightClock when the result was stored
+	short x1, y1, x2, y2;		// blocks covered by the trace
+	bool anyblock;				// went through portals, any change invalidates it
+	bool result;
+};
+
+enum
+{
+	SIGHTCACHE_SIZE = 4096,		// must be a power of 2
+};
+
+static SightCacheEntry SightCache[SIGHTCACHE_SIZE];
+static TArray<int> SightBlockStamps;
+static int SightGeneration = 1;
+static int SightClock;
+static int SightCacheHits, SightCacheMisses;
+
+static inline uint64_t SightHashValue(uint64_t h, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	h ^= bits;
+	h *= 0x100000001b3ull;
+	return h ^ (h >> 29);
+}
+
+static SightCacheEntry *P_GetSightCacheEntry(AActor *t1, AActor *t2, int flags)
+{
+	uint64_t h = 0xcbf29ce484222325ull ^ flags;
+	h = SightHashValue(h, t1->X());
+	h = SightHashValue(h, t1->Y());
+	h = SightHashValue(h, t1->Z());
+	h = SightHashValue(h, t2->X());
+	h = SightHashValue(h, t2->Y());
+	h = SightHashValue(h, t2->Z());
+	return &SightCache[(h ^ (h >> 32)) & (SIGHTCACHE_SIZE - 1)];
+}
+
+static bool P_CheckSightCache(const SightCacheEntry *entry, AActor *t1, AActor *t2, int flags)
+{
+	if (entry->generation != SightGeneration || entry->flags != flags ||
+		entry->sec1 != t1->Sector || entry->sec2 != t2->Sector ||
+		entry->pos1 != t1->Pos() || entry->pos2 != t2->Pos() ||
+		entry->height1 != t1->Height || entry->height2 != t2->Height)
+	{
+		return false;
+	}
+	if (entry->time == SightClock)
+	{
+		return true;
+	}
+	if (entry->anyblock)
+	{
+		return false;
+	}
+	int width = t1->Level->blockmap.bmapwidth;
+	for (int y = entry->y1; y <= entry->y2; y++)
+	{
+		for (int x = entry->x1; x <= entry->x2; x++)
+		{
+			if (SightBlockStamps[y * width + x] > entry->time) return false;
+		}
+	}
+	return true;
+}
+
+static void P_StoreSightCache(SightCacheEntry *entry, AActor *t1, AActor *t2, int flags, bool anyblock, bool result)
+{
+	auto &bmap = t1->Level->blockmap;
+	if (SightBlockStamps.Size() != unsigned(bmap.bmapwidth * bmap.bmapheight))
+	{
+		P_InvalidateSight();
+		SightBlockStamps.Resize(bmap.bmapwidth * bmap.bmapheight);
+		memset(SightBlockStamps.Data(), 0, SightBlockStamps.Size() * sizeof(int));
+		SightClock = 0;
+	}
+
+	entry->pos1 = t1->Pos();
+	entry->pos2 = t2->Pos();
+	entry->height1 = t1->Height;
+	entry->height2 = t2->Height;
+	entry->sec1 = t1->Sector;
+	entry->sec2 = t2->Sector;
+	entry->flags = flags;
+	entry->generation = SightGeneration;
+	entry->time = SightClock;
+	entry->anyblock = anyblock;
+	entry->result = result;
+
+	int x1 = bmap.GetBlockX(min(t1->X(), t2->X()));
+	int x2 = bmap.GetBlockX(max(t1->X(), t2->X()));
+	int y1 = bmap.GetBlockY(min(t1->Y(), t2->Y()));
+	int y2 = bmap.GetBlockY(max(t1->Y(), t2->Y()));
+	entry->x1 = (short)clamp(x1, 0, bmap.bmapwidth - 1);
+	entry->x2 = (short)clamp(x2, 0, bmap.bmapwidth - 1);
+	entry->y1 = (short)clamp(y1, 0, bmap.bmapheight - 1);
+	entry->y2 = (short)clamp(y2, 0, bmap.bmapheight - 1);
+}
+
+//==========================================================================
+//
+// P_InvalidateSight
+//
+//==========================================================================
+
+void P_InvalidateSight()
+{
+	if (++SightGeneration == 0) SightGeneration = 1;
+}
+
+void P_InvalidateSightBlocks(FLevelLocals *Level, int x1, int y1, int x2, int y2)
+{
+	auto &bmap = Level->blockmap;
+	if (SightBlockStamps.Size() != unsigned(bmap.bmapwidth * bmap.bmapheight))
+	{
+		return;	// nothing has been cached for this level yet.
+	}
+	x1 = max(x1, 0);
+	y1 = max(y1, 0);
+	x2 = min(x2, bmap.bmapwidth - 1);
+	y2 = min(y2, bmap.bmapheight - 1);
+
+	SightClock++;
+	for (int y = y1; y <= y2; y++)
+	{
+		for (int x = x1; x <= x2; x++)
+		{
+			SightBlockStamps[y * bmap.bmapwidth + x] = SightClock;
+		}
+	}
+}
+
+void P_InvalidateSight(FLevelLocals *Level, const FBoundingBox &box)
+{
+	auto &bmap = Level->blockmap;
+	P_InvalidateSightBlocks(Level, bmap.GetBlockX(box.Left()), bmap.GetBlockY(box.Bottom()),
+		bmap.GetBlockX(box.Right()), bmap.GetBlockY(box.Top()));
+}
+
+void P_InvalidateSight(line_t *line)
+{
+	P_InvalidateSight(line->GetLevel(), FBoundingBox(line->bbox[BOXLEFT], line->bbox[BOXBOTTOM], line->bbox[BOXRIGHT], line->bbox[BOXTOP]));
+}
+
+void P_InvalidateSight(sector_t *sector)
+{
+	if (sector->e->XFloor.attached.Size() > 0 || sector->e->FakeFloor.Sectors.Size() > 0)
+	{
+		// The planes of this sector show up somewhere else.
+		P_InvalidateSight();
+		return;
+	}
+	FBoundingBox box;
+	box.ClearBox();
+	for (auto line : sector->Lines)
+	{
+		box.AddToBox(line->v1->fPos());
+		box.AddToBox(line->v2->fPos());
+	}
+	P_InvalidateSight(sector->Level, box);
+}
+
 class SightCheck
 {
 	FLevelLocals *Level;
@@ -108,13 +356,16 @@ class SightCheck
 	int portalgroup;
 	bool portalfound;
 	unsigned int myseethrough;
+	SightBatch *batch;				// only set if this trace goes through the batch's point
 
 	void P_SightOpening(SightOpening &open, const line_t *linedef, double x, double y);
 	bool PTR_SightTraverse (intercept_t *in);
 	bool P_SightCheckLine (line_t *ld);
 	int P_SightBlockLinesIterator (int x, int y);
 	bool P_SightTraverseIntercepts ();
+	bool LineFlagsBlockSight(line_t *ld);
 	bool LineBlocksSight(line_t *ld);
+	SightLineMemo *LineMemo(line_t *ld);
 
 public:
 	SightCheck(FLevelLocals *l)
@@ -124,7 +375,7 @@ public:
 
 	bool P_SightPathTraverse ();
 
-	void init(AActor * t1, AActor * t2, sector_t *startsector, SightTask *task, int flags)
+	void init(AActor * t1, AActor * t2, sector_t *startsector, SightTask *task, int flags, SightBatch *sb = nullptr)
 	{
 		sightstart = t1->PosRelative(task->portalgroup);
 		sightend = t2->PosRelative(task->portalgroup).XY();
@@ -143,6 +394,7 @@ public:
 		portalfound = false;
 
 		myseethrough = FF_SEETHROUGH;
+		batch = sb != nullptr && sb->point == (sb->atstart ? sightstart.XY() : sightend) ? sb : nullptr;
 	}
 };
 
@@ -386,7 +638,36 @@ bool SightCheck::PTR_SightTraverse (intercept_t *in)
 
 
 // performs trivial visibility checks.
+//==========================================================================
+//
+// Returns the batch's data for this line, nullptr outside of a batch
+//
+//==========================================================================
+
+SightLineMemo *SightCheck::LineMemo(line_t *ld)
+{
+	if (batch == nullptr) return nullptr;
+
+	SightLineMemo *memo = &SightLineMemos[ld->Index()];
+	if (memo->stamp != batch->stamp)
+	{
+		memo->stamp = batch->stamp;
+		P_MakeDivline(ld, &memo->dl);
+		memo->side = batch->atstart ? P_PointOnDivlineSide(batch->point.X, batch->point.Y, &memo->dl) : 0;
+		memo->blocks = -1;
+	}
+	return memo;
+}
+
 bool SightCheck::LineBlocksSight(line_t *ld)
+{
+	SightLineMemo *memo = LineMemo(ld);
+	if (memo == nullptr) return LineFlagsBlockSight(ld);
+	if (memo->blocks < 0) memo->blocks = LineFlagsBlockSight(ld);
+	return !!memo->blocks;
+}
+
+bool SightCheck::LineFlagsBlockSight(line_t *ld)
 {
 	// try to early out the check
 	if (!ld->backsector || !(ld->flags & ML_TWOSIDED) || (ld->flags & ML_BLOCKSIGHT))
@@ -444,9 +725,14 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 	{
 		return true;		// line isn't crossed
 	}
-	P_MakeDivline (ld, &dl);
-	if (P_PointOnDivlineSide (Trace.x, Trace.y, &dl) ==
-		P_PointOnDivlineSide (Trace.x+Trace.dx, Trace.y+Trace.dy, &dl))
+	SightLineMemo *memo = LineMemo(ld);
+	const divline_t *pdl = &dl;
+	if (memo == nullptr) P_MakeDivline (ld, &dl);
+	else pdl = &memo->dl;
+
+	// Trace.x and Trace.y are exactly the shared start of a looker batch.
+	int startside = memo != nullptr && batch->atstart ? memo->side : P_PointOnDivlineSide (Trace.x, Trace.y, pdl);
+	if (startside == P_PointOnDivlineSide (Trace.x+Trace.dx, Trace.y+Trace.dy, pdl))
 	{
 		return true;		// line isn't crossed
 	}
@@ -547,8 +833,9 @@ bool SightCheck::P_SightTraverseIntercepts ()
 	for (scanpos = 0; scanpos < intercepts.Size (); scanpos++)
 	{
 		scan = &intercepts[scanpos];
-		P_MakeDivline (scan->d.line, &dl);
-		scan->frac = P_InterceptVector (&Trace, &dl);
+		SightLineMemo *memo = LineMemo(scan->d.line);
+		if (memo == nullptr) P_MakeDivline (scan->d.line, &dl);
+		scan->frac = P_InterceptVector (&Trace, memo != nullptr ? &memo->dl : &dl);
 		if (scan->frac < Startfrac)
 		{
 			scan->frac = INT_MAX;
@@ -838,16 +1125,33 @@ sightcounts[2]++;
 =====================
 */
 
-int P_CheckSight (AActor *t1, AActor *t2, int flags)
+// The part of the setup that only depends on the looker, so that it can
+// be shared by batched checks.
+struct SightLooker
 {
-	SightCycles.Clock();
+	AActor *t1;
+	sector_t *sec = nullptr;
+	double lookheight;
 
-	bool res;
+	SightLooker(AActor *t1) : t1(t1) {}
 
-	if (t1 == nullptr || t2 == nullptr)
+	sector_t *EyeSector()
 	{
-		return false;
+		if (sec == nullptr)
+		{
+			lookheight = t1->Z() + t1->Height*0.75;
+			t1->GetPortalTransition(lookheight, &sec);
+		}
+		return sec;
 	}
+};
+
+static bool P_CheckSightFrom (SightLooker &looker, AActor *t2, int flags, SightBatch *batch = nullptr)
+{
+	AActor *t1 = looker.t1;
+	bool res;
+
+	SightChecks++;
 
 	if ((t2->flags8 & MF8_MVISBLOCKED) && !(flags & SF_IGNOREVISIBILITY))
 	{
@@ -907,12 +1211,25 @@ sightcounts[0]++;
 	// An unobstructed LOS is possible.
 	// Now look from eyes of t1 to any part of t2.
 
+	{
+	SightCacheEntry *cache = nullptr;
+	if (sv_sightcache > 0)
+	{
+		cache = P_GetSightCacheEntry(t1, t2, flags);
+		if (P_CheckSightCache(cache, t1, t2, flags))
+		{
+			SightCacheHits++;
+			res = cache->result;
+			goto done;
+		}
+		SightCacheMisses++;
+	}
+
 	validcount++;
 	portals.Clear();
 	{
-		sector_t *sec;
-		double lookheight = t1->Z() + t1->Height*0.75;
-		t1->GetPortalTransition(lookheight, &sec);
+		sector_t *sec = looker.EyeSector();
+		double lookheight = looker.lookheight;
 
 		double bottomslope = t2->Z() - lookheight;
 		double topslope = bottomslope + t2->Height;
@@ -920,7 +1237,7 @@ sightcounts[0]++;
 
 
 		SightCheck s(t1->Level);
-		s.init(t1, t2, sec, &task, flags);
+		s.init(t1, t2, sec, &task, flags, batch);
 		res = s.P_SightPathTraverse ();
 		if (!res)
 		{
@@ -928,7 +1245,7 @@ sightcounts[0]++;
 			for (unsigned i = 0; i < portals.Size(); i++)
 			{
 				portals[i].Frac += 1 / dist;
-				s.init(t1, t2, NULL, &portals[i], flags);
+				s.init(t1, t2, NULL, &portals[i], flags, batch);
 				if (s.P_SightPathTraverse())
 				{
 					res = true;
@@ -936,19 +1253,114 @@ sightcounts[0]++;
 				}
 			}
 		}
+		if (cache != nullptr)
+		{
+			bool anyblock = portals.Size() > 0 || sec->PortalGroup != t1->Sector->PortalGroup || sec->PortalGroup != t2->Sector->PortalGroup;
+			P_StoreSightCache(cache, t1, t2, flags, anyblock, res);
+		}
+	}
 	}
 
 done:
+	return res;
+}
+
+int P_CheckSight (AActor *t1, AActor *t2, int flags)
+{
+	if (t1 == nullptr || t2 == nullptr)
+	{
+		return false;
+	}
+
+	SightCycles.Clock();
+	SightLooker looker(t1);
+	bool res = P_CheckSightFrom(looker, t2, flags);
 	SightCycles.Unclock();
 	return res;
 }
 
+//==========================================================================
+//
+// P_CheckSightMulti
+//
+// Checks one looker against a list of targets. The looker's setup and
+// the per-line work described at SightBatch are shared between all
+// checks. results[i] receives the result for targets[i]; the return
+// value is the number of visible targets. The checks are done in list
+// order, so the outcome is the same as for calling P_CheckSight for each
+// target, including the random numbers used for invisible targets.
+//
+//==========================================================================
+
+int P_CheckSightMulti (AActor *looker, AActor *const *targets, unsigned count, int flags, bool *results)
+{
+	int visible = 0;
+
+	if (looker == nullptr)
+	{
+		memset(results, 0, count * sizeof(bool));
+		return 0;
+	}
+
+	SightCycles.Clock();
+	SightLooker sl(looker);
+	SightBatch batch;
+	P_StartSightBatch(batch, looker->Level, looker->Pos().XY(), true);
+	for (unsigned i = 0; i < count; i++)
+	{
+		results[i] = targets[i] != nullptr && P_CheckSightFrom(sl, targets[i], flags, targets[i]->Level == looker->Level ? &batch : nullptr);
+		visible += results[i];
+	}
+	SightCycles.Unclock();
+	return visible;
+}
+
+//==========================================================================
+//
+// P_CheckSeenByMulti
+//
+// The reverse case: which of the lookers can see the target. Here the
+// traces share their end, so the per-line work is shared the same way.
+// Only the eye position has to be set up for each looker.
+//
+//==========================================================================
+
+int P_CheckSeenByMulti (AActor *const *lookers, unsigned count, AActor *target, int flags, bool *results)
+{
+	int visible = 0;
+
+	if (target == nullptr)
+	{
+		memset(results, 0, count * sizeof(bool));
+		return 0;
+	}
+
+	SightCycles.Clock();
+	SightBatch batch;
+	P_StartSightBatch(batch, target->Level, target->Pos().XY(), false);
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (lookers[i] == nullptr)
+		{
+			results[i] = false;
+			continue;
+		}
+		SightLooker sl(lookers[i]);
+		results[i] = P_CheckSightFrom(sl, target, flags, lookers[i]->Level == target->Level ? &batch : nullptr);
+		visible += results[i];
+	}
+	SightCycles.Unclock();
+	return visible;
+}
+
 ADD_STAT (sight)
 {
 	FString out;
-	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d\n",
+	int lookups = SightCacheHits + SightCacheMisses;
+	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d, cache %d/%d (%.0f%%)\n",
 		SightCycles.TimeMS(), MaxSightCycles.TimeMS(),
-		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5]);
+		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5],
+		SightCacheHits, lookups, lookups > 0 ? SightCacheHits * 100. / lookups : 0.);
 	return out;
 }
 
@@ -963,5 +1375,16 @@ void P_ResetSightCounters (bool full)
 		MaxSightCycles = SightCycles;
 	}
 	SightCycles.Reset();
+	SightChecks = 0;
+	SightCacheHits = SightCacheMisses = 0;
 	memset (sightcounts, 0, sizeof(sightcounts));
+
+	if (full || sv_sightcache < 2)
+	{
+		P_InvalidateSight();
+	}
+	if (full)
+	{
+		SightBlockStamps.Clear();
+	}
 }
@@ -186,6 +186,7 @@ bool P_ActivateLine (line_t *line, AActor *mo, int side, int activationType, DVe
 	if (!repeat && buttonSuccess)
 	{ // clear the special on non-retriggerable lines
 		line->special = 0;
+		P_InvalidateSight(line);
 	}
 
 	if (buttonSuccess)
@@ -207,6 +208,7 @@ bool P_ActivateLine (line_t *line, AActor *mo, int side, int activationType, DVe
 	{
 		P_ChangeSwitchTexture (line->sidedef[0], repeat, special);
 		line->special = 0;
+		P_InvalidateSight(line);
 	}
 // end of changed code
 	if (developer >= DMSG_SPAMMY && buttonSuccess)
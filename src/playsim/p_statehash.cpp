@@ -0,0 +1,569 @@
+/*
+** p_statehash.cpp
+** Per-tic hashes of the playsim state, for finding desyncs
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** After every tic, the actors, sectors, lines and polyobjects of the primary
+** level and the RNGs are hashed separately. Nothing is hashed unless someone needs it:
+**
+** - Recording a demo with demo_statehash on stores the hashes of every tic
+**   in a HASH chunk after the BODY.
+** - Playing back such a demo compares them and reports the first tic that
+**   differs, and which parts of the state it was.
+** - statehashdump writes the hashes, and one line for every actor, to a
+**   text file. statehashcompare finds the first tic and the first actor
+**   that differ between two such files, e.g. from the same demo played
+**   back before and after a change.
+**
+** Pointers are never hashed directly. Other actors are identified by their
+** spawn order, sectors by their index and states by sprite and frame, so
+** that the hashes are the same from one run to the next.
+**
+*/
+
+#include <stdio.h>
+
+#include "actor.h"
+#include "p_local.h"
+#include "po_man.h"
+#include "g_levellocals.h"
+#include "d_protocol.h"
+#include "doomstat.h"
+#include "m_random.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "printf.h"
+#include "v_text.h"
+#include "parallel_for.h"
+#include "p_statehash.h"
+
+CVAR(Bool, demo_statehash, false, CVAR_ARCHIVE)
+
+#define HASH_ID				BIGE_ID('H','A','S','H')
+#define HASHCHUNKVERSION	1
+
+// Number of actors each parallel job hashes.
+#define HASHCHUNK			512
+
+static const char *PartNames[NUM_SHASH] = { "actors", "sectors", "lines", "polyobjects", "RNGs" };
+
+static bool Recording;
+static TArray<uint32_t> Recorded;		// NUM_SHASH entries per tic
+static TArray<uint32_t> Expected;
+static unsigned HashTic;
+static bool Desynced;
+
+static FStateHash LastHash;
+static bool HaveLastHash;
+
+static TArray<AActor *> HashedActors;
+static TArray<uint32_t> ActorHashes;
+
+static FileWriter *DumpFile;
+static unsigned DumpFirst, DumpLast;
+
+//==========================================================================
+//
+// The hash function works on 64 bit words. Floating point values are hashed
+// by their bits, since a desync can start in the last one.
+//
+//==========================================================================
+
+struct FStateHasher
+{
+	uint64_t h = 0x9E3779B97F4A7C15ull;
+
+	void Int(uint64_t v)
+	{
+		h = (h ^ v) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+
+	void Float(double d)
+	{
+		uint64_t v;
+		memcpy(&v, &d, sizeof(v));
+		Int(v);
+	}
+
+	void Vector(const DVector3 &v)
+	{
+		Float(v.X);
+		Float(v.Y);
+		Float(v.Z);
+	}
+
+	uint32_t Get() const
+	{
+		return uint32_t(h ^ (h >> 29));
+	}
+};
+
+static inline uint64_t ActorID(AActor *actor)
+{
+	return actor == nullptr || (actor->ObjectFlags & OF_EuthanizeMe) ? ~0ull : actor->SpawnOrder;
+}
+
+static uint32_t HashActor(AActor *actor)
+{
+	FStateHasher h;
+	h.Int(actor->SpawnOrder);
+	h.Int(actor->GetClass()->TypeName.GetIndex());
+	h.Vector(actor->Pos());
+	h.Vector(actor->Vel);
+	h.Int(actor->Angles.Yaw.BAMs());
+	h.Int(actor->Angles.Pitch.BAMs());
+	h.Float(actor->floorz);
+	h.Float(actor->ceilingz);
+	h.Int(actor->health);
+	h.Int(actor->tics);
+	if (actor->state != nullptr)
+	{
+		h.Int(actor->state->sprite);
+		h.Int(actor->state->GetFrame());
+	}
+	h.Int(actor->flags.GetValue() | (uint64_t(actor->flags2.GetValue()) << 32));
+	h.Int(actor->flags3.GetValue() | (uint64_t(actor->flags4.GetValue()) << 32));
+	h.Int(actor->flags5.GetValue() | (uint64_t(actor->flags6.GetValue()) << 32));
+	h.Int(actor->flags7.GetValue() | (uint64_t(actor->flags8.GetValue()) << 32));
+	h.Int(actor->special);
+	for (auto arg : actor->args) h.Int(arg);
+	h.Int(actor->movedir | (uint64_t(actor->movecount) << 32));
+	h.Int(actor->reactiontime | (uint64_t(actor->threshold) << 32));
+	h.Int(actor->Sector != nullptr ? actor->Sector->Index() : -1);
+	h.Int(ActorID(actor->target.ForceGet()));
+	h.Int(ActorID(actor->tracer.ForceGet()));
+	h.Int(ActorID(actor->master.ForceGet()));
+	return h.Get();
+}
+
+static uint32_t HashSectors(FLevelLocals *Level)
+{
+	FStateHasher h;
+	for (auto &sec : Level->sectors)
+	{
+		h.Float(sec.floorplane.fD());
+		h.Float(sec.ceilingplane.fD());
+		h.Int(sec.lightlevel | (uint64_t(sec.special) << 32));
+		h.Int(sec.Flags | (uint64_t(sec.damageamount) << 32));
+		h.Int(sec.GetTexture(sector_t::floor).GetIndex() | (uint64_t(sec.GetTexture(sector_t::ceiling).GetIndex()) << 32));
+	}
+	return h.Get();
+}
+
+static uint32_t HashLines(FLevelLocals *Level)
+{
+	FStateHasher h;
+	for (auto &line : Level->lines)
+	{
+		h.Int(line.flags | (uint64_t(line.special) << 32));
+		h.Int(line.activation | (uint64_t(line.health) << 32));
+		for (auto arg : line.args) h.Int(arg);
+		h.Float(line.alpha);
+	}
+	for (auto &side : Level->sides)
+	{
+		for (auto &part : side.textures)
+		{
+			h.Int(part.texture.GetIndex());
+			h.Float(part.xOffset);
+			h.Float(part.yOffset);
+		}
+	}
+	return h.Get();
+}
+
+static uint32_t HashPolyobjs(FLevelLocals *Level)
+{
+	FStateHasher h;
+	for (auto &poly : Level->Polyobjects)
+	{
+		h.Float(poly.StartSpot.pos.X);
+		h.Float(poly.StartSpot.pos.Y);
+		h.Int(poly.Angle.BAMs());
+	}
+	return h.Get();
+}
+
+//==========================================================================
+//
+// P_HashLevelState
+//
+// Actors are hashed in parallel and combined in thinker order, so the
+// actor part also catches thinkers that got reordered.
+//
+//==========================================================================
+
+void P_HashLevelState(FLevelLocals *Level, FStateHash &hash)
+{
+	HashedActors.Clear();
+	auto it = Level->GetThinkerIterator<AActor>();
+	while (auto actor = it.Next())
+	{
+		HashedActors.Push(actor);
+	}
+
+	const uint32_t count = HashedActors.Size();
+	const uint32_t numchunks = (count + HASHCHUNK - 1) / HASHCHUNK;
+	ActorHashes.Resize(count);
+	parallel_for(0u, numchunks, 1u, [&](uint32_t chunk)
+	{
+		uint32_t end = min<uint32_t>(count, (chunk + 1) * HASHCHUNK);
+		for (uint32_t i = chunk * HASHCHUNK; i < end; i++)
+		{
+			ActorHashes[i] = HashActor(HashedActors[i]);
+		}
+	});
+
+	FStateHasher actors;
+	for (auto h : ActorHashes) actors.Int(h);
+
+	hash.Parts[SHASH_Actors] = actors.Get();
+	hash.Parts[SHASH_Sectors] = HashSectors(Level);
+	hash.Parts[SHASH_Lines] = HashLines(Level);
+	hash.Parts[SHASH_Polyobjs] = HashPolyobjs(Level);
+	hash.Parts[SHASH_RNG] = 0;
+}
+
+//==========================================================================
+//
+// Dumping
+//
+//==========================================================================
+
+static void DumpTic(unsigned tic, const FStateHash &hash, bool actors)
+{
+	DumpFile->Printf("tic %u", tic);
+	for (auto part : hash.Parts) DumpFile->Printf(" %08x", part);
+	DumpFile->Printf("\n");
+
+	if (actors)
+	{
+		for (unsigned i = 0; i < HashedActors.Size(); i++)
+		{
+			AActor *actor = HashedActors[i];
+			DumpFile->Printf("  %u %s %08x pos (%.4f, %.4f, %.4f) health %d tics %d\n",
+				actor->SpawnOrder, actor->GetClass()->TypeName.GetChars(), ActorHashes[i],
+				actor->X(), actor->Y(), actor->Z(), actor->health, actor->tics);
+		}
+	}
+}
+
+static void CloseDump()
+{
+	if (DumpFile != nullptr)
+	{
+		delete DumpFile;
+		DumpFile = nullptr;
+	}
+}
+
+//==========================================================================
+//
+// P_StateHashTic
+//
+// Called at the end of every tic that ran the playsim.
+//
+//==========================================================================
+
+void P_StateHashTic()
+{
+	unsigned tic = HashTic++;
+	bool record = Recording && demorecording;
+	bool compare = demoplayback && tic * NUM_SHASH < Expected.Size();
+
+	if (!record && !compare && DumpFile == nullptr)
+	{
+		HaveLastHash = false;
+		return;
+	}
+
+	// Secondary levels are not hashed, they do not get ticked consistently anyway.
+	FStateHash hash;
+	P_HashLevelState(primaryLevel, hash);
+	hash.Parts[SHASH_RNG] = FRandom::StaticHashSeeds();
+	LastHash = hash;
+	HaveLastHash = true;
+
+	if (record)
+	{
+		for (auto part : hash.Parts) Recorded.Push(part);
+	}
+	if (compare && !Desynced)
+	{
+		FString parts;
+		for (int i = 0; i < NUM_SHASH; i++)
+		{
+			if (hash.Parts[i] != Expected[tic * NUM_SHASH + i])
+			{
+				if (parts.IsNotEmpty()) parts += ", ";
+				parts += PartNames[i];
+			}
+		}
+		if (parts.IsNotEmpty())
+		{
+			Desynced = true;
+			Printf(TEXTCOLOR_RED "Demo desynced at tic %u, %s differ. Use statehashdump to find the actor.\n", tic, parts.GetChars());
+		}
+	}
+	if (DumpFile != nullptr && tic >= DumpFirst)
+	{
+		DumpTic(tic, hash, true);
+		if (tic >= DumpLast)
+		{
+			CloseDump();
+			Printf("State hash dump finished at tic %u\n", tic);
+		}
+	}
+}
+
+//==========================================================================
+//
+// Demo support
+//
+//==========================================================================
+
+void P_StartStateHashRecording()
+{
+	Recording = demo_statehash;
+	Recorded.Clear();
+	HashTic = 0;
+}
+
+size_t P_StateHashChunkSize()
+{
+	return Recording && Recorded.Size() > 0 ? 16 + Recorded.Size() * 4 : 0;
+}
+
+void P_WriteStateHashChunk(uint8_t **stream)
+{
+	if (P_StateHashChunkSize() > 0)
+	{
+		StartChunk(HASH_ID, stream);
+		WriteInt32(HASHCHUNKVERSION, stream);
+		WriteInt32(Recorded.Size() / NUM_SHASH, stream);
+		for (auto h : Recorded) WriteInt32(h, stream);
+		FinishChunk(stream);
+	}
+	Recording = false;
+	Recorded.Clear();
+}
+
+// The chunk comes after the BODY, so this finds it on its own.
+void P_ReadStateHashChunk(uint8_t *chunk, int len)
+{
+	uint8_t *end = chunk + len;
+	P_ClearStateHashes();
+
+	while (chunk + 8 <= end)
+	{
+		int id = ReadInt32(&chunk);
+		int chunklen = ReadInt32(&chunk);
+		uint8_t *next = chunk + chunklen + (chunklen & 1);
+		if (chunklen < 0 || next > end) break;
+
+		if (id == HASH_ID && chunklen >= 8 && ReadInt32(&chunk) == HASHCHUNKVERSION)
+		{
+			unsigned numtics = ReadInt32(&chunk);
+			if (numtics <= unsigned(chunklen - 8) / (4 * NUM_SHASH))
+			{
+				Expected.Resize(numtics * NUM_SHASH);
+				for (auto &h : Expected) h = ReadInt32(&chunk);
+			}
+			break;
+		}
+		chunk = next;
+	}
+}
+
+void P_ClearStateHashes()
+{
+	Expected.Clear();
+	HashTic = 0;
+	Desynced = false;
+}
+
+//==========================================================================
+//
+// CCMD statehashdump
+//
+//==========================================================================
+
+CCMD(statehashdump)
+{
+	CloseDump();
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: statehashdump <file> [first tic] [last tic]\n");
+		return;
+	}
+	DumpFile = FileWriter::Open(argv[1]);
+	if (DumpFile == nullptr)
+	{
+		Printf("Could not open %s\n", argv[1]);
+		return;
+	}
+	// Tics are counted from the start of the demo, so this is best given on the command line.
+	DumpFirst = argv.argc() > 2 ? (unsigned)atoi(argv[2]) : 0;
+	DumpLast = argv.argc() > 3 ? (unsigned)atoi(argv[3]) : ~0u;
+}
+
+//==========================================================================
+//
+// CCMD statehashcompare
+//
+// Reads two dumps a tic at a time and stops at the first difference.
+//
+//==========================================================================
+
+struct FHashDumpTic
+{
+	unsigned Tic;
+	FString Hashes;
+	TArray<FString> Actors;
+};
+
+struct FHashDumpReader
+{
+	FILE *File;
+	char Line[1024];
+	bool Pending = false;
+
+	bool Read(FHashDumpTic &tic)
+	{
+		if (!Pending && !fgets(Line, sizeof(Line), File)) return false;
+		Pending = false;
+		if (sscanf(Line, "tic %u", &tic.Tic) != 1) return false;
+
+		const char *hashes = strchr(Line + 4, ' ');
+		tic.Hashes = hashes != nullptr ? hashes : "";
+		tic.Hashes.StripRight();
+		tic.Actors.Clear();
+		while (fgets(Line, sizeof(Line), File))
+		{
+			if (Line[0] != ' ')
+			{
+				Pending = true;
+				break;
+			}
+			FString actor = Line;
+			actor.StripLeftRight();
+			tic.Actors.Push(actor);
+		}
+		return true;
+	}
+};
+
+// Splits "spawnorder class hash ..." after the hash.
+static FString ActorKey(const FString &line)
+{
+	auto parts = line.Split(" ");
+	return parts.Size() >= 3 ? parts[0] + " " + parts[1] + " " + parts[2] : line;
+}
+
+CCMD(statehashcompare)
+{
+	if (argv.argc() < 3)
+	{
+		Printf("Usage: statehashcompare <dump> <dump>\n");
+		return;
+	}
+	FHashDumpReader a, b;
+	a.File = fopen(argv[1], "r");
+	b.File = fopen(argv[2], "r");
+	if (a.File == nullptr || b.File == nullptr)
+	{
+		Printf("Could not open %s\n", a.File == nullptr ? argv[1] : argv[2]);
+		if (a.File) fclose(a.File);
+		if (b.File) fclose(b.File);
+		return;
+	}
+
+	FHashDumpTic ta, tb;
+	unsigned tics = 0;
+	bool found = false;
+	while (!found && a.Read(ta) && b.Read(tb))
+	{
+		tics++;
+		if (ta.Tic != tb.Tic)
+		{
+			Printf("The dumps are out of step at tic %u and %u\n", ta.Tic, tb.Tic);
+			found = true;
+		}
+		else if (ta.Hashes.Compare(tb.Hashes) != 0)
+		{
+			found = true;
+			Printf("First difference at tic %u\n  %s\n  %s\n", ta.Tic, ta.Hashes.GetChars(), tb.Hashes.GetChars());
+
+			for (unsigned i = 0; i < ta.Actors.Size() || i < tb.Actors.Size(); i++)
+			{
+				const char *la = i < ta.Actors.Size() ? ta.Actors[i].GetChars() : "(none)";
+				const char *lb = i < tb.Actors.Size() ? tb.Actors[i].GetChars() : "(none)";
+				if (i >= ta.Actors.Size() || i >= tb.Actors.Size() || ActorKey(ta.Actors[i]).Compare(ActorKey(tb.Actors[i])) != 0)
+				{
+					Printf("First different actor:\n  %s\n  %s\n", la, lb);
+					break;
+				}
+			}
+		}
+	}
+	if (!found)
+	{
+		Printf("No difference in %u tics\n", tics);
+	}
+	fclose(a.File);
+	fclose(b.File);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+ADD_STAT(statehash)
+{
+	FString out;
+	if (!HaveLastHash)
+	{
+		out = "Not hashing";
+		return out;
+	}
+	out.Format("Tic %u:", HashTic - 1);
+	for (int i = 0; i < NUM_SHASH; i++)
+	{
+		out.AppendFormat(" %s %08x", PartNames[i], LastHash.Parts[i]);
+	}
+	if (Expected.Size() > 0)
+	{
+		out.AppendFormat("\n%s", Desynced ? "Demo desynced" : "Demo in sync");
+	}
+	return out;
+}
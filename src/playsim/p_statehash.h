@@ -0,0 +1,75 @@
+/*
+** p_statehash.h
+** Per-tic hashes of the playsim state
+**
+**---------------------------------------------------------------------------
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct FLevelLocals;
+
+enum EStateHashPart
+{
+	SHASH_Actors,
+	SHASH_Sectors,
+	SHASH_Lines,
+	SHASH_Polyobjs,
+	SHASH_RNG,
+
+	NUM_SHASH
+};
+
+struct FStateHash
+{
+	uint32_t Parts[NUM_SHASH];
+
+	bool operator==(const FStateHash &other) const
+	{
+		for (int i = 0; i < NUM_SHASH; i++) if (Parts[i] != other.Parts[i]) return false;
+		return true;
+	}
+	bool operator!=(const FStateHash &other) const
+	{
+		return !(*this == other);
+	}
+};
+
+void P_HashLevelState(FLevelLocals *Level, FStateHash &hash);
+void P_StateHashTic();
+
+// Demo support
+void P_StartStateHashRecording();
+size_t P_StateHashChunkSize();
+void P_WriteStateHashChunk(uint8_t **stream);
+void P_ReadStateHashChunk(uint8_t *chunk, int len);
+void P_ClearStateHashes();
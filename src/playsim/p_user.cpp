@@ -1469,6 +1469,10 @@ void P_PredictPlayer (player_t *player)
 			block->NextActor->PrevActor = block->PrevActor;
 		}
 		*(block->PrevActor) = block->NextActor;
+		if (act->Level->blockmap.blockactors != nullptr)
+		{
+			act->Level->blockmap.RemoveFromBlock(block);
+		}
 		block = block->NextBlock;
 	}
 	act->BlockNode = NULL;
@@ -1612,6 +1616,10 @@ void P_UnPredictPlayer ()
 			{
 				block->NextActor->PrevActor = &block->NextActor;
 			}
+			if (act->Level->blockmap.blockactors != nullptr)
+			{
+				act->Level->blockmap.RebuildBlock(block->BlockIndex);
+			}
 			block = block->NextBlock;
 		}
 
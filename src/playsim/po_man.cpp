@@ -996,6 +996,8 @@ void FPolyObj::UnLinkPolyobj ()
 	int i, j;
 	int index;
 
+	P_InvalidateSightBlocks(Level, bbox[BOXLEFT], bbox[BOXBOTTOM], bbox[BOXRIGHT], bbox[BOXTOP]);
+
 	// remove the polyobj from each blockmap section
 	for(j = bbox[BOXBOTTOM]; j <= bbox[BOXTOP]; j++)
 	{
@@ -1176,6 +1178,7 @@ void FPolyObj::LinkPolyobj ()
 	bbox[BOXLEFT] = Level->blockmap.GetBlockX(Bounds.Left());
 	bbox[BOXTOP] = Level->blockmap.GetBlockY(Bounds.Top());
 	bbox[BOXBOTTOM] = Level->blockmap.GetBlockY(Bounds.Bottom());
+	P_InvalidateSightBlocks(Level, bbox[BOXLEFT], bbox[BOXBOTTOM], bbox[BOXRIGHT], bbox[BOXTOP]);
 	// add the polyobj to each blockmap section
 	for(int j = bbox[BOXBOTTOM]*bmapwidth; j <= bbox[BOXTOP]*bmapwidth;
 		j += bmapwidth)
@@ -53,32 +53,33 @@ CVAR (Bool, gl_light_particles, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 //==========================================================================
 bool GetLight(FDynLightData& dld, int group, Plane & p, FDynamicLight * light, bool checkside)
 {
-	DVector3 pos = light->PosRelative(group);
 	float radius = (light->GetRadius());
+	if (radius <= 0.f) return false;
 
+	DVector3 pos = light->PosRelative(group);
 	auto dist = fabs(p.DistToPoint((float)pos.X, (float)pos.Z, (float)pos.Y));
 
-	if (radius <= 0.f) return false;
 	if (dist > radius) return false;
 	if (checkside && p.PointOnSide((float)pos.X, (float)pos.Z, (float)pos.Y))
 	{
 		return false;
 	}
 
-	AddLightToList(dld, group, light, false);
+	AddLightToList(dld, pos, light, false);
 	return true;
 }
 
 //==========================================================================
 //
-// Add one dynamic light to the light data list
+// Fills in one light's data, except for its position which depends on
+// the portal group it gets used in. Returns the list the data goes into.
 //
 //==========================================================================
-void AddLightToList(FDynLightData &dld, int group, FDynamicLight * light, bool forceAttenuate)
+
+static int MakeLightData(FDynamicLight * light, float *data)
 {
 	int i = 0;
 
-	DVector3 pos = light->PosRelative(group);
 	float radius = light->GetRadius();
 
 	float cs;
@@ -114,7 +115,7 @@ void AddLightToList(FDynLightData &dld, int group, FDynamicLight * light, bool f
 	}
 	else shadowIndex = 1025.f;
 	// Store attenuate flag in the sign bit of the float.
-	if (light->IsAttenuated() || forceAttenuate) shadowIndex = -shadowIndex;
+	if (light->IsAttenuated()) shadowIndex = -shadowIndex;
 
 	float lightType = 0.0f;
 	float spotInnerAngle = 0.0f;
@@ -136,10 +137,9 @@ void AddLightToList(FDynLightData &dld, int group, FDynamicLight * light, bool f
 		spotDirZ = float(-Angle.Sin() * xzLen);
 	}
 
-	float *data = &dld.arrays[i][dld.arrays[i].Reserve(16)];
-	data[0] = float(pos.X);
-	data[1] = float(pos.Z);
-	data[2] = float(pos.Y);
+	data[0] = 0.0f;
+	data[1] = 0.0f;
+	data[2] = 0.0f;
 	data[3] = radius;
 	data[4] = r;
 	data[5] = g;
@@ -153,5 +153,62 @@ void AddLightToList(FDynLightData &dld, int group, FDynamicLight * light, bool f
 	data[13] = spotOuterAngle;
 	data[14] = 0.0f; // unused
 	data[15] = 0.0f; // unused
+	return i;
+}
+
+//==========================================================================
+//
+// Most lights get added to many surfaces per frame but only their position
+// can differ between them. So everything else gets set up once per frame
+// here and adding a light to a list is just a copy.
+//
+// This must be called after the shadow map has assigned its light indices.
+//
+//==========================================================================
+
+static int lightDataFrame;
+
+void PrepareLightData(FLevelLocals *Level)
+{
+	lightDataFrame++;
+	for (auto light = Level->lights; light; light = light->next)
+	{
+		light->mRenderDataList = MakeLightData(light, light->mRenderData);
+		light->mRenderDataFrame = lightDataFrame;
+	}
 }
 
+//==========================================================================
+//
+// Add one dynamic light to the light data list
+//
+//==========================================================================
+void AddLightToList(FDynLightData &dld, const DVector3 &pos, FDynamicLight * light, bool forceAttenuate)
+{
+	int i;
+	float *data;
+
+	if (light->mRenderDataFrame == lightDataFrame)
+	{
+		i = light->mRenderDataList;
+		data = &dld.arrays[i][dld.arrays[i].Reserve(16)];
+		memcpy(data, light->mRenderData, sizeof(light->mRenderData));
+	}
+	else
+	{
+		// Not prepared for this frame.
+		float lightdata[16];
+		i = MakeLightData(light, lightdata);
+		data = &dld.arrays[i][dld.arrays[i].Reserve(16)];
+		memcpy(data, lightdata, sizeof(lightdata));
+	}
+	data[0] = float(pos.X);
+	data[1] = float(pos.Z);
+	data[2] = float(pos.Y);
+	if (forceAttenuate) data[7] = -fabsf(data[7]);
+}
+
+void AddLightToList(FDynLightData &dld, int group, FDynamicLight * light, bool forceAttenuate)
+{
+	AddLightToList(dld, light->PosRelative(group), light, forceAttenuate);
+}
@@ -25,6 +25,8 @@
 **
 */
 
+#include <thread>
+
 #include "gi.h"
 #include "a_dynlight.h"
 #include "m_png.h"
@@ -50,9 +52,13 @@
 #include "hwrenderer/scene/hw_fakeflat.h"
 #include "hwrenderer/scene/hw_clipper.h"
 #include "hwrenderer/scene/hw_portal.h"
+#include "hwrenderer/scene/hw_lightindex.h"
 #include "hw_vrmodes.h"
+#include "c_dispatch.h"
 
 EXTERN_CVAR(Bool, cl_capfps)
+EXTERN_CVAR(Bool, gl_multithread)
+EXTERN_CVAR(Int, gl_multithread_workers)
 extern bool NoInterpolateView;
 
 static SWSceneDrawer *swdrawer;
@@ -130,6 +136,8 @@ sector_t* RenderViewpoint(FRenderViewpoint& mainvp, AActor* camera, IntRect* bou
 	// Update the attenuation flag of all light defaults for each viewpoint.
 	// This function will only do something if the setting differs.
 	FLightDefaults::SetAttenuationForLevel(!!(camera->Level->flags3 & LEVEL3_ATTENUATE));
+	PrepareLightData(camera->Level);
+	LightIndex.Build(camera->Level);
 
 	// Render (potentially) multiple views for stereo 3d
 	// Fixme. The view offsetting should be done with a static table and not require setup of the entire render state for the mode.
@@ -313,6 +321,207 @@ static void CheckTimer(FRenderState &state, uint64_t ShaderStartTime)
 }
 
 
+//===========================================================================
+//
+// Scene processing benchmark
+//
+// Creates the draw lists for the current view over and over without ever
+// drawing them, once single threaded and then with different numbers of
+// BSP workers.
+//
+//===========================================================================
+
+static int benchSceneFrames;
+
+CCMD(gl_benchscene)
+{
+	benchSceneFrames = argv.argc() > 1 ? clamp(atoi(argv[1]), 1, 10000) : 100;
+}
+
+//-----------------------------------------------------------------------------
+//
+// Builds the draw lists for the player's view without drawing anything.
+//
+//-----------------------------------------------------------------------------
+
+static HWDrawInfo* CreateBenchScene(player_t* player, uint64_t* time = nullptr)
+{
+	screen->mVertexData->Reset();
+	screen->mLights->Clear();
+	screen->mBones->Clear();
+	hw_ClearFakeFlat();
+
+	FRenderViewpoint vp;
+	R_SetupFrame(vp, r_viewwindow, player->camera);
+	PrepareLightData(vp.ViewLevel);
+	LightIndex.Build(vp.ViewLevel);
+	auto di = HWDrawInfo::StartDrawInfo(vp.ViewLevel, nullptr, vp, nullptr);
+	di->SetViewArea();
+	di->SetFullbrightFlags(player);
+	di->Viewpoint.FieldOfView = r_viewpoint.FieldOfView;
+	portalState.BeginScene();
+	di->CurrentMapSections.Set(di->Level->PointInRenderSubsector(di->Viewpoint.Pos)->mapsection);
+
+	ActorRenderFlags savedflags = vp.camera->renderflags;
+	uint64_t start = I_nsTime();
+	di->CreateScene(false);
+	if (time) *time += I_nsTime() - start;
+	vp.camera->renderflags = savedflags;
+	return di;
+}
+
+static void EndBenchScene(HWDrawInfo* di)
+{
+	// The scene never gets drawn, so its portals need to be discarded here.
+	HWPortal* p;
+	while (di->Portals.Pop(p)) delete p;
+	di->EndDrawInfo();
+}
+
+static double TimeSceneCreation(player_t* player, int frames)
+{
+	uint64_t total = 0;
+
+	for (int i = 0; i < frames; i++)
+	{
+		EndBenchScene(CreateBenchScene(player, &total));
+	}
+	return total / 1e6 / frames;
+}
+
+static void RunSceneBenchmark(player_t* player)
+{
+	int frames = benchSceneFrames;
+	bool savedmt = gl_multithread;
+	int savedworkers = gl_multithread_workers;
+	int maxworkers = clamp((int)std::thread::hardware_concurrency(), 1, 16);
+
+	benchSceneFrames = 0;
+	if (player->camera == nullptr) return;
+
+	gl_multithread = false;
+	double base = TimeSceneCreation(player, frames);
+	Printf("Scene processing, %d frames:\n", frames);
+	Printf("  single threaded: %.3f ms\n", base);
+
+	gl_multithread = true;
+	for (int workers = 1; workers <= maxworkers; workers *= 2)
+	{
+		gl_multithread_workers = workers;
+		double time = TimeSceneCreation(player, frames);
+		Printf("  %2d worker%s: %.3f ms (%.2fx)\n", workers, workers == 1 ? " " : "s", time, time > 0 ? base / time : 0.);
+	}
+
+	gl_multithread = savedmt;
+	gl_multithread_workers = savedworkers;
+	screen->mVertexData->Reset();
+	hw_ClearFakeFlat();
+}
+
+//-----------------------------------------------------------------------------
+//
+// Translucency sorting benchmark
+//
+// Adds a given number of synthetic translucent sprites to the real
+// translucent items of the current view and times sorting them, with
+// and without taking the sprites apart from the walls and flats first.
+//
+//-----------------------------------------------------------------------------
+
+EXTERN_CVAR(Bool, gl_sort_presplit)
+
+static int benchSortItems;
+
+CCMD(gl_benchsort)
+{
+	benchSortItems = argv.argc() > 1 ? clamp(atoi(argv[1]), 64, 65536) : 16384;
+}
+
+static void AddBenchSprites(HWDrawInfo* di, HWDrawList& list, int count)
+{
+	const auto& vp = di->Viewpoint;
+	uint32_t seed = 1;
+	auto random = [&](float range)
+	{
+		seed = seed * 1664525 + 1013904223;
+		return (seed >> 8) * range / 16777216.f;
+	};
+
+	// Scatter them over a wedge in front of the view.
+	for (int i = 0; i < count; i++)
+	{
+		DAngle angle = vp.Angles.Yaw + DAngle::fromDeg(random(90.f) - 45.f);
+		double dist = 16 + random(2048.f);
+		float x = float(vp.Pos.X + angle.Cos() * dist);
+		float y = float(vp.Pos.Y + angle.Sin() * dist);
+		float z = float(vp.Pos.Z + random(256.f) - 128.f);
+		float size = 4 + random(28.f);
+
+		HWSprite* s = list.NewSprite();
+		memset(s, 0, sizeof(HWSprite));
+		s->x = x;
+		s->y = y;
+		s->z = z;
+		s->x1 = x - size * float(vp.Angles.Yaw.Sin());
+		s->y1 = y + size * float(vp.Angles.Yaw.Cos());
+		s->x2 = x + size * float(vp.Angles.Yaw.Sin());
+		s->y2 = y - size * float(vp.Angles.Yaw.Cos());
+		s->z1 = z + size;
+		s->z2 = z - size;
+		s->ur = s->vb = 1.f;
+		s->index = i;
+		s->vertexindex = -1;
+		s->dynlightindex = -1;
+		s->depth = (float)((x - vp.Pos.X) * vp.TanCos + (y - vp.Pos.Y) * vp.TanSin);
+	}
+}
+
+static double TimeTranslucentSort(player_t* player, int count, int frames)
+{
+	uint64_t total = 0;
+
+	for (int i = 0; i < frames; i++)
+	{
+		auto di = CreateBenchScene(player);
+		auto& list = di->drawlists[GLDL_TRANSLUCENT];
+		AddBenchSprites(di, list, count);
+
+		screen->mVertexData->Map();
+		uint64_t start = I_nsTime();
+		list.Sort(di);
+		total += I_nsTime() - start;
+		screen->mVertexData->Unmap();
+
+		EndBenchScene(di);
+	}
+	return total / 1e6 / frames;
+}
+
+static void RunSortBenchmark(player_t* player)
+{
+	int maxitems = benchSortItems;
+	bool savedpresplit = gl_sort_presplit;
+
+	benchSortItems = 0;
+	if (player->camera == nullptr) return;
+
+	Printf("Translucency sorting:\n");
+	for (int count = 64; count <= maxitems; count *= 4)
+	{
+		// Fewer rounds for the larger counts, the tree sort may well be quadratic.
+		int frames = clamp(65536 / count, 2, 100);
+		gl_sort_presplit = false;
+		double tree = TimeTranslucentSort(player, count, frames);
+		gl_sort_presplit = true;
+		double presplit = TimeTranslucentSort(player, count, frames);
+		Printf("  %5d sprites: %.3f ms tree only, %.3f ms presplit (%.2fx)\n", count, tree, presplit, presplit > 0 ? tree / presplit : 0.);
+	}
+
+	gl_sort_presplit = savedpresplit;
+	screen->mVertexData->Reset();
+	hw_ClearFakeFlat();
+}
+
 sector_t* RenderView(player_t* player)
 {
 	auto RenderState = screen->RenderState();
@@ -336,6 +545,11 @@ sector_t* RenderView(player_t* player)
 
 		checkBenchActive();
 
+		if (benchSceneFrames > 0)
+			RunSceneBenchmark(player);
+		if (benchSortItems > 0)
+			RunSortBenchmark(player);
+
 		// reset statistics counters
 		ResetProfilingData();
 
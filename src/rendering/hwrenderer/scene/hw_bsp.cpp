@@ -48,11 +48,22 @@
 #include <immintrin.h>
 #endif // ARCH_IA32
 
+#include <mutex>
+#include <thread>
+
+enum { MAX_BSP_WORKERS = 16 };
+
 CVAR(Bool, gl_multithread, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CUSTOM_CVAR(Int, gl_multithread_workers, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// 0 means one per physical core, up to 8
+{
+	if (self < 0) self = 0;
+	else if (self > MAX_BSP_WORKERS) self = MAX_BSP_WORKERS;
+}
 
 EXTERN_CVAR(Float, r_actorspriteshadowdist)
 
 thread_local bool isWorkerThread;
+thread_local HWWorkerOutput *workerOutput;
 ctpl::thread_pool renderPool(1);
 bool inited = false;
 
@@ -65,154 +76,653 @@ struct RenderJob
 		SpriteJob,
 		ParticleJob,
 		PortalJob,
-		TerminateJob	// inserted when all work is done so that the worker can return.
 	};
 	
 	int type;
 	subsector_t *sub;
 	seg_t *seg;
+	unsigned index;		// submission order, which is also the order in which the results get merged.
+};
+
+static inline void SpinPause()
+{
+#ifdef ARCH_IA32
+	// Yielding would be too costly here and possibly cause further delays down the line if the thread is halted.
+	// So instead add a few pause instructions and retry immediately.
+	for (int i = 0; i < 10; i++) _mm_pause();
+#endif // ARCH_IA32
+}
+
+//==========================================================================
+//
+// The jobs of one worker. The main thread appends to the end, the owning
+// worker takes from the front and idle workers steal from the end.
+// All accesses are very short so a spin lock is sufficient.
+//
+//==========================================================================
+
+class RenderJobDeque
+{
+	TArray<RenderJob> jobs;
+	unsigned head = 0;
+	std::atomic<int> available{};
+	std::atomic_flag lock = ATOMIC_FLAG_INIT;
+
+	void Lock()
+	{
+		while (lock.test_and_set(std::memory_order_acquire)) SpinPause();
+	}
+
+	void Unlock()
+	{
+		lock.clear(std::memory_order_release);
+	}
+
+public:
+	bool IsEmpty() const
+	{
+		return available.load(std::memory_order_acquire) == 0;
+	}
+
+	void Push(const RenderJob *batch, unsigned count)
+	{
+		Lock();
+		for (unsigned i = 0; i < count; i++) jobs.Push(batch[i]);
+		available.fetch_add(count, std::memory_order_release);
+		Unlock();
+	}
+
+	bool PopFront(RenderJob &job)
+	{
+		if (IsEmpty()) return false;
+		Lock();
+		bool found = head < jobs.Size();
+		if (found)
+		{
+			job = jobs[head++];
+			available.fetch_sub(1, std::memory_order_relaxed);
+		}
+		Unlock();
+		return found;
+	}
+
+	bool PopBack(RenderJob &job)
+	{
+		if (IsEmpty()) return false;
+		Lock();
+		bool found = head < jobs.Size();
+		if (found)
+		{
+			jobs.Pop(job);
+			available.fetch_sub(1, std::memory_order_relaxed);
+		}
+		Unlock();
+		return found;
+	}
+
+	void Clear()
+	{
+		jobs.Clear();
+		head = 0;
+		available = 0;
+	}
 };
 
+//==========================================================================
+//
+// Sprite jobs alter the actors they process (validcount, temporary flag
+// changes) and an actor can be reached from more than one sector, so these
+// jobs go into a separate lane that only one worker at a time may own.
+// Whichever worker is idle picks it up.
+//
+//==========================================================================
+
+class RenderJobLane : public RenderJobDeque
+{
+	std::atomic_flag owned = ATOMIC_FLAG_INIT;
+
+public:
+	bool Acquire()
+	{
+		return !IsEmpty() && !owned.test_and_set(std::memory_order_acquire);
+	}
+
+	void Release()
+	{
+		owned.clear(std::memory_order_release);
+	}
+};
 
 class RenderJobQueue
 {
-	RenderJob pool[300000];	// Way more than ever needed. The largest ever seen on a single viewpoint is around 40000.
-	std::atomic<int> readindex{};
-	std::atomic<int> writeindex{};
+	enum { BatchSize = 16 };	// jobs are handed out in batches to keep the locking overhead down and neighboring subsectors on the same worker.
+
+	RenderJobDeque deques[MAX_BSP_WORKERS];
+	RenderJobLane actorLane;
+	HWWorkerOutput outputs[MAX_BSP_WORKERS];
+	RenderJob batch[BatchSize];
+	unsigned batchCount = 0;
+	unsigned numJobs = 0;
+	int numWorkers = 1;
+	int nextDeque = 0;
+	std::atomic<bool> finished{};
+
+	void Flush()
+	{
+		if (batchCount > 0)
+		{
+			deques[nextDeque].Push(batch, batchCount);
+			if (++nextDeque == numWorkers) nextDeque = 0;
+			batchCount = 0;
+		}
+	}
+
 public:
+	void Start(int workers)
+	{
+		numWorkers = workers;
+		for (int i = 0; i < workers; i++)
+		{
+			deques[i].Clear();
+			outputs[i].Reset();
+		}
+		actorLane.Clear();
+		batchCount = 0;
+		numJobs = 0;
+		nextDeque = 0;
+		finished = false;
+	}
+
 	void AddJob(int type, subsector_t *sub, seg_t *seg = nullptr)
 	{
-		// This does not check for array overflows. The pool should be large enough that it never hits the limit.
+		RenderJob job = { type, sub, seg, numJobs++ };
 
-		pool[writeindex] = { type, sub, seg };
-		writeindex++;	// update index only after the value has been written.
+		// With a single worker everything goes through the same queue so that the worker can write to the draw info directly.
+		if (type == RenderJob::SpriteJob && numWorkers > 1)
+		{
+			actorLane.Push(&job, 1);
+		}
+		else
+		{
+			batch[batchCount++] = job;
+			if (batchCount == BatchSize) Flush();
+		}
 	}
 
-	RenderJob *GetJob()
+	void Finish()
 	{
-		if (readindex < writeindex) return &pool[readindex++];
-		return nullptr;
+		Flush();
+		finished.store(true, std::memory_order_release);
 	}
-	
-	void ReleaseAll()
+
+	bool GetJob(int worker, RenderJob &job)
 	{
-		readindex = 0;
-		writeindex = 0;
+		if (deques[worker].PopFront(job)) return true;
+		for (int i = 1; i < numWorkers; i++)
+		{
+			if (deques[(worker + i) % numWorkers].PopBack(job)) return true;
+		}
+		return false;
+	}
+
+	bool IsDone() const
+	{
+		if (!finished.load(std::memory_order_acquire) || !actorLane.IsEmpty()) return false;
+		for (int i = 0; i < numWorkers; i++)
+		{
+			if (!deques[i].IsEmpty()) return false;
+		}
+		return true;
 	}
+
+	RenderJobLane &ActorLane() { return actorLane; }
+	HWWorkerOutput *Output(int worker) { return numWorkers > 1 ? &outputs[worker] : nullptr; }
+	HWWorkerOutput &GetOutput(int worker) { return outputs[worker]; }
+	int NumWorkers() const { return numWorkers; }
+	unsigned NumJobs() const { return numJobs; }
 };
 
 static RenderJobQueue jobQueue;	// One static queue is sufficient here. This code will never be called recursively.
 
-void HWDrawInfo::WorkerThread()
+static int BSPWorkerCount()
+{
+	if (gl_multithread_workers > 0) return gl_multithread_workers;
+	// The hardware threads usually come in pairs per core.
+	int threads = (int)std::thread::hardware_concurrency();
+	return clamp(threads / 2, 1, 8);
+}
+
+//==========================================================================
+//
+// Workers take their memory from the render data allocator in large
+// blocks so that it only rarely needs to be locked.
+//
+//==========================================================================
+
+static std::mutex renderDataMutex;
+
+void *HWWorkerOutput::Alloc(size_t size)
+{
+	size = (size + 15) & ~size_t(15);
+	if (size > MemoryLeft)
+	{
+		size_t blocksize = std::max<size_t>(size, 64 * 1024);
+		std::lock_guard<std::mutex> lock(renderDataMutex);
+		Memory = (uint8_t*)RenderDataAllocator.Alloc(blocksize);
+		MemoryLeft = blocksize;
+	}
+	auto mem = Memory;
+	Memory += size;
+	MemoryLeft -= size;
+	return mem;
+}
+
+void HWDrawInfo::RunJob(RenderJob &job, HWWallDispatcher &disp, bool timing)
 {
 	sector_t *front, *back;
-	HWWallDispatcher disp(this);
 
-	WTTotal.Clock();
-	isWorkerThread = true;	// for adding asserts in GL API code. The worker thread may never call any GL API.
-	while (true)
+	// Note that the main thread MUST have prepared the fake sectors that get used below!
+	// This worker thread cannot prepare them itself without costly synchronization.
+	switch (job.type)
 	{
-		auto job = jobQueue.GetJob();
-		if (job == nullptr)
+	case RenderJob::WallJob:
+	{
+		HWWall wall;
+		if (timing) SetupWall.Clock();
+		wall.sub = job.sub;
+
+		front = hw_FakeFlat(job.sub->sector, in_area, false);
+		auto seg = job.seg;
+		auto backsector = seg->backsector;
+		if (!backsector && seg->linedef->isVisualPortal() && seg->sidedef == seg->linedef->sidedef[0]) // For one-sided portals use the portal's destination sector as backsector.
 		{
-#ifdef ARCH_IA32
-			// The queue is empty. But yielding would be too costly here and possibly cause further delays down the line if the thread is halted.
-			// So instead add a few pause instructions and retry immediately.
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-			_mm_pause();
-#endif // ARCH_IA32
+			auto portal = seg->linedef->getPortal();
+			backsector = portal->mDestination->frontsector;
+			back = hw_FakeFlat(backsector, in_area, true);
+			if (front->floorplane.isSlope() || front->ceilingplane.isSlope() || back->floorplane.isSlope() || back->ceilingplane.isSlope())
+			{
+				// Having a one-sided portal like this with slopes is too messy so let's ignore that case.
+				back = nullptr;
+			}
 		}
-		// Note that the main thread MUST have prepared the fake sectors that get used below!
-		// This worker thread cannot prepare them itself without costly synchronization.
-		else switch (job->type)
+		else if (backsector)
 		{
-		case RenderJob::TerminateJob:
-			WTTotal.Unclock();
-			return;
-
-		case RenderJob::WallJob:
-		{
-			HWWall wall;
-			SetupWall.Clock();
-			wall.sub = job->sub;
-
-			front = hw_FakeFlat(job->sub->sector, in_area, false);
-			auto seg = job->seg;
-			auto backsector = seg->backsector;
-			if (!backsector && seg->linedef->isVisualPortal() && seg->sidedef == seg->linedef->sidedef[0]) // For one-sided portals use the portal's destination sector as backsector.
+			if (front->sectornum == backsector->sectornum || (seg->sidedef->Flags & WALLF_POLYOBJ))
+			{
+				back = front;
+			}
+			else
 			{
-				auto portal = seg->linedef->getPortal();
-				backsector = portal->mDestination->frontsector;
 				back = hw_FakeFlat(backsector, in_area, true);
-				if (front->floorplane.isSlope() || front->ceilingplane.isSlope() || back->floorplane.isSlope() || back->ceilingplane.isSlope())
-				{
-					// Having a one-sided portal like this with slopes is too messy so let's ignore that case.
-					back = nullptr;
-				}
 			}
-			else if (backsector)
+		}
+		else back = nullptr;
+
+		wall.Process(&disp, job.seg, front, back);
+		CountStat(rendered_lines, &HWWorkerOutput::RenderedLines);
+		if (timing) SetupWall.Unclock();
+		break;
+	}
+
+	case RenderJob::FlatJob:
+	{
+		HWFlat flat;
+		if (timing) SetupFlat.Clock();
+		flat.section = job.sub->section;
+		front = hw_FakeFlat(job.sub->render_sector, in_area, false);
+		flat.ProcessSector(this, front);
+		if (timing) SetupFlat.Unclock();
+		break;
+	}
+
+	case RenderJob::SpriteJob:
+		if (timing) SetupSprite.Clock();
+		front = hw_FakeFlat(job.sub->sector, in_area, false);
+		RenderThings(job.sub, front);
+		if (timing) SetupSprite.Unclock();
+		break;
+
+	case RenderJob::ParticleJob:
+		if (timing) SetupSprite.Clock();
+		front = hw_FakeFlat(job.sub->sector, in_area, false);
+		RenderParticles(job.sub, front);
+		if (timing) SetupSprite.Unclock();
+		break;
+
+	case RenderJob::PortalJob:
+		AddSubsectorToPortal((FSectorPortalGroup *)job.seg, job.sub);
+		break;
+	}
+}
+
+void HWDrawInfo::WorkerThread(int worker)
+{
+	HWWallDispatcher disp(this);
+	RenderJob job;
+	auto &lane = jobQueue.ActorLane();
+	auto output = jobQueue.Output(worker);
+	bool timing = worker == 0;	// the profiling timers are not thread safe.
+
+	if (timing) WTTotal.Clock();
+	isWorkerThread = true;	// for adding asserts in GL API code. The worker thread may never call any GL API.
+	workerOutput = output;
+	while (true)
+	{
+		if (lane.Acquire())
+		{
+			while (lane.PopFront(job))
 			{
-				if (front->sectornum == backsector->sectornum || (seg->sidedef->Flags & WALLF_POLYOBJ))
-				{
-					back = front;
-				}
-				else
-				{
-					back = hw_FakeFlat(backsector, in_area, true);
-				}
+				if (output) output->CurrentJob = job.index;
+				RunJob(job, disp, timing);
 			}
-			else back = nullptr;
+			lane.Release();
+		}
 
-			wall.Process(&disp, job->seg, front, back);
-			rendered_lines++;
-			SetupWall.Unclock();
+		if (jobQueue.GetJob(worker, job))
+		{
+			if (output) output->CurrentJob = job.index;
+			RunJob(job, disp, timing);
+		}
+		else if (jobQueue.IsDone())
+		{
 			break;
 		}
+		else
+		{
+			// The main thread has not caught up yet.
+			SpinPause();
+		}
+	}
+	workerOutput = nullptr;
+	if (timing) WTTotal.Unclock();
+}
 
-		case RenderJob::FlatJob:
+//==========================================================================
+//
+// Adds everything the workers have recorded to the draw info, in the
+// order the jobs were submitted. The records of one job all come from
+// the same worker and are already in order, so sorting by job suffices.
+//
+//==========================================================================
+
+void HWDrawInfo::ReplayWorkerOutput()
+{
+	static TArray<unsigned> jobStart;
+	static TArray<HWDeferredOp *> sorted;
+
+	unsigned numjobs = jobQueue.NumJobs();
+	jobStart.Resize(numjobs + 1);
+	memset(jobStart.Data(), 0, jobStart.Size() * sizeof(unsigned));
+
+	for (int w = 0; w < jobQueue.NumWorkers(); w++)
+	{
+		auto &output = jobQueue.GetOutput(w);
+		for (auto &op : output.Ops) jobStart[op.job + 1]++;
+
+		rendered_lines += output.RenderedLines;
+		rendered_flats += output.RenderedFlats;
+		rendered_sprites += output.RenderedSprites;
+		iter_dlight += output.IterDLight;
+		draw_dlight += output.DrawDLight;
+		iter_dlightf += output.IterDLightF;
+		draw_dlightf += output.DrawDLightF;
+	}
+	for (unsigned j = 0; j < numjobs; j++)
+	{
+		jobStart[j + 1] += jobStart[j];
+	}
+	sorted.Resize(jobStart[numjobs]);
+	for (int w = 0; w < jobQueue.NumWorkers(); w++)
+	{
+		for (auto &op : jobQueue.GetOutput(w).Ops) sorted[jobStart[op.job]++] = &op;
+	}
+
+	HWWallDispatcher disp(this);
+	for (auto op : sorted)
+	{
+		switch (op->type)
 		{
-			HWFlat flat;
-			SetupFlat.Clock();
-			flat.section = job->sub->section;
-			front = hw_FakeFlat(job->sub->render_sector, in_area, false);
-			flat.ProcessSector(this, front);
-			SetupFlat.Unclock();
+		case HWDeferredOp::Wall:
+			drawlists[op->list].AddWall((HWWall *)op->item);
 			break;
-		}
 
-		case RenderJob::SpriteJob:
-			SetupSprite.Clock();
-			front = hw_FakeFlat(job->sub->sector, in_area, false);
-			RenderThings(job->sub, front);
-			SetupSprite.Unclock();
+		case HWDeferredOp::Flat:
+			drawlists[op->list].AddFlat((HWFlat *)op->item);
 			break;
 
-		case RenderJob::ParticleJob:
-			SetupSprite.Clock();
-			front = hw_FakeFlat(job->sub->sector, in_area, false);
-			RenderParticles(job->sub, front);
-			SetupSprite.Unclock();
+		case HWDeferredOp::Sprite:
+			drawlists[op->list].AddSprite((HWSprite *)op->item);
+			break;
+
+		case HWDeferredOp::Decal:
+			Decals[op->list].Push((HWDecal *)op->item);
+			break;
+
+		case HWDeferredOp::UpperMissing:
+			AddUpperMissingTexture((side_t *)op->item, (subsector_t *)op->item2, op->height);
+			break;
+
+		case HWDeferredOp::LowerMissing:
+			AddLowerMissingTexture((side_t *)op->item, (subsector_t *)op->item2, op->height);
+			break;
+
+		case HWDeferredOp::Portal:
+			((HWWall *)op->item)->PutPortal(&disp, op->list, op->plane);
 			break;
 
-		case RenderJob::PortalJob:
-			AddSubsectorToPortal((FSectorPortalGroup *)job->seg, job->sub);
+		case HWDeferredOp::SubsectorPortal:
+			AddSubsectorToPortal((FSectorPortalGroup *)op->item, (subsector_t *)op->item2);
 			break;
 		}
+	}
+}
+
+
+//==========================================================================
+//
+// Visibility cache for the main view
+//
+// The BSP walk and the clipper always run on the main thread, no matter
+// how many workers are processing its output. If neither the view nor
+// any geometry that took part in the visibility decisions has changed
+// since the walk was recorded, the subsectors and segs it found are fed
+// to the same processing code again without any clipping.
+//
+// Only the walk gets cached, not the walls and flats made from it. They
+// depend on lights, animated textures and vertex buffers which all get
+// refreshed every frame anyway.
+//
+//==========================================================================
+
+CVAR(Bool, gl_viscache, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CVAR(Float, gl_viscache_maxmove, 0.f, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// anything above 0 allows small errors at occluder edges.
+
+struct HWVisibleSubsector
+{
+	subsector_t *sub;
+	unsigned firstseg;
+	unsigned numsegs;
+};
+
+static inline void HashBits(uint64_t &hash, uint64_t value)
+{
+	hash = (hash ^ value) * 0x100000001b3ull;
+}
+
+static inline void HashDouble(uint64_t &hash, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	HashBits(hash, bits);
+}
+
+static void HashPlane(uint64_t &hash, const secplane_t &plane)
+{
+	auto &normal = plane.Normal();
+	HashDouble(hash, normal.X);
+	HashDouble(hash, normal.Y);
+	HashDouble(hash, normal.Z);
+	HashDouble(hash, plane.fD());
+}
+
+struct HWVisibilityCache
+{
+	TArray<HWVisibleSubsector> Subsectors;
+	TArray<seg_t *> Segs;
+	TArray<sector_t *> Sectors;	// everything that can change the clipping of the cached segs.
+
+	// The view the cache was recorded for.
+	FLevelLocals *Level = nullptr;
+	FString MapName;
+	subsector_t *LevelSubsectors;
+	subsector_t *ViewSubsector;
+	fixed_t ViewX, ViewY;
+	angle_t ViewAngle, ViewFrustum;
+	area_t Area;
+	FTextureID SkyFlat;
+	uint64_t GeometryHash;
+	bool Valid = false;
+
+	void Begin(HWDrawInfo *di, subsector_t *viewsub, angle_t frustum);
+	void Finish();
+	bool Matches(HWDrawInfo *di, subsector_t *viewsub, angle_t frustum);
+	uint64_t HashGeometry() const;
+
+	void AddSubsector(subsector_t *sub)
+	{
+		Subsectors.Push({ sub, Segs.Size(), 0 });
+	}
+
+	void AddSeg(seg_t *seg)
+	{
+		Segs.Push(seg);
+		Subsectors.Last().numsegs++;
+	}
+};
+
+static HWVisibilityCache visibilityCache;
+
+void HWVisibilityCache::Begin(HWDrawInfo *di, subsector_t *viewsub, angle_t frustum)
+{
+	Valid = false;
+	Subsectors.Clear();
+	Segs.Clear();
+	Sectors.Clear();
+
+	Level = di->Level;
+	MapName = Level->MapName;
+	LevelSubsectors = Level->subsectors.Data();
+	ViewSubsector = viewsub;
+	ViewX = di->viewx;
+	ViewY = di->viewy;
+	ViewAngle = di->Viewpoint.Angles.Yaw.BAMs();
+	ViewFrustum = frustum;
+	Area = di->in_area;
+	SkyFlat = skyflatnum;
+}
+
+void HWVisibilityCache::Finish()
+{
+	static TArray<uint8_t> added;
+
+	added.Resize(Level->sectors.Size());
+	memset(added.Data(), 0, added.Size());
+	auto addSector = [&](sector_t *sec)
+	{
+		while (sec != nullptr && !added[sec->Index()])
+		{
+			added[sec->Index()] = true;
+			Sectors.Push(sec);
+			sec = sec->heightsec;	// the fake flats made from the control sector decide the clipping as well.
+		}
+	};
 
+	for (auto &vis : Subsectors) addSector(vis.sub->sector);
+	for (auto seg : Segs)
+	{
+		addSector(seg->frontsector);
+		addSector(seg->backsector);
+	}
+	GeometryHash = HashGeometry();
+	Valid = true;
+}
+
+uint64_t HWVisibilityCache::HashGeometry() const
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (auto &vis : Subsectors)
+	{
+		// The dirty flag cannot be used to see whether a polyobject moved, because
+		// another view's BSP walk may already have rebuilt the mini-BSP and cleared
+		// it. So the polyobjects' positions are hashed, along with the segs the
+		// recorded pointers point into.
+		auto sub = vis.sub;
+		HashBits(hash, (uintptr_t)sub->polys);
+		for (auto pnode = sub->polys; pnode != nullptr; pnode = pnode->pnext)
+		{
+			auto poly = pnode->poly;
+			HashBits(hash, (uintptr_t)poly);
+			HashDouble(hash, poly->CenterSpot.pos.X);
+			HashDouble(hash, poly->CenterSpot.pos.Y);
+			HashDouble(hash, poly->Angle.Degrees());
+		}
+		if (sub->polys != nullptr && sub->BSP != nullptr)
+		{
+			HashBits(hash, (uintptr_t)sub->BSP->Segs.Data());
+			HashBits(hash, sub->BSP->Segs.Size());
+		}
 	}
+	for (auto seg : Segs)
+	{
+		auto side = seg->sidedef;
+		HashBits(hash, side->GetTexture(side_t::top).GetIndex());
+		HashBits(hash, side->GetTexture(side_t::mid).GetIndex());
+		HashBits(hash, side->GetTexture(side_t::bottom).GetIndex());
+		HashBits(hash, seg->linedef->isVisualPortal());
+	}
+	for (auto sec : Sectors)
+	{
+		HashPlane(hash, sec->floorplane);
+		HashPlane(hash, sec->ceilingplane);
+		HashBits(hash, sec->GetTexture(sector_t::floor).GetIndex());
+		HashBits(hash, sec->GetTexture(sector_t::ceiling).GetIndex());
+		HashBits(hash, sec->GetPortal(sector_t::floor)->mFlags);
+		HashBits(hash, sec->GetPortal(sector_t::ceiling)->mFlags);
+		HashBits(hash, (uintptr_t)sec->heightsec);
+		HashBits(hash, sec->MoreFlags & ~SECMF_DRAWN);
+	}
+	return hash;
 }
 
+bool HWVisibilityCache::Matches(HWDrawInfo *di, subsector_t *viewsub, angle_t frustum)
+{
+	if (!Valid || di->Level != Level || Level->subsectors.Data() != LevelSubsectors || MapName.Compare(Level->MapName)) return false;
+	if (viewsub != ViewSubsector || di->in_area != Area || skyflatnum != SkyFlat) return false;
+	if (di->Viewpoint.Angles.Yaw.BAMs() != ViewAngle || frustum != ViewFrustum) return false;
+
+	// The height of the view does not matter unless it changes the area, which has already been checked.
+	fixed_t maxmove = FLOAT2FIXED(max<double>(gl_viscache_maxmove, 0));
+	if (abs(di->viewx - ViewX) > maxmove || abs(di->viewy - ViewY) > maxmove) return false;
 
+	return HashGeometry() == GeometryHash;
+}
 
+//==========================================================================
+//
+// Processes the cached subsectors in the order they were originally found.
+//
+//==========================================================================
 
+void HWDrawInfo::RenderVisibleSet()
+{
+	for (auto &vis : visibilityCache.Subsectors)
+	{
+		mVisSegs = visibilityCache.Segs.Data() + vis.firstseg;
+		mVisNumSegs = vis.numsegs;
+		DoSubsector(vis.sub);
+	}
+}
 
 EXTERN_CVAR(Bool, gl_render_segs)
 
@@ -259,38 +769,44 @@ void HWDrawInfo::AddLine (seg_t *seg, bool portalclip)
 #endif
 
 	sector_t * backsector = nullptr;
+	auto &clipper = *mClipper;
+	angle_t startAngle = 0, endAngle = 0;
 
-	if (portalclip)
+	// Segs from the visibility cache are already known to be visible.
+	if (!mVisReplay)
 	{
-		int clipres = mClipPortal->ClipSeg(seg, Viewpoint.Pos);
-		if (clipres == PClip_InFront) return;
-	}
+		if (portalclip)
+		{
+			int clipres = mClipPortal->ClipSeg(seg, Viewpoint.Pos);
+			if (clipres == PClip_InFront) return;
+		}
 
-	auto &clipper = *mClipper;
-	angle_t startAngle = clipper.GetClipAngle(seg->v2);
-	angle_t endAngle = clipper.GetClipAngle(seg->v1);
+		startAngle = clipper.GetClipAngle(seg->v2);
+		endAngle = clipper.GetClipAngle(seg->v1);
 
-	// Back side, i.e. backface culling	- read: endAngle >= startAngle!
-	if (startAngle-endAngle<ANGLE_180)  
-	{
-		return;
-	}
+		// Back side, i.e. backface culling	- read: endAngle >= startAngle!
+		if (startAngle-endAngle<ANGLE_180)  
+		{
+			return;
+		}
 
-	if (seg->sidedef == nullptr)
-	{
-		if (!(currentsubsector->flags & SSECMF_DRAWN))
+		if (seg->sidedef == nullptr)
 		{
-			if (clipper.SafeCheckRange(startAngle, endAngle)) 
+			if (!(currentsubsector->flags & SSECMF_DRAWN))
 			{
-				currentsubsector->flags |= SSECMF_DRAWN;
+				if (clipper.SafeCheckRange(startAngle, endAngle)) 
+				{
+					currentsubsector->flags |= SSECMF_DRAWN;
+				}
 			}
+			return;
 		}
-		return;
-	}
 
-	if (!clipper.SafeCheckRange(startAngle, endAngle)) 
-	{
-		return;
+		if (!clipper.SafeCheckRange(startAngle, endAngle)) 
+		{
+			return;
+		}
+		if (mVisRecord) visibilityCache.AddSeg(seg);
 	}
 	currentsubsector->flags |= SSECMF_DRAWN;
 
@@ -298,7 +814,7 @@ void HWDrawInfo::AddLine (seg_t *seg, bool portalclip)
 
 	if (!seg->backsector)
 	{
-		clipper.SafeAddClipRange(startAngle, endAngle);
+		if (!mVisReplay) clipper.SafeAddClipRange(startAngle, endAngle);
 	}
 	else if (!ispoly)	// Two-sided polyobjects never obstruct the view
 	{
@@ -323,7 +839,7 @@ void HWDrawInfo::AddLine (seg_t *seg, bool portalclip)
 
 			backsector = hw_FakeFlat(seg->backsector, in_area, true);
 
-			if (hw_CheckClip(seg->sidedef, currentsector, backsector))
+			if (!mVisReplay && hw_CheckClip(seg->sidedef, currentsector, backsector))
 			{
 				clipper.SafeAddClipRange(startAngle, endAngle);
 			}
@@ -456,7 +972,15 @@ void HWDrawInfo::AddLines(subsector_t * sub, sector_t * sector)
 	currentsubsector = sub;
 
 	ClipWall.Clock();
-	if (sub->polys != nullptr)
+	if (mVisReplay)
+	{
+		// This includes the segs of any polyobjects in the subsector.
+		for (unsigned i = 0; i < mVisNumSegs; i++)
+		{
+			AddLine(mVisSegs[i], false);
+		}
+	}
+	else if (sub->polys != nullptr)
 	{
 		AddPolyobjs(sub);
 	}
@@ -596,7 +1120,6 @@ void HWDrawInfo::RenderThings(subsector_t * sub, sector_t * sector)
 
 void HWDrawInfo::RenderParticles(subsector_t *sub, sector_t *front)
 {
-	SetupSprite.Clock();
 	for (uint32_t i = 0; i < sub->sprites.Size(); i++)
 	{
 		DVisualThinker *sp = sub->sprites[i];
@@ -612,7 +1135,7 @@ void HWDrawInfo::RenderParticles(subsector_t *sub, sector_t *front)
 
 		sp->spr->ProcessParticle(this, &sp->PT, front, sp);
 	}
-	for (int i = Level->ParticlesInSubsec[sub->Index()]; i != NO_PARTICLE; i = Level->Particles[i].snext)
+	for (uint32_t i = Level->ParticlesInSubsec[sub->Index()]; i != NO_PARTICLE; i = Level->ParticleSubsecNext[i])
 	{
 		if (mClipPortal)
 		{
@@ -623,7 +1146,6 @@ void HWDrawInfo::RenderParticles(subsector_t *sub, sector_t *front)
 		HWSprite sprite;
 		sprite.ProcessParticle(this, &Level->Particles[i], front, nullptr);
 	}
-	SetupSprite.Unclock();
 }
 
 
@@ -651,18 +1173,21 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 	sector=sub->sector;
 	if (!sector) return;
 
-	// If the mapsections differ this subsector can't possibly be visible from the current view point
-	if (!CurrentMapSections[sub->mapsection]) return;
-	if (sub->flags & SSECF_POLYORG) return;	// never render polyobject origin subsectors because their vertices no longer are where one may expect.
-
-	if (ss_renderflags[sub->Index()] & SSRF_SEEN)
+	if (!mVisReplay)
 	{
-		// This means that we have reached a subsector in a portal that has been marked 'seen'
-		// from the other side of the portal. This means we must clear the clipper for the
-		// range this subsector spans before going on.
-		UnclipSubsector(sub);
+		// If the mapsections differ this subsector can't possibly be visible from the current view point
+		if (!CurrentMapSections[sub->mapsection]) return;
+		if (sub->flags & SSECF_POLYORG) return;	// never render polyobject origin subsectors because their vertices no longer are where one may expect.
+
+		if (ss_renderflags[sub->Index()] & SSRF_SEEN)
+		{
+			// This means that we have reached a subsector in a portal that has been marked 'seen'
+			// from the other side of the portal. This means we must clear the clipper for the
+			// range this subsector spans before going on.
+			UnclipSubsector(sub);
+		}
+		if (mClipper->IsBlocked()) return;	// if we are inside a stacked sector portal which hasn't unclipped anything yet.
 	}
-	if (mClipper->IsBlocked()) return;	// if we are inside a stacked sector portal which hasn't unclipped anything yet.
 
 	fakesector=hw_FakeFlat(sector, in_area, false);
 
@@ -677,6 +1202,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 			return;
 		}
 	}
+	if (mVisRecord) visibilityCache.AddSubsector(sub);
 
 	if (sector->validcount != validcount)
 	{
@@ -859,26 +1385,59 @@ void HWDrawInfo::RenderBSP(void *node, bool drawpsprites)
 
 	validcount++;	// used for processing sidedefs only once by the renderer.
 
+	// Only the main view gets cached. Portals and camera textures would just keep replacing it.
+	mVisRecord = mVisReplay = false;
+	if (gl_viscache && drawpsprites && outer == nullptr && mCurrentPortal == nullptr && mClipPortal == nullptr)
+	{
+		auto viewsub = Level->PointInRenderSubsector(Viewpoint.Pos);
+		angle_t frustum = FrustumAngle();
+		mVisReplay = visibilityCache.Matches(this, viewsub, frustum);
+		if (!mVisReplay)
+		{
+			visibilityCache.Begin(this, viewsub, frustum);
+			mVisRecord = true;
+		}
+	}
+
 	multithread = gl_multithread;
 	if (multithread)
 	{
-		jobQueue.ReleaseAll();
-		auto future = renderPool.push([&](int id) {
-			WorkerThread();
-		});
-		RenderBSPNode(node);
+		int numworkers = BSPWorkerCount();
+		std::future<void> futures[MAX_BSP_WORKERS];
+
+		if (renderPool.size() < numworkers) renderPool.resize(numworkers);
+		jobQueue.Start(numworkers);
+		for (int i = 0; i < numworkers; i++)
+		{
+			futures[i] = renderPool.push([this, i](int id) {
+				WorkerThread(i);
+			});
+		}
+		if (mVisReplay) RenderVisibleSet();
+		else RenderBSPNode(node);
 
-		jobQueue.AddJob(RenderJob::TerminateJob, nullptr, nullptr);
+		jobQueue.Finish();
 		Bsp.Unclock();
 		MTWait.Clock();
-		future.wait();
+		for (int i = 0; i < numworkers; i++) futures[i].wait();
 		MTWait.Unclock();
+
+		if (numworkers > 1)
+		{
+			Bsp.Clock();
+			ReplayWorkerOutput();
+			Bsp.Unclock();
+		}
 	}
 	else
 	{
-		RenderBSPNode(node);
+		if (mVisReplay) RenderVisibleSet();
+		else RenderBSPNode(node);
 		Bsp.Unclock();
 	}
+	if (mVisRecord) visibilityCache.Finish();
+	mVisRecord = mVisReplay = false;
+
 	// Process all the sprites on the current portal's back side which touch the portal.
 	if (mCurrentPortal != nullptr) mCurrentPortal->RenderAttached(this);
 
@@ -422,6 +422,7 @@ HWPortal * HWDrawInfo::FindPortal(const void * src)
 
 HWDecal *HWDrawInfo::AddDecal(bool onmirror)
 {
+	if (workerOutput) return (HWDecal*)workerOutput->NewItem(HWDeferredOp::Decal, onmirror, sizeof(HWDecal));
 	auto decal = (HWDecal*)RenderDataAllocator.Alloc(sizeof(HWDecal));
 	Decals[onmirror ? 1 : 0].Push(decal);
 	return decal;
@@ -877,6 +878,11 @@ void HWDrawInfo::ProcessScene(bool toscreen)
 
 void HWDrawInfo::AddSubsectorToPortal(FSectorPortalGroup *ptg, subsector_t *sub)
 {
+	if (workerOutput)
+	{
+		workerOutput->Record(HWDeferredOp::SubsectorPortal, 0, ptg, sub);
+		return;
+	}
 	auto portal = FindPortal(ptg);
 	if (!portal)
 	{
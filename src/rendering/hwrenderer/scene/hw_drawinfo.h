@@ -36,6 +36,8 @@ class FFlatVertexBuffer;
 class IRenderQueue;
 class HWScenePortalBase;
 class FRenderState;
+struct HWWallDispatcher;
+struct RenderJob;
 
 //==========================================================================
 //
@@ -80,6 +82,82 @@ enum EPortalClip
 	PClip_Behind,
 };
 
+//==========================================================================
+//
+// When more than one BSP worker is running, nothing a job produces may go
+// straight into the draw info. Instead each worker records it here and the
+// main thread replays the records in job order once the BSP is done, so that
+// the result is the same as if a single worker had processed all jobs.
+//
+//==========================================================================
+
+struct HWDeferredOp
+{
+	enum
+	{
+		Wall,
+		Flat,
+		Sprite,
+		Decal,
+		UpperMissing,
+		LowerMissing,
+		Portal,
+		SubsectorPortal
+	};
+
+	unsigned job;
+	uint8_t type;
+	uint8_t list;		// draw list, decal list or portal type
+	int8_t plane;		// portal plane
+	float height;		// backsector height for missing textures
+	void *item;
+	void *item2;
+};
+
+struct HWWorkerOutput
+{
+	TArray<HWDeferredOp> Ops;
+	unsigned CurrentJob = 0;
+	uint8_t *Memory = nullptr;
+	size_t MemoryLeft = 0;
+
+	// Statistics of this worker, added to the global counters by ReplayWorkerOutput.
+	int RenderedLines = 0, RenderedFlats = 0, RenderedSprites = 0;
+	int IterDLight = 0, DrawDLight = 0, IterDLightF = 0, DrawDLightF = 0;
+
+	void *Alloc(size_t size);
+
+	void Record(uint8_t type, uint8_t list, void *item, void *item2 = nullptr, float height = 0, int plane = -1)
+	{
+		Ops.Push({ CurrentJob, type, list, (int8_t)plane, height, item, item2 });
+	}
+
+	void *NewItem(uint8_t type, uint8_t list, size_t size)
+	{
+		auto item = Alloc(size);
+		Record(type, list, item);
+		return item;
+	}
+
+	void Reset()
+	{
+		Ops.Clear();
+		Memory = nullptr;
+		MemoryLeft = 0;
+		RenderedLines = RenderedFlats = RenderedSprites = 0;
+		IterDLight = DrawDLight = IterDLightF = DrawDLightF = 0;
+	}
+};
+
+extern thread_local HWWorkerOutput *workerOutput;
+
+// Workers count into their own output, the global counters are not thread safe.
+inline void CountStat(int &global, int HWWorkerOutput::*counter, int amount = 1)
+{
+	if (workerOutput) workerOutput->*counter += amount;
+	else global += amount;
+}
+
 enum DrawListType
 {
 	GLDL_PLAINWALLS,
@@ -191,7 +269,17 @@ private:
 	subsector_t *currentsubsector;	// used by the line processing code.
 	sector_t *currentsector;
 
-	void WorkerThread();
+	// For the visibility cache
+	bool mVisRecord = false;
+	bool mVisReplay = false;
+	seg_t **mVisSegs = nullptr;
+	unsigned mVisNumSegs = 0;
+
+	void RenderVisibleSet();
+
+	void WorkerThread(int worker);
+	void RunJob(RenderJob &job, HWWallDispatcher &disp, bool timing);
+	void ReplayWorkerOutput();
 
 	void UnclipSubsector(subsector_t *sub);
 	
@@ -286,7 +374,7 @@ public:
 	void AddOtherFloorPlane(int sector, gl_subsectorrendernode * node);
 	void AddOtherCeilingPlane(int sector, gl_subsectorrendernode * node);
 
-	void GetDynSpriteLight(AActor *self, float x, float y, float z, FLightNode *node, int portalgroup, float *out);
+	void GetDynSpriteLight(AActor *self, float x, float y, float z, FSection *section, int portalgroup, float *out);
 	void GetDynSpriteLight(AActor *thing, particle_t *particle, float *out);
 
 	void PreparePlayerSprites(sector_t * viewsector, area_t in_area);
@@ -310,6 +398,10 @@ public:
 	void AddFlat(HWFlat *flat, bool fog);
 	void AddSprite(HWSprite *sprite, bool translucent);
 
+	HWWall *NewWall(int list);
+	HWFlat *NewFlat(int list);
+	HWSprite *NewSprite(int list);
+
 
     HWDecal *AddDecal(bool onmirror);
 
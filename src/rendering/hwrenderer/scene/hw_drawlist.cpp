@@ -83,6 +83,7 @@ void HWDrawList::Reset()
 {
 	if (sorted) SortNodes.Release(SortNodeStart);
 	sorted=NULL;
+	sortedFar=sortedNear=NULL;
 	walls.Clear();
 	flats.Clear();
 	sprites.Clear();
@@ -602,6 +603,66 @@ inline int HWDrawList::CompareSprites(SortNode * a,SortNode * b)
 	return reverseSort? s2->index-s1->index : s1->index-s2->index;
 }
 
+//==========================================================================
+//
+// Sprites are sorted by a 64 bit key that puts them in the same order
+// as CompareSprites. Large lists get a radix sort, which is stable, so
+// sprites with the same key also keep their order.
+//
+//==========================================================================
+
+struct SpriteKey
+{
+	uint64_t key;
+	SortNode *node;
+};
+
+enum { RadixSortMinSprites = 64 };
+
+uint64_t HWDrawList::SpriteSortKey(SortNode * node)
+{
+	HWSprite * s = sprites[drawitems[node->itemindex].index];
+
+	float depth = s->depth == 0 ? 0.f : s->depth;	// no separate -0.
+	uint32_t depthbits;
+	memcpy(&depthbits, &depth, sizeof(depthbits));
+	depthbits = (depthbits & 0x80000000) ? ~depthbits : depthbits | 0x80000000;	// now ascending like the float values.
+
+	uint32_t index = uint32_t(s->index) ^ 0x80000000;
+	if (reverseSort) index = ~index;
+
+	// The farthest sprite comes first.
+	return (uint64_t(~depthbits) << 32) | index;
+}
+
+static void RadixSortKeys(TArray<SpriteKey> &keys)
+{
+	static TArray<SpriteKey> temp;
+
+	unsigned count = keys.Size();
+	if (count < 2) return;
+	temp.Resize(count);
+
+	SpriteKey *src = keys.Data(), *dst = temp.Data();
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		unsigned buckets[256] = {};
+		for (unsigned i = 0; i < count; i++) buckets[(src[i].key >> shift) & 255]++;
+		if (buckets[(src[0].key >> shift) & 255] == count) continue;	// all keys have the same byte here.
+
+		unsigned pos = 0;
+		for (auto &b : buckets)
+		{
+			unsigned n = b;
+			b = pos;
+			pos += n;
+		}
+		for (unsigned i = 0; i < count; i++) dst[buckets[(src[i].key >> shift) & 255]++] = src[i];
+		std::swap(src, dst);
+	}
+	if (src != keys.Data()) memcpy(keys.Data(), src, count * sizeof(SpriteKey));
+}
+
 //==========================================================================
 //
 //
@@ -614,15 +675,26 @@ SortNode * HWDrawList::SortSpriteList(SortNode * head)
 	unsigned i;
 
 	static TArray<SortNode*> sortspritelist;
+	static TArray<SpriteKey> keys;
 
 	SortNode * parent=head->parent;
 
 	sortspritelist.Clear();
 	for(count=0,n=head;n;n=n->next) sortspritelist.Push(n);
-	std::stable_sort(sortspritelist.begin(), sortspritelist.end(), [=](SortNode *a, SortNode *b)
+	if (sortspritelist.Size() < RadixSortMinSprites)
 	{
-		return CompareSprites(a, b) < 0;
-	});
+		std::stable_sort(sortspritelist.begin(), sortspritelist.end(), [=](SortNode *a, SortNode *b)
+		{
+			return CompareSprites(a, b) < 0;
+		});
+	}
+	else
+	{
+		keys.Resize(sortspritelist.Size());
+		for (i = 0; i < keys.Size(); i++) keys[i] = { SpriteSortKey(sortspritelist[i]), sortspritelist[i] };
+		RadixSortKeys(keys);
+		for (i = 0; i < keys.Size(); i++) sortspritelist[i] = keys[i].node;
+	}
 
 	for(i=0;i<sortspritelist.Size();i++)
 	{
@@ -706,6 +778,136 @@ SortNode * HWDrawList::DoSort(HWDrawInfo *di, SortNode * head)
 	return sn;
 }
 
+//==========================================================================
+//
+// Takes the sprites that cannot overlap any wall or flat out of the list
+// before it gets sorted.
+//
+// The sort tree tests every item against every splitter on its way down
+// and duplicates sprites that cross a translucent flat's plane for each
+// of them. With thousands of translucent sprites that gets very slow,
+// even though most of them are nowhere near a translucent wall or flat.
+//
+// So all sprites get sorted by depth first. The farthest ones that are
+// behind every wall and flat are drawn before the tree, and the nearest
+// ones that are in front of all of them after it. Both are in the order
+// the tree would have put them among each other. Only the ones in
+// between need the geometric sorting.
+//
+//==========================================================================
+
+CVAR(Bool, gl_sort_presplit, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+
+SortNode * HWDrawList::SplitOffSprites(HWDrawInfo *di, SortNode * head)
+{
+	static TArray<SpriteKey> keys;
+
+	// Depth along the horizontal view direction. Since this is zero at the view point,
+	// the item with the lower value is always the closer one along any line of sight
+	// on which both are in front of the viewer.
+	const auto &vp = di->Viewpoint;
+	double viewcos = vp.Angles.Yaw.Cos(), viewsin = vp.Angles.Yaw.Sin();
+	auto viewdepth = [&](double x, double y) { return (x - vp.Pos.X) * viewcos + (y - vp.Pos.Y) * viewsin; };
+
+	double mingeo = DBL_MAX, maxgeo = -DBL_MAX;
+	SortNode * anchor = nullptr;
+	auto addgeo = [&](double d)
+	{
+		mingeo = min(mingeo, d);
+		maxgeo = max(maxgeo, d);
+	};
+
+	keys.Clear();
+	for (SortNode * node = head; node; node = node->next)
+	{
+		auto &item = drawitems[node->itemindex];
+		switch (item.rendertype)
+		{
+		case DrawType_WALL:
+		{
+			HWWall * w = walls[item.index];
+			addgeo(viewdepth(w->glseg.x1, w->glseg.y1));
+			addgeo(viewdepth(w->glseg.x2, w->glseg.y2));
+			anchor = node;
+			break;
+		}
+
+		case DrawType_FLAT:
+		{
+			HWFlat * f = flats[item.index];
+			if (f->section == nullptr) return head;
+			auto &bounds = f->section->bounds;
+			addgeo(viewdepth(bounds.left, bounds.top));
+			addgeo(viewdepth(bounds.left, bounds.bottom));
+			addgeo(viewdepth(bounds.right, bounds.top));
+			addgeo(viewdepth(bounds.right, bounds.bottom));
+			anchor = node;
+			break;
+		}
+
+		case DrawType_SPRITE:
+			keys.Push({ SpriteSortKey(node), node });
+			break;
+		}
+	}
+
+	// Lists with nothing but sprites are just sorted by depth anyway.
+	if (anchor == nullptr || keys.Size() < RadixSortMinSprites) return head;
+	RadixSortKeys(keys);
+
+	auto spriterange = [&](unsigned i, double &nearest, double &farthest)
+	{
+		HWSprite * s = sprites[drawitems[keys[i].node->itemindex].index];
+		if (s->modelframe) return false;
+
+		// Rolled and billboarded sprites get turned around either the actor position or
+		// the center of their quad, so their corners stay within this distance of the actor.
+		double cx = (s->x1 + s->x2) * 0.5 - s->x, cy = (s->y1 + s->y2) * 0.5 - s->y, cz = (s->z1 + s->z2) * 0.5 - s->z;
+		double dx = s->x2 - s->x1, dy = s->y2 - s->y1, dz = s->z2 - s->z1;
+		double radius = sqrt(cx * cx + cy * cy + cz * cz) + sqrt(dx * dx + dy * dy + dz * dz);
+		double d = viewdepth(s->x, s->y);
+		nearest = d - radius;
+		farthest = d + radius;
+		return true;
+	};
+
+	unsigned first = 0, last = keys.Size();
+	double nearest, farthest;
+	while (first < last && spriterange(first, nearest, farthest) && nearest > max(maxgeo, 0.))
+	{
+		first++;
+	}
+	if (mingeo > 0)
+	{
+		while (last > first && spriterange(last - 1, nearest, farthest) && farthest < mingeo)
+		{
+			last--;
+		}
+	}
+	if (first == 0 && last == keys.Size()) return head;
+
+	auto makechain = [&](unsigned start, unsigned end)
+	{
+		SortNode * chain = nullptr, * tail = nullptr;
+		for (unsigned i = start; i < end; i++)
+		{
+			SortNode * node = keys[i].node;
+			node->UnlinkFromChain();
+			if (tail) tail->equal = node;
+			else chain = node;
+			tail = node;
+		}
+		return chain;
+	};
+	sortedFar = makechain(0, first);
+	sortedNear = makechain(last, keys.Size());
+
+	// The walls and flats are all still there.
+	head = anchor;
+	while (head->parent) head = head->parent;
+	return head;
+}
+
 //==========================================================================
 //
 //
@@ -716,7 +918,10 @@ void HWDrawList::Sort(HWDrawInfo *di)
 	reverseSort = !!(di->Level->i_compatflags & COMPATF_SPRITESORT);
     SortZ = di->Viewpoint.Pos.Z;
 	MakeSortList();
-	sorted = DoSort(di, SortNodes[SortNodeStart]);
+	SortNode * head = SortNodes[SortNodeStart];
+	sortedFar = sortedNear = NULL;
+	if (gl_sort_presplit) head = SplitOffSprites(di, head);
+	sorted = DoSort(di, head);
 }
 
 //==========================================================================
@@ -764,7 +969,7 @@ void HWDrawList::SortFlats()
 HWWall *HWDrawList::NewWall()
 {
 	auto wall = (HWWall*)RenderDataAllocator.Alloc(sizeof(HWWall));
-	drawitems.Push(HWDrawItem(DrawType_WALL, walls.Push(wall)));
+	AddWall(wall);
 	return wall;
 }
 
@@ -776,7 +981,7 @@ HWWall *HWDrawList::NewWall()
 HWFlat *HWDrawList::NewFlat()
 {
 	auto flat = (HWFlat*)RenderDataAllocator.Alloc(sizeof(HWFlat));
-	drawitems.Push(HWDrawItem(DrawType_FLAT,flats.Push(flat)));
+	AddFlat(flat);
 	return flat;
 }
 
@@ -788,7 +993,7 @@ HWFlat *HWDrawList::NewFlat()
 HWSprite *HWDrawList::NewSprite()
 {	
 	auto sprite = (HWSprite*)RenderDataAllocator.Alloc(sizeof(HWSprite));
-	drawitems.Push(HWDrawItem(DrawType_SPRITE, sprites.Push(sprite)));
+	AddSprite(sprite);
 	return sprite;
 }
 
@@ -953,7 +1158,9 @@ void HWDrawList::DrawSorted(HWDrawInfo *di, FRenderState &state)
 	state.ClearClipSplit();
 	state.EnableClipDistance(1, true);
 	state.EnableClipDistance(2, true);
+	if (sortedFar) DrawSorted(di, state, sortedFar);
 	DrawSorted(di, state, sorted);
+	if (sortedNear) DrawSorted(di, state, sortedNear);
 	state.EnableClipDistance(1, false);
 	state.EnableClipDistance(2, false);
 	state.ClearClipSplit();
@@ -68,6 +68,8 @@ struct HWDrawList
 	int SortNodeStart;
     float SortZ;
 	SortNode * sorted;
+	SortNode * sortedFar;	// sprites behind all walls and flats, drawn before the sorted tree
+	SortNode * sortedNear;	// sprites in front of all walls and flats, drawn after it
 	bool reverseSort;
 	
 public:
@@ -76,6 +78,7 @@ public:
 		next=NULL;
 		SortNodeStart=-1;
 		sorted=NULL;
+		sortedFar=sortedNear=NULL;
 	}
 	
 	~HWDrawList()
@@ -91,6 +94,23 @@ public:
 	HWWall *NewWall();
 	HWFlat *NewFlat();
 	HWSprite *NewSprite();
+
+	// For items that have already been allocated elsewhere, i.e. by a BSP worker.
+	void AddWall(HWWall *wall)
+	{
+		drawitems.Push(HWDrawItem(DrawType_WALL, walls.Push(wall)));
+	}
+
+	void AddFlat(HWFlat *flat)
+	{
+		drawitems.Push(HWDrawItem(DrawType_FLAT, flats.Push(flat)));
+	}
+
+	void AddSprite(HWSprite *sprite)
+	{
+		drawitems.Push(HWDrawItem(DrawType_SPRITE, sprites.Push(sprite)));
+	}
+
 	void Reset();
 	void SortWalls();
 	void SortFlats();
@@ -105,7 +125,9 @@ public:
 	void SortWallIntoWall(HWDrawInfo *di, SortNode * head,SortNode * sort);
 	void SortSpriteIntoWall(HWDrawInfo *di, SortNode * head,SortNode * sort);
 	int CompareSprites(SortNode * a,SortNode * b);
+	uint64_t SpriteSortKey(SortNode * node);
 	SortNode * SortSpriteList(SortNode * head);
+	SortNode * SplitOffSprites(HWDrawInfo *di, SortNode * head);
 	SortNode * DoSort(HWDrawInfo *di, SortNode * head);
 	void Sort(HWDrawInfo *di);
 
@@ -31,6 +31,31 @@
 
 EXTERN_CVAR(Bool, gl_seamless)
 
+//==========================================================================
+//
+// Allocates a draw item either in the given list or, on a BSP worker,
+// in the worker's output.
+//
+//==========================================================================
+
+HWWall *HWDrawInfo::NewWall(int list)
+{
+	if (workerOutput == nullptr) return drawlists[list].NewWall();
+	return (HWWall*)workerOutput->NewItem(HWDeferredOp::Wall, list, sizeof(HWWall));
+}
+
+HWFlat *HWDrawInfo::NewFlat(int list)
+{
+	if (workerOutput == nullptr) return drawlists[list].NewFlat();
+	return (HWFlat*)workerOutput->NewItem(HWDeferredOp::Flat, list, sizeof(HWFlat));
+}
+
+HWSprite *HWDrawInfo::NewSprite(int list)
+{
+	if (workerOutput == nullptr) return drawlists[list].NewSprite();
+	return (HWSprite*)workerOutput->NewItem(HWDeferredOp::Sprite, list, sizeof(HWSprite));
+}
+
 //==========================================================================
 //
 // 
@@ -41,7 +66,7 @@ void HWDrawInfo::AddWall(HWWall *wall)
 {
 	if (wall->flags & HWWall::HWF_TRANSLUCENT)
 	{
-		auto newwall = drawlists[GLDL_TRANSLUCENT].NewWall();
+		auto newwall = NewWall(GLDL_TRANSLUCENT);
 		*newwall = *wall;
 	}
 	else
@@ -57,7 +82,7 @@ void HWDrawInfo::AddWall(HWWall *wall)
 		{
 			list = masked ? GLDL_MASKEDWALLS : GLDL_PLAINWALLS;
 		}
-		auto newwall = drawlists[list].NewWall();
+		auto newwall = NewWall(list);
 		*newwall = *wall;
 	}
 }
@@ -71,7 +96,7 @@ void HWDrawInfo::AddWall(HWWall *wall)
 void HWDrawInfo::AddMirrorSurface(HWWall *w)
 {
 	w->type = RENDERWALL_MIRRORSURFACE;
-	auto newwall = drawlists[GLDL_TRANSLUCENTBORDER].NewWall();
+	auto newwall = NewWall(GLDL_TRANSLUCENTBORDER);
 	*newwall = *w;
 
 	// Invalidate vertices to allow setting of texture coordinates
@@ -130,7 +155,7 @@ void HWDrawInfo::AddFlat(HWFlat *flat, bool fog)
 		bool masked = flat->texture->isMasked() && ((flat->renderflags&SSRF_RENDER3DPLANES) || flat->stack);
 		list = masked ? GLDL_MASKEDFLATS : GLDL_PLAINFLATS;
 	}
-	auto newflat = drawlists[list].NewFlat();
+	auto newflat = NewFlat(list);
 	*newflat = *flat;
 }
 
@@ -153,7 +178,7 @@ void HWDrawInfo::AddSprite(HWSprite *sprite, bool translucent)
 		list = GLDL_MODELS;
 	}
 
-	auto newsprt = drawlists[list].NewSprite();
+	auto newsprt = NewSprite(list);
 	*newsprt = *sprite;
 }
 
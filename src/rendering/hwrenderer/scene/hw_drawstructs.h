@@ -333,7 +333,7 @@ public:
 	int dynlightindex;
 
 	void CreateSkyboxVertices(FFlatVertex *buffer);
-	void SetupLights(HWDrawInfo *di, FLightNode *head, FDynLightData &lightdata, int portalgroup);
+	void SetupLights(HWDrawInfo *di, FSection *section, FDynLightData &lightdata, int portalgroup);
 
 	void PutFlat(HWDrawInfo *di, bool fog = false);
 	void Process(HWDrawInfo *di, sector_t * model, int whichplane, bool notexture);
@@ -448,6 +448,7 @@ inline float Dist2(float x1,float y1,float x2,float y2)
 
 bool hw_SetPlaneTextureRotation(const HWSectorPlane * secplane, FGameTexture * gltexture, VSMatrix &mat);
 void hw_GetDynModelLight(AActor *self, FDynLightData &modellightdata);
+void hw_GetDynModelLights(AActor *self, TArray<struct FDynamicLight *> &lights);
 LightProbe* FindLightProbe(FLevelLocals* level, float x, float y, float z);
 
 extern const float LARGE_VALUE;
@@ -456,4 +457,6 @@ struct FDynLightData;
 struct FDynamicLight;
 bool GetLight(FDynLightData& dld, int group, Plane& p, FDynamicLight* light, bool checkside);
 void AddLightToList(FDynLightData &dld, int group, FDynamicLight* light, bool forceAttenuate);
+void AddLightToList(FDynLightData &dld, const DVector3 &pos, FDynamicLight* light, bool forceAttenuate);
+void PrepareLightData(FLevelLocals *Level);
 void SetSplitPlanes(FRenderState& state, const secplane_t& top, const secplane_t& bottom);
@@ -37,6 +37,7 @@
 #include "p_lnspec.h"
 #include "matrix.h"
 #include "hw_dynlightdata.h"
+#include "hw_lightindex.h"
 #include "hw_cvars.h"
 #include "hw_clock.h"
 #include "hw_lighting.h"
@@ -147,7 +148,7 @@ void HWFlat::CreateSkyboxVertices(FFlatVertex *vert)
 //
 //==========================================================================
 
-void HWFlat::SetupLights(HWDrawInfo *di, FLightNode * node, FDynLightData &lightdata, int portalgroup)
+void HWFlat::SetupLights(HWDrawInfo *di, FSection *section, FDynLightData &lightdata, int portalgroup)
 {
 	Plane p;
 
@@ -157,29 +158,26 @@ void HWFlat::SetupLights(HWDrawInfo *di, FLightNode * node, FDynLightData &light
 		dynlightindex = -1;
 		return;	// no lights on additively blended surfaces.
 	}
-	while (node)
+	for (auto index : LightIndex.SectionLights(section))
 	{
-		FDynamicLight * light = node->lightsource;
+		FDynamicLight * light = LightIndex.Lights[index].light;
 
-		if (!light->IsActive() || light->DontLightMap())
+		if (light->DontLightMap())
 		{
-			node = node->nextLight;
 			continue;
 		}
-		iter_dlightf++;
+		CountStat(iter_dlightf, &HWWorkerOutput::IterDLightF);
 
 		// we must do the side check here because gl_GetLight needs the correct plane orientation
 		// which we don't have for Legacy-style 3D-floors
 		double planeh = plane.plane.ZatPoint(light->Pos);
 		if ((planeh<light->Z() && ceiling) || (planeh>light->Z() && !ceiling))
 		{
-			node = node->nextLight;
 			continue;
 		}
 
 		p.Set(plane.plane.Normal(), plane.plane.fD());
-		draw_dlightf += GetLight(lightdata, portalgroup, p, light, false);
-		node = node->nextLight;
+		CountStat(draw_dlightf, &HWWorkerOutput::DrawDLightF, GetLight(lightdata, portalgroup, p, light, false));
 	}
 
 	dynlightindex = screen->mLights->UploadLights(lightdata);
@@ -195,7 +193,7 @@ void HWFlat::DrawSubsectors(HWDrawInfo *di, FRenderState &state)
 {
 	if (di->Level->HasDynamicLights && screen->BuffersArePersistent() && !di->isFullbrightScene())
 	{
-		SetupLights(di, section->lighthead, lightdata, sector->PortalGroup);
+		SetupLights(di, section, lightdata, sector->PortalGroup);
 	}
 	state.SetLightIndex(dynlightindex);
 
@@ -392,7 +390,7 @@ inline void HWFlat::PutFlat(HWDrawInfo *di, bool fog)
 	{
 		if (di->Level->HasDynamicLights && texture != nullptr && !di->isFullbrightScene() && !(hacktype & (SSRF_PLANEHACK|SSRF_FLOODHACK)) )
 		{
-			SetupLights(di, section->lighthead, lightdata, sector->PortalGroup);
+			SetupLights(di, section, lightdata, sector->PortalGroup);
 		}
 	}
 	di->AddFlat(this, fog);
@@ -440,7 +438,7 @@ void HWFlat::Process(HWDrawInfo *di, sector_t * model, int whichplane, bool fog)
 
 	// For hacks this won't go into a render list.
 	PutFlat(di, fog);
-	rendered_flats++;
+	CountStat(rendered_flats, &HWWorkerOutput::RenderedFlats);
 }
 
 //==========================================================================
@@ -0,0 +1,283 @@
+//
+//---------------------------------------------------------------------------
+//
+// Copyright(C) 2002-2018 Christoph Oelckers
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+//--------------------------------------------------------------------------
+//
+/*
+** hw_lightindex.cpp
+** Per-viewpoint index of the lights touching each section and sidedef
+**
+*/
+
+#include "c_dispatch.h"
+#include "doomstat.h"
+#include "a_dynlight.h"
+#include "g_levellocals.h"
+#include "actorinlines.h"
+#include "hw_dynlightdata.h"
+#include "hw_lightindex.h"
+#include "hwrenderer/scene/hw_drawstructs.h"
+#include "models.h"
+
+HWLightIndex LightIndex;
+
+//==========================================================================
+//
+// Adds all active lights of one light node list
+//
+//==========================================================================
+
+static void AddLightRefs(TArray<unsigned> &refs, FLightNode *node)
+{
+	while (node)
+	{
+		FDynamicLight *light = node->lightsource;
+		if (light->IsActive()) refs.Push(light->mLightIndex);
+		node = node->nextLight;
+	}
+}
+
+//==========================================================================
+//
+// Starts a new build. Slots that do not carry the current stamp are empty.
+//
+//==========================================================================
+
+void HWLightIndex::NewStamp(unsigned numsections, unsigned numsides)
+{
+	auto grow = [](TArray<RefList> &lists, unsigned size)
+	{
+		unsigned oldsize = lists.Size();
+		if (oldsize >= size) return;
+		lists.Resize(size);
+		for (unsigned i = oldsize; i < size; i++) lists[i].stamp = 0;
+	};
+	grow(SectionLists, numsections);
+	grow(SideLists, numsides);
+
+	if (++Stamp == 0)
+	{
+		for (auto &list : SectionLists) list.stamp = 0;
+		for (auto &list : SideLists) list.stamp = 0;
+		Stamp = 1;
+	}
+}
+
+void HWLightIndex::AddList(RefList &list, unsigned stamp, TArray<unsigned> &refs, FLightNode *head)
+{
+	if (list.stamp == stamp) return;	// already added for another light.
+	list.stamp = stamp;
+	list.start = refs.Size();
+	AddLightRefs(refs, head);
+	list.count = refs.Size() - list.start;
+}
+
+TArrayView<unsigned> HWLightIndex::GetList(const TArray<RefList> &lists, unsigned index, unsigned stamp, TArray<unsigned> &refs)
+{
+	if (index >= lists.Size() || lists[index].stamp != stamp || lists[index].count == 0) return TArrayView<unsigned>(nullptr, 0);
+	return TArrayView<unsigned>(&refs[lists[index].start], lists[index].count);
+}
+
+//==========================================================================
+//
+// Rebuilds everything for the level's current state
+//
+//==========================================================================
+
+void HWLightIndex::Build(FLevelLocals *lev)
+{
+	Clear();
+	Level = lev;
+	if (!Level->HasDynamicLights) return;
+
+	for (auto light = Level->lights; light; light = light->next)
+	{
+		if (!light->IsActive())
+		{
+			light->mLightIndex = -1;
+			continue;
+		}
+		light->mLightIndex = Lights.Size();
+
+		HWIndexedLight &rec = Lights[Lights.Reserve(1)];
+		rec.light = light;
+		rec.pos = light->Pos;
+		rec.radius = light->GetRadius();
+		rec.portalgroup = light->Sector->PortalGroup;
+		rec.shadowmapped = light->shadowmapped;
+
+		float lr = light->GetRed() / 255.0f;
+		float lg = light->GetGreen() / 255.0f;
+		float lb = light->GetBlue() / 255.0f;
+		if (light->IsSubtractive())
+		{
+			float bright = (float)FVector3(lr, lg, lb).Length();
+			lr = (bright - lr) * -1;
+			lg = (bright - lg) * -1;
+			lb = (bright - lb) * -1;
+		}
+		rec.spritecolor = { lr, lg, lb };
+
+		rec.spot = light->IsSpot();
+		if (rec.spot)
+		{
+			DAngle negPitch = -*light->pPitch;
+			DAngle Angle = light->target->Angles.Yaw;
+			double xyLen = negPitch.Cos();
+			rec.spotdir = { -Angle.Cos() * xyLen, -Angle.Sin() * xyLen, -negPitch.Sin() };
+			rec.spotinner = light->pSpotInnerAngle->Cos();
+			rec.spotouter = light->pSpotOuterAngle->Cos();
+		}
+		else
+		{
+			rec.spotdir.Zero();
+			rec.spotinner = rec.spotouter = 0;
+		}
+	}
+	if (Lights.Size() == 0) return;
+
+	NewStamp(Level->sections.allSections.Size(), Level->sides.Size());
+	for (auto &rec : Lights)
+	{
+		for (FLightNode *node = rec.light->touching_sector; node; node = node->nextTarget)
+		{
+			auto section = (FSection *)node->targ;
+			AddList(SectionLists[Level->sections.SectionIndex(section)], Stamp, SectionRefs, section->lighthead);
+		}
+		for (FLightNode *node = rec.light->touching_sides; node; node = node->nextTarget)
+		{
+			auto side = node->targLine;
+			AddList(SideLists[side->Index()], Stamp, SideRefs, side->lighthead);
+		}
+	}
+}
+
+//==========================================================================
+//
+// The arrays keep their memory so that rebuilding does not reallocate.
+//
+//==========================================================================
+
+void HWLightIndex::Clear()
+{
+	Level = nullptr;
+	Lights.Clear();
+	SectionRefs.Clear();
+	SideRefs.Clear();
+	NewStamp(0, 0);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+TArrayView<unsigned> HWLightIndex::SectionLights(const FSection *section)
+{
+	if (SectionRefs.Size() == 0) return TArrayView<unsigned>(nullptr, 0);
+	return GetList(SectionLists, Level->sections.SectionIndex(section), Stamp, SectionRefs);
+}
+
+TArrayView<unsigned> HWLightIndex::SideLights(const side_t *side)
+{
+	if (SideRefs.Size() == 0) return TArrayView<unsigned>(nullptr, 0);
+	return GetList(SideLists, side->Index(), Stamp, SideRefs);
+}
+
+//==========================================================================
+//
+// Compares the index against the light nodes it was built from,
+// and the model lights found through it against a search through the
+// light nodes themselves.
+//
+//==========================================================================
+
+static bool CompareLightList(FLightNode *node, TArrayView<unsigned> list)
+{
+	unsigned i = 0;
+	for (; node; node = node->nextLight)
+	{
+		if (!node->lightsource->IsActive()) continue;
+		if (i >= list.Size() || LightIndex.Lights[list[i]].light != node->lightsource) return false;
+		i++;
+	}
+	return i == list.Size();
+}
+
+static void GetNodeModelLights(AActor *self, TArray<FDynamicLight *> &addedLights)
+{
+	float x = (float)self->X();
+	float y = (float)self->Y();
+	float z = (float)self->Center();
+	float actorradius = (float)self->RenderRadius();
+
+	BSPWalkCircle(self->Level, x, y, actorradius * actorradius, [&](subsector_t *subsector)
+	{
+		for (FLightNode *node = subsector->section->lighthead; node; node = node->nextLight)
+		{
+			FDynamicLight *light = node->lightsource;
+			if (light->ShouldLightActor(self))
+			{
+				DVector3 pos = light->PosRelative(subsector->sector->PortalGroup);
+				float radius = (float)(light->GetRadius() + actorradius);
+				double dx = pos.X - x;
+				double dy = pos.Y - y;
+				double dz = pos.Z - z;
+				if (dx * dx + dy * dy + dz * dz < radius * radius && addedLights.Find(light) == addedLights.Size())
+				{
+					addedLights.Push(light);
+				}
+			}
+		}
+	});
+}
+
+CCMD(gl_checklightindex)
+{
+	auto Level = primaryLevel;
+	if (Level == nullptr || gamestate != GS_LEVEL) return;
+
+	LightIndex.Build(Level);
+
+	int badsections = 0, badsides = 0, badactors = 0, numactors = 0;
+	for (auto &section : Level->sections.allSections)
+	{
+		if (!CompareLightList(section.lighthead, LightIndex.SectionLights(&section))) badsections++;
+	}
+	for (auto &side : Level->sides)
+	{
+		if (!CompareLightList(side.lighthead, LightIndex.SideLights(&side))) badsides++;
+	}
+
+	TArray<FDynamicLight *> nodelights, indexlights;
+	auto it = Level->GetThinkerIterator<AActor>();
+	AActor *actor;
+	while ((actor = it.Next()))
+	{
+		numactors++;
+		nodelights.Clear();
+		GetNodeModelLights(actor, nodelights);
+		hw_GetDynModelLights(actor, indexlights);
+		if (!(nodelights == indexlights)) badactors++;
+	}
+	Printf("%d active lights. Mismatches: %d of %d sections, %d of %d sides, %d of %d actors\n",
+		LightIndex.Lights.Size(), badsections, Level->sections.allSections.Size(), badsides, Level->sides.Size(), badactors, numactors);
+	LightIndex.Clear();
+}
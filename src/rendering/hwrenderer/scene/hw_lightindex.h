@@ -0,0 +1,74 @@
+#pragma once
+
+#include "tarray.h"
+#include "vectors.h"
+
+struct FDynamicLight;
+struct FLightNode;
+struct FSection;
+struct side_t;
+struct FLevelLocals;
+
+//==========================================================================
+//
+// All active lights of a level packed into one array, plus the lists of
+// lights touching each section and sidedef as indices into it. This gets
+// built once per viewpoint so that the surfaces and sprites do not have
+// to chase the light nodes and can reuse what only depends on the light.
+//
+// The lists contain the lights in the same order as the FLightNode lists
+// they are built from, minus the inactive ones, which every user skips.
+// Only the sections and sidedefs touched by an active light get a list,
+// found through the lights' own node lists, so building this costs as
+// much as the lights cover, not as much as the map has. The slots of all
+// others are recognized as empty by their stale stamp.
+//
+// The light data for the shaders is still uploaded per surface through
+// the light buffer. Only the CPU side gathers it from this one array.
+//
+//==========================================================================
+
+struct HWIndexedLight
+{
+	FDynamicLight *light;
+	DVector3 pos;
+	float radius;
+	int portalgroup;
+	FVector3 spritecolor;	// color as applied to sprites, with subtraction already done
+	DVector3 spotdir;
+	double spotinner, spotouter;
+	bool spot;
+	bool shadowmapped;
+};
+
+class HWLightIndex
+{
+	struct RefList
+	{
+		unsigned stamp;
+		unsigned start;
+		unsigned count;
+	};
+
+	FLevelLocals *Level = nullptr;
+	unsigned Stamp = 0;
+	TArray<RefList> SectionLists;
+	TArray<RefList> SideLists;
+	TArray<unsigned> SectionRefs;
+	TArray<unsigned> SideRefs;
+
+	void NewStamp(unsigned numsections, unsigned numsides);
+	static void AddList(RefList &list, unsigned stamp, TArray<unsigned> &refs, FLightNode *head);
+	static TArrayView<unsigned> GetList(const TArray<RefList> &lists, unsigned index, unsigned stamp, TArray<unsigned> &refs);
+
+public:
+	TArray<HWIndexedLight> Lights;
+
+	void Build(FLevelLocals *Level);
+	void Clear();
+
+	TArrayView<unsigned> SectionLights(const FSection *section);
+	TArrayView<unsigned> SideLights(const side_t *side);
+};
+
+extern HWLightIndex LightIndex;
@@ -37,6 +37,7 @@
 #include "hw_drawstructs.h"
 #include "hw_clock.h"
 #include "hw_dynlightdata.h"
+#include "hw_lightindex.h"
 #include "flatvertices.h"
 #include "hw_lightbuffer.h"
 #include "hwrenderer/scene/hw_portal.h"
@@ -115,23 +116,14 @@ int HWDrawInfo::SetupLightsForOtherPlane(subsector_t * sub, FDynLightData &light
 	{
 		Plane p;
 
-		FLightNode * node = sub->section->lighthead;
-
 		lightdata.Clear();
-		while (node)
+		for (auto index : LightIndex.SectionLights(sub->section))
 		{
-			FDynamicLight * light = node->lightsource;
-
-			if (!light->IsActive())
-			{
-				node = node->nextLight;
-				continue;
-			}
+			FDynamicLight * light = LightIndex.Lights[index].light;
 			iter_dlightf++;
 
 			p.Set(plane->Normal(), plane->fD());
 			draw_dlightf += GetLight(lightdata, sub->sector->PortalGroup, p, light, true);
-			node = node->nextLight;
 		}
 
 		return screen->mLights->UploadLights(lightdata);
@@ -196,6 +188,11 @@ void HWDrawInfo::AddOtherCeilingPlane(int sector, gl_subsectorrendernode * node)
 void HWDrawInfo::AddUpperMissingTexture(side_t * side, subsector_t *sub, float Backheight)
 {
 	if (!side->segs[0]->backsector) return;
+	if (workerOutput)
+	{
+		workerOutput->Record(HWDeferredOp::UpperMissing, 0, side, sub, Backheight);
+		return;
+	}
 
 	for (int i = 0; i < side->numsegs; i++)
 	{
@@ -249,6 +246,11 @@ void HWDrawInfo::AddLowerMissingTexture(side_t * side, subsector_t *sub, float B
 {
 	sector_t *backsec = side->segs[0]->backsector;
 	if (!backsec) return;
+	if (workerOutput)
+	{
+		workerOutput->Record(HWDeferredOp::LowerMissing, 0, side, sub, Backheight);
+		return;
+	}
 	if (backsec->transdoor)
 	{
 		// Transparent door hacks alter the backsector's floor height so we should not
@@ -36,6 +36,7 @@
 #include "hw_shadowmap.h"
 #include "hwrenderer/scene/hw_drawinfo.h"
 #include "hwrenderer/scene/hw_drawstructs.h"
+#include "hw_lightindex.h"
 #include "models.h"
 #include <cmath>	// needed for std::floor on mac
 
@@ -107,11 +108,9 @@ LightProbe* FindLightProbe(FLevelLocals* level, float x, float y, float z)
 //
 //==========================================================================
 
-void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FLightNode *node, int portalgroup, float *out)
+void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FSection *section, int portalgroup, float *out)
 {
-	FDynamicLight *light;
-	float frac, lr, lg, lb;
-	float radius;
+	float frac;
 	
 	out[0] = out[1] = out[2] = 0.f;
 
@@ -124,10 +123,10 @@ void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FLig
 	}
 
 	// Go through both light lists
-	while (node)
+	for (auto index : LightIndex.SectionLights(section))
 	{
-		light=node->lightsource;
-		if (light->ShouldLightActor(self))
+		auto &rec = LightIndex.Lights[index];
+		if (rec.light->ShouldLightActor(self))
 		{
 			float dist;
 			FVector3 L;
@@ -136,21 +135,21 @@ void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FLig
 			// This will do the calculations explicitly rather than calling one of AActor's utility functions.
 			if (Level->Displacements.size > 0)
 			{
-				int fromgroup = light->Sector->PortalGroup;
+				int fromgroup = rec.portalgroup;
 				int togroup = portalgroup;
 				if (fromgroup == togroup || fromgroup == 0 || togroup == 0) goto direct;
 
 				DVector2 offset = Level->Displacements.getOffset(fromgroup, togroup);
-				L = FVector3(x - (float)(light->X() + offset.X), y - (float)(light->Y() + offset.Y), z - (float)light->Z());
+				L = FVector3(x - (float)(rec.pos.X + offset.X), y - (float)(rec.pos.Y + offset.Y), z - (float)rec.pos.Z);
 			}
 			else
 			{
 			direct:
-				L = FVector3(x - (float)light->X(), y - (float)light->Y(), z - (float)light->Z());
+				L = FVector3(x - (float)rec.pos.X, y - (float)rec.pos.Y, z - (float)rec.pos.Z);
 			}
 
 			dist = (float)L.LengthSquared();
-			radius = light->GetRadius();
+			float radius = rec.radius;
 
 			if (dist < radius * radius)
 			{
@@ -158,40 +157,21 @@ void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FLig
 
 				frac = 1.0f - (dist / radius);
 
-				if (light->IsSpot())
+				if (rec.spot)
 				{
 					L *= -1.0f / dist;
-					DAngle negPitch = -*light->pPitch;
-					DAngle Angle = light->target->Angles.Yaw;
-					double xyLen = negPitch.Cos();
-					double spotDirX = -Angle.Cos() * xyLen;
-					double spotDirY = -Angle.Sin() * xyLen;
-					double spotDirZ = -negPitch.Sin();
-					double cosDir = L.X * spotDirX + L.Y * spotDirY + L.Z * spotDirZ;
-					frac *= (float)smoothstep(light->pSpotOuterAngle->Cos(), light->pSpotInnerAngle->Cos(), cosDir);
+					double cosDir = L.X * rec.spotdir.X + L.Y * rec.spotdir.Y + L.Z * rec.spotdir.Z;
+					frac *= (float)smoothstep(rec.spotouter, rec.spotinner, cosDir);
 				}
 
-				if (frac > 0 && (!light->shadowmapped || (light->GetRadius() > 0 && screen->mShadowMap.ShadowTest(light->Pos, { x, y, z }))))
+				if (frac > 0 && (!rec.shadowmapped || (radius > 0 && screen->mShadowMap.ShadowTest(rec.pos, { x, y, z }))))
 				{
-					lr = light->GetRed() / 255.0f;
-					lg = light->GetGreen() / 255.0f;
-					lb = light->GetBlue() / 255.0f;
-					if (light->IsSubtractive())
-					{
-						float bright = (float)FVector3(lr, lg, lb).Length();
-						FVector3 lightColor(lr, lg, lb);
-						lr = (bright - lr) * -1;
-						lg = (bright - lg) * -1;
-						lb = (bright - lb) * -1;
-					}
-
-					out[0] += lr * frac;
-					out[1] += lg * frac;
-					out[2] += lb * frac;
+					out[0] += rec.spritecolor.X * frac;
+					out[1] += rec.spritecolor.Y * frac;
+					out[2] += rec.spritecolor.Z * frac;
 				}
 			}
 		}
-		node = node->nextLight;
 	}
 }
 
@@ -199,63 +179,104 @@ void HWDrawInfo::GetDynSpriteLight(AActor *thing, particle_t *particle, float *o
 {
 	if (thing != NULL)
 	{
-		GetDynSpriteLight(thing, (float)thing->X(), (float)thing->Y(), (float)thing->Center(), thing->section->lighthead, thing->Sector->PortalGroup, out);
+		GetDynSpriteLight(thing, (float)thing->X(), (float)thing->Y(), (float)thing->Center(), thing->section, thing->Sector->PortalGroup, out);
 	}
 	else if (particle != NULL)
 	{
-		GetDynSpriteLight(NULL, (float)particle->Pos.X, (float)particle->Pos.Y, (float)particle->Pos.Z, particle->subsector->section->lighthead, particle->subsector->sector->PortalGroup, out);
+		GetDynSpriteLight(NULL, (float)particle->Pos.X, (float)particle->Pos.Y, (float)particle->Pos.Z, particle->subsector->section, particle->subsector->sector->PortalGroup, out);
 	}
 }
 
-// static so that we build up a reserve (memory allocations stop)
-// For multithread processing each worker thread needs its own copy, though.
-static thread_local TArray<FDynamicLight*> addedLightsArray; 
+//==========================================================================
+//
+// Finds all lights touching a model. Each light is reported once,
+// with the portal group of the first section it was found in.
+//
+// The marks are per thread because models get processed by several
+// worker threads at once.
+//
+//==========================================================================
 
-void hw_GetDynModelLight(AActor *self, FDynLightData &modellightdata)
+static thread_local TArray<int> lightMarks;
+static thread_local TArray<int> sectionMarks;
+static thread_local int modelMark;
+
+template<class Callback>
+static void CollectModelLights(AActor *self, const Callback &callback)
 {
-	modellightdata.Clear();
+	auto Level = self->Level;
+	auto &lightmarks = lightMarks;	// avoid going through the thread local storage for each use.
+	auto &sectionmarks = sectionMarks;
+	unsigned numlights = LightIndex.Lights.Size();
+	unsigned numsections = Level->sections.allSections.Size();
 
-	if (self)
+	if (numlights == 0) return;
+	if (lightmarks.Size() < numlights || sectionmarks.Size() < numsections || modelMark == INT_MAX)
 	{
-		auto &addedLights = addedLightsArray;	// avoid going through the thread local storage for each use.
+		lightmarks.Resize(max(lightmarks.Size(), numlights));
+		sectionmarks.Resize(max(sectionmarks.Size(), numsections));
+		memset(lightmarks.Data(), 0, lightmarks.Size() * sizeof(int));
+		memset(sectionmarks.Data(), 0, sectionmarks.Size() * sizeof(int));
+		modelMark = 0;
+	}
+	const int mark = ++modelMark;
 
-		addedLights.Clear();
+	float x = (float)self->X();
+	float y = (float)self->Y();
+	float z = (float)self->Center();
+	float actorradius = (float)self->RenderRadius();
+	float radiusSquared = actorradius * actorradius;
 
-		float x = (float)self->X();
-		float y = (float)self->Y();
-		float z = (float)self->Center();
-		float actorradius = (float)self->RenderRadius();
-		float radiusSquared = actorradius * actorradius;
-		dl_validcount++;
+	BSPWalkCircle(Level, x, y, radiusSquared, [&](subsector_t *subsector) // Iterate through all subsectors potentially touched by actor
+	{
+		auto section = subsector->section;
+		int &sectionmark = sectionmarks[Level->sections.SectionIndex(section)];
+		if (sectionmark == mark) return;	// already done from a previous subsector.
+		sectionmark = mark;
 
-		BSPWalkCircle(self->Level, x, y, radiusSquared, [&](subsector_t *subsector) // Iterate through all subsectors potentially touched by actor
+		int group = subsector->sector->PortalGroup;
+		for (auto index : LightIndex.SectionLights(section)) // check all lights touching a subsector
 		{
-			auto section = subsector->section;
-			if (section->validcount == dl_validcount) return;	// already done from a previous subsector.
-			FLightNode * node = section->lighthead;
-			while (node) // check all lights touching a subsector
+			if (lightmarks[index] == mark) continue;	// already added from a different subsector
+
+			auto &rec = LightIndex.Lights[index];
+			FDynamicLight *light = rec.light;
+			if (light->ShouldLightActor(self))
 			{
-				FDynamicLight *light = node->lightsource;
-				if (light->ShouldLightActor(self))
+				DVector3 pos = rec.pos + Level->Displacements.getOffset(rec.portalgroup, group);
+				float radius = (float)(rec.radius + actorradius);
+				double dx = pos.X - x;
+				double dy = pos.Y - y;
+				double dz = pos.Z - z;
+				double distSquared = dx * dx + dy * dy + dz * dz;
+				if (distSquared < radius * radius) // Light and actor touches
 				{
-					int group = subsector->sector->PortalGroup;
-					DVector3 pos = light->PosRelative(group);
-					float radius = (float)(light->GetRadius() + actorradius);
-					double dx = pos.X - x;
-					double dy = pos.Y - y;
-					double dz = pos.Z - z;
-					double distSquared = dx * dx + dy * dy + dz * dz;
-					if (distSquared < radius * radius) // Light and actor touches
-					{
-						if (std::find(addedLights.begin(), addedLights.end(), light) == addedLights.end()) // Check if we already added this light from a different subsector
-						{
-							AddLightToList(modellightdata, group, light, true);
-							addedLights.Push(light);
-						}
-					}
+					lightmarks[index] = mark;
+					callback(light, pos);
 				}
-				node = node->nextLight;
 			}
+		}
+	});
+}
+
+void hw_GetDynModelLight(AActor *self, FDynLightData &modellightdata)
+{
+	modellightdata.Clear();
+
+	if (self)
+	{
+		CollectModelLights(self, [&](FDynamicLight *light, const DVector3 &pos)
+		{
+			AddLightToList(modellightdata, pos, light, true);
 		});
 	}
 }
+
+void hw_GetDynModelLights(AActor *self, TArray<FDynamicLight *> &lights)
+{
+	lights.Clear();
+	CollectModelLights(self, [&](FDynamicLight *light, const DVector3 &pos)
+	{
+		lights.Push(light);
+	});
+}
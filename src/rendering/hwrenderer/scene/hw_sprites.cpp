@@ -1282,7 +1282,7 @@ void HWSprite::Process(HWDrawInfo *di, AActor* thing, sector_t * sector, area_t
 		lightlist = nullptr;
 	}
 	PutSprite(di, hw_styleflags != STYLEHW_Solid);
-	rendered_sprites++;
+	CountStat(rendered_sprites, &HWWorkerOutput::RenderedSprites);
 }
 
 
@@ -1462,7 +1462,7 @@ void HWSprite::ProcessParticle(HWDrawInfo *di, particle_t *particle, sector_t *s
 		lightlist = nullptr;
 
 	PutSprite(di, hw_styleflags != STYLEHW_Solid);
-	rendered_sprites++;
+	CountStat(rendered_sprites, &HWWorkerOutput::RenderedSprites);
 }
 
 // [MC] VisualThinkers are to be rendered akin to actor sprites. The reason this whole system
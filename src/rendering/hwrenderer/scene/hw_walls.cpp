@@ -33,6 +33,7 @@
 #include "actorinlines.h"
 #include "texturemanager.h"
 #include "hw_dynlightdata.h"
+#include "hw_lightindex.h"
 #include "hw_material.h"
 #include "hw_cvars.h"
 #include "hw_clock.h"
@@ -402,35 +403,34 @@ void HWWall::SetupLights(HWDrawInfo*di, FDynLightData &lightdata)
 	auto normal = glseg.Normal();
 	p.Set(normal, -normal.X * glseg.x1 - normal.Z * glseg.y1);
 
-	FLightNode *node;
-	if (seg->sidedef == NULL)
+	TArrayView<unsigned> lights(nullptr, 0);
+	if (seg->sidedef != NULL)
 	{
-		node = NULL;
-	}
-	else if (!(seg->sidedef->Flags & WALLF_POLYOBJ))
-	{
-		node = seg->sidedef->lighthead;
-	}
-	else if (sub)
-	{
-		// Polobject segs cannot be checked per sidedef so use the subsector instead.
-		node = sub->section->lighthead;
+		if (!(seg->sidedef->Flags & WALLF_POLYOBJ))
+		{
+			lights = LightIndex.SideLights(seg->sidedef);
+		}
+		else if (sub)
+		{
+			// Polobject segs cannot be checked per sidedef so use the subsector instead.
+			lights = LightIndex.SectionLights(sub->section);
+		}
 	}
-	else node = NULL;
 
 	// Iterate through all dynamic lights which touch this wall and render them
-	while (node)
+	for (auto index : lights)
 	{
-		if (node->lightsource->IsActive() && !node->lightsource->DontLightMap())
+		auto &light = LightIndex.Lights[index];
+		if (!light.light->DontLightMap())
 		{
-			iter_dlight++;
+			CountStat(iter_dlight, &HWWorkerOutput::IterDLight);
 
-			DVector3 posrel = node->lightsource->PosRelative(seg->frontsector->PortalGroup);
+			DVector3 posrel = light.pos + di->Level->Displacements.getOffset(light.portalgroup, seg->frontsector->PortalGroup);
 			float x = posrel.X;
 			float y = posrel.Y;
 			float z = posrel.Z;
 			float dist = fabsf(p.DistToPoint(x, z, y));
-			float radius = node->lightsource->GetRadius();
+			float radius = light.radius;
 			float scale = 1.0f / ((2.f * radius) - dist);
 			FVector3 fn, pos;
 
@@ -466,11 +466,10 @@ void HWWall::SetupLights(HWDrawInfo*di, FDynLightData &lightdata)
 				}
 				if (outcnt[0]!=4 && outcnt[1]!=4 && outcnt[2]!=4 && outcnt[3]!=4) 
 				{
-					draw_dlight += GetLight(lightdata, seg->frontsector->PortalGroup, p, node->lightsource, true);
+					CountStat(draw_dlight, &HWWorkerOutput::DrawDLight, GetLight(lightdata, seg->frontsector->PortalGroup, p, light.light, true));
 				}
 			}
 		}
-		node = node->nextLight;
 	}
 	dynlightindex = screen->mLights->UploadLights(lightdata);
 }
@@ -578,7 +577,26 @@ void HWWall::PutPortal(HWWallDispatcher *di, int ptype, int plane)
 	HWPortal * portal = nullptr;
 
 	auto ddi = di->di;
-	if (ddi)
+	if (ddi && workerOutput)
+	{
+		// The portal list is shared by all workers, so this must wait for the main thread.
+		// The sky and horizon info live on the caller's stack and need to be copied as well.
+		auto wall = (HWWall*)workerOutput->Alloc(sizeof(HWWall));
+		*wall = *this;
+		if (ptype == PORTALTYPE_SKY)
+		{
+			wall->sky = (HWSkyInfo*)workerOutput->Alloc(sizeof(HWSkyInfo));
+			memcpy(wall->sky, sky, sizeof(HWSkyInfo));
+		}
+		else if (ptype == PORTALTYPE_HORIZON)
+		{
+			wall->horizon = (HWHorizonInfo*)workerOutput->Alloc(sizeof(HWHorizonInfo));
+			memcpy(wall->horizon, horizon, sizeof(HWHorizonInfo));
+		}
+		workerOutput->Record(HWDeferredOp::Portal, ptype, wall, nullptr, 0, plane);
+		vertcount = 0;
+	}
+	else if (ddi)
 	{
 		MakeVertices(false);
 		switch (ptype)
@@ -973,6 +973,85 @@ DEFINE_ACTION_FUNCTION_NATIVE(DObject, BuiltinNewDoom, BuiltinNewDoom)
 }
 
 
+//==========================================================================
+//
+// State label storage for the bytecode cache
+//
+// Resolving state labels appends them to StateLabels and the generated
+// code refers to them by their offset. For cached code to remain valid,
+// everything that was appended while compiling is stored in the cache and
+// appended again, at the same offset, before anything else gets compiled.
+// State pointers are stored as owning class and index.
+//
+//==========================================================================
+
+static void AppendBytes(TArray<uint8_t> &array, const void *data, unsigned size)
+{
+	memcpy(&array[array.Reserve(size)], data, size);
+}
+
+static unsigned MarkStateLabels()
+{
+	return StateLabels.Storage.Size();
+}
+
+static bool SaveStateLabels(unsigned mark, TArray<uint8_t> &data)
+{
+	auto &storage = StateLabels.Storage;
+	unsigned pos = mark;
+	while (pos < storage.Size())
+	{
+		int count;
+		memcpy(&count, &storage[pos], sizeof(int));
+		if (count == 0)
+		{
+			FState *state;
+			memcpy(&state, &storage[pos + sizeof(int)], sizeof(state));
+			auto owner = FState::StaticFindStateOwner(state);
+			if (owner == nullptr) return false;
+			int entry[3] = { 0, owner->TypeName.GetIndex(), int(state - owner->GetStates()) };
+			AppendBytes(data, entry, sizeof(entry));
+			pos += sizeof(int) + sizeof(state);
+		}
+		else
+		{
+			AppendBytes(data, &storage[pos], sizeof(int) + count * sizeof(FName));
+			pos += sizeof(int) + count * sizeof(FName);
+		}
+	}
+	return pos == storage.Size();
+}
+
+static bool RestoreStateLabels(unsigned mark, const TArray<uint8_t> &data)
+{
+	if (StateLabels.Storage.Size() != mark) return false;
+	unsigned pos = 0;
+	while (pos + sizeof(int) <= data.Size())
+	{
+		int count;
+		memcpy(&count, &data[pos], sizeof(int));
+		if (count == 0)
+		{
+			int entry[3];
+			if (pos + sizeof(entry) > data.Size()) return false;
+			memcpy(entry, &data[pos], sizeof(entry));
+			FName name = ENamedName(entry[1]);
+			auto owner = name.IsValidName() ? PClass::FindActor(name) : nullptr;
+			if (owner == nullptr || entry[2] < 0 || unsigned(entry[2]) >= owner->GetStateCount()) return false;
+			StateLabels.AddPointer(owner->GetStates() + entry[2]);
+			pos += sizeof(entry);
+		}
+		else
+		{
+			unsigned size = sizeof(int) + count * sizeof(FName);
+			if (count < 0 || pos + size > data.Size()) return false;
+			AppendBytes(StateLabels.Storage, &data[pos], size);
+			pos += size;
+		}
+	}
+	return pos == data.Size();
+}
+
 void SetDoomCompileEnvironment()
 {
 	compileEnvironment.SpecialTypeCast = CustomTypeCast;
@@ -984,6 +1063,9 @@ void SetDoomCompileEnvironment()
 	compileEnvironment.ResolveSpecialFunction = AJumpProcessing;
 	compileEnvironment.CheckCustomGlobalFunctions = ResolveGlobalCustomFunction;
 	compileEnvironment.CustomBuiltinNew = "BuiltinNewDoom";
+	compileEnvironment.MarkTables = MarkStateLabels;
+	compileEnvironment.SaveTables = SaveStateLabels;
+	compileEnvironment.RestoreTables = RestoreStateLabels;
 }
 
 
@@ -179,6 +179,8 @@ public:
 	DBlockThingsIterator(AActor *origin, double checkradius = -1, bool ignorerestricted = false)
 		: iterator(check, origin, checkradius, ignorerestricted)
 	{
+		// Script iterators may be kept around indefinitely.
+		iterator.UseChains();
 		cres.thing = nullptr;
 		cres.Position.Zero();
 		cres.portalflags = 0;
@@ -187,6 +189,7 @@ public:
 	DBlockThingsIterator(double checkx, double checky, double checkz, double checkh, double checkradius, bool ignorerestricted, sector_t *newsec)
 		: iterator(check, currentVMLevel, checkx, checky, checkz, checkh, checkradius, ignorerestricted, newsec)
 	{
+		iterator.UseChains();
 		cres.thing = nullptr;
 		cres.Position.Zero();
 		cres.portalflags = 0;
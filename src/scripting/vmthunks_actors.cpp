@@ -1453,6 +1453,51 @@ DEFINE_ACTION_FUNCTION_NATIVE(AActor, CheckSight, P_CheckSight)
 	ACTION_RETURN_BOOL(P_CheckSight(self, target, flags));
 }
 
+// Batched sight checks. Fills 'visible' with the actors that passed.
+static int CheckSightMulti(AActor *self, TArray<AActor *> *targets, TArray<AActor *> *visible, int flags)
+{
+	TArray<bool> results(targets->Size(), true);
+	int count = P_CheckSightMulti(self, targets->Data(), targets->Size(), flags, results.Data());
+	TArray<AActor *> passed(count);	// the output may be the same array as the input
+	for (unsigned i = 0; i < targets->Size(); i++)
+	{
+		if (results[i]) passed.Push((*targets)[i]);
+	}
+	*visible = std::move(passed);
+	return count;
+}
+
+DEFINE_ACTION_FUNCTION_NATIVE(AActor, CheckSightMulti, CheckSightMulti)
+{
+	PARAM_SELF_PROLOGUE(AActor);
+	PARAM_POINTER(targets, TArray<AActor *>);
+	PARAM_POINTER(visible, TArray<AActor *>);
+	PARAM_INT(flags);
+	ACTION_RETURN_INT(CheckSightMulti(self, targets, visible, flags));
+}
+
+static int CheckSeenByMulti(AActor *self, TArray<AActor *> *lookers, TArray<AActor *> *seers, int flags)
+{
+	TArray<bool> results(lookers->Size(), true);
+	int count = P_CheckSeenByMulti(lookers->Data(), lookers->Size(), self, flags, results.Data());
+	TArray<AActor *> passed(count);	// the output may be the same array as the input
+	for (unsigned i = 0; i < lookers->Size(); i++)
+	{
+		if (results[i]) passed.Push((*lookers)[i]);
+	}
+	*seers = std::move(passed);
+	return count;
+}
+
+DEFINE_ACTION_FUNCTION_NATIVE(AActor, CheckSeenByMulti, CheckSeenByMulti)
+{
+	PARAM_SELF_PROLOGUE(AActor);
+	PARAM_POINTER(lookers, TArray<AActor *>);
+	PARAM_POINTER(seers, TArray<AActor *>);
+	PARAM_INT(flags);
+	ACTION_RETURN_INT(CheckSeenByMulti(self, lookers, seers, flags));
+}
+
 static void GiveSecret(AActor *self, bool printmessage, bool playsound)
 {
 	P_GiveSecret(self->Level, self, printmessage, playsound, -1);
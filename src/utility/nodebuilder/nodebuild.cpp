@@ -43,11 +43,17 @@
 
 #include "doomdata.h"
 #include "nodebuild.h"
+#include "parallel_for.h"
 
 const int MaxSegs = 64;
 const int SplitCost = 8;
 const int AAPreference = 16;
 
+// Splitter candidates are only scored in parallel when there is enough work
+// (candidates times segs in the set) to make up for starting the workers.
+const int ParallelScoreWork = 1 << 16;
+const unsigned int ScoreChunk = 8;
+
 #if 0
 #define D(x) x
 #else
@@ -106,6 +112,8 @@ void FNodeBuilder::Clear()
 	Planes.Clear();
 	Touched.Clear();
 	Colinear.Clear();
+	Candidates.Clear();
+	CandidateScores.Clear();
 	SplitSharers.Clear();
 	if (VertexMap == NULL)
 	{
@@ -444,6 +452,7 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 	int bestvalue;
 	uint32_t bestseg;
 	uint32_t seg;
+	int segsInSet = 0;
 	bool nosplitters = false;
 
 	bestvalue = 0;
@@ -453,9 +462,12 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 	stepleft = 0;
 
 	memset (&PlaneChecked[0], 0, PlaneChecked.Size());
+	Candidates.Clear();
 
 	D(Printf (PRINT_LOG, "Processing set %d\n", set));
 
+	// Which segs get scored does not depend on any of the scores, so gather
+	// them first and score them all at once.
 	while (seg != UINT_MAX)
 	{
 		FPrivSeg *pseg = &Segs[seg];
@@ -473,28 +485,35 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 				}
 
 				stepleft = step;
-				SetNodeFromSeg (node, pseg);
-
-				int value = Heuristic (node, set, nosplit);
-
-				D(Printf (PRINT_LOG, "Seg %5d, ld %d (%5d,%5d)-(%5d,%5d) scores %d\n", seg, Segs[seg].linedef, node.x>>16, node.y>>16,
-					(node.x+node.dx)>>16, (node.y+node.dy)>>16, value));
-
-				if (value > bestvalue)
-				{
-					bestvalue = value;
-					bestseg = seg;
-				}
-				else if (value < 0)
-				{
-					nosplitters = true;
-				}
+				Candidates.Push (seg);
 			}
 		}
 
+		segsInSet++;
 		seg = pseg->next;
 	}
 
+	ScoreCandidates (set, nosplit, segsInSet);
+
+	// Pick the best in seg order, so ties go the same way no matter how the
+	// scores were computed.
+	for (unsigned int i = 0; i < Candidates.Size(); ++i)
+	{
+		int value = CandidateScores[i];
+
+		D(Printf (PRINT_LOG, "Seg %5d, ld %d scores %d\n", Candidates[i], Segs[Candidates[i]].linedef, value));
+
+		if (value > bestvalue)
+		{
+			bestvalue = value;
+			bestseg = Candidates[i];
+		}
+		else if (value < 0)
+		{
+			nosplitters = true;
+		}
+	}
+
 	if (bestseg == UINT_MAX)
 	{
 		// No lines split any others into two sets, so this is a convex region.
@@ -509,6 +528,40 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 	return 1;
 }
 
+// Fills CandidateScores with the Heuristic score of each seg in Candidates.
+// Scoring only reads the segs and vertices, so for big sets the candidates
+// are handed out to worker threads in chunks, each with its own scratch lists.
+
+void FNodeBuilder::ScoreCandidates (uint32_t set, bool honorNoSplit, int segsInSet)
+{
+	const unsigned int count = Candidates.Size();
+	CandidateScores.Resize (count);
+
+	if (count <= ScoreChunk || (int64_t)count * segsInSet < ParallelScoreWork)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			node_t node;
+			SetNodeFromSeg (node, &Segs[Candidates[i]]);
+			CandidateScores[i] = Heuristic (node, set, honorNoSplit, Touched, Colinear);
+		}
+		return;
+	}
+
+	const unsigned int numchunks = (count + ScoreChunk - 1) / ScoreChunk;
+	parallel_for (0u, numchunks, 1u, [&](unsigned int chunk)
+	{
+		TArray<int> touched, colinear;
+		unsigned int end = std::min (count, (chunk + 1) * ScoreChunk);
+		for (unsigned int i = chunk * ScoreChunk; i < end; ++i)
+		{
+			node_t node;
+			SetNodeFromSeg (node, &Segs[Candidates[i]]);
+			CandidateScores[i] = Heuristic (node, set, honorNoSplit, touched, colinear);
+		}
+	});
+}
+
 // Given a splitter (node), returns a score based on how "good" the resulting
 // split in a set of segs is. Higher scores are better. -1 means this splitter
 // splits something it shouldn't and will only be returned if honorNoSplit is
@@ -516,6 +569,11 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 // in the set.
 
 int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
+{
+	return Heuristic (node, set, honorNoSplit, Touched, Colinear);
+}
+
+int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear)
 {
 	// Set the initial score above 0 so that near vertex anti-weighting is less likely to produce a negative score.
 	int score = 1000000;
@@ -530,8 +588,8 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 	unsigned int max, m2, p, q;
 	double frac;
 
-	Touched.Clear ();
-	Colinear.Clear ();
+	touched.Clear ();
+	colinear.Clear ();
 
 	while (i != UINT_MAX)
 	{
@@ -557,32 +615,32 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 			{
 				if ((sidev[0] | sidev[1]) != 0)
 				{
-					max = Touched.Size();
+					max = touched.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Touched[p] == test->loopnum)
+						if (touched[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Touched.Push (test->loopnum);
+						touched.Push (test->loopnum);
 					}
 				}
 				else
 				{
-					max = Colinear.Size();
+					max = colinear.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Colinear[p] == test->loopnum)
+						if (colinear[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Colinear.Push (test->loopnum);
+						colinear.Push (test->loopnum);
 					}
 				}
 			}
@@ -699,8 +757,8 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 	// seg of that sector must be crossing the container's corner and does not
 	// actually split the container.
 
-	max = Touched.Size ();
-	m2 = Colinear.Size ();
+	max = touched.Size ();
+	m2 = colinear.Size ();
 
 	// If honorNoSplit is false, then both these lists will be empty.
 
@@ -713,10 +771,10 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 
 	for (p = 0; p < max; ++p)
 	{
-		int look = Touched[p];
+		int look = touched[p];
 		for (q = 0; q < m2; ++q)
 		{
-			if (look == Colinear[q])
+			if (look == colinear[q])
 			{
 				break;
 			}
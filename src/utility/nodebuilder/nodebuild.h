@@ -267,6 +267,8 @@ private:
 
 	TArray<int> Touched;	// Loops a splitter touches on a vertex
 	TArray<int> Colinear;	// Loops with edges colinear to a splitter
+	TArray<uint32_t> Candidates;	// Segs SelectSplitter wants scored, one per plane
+	TArray<int> CandidateScores;
 	FEventTree Events;		// Vertices intersected by the current splitter
 
 	TArray<uint32_t> UnsetSegs;			// Segs with no definitive side in current splitter
@@ -301,6 +303,8 @@ private:
 	void SplitSegs (uint32_t set, node_t &node, uint32_t splitseg, uint32_t &outset0, uint32_t &outset1, unsigned int &count0, unsigned int &count1);
 	uint32_t SplitSeg (uint32_t segnum, int splitvert, int v1InFront);
 	int Heuristic (node_t &node, uint32_t set, bool honorNoSplit);
+	int Heuristic (node_t &node, uint32_t set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear);
+	void ScoreCandidates (uint32_t set, bool honorNoSplit, int segsInSet);
 
 	// Returns:
 	//	0 = seg is in front